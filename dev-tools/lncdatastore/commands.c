@@ -44,7 +44,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
 #include <libxml/parser.h>
+#include <libxml/xmlreader.h>
+#include <libxml/xmlwriter.h>
 
 #include "commands.h"
 #include "mreadline.h"
@@ -191,6 +196,14 @@ void cmd_verb_help(void) {
 	printf("verb (error | warning | verbose | debug)\n");
 }
 
+void cmd_import_help(void) {
+	printf("import input-file datastore-file [ (running | startup | candidate) ] [--validate]\n");
+}
+
+void cmd_export_help(void) {
+	printf("export datastore-file [ (running | startup | candidate) ] [<output-file>]\n");
+}
+
 int cmd_add_datastore(const char* arg) {
 	char* argv, *ptr, *ptr2;
 	struct ncds_ds* new_ds;
@@ -501,6 +514,793 @@ int cmd_verb(const char* arg) {
 	return 0;
 }
 
+/* content of a new file datastore, the same as created by the file datastore itself */
+#define IMPORT_FRAME "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\
+<datastores xmlns=\"urn:cesnet:tmc:datastores:file\">\
+<running lock=\"\"/><startup lock=\"\"/><candidate modified=\"false\" lock=\"\"/>\
+</datastores>"
+
+/* number of errors after which the validation of the imported configuration stops */
+#define IMPORT_MAX_ERRORS 10
+
+/*
+ * Namespace declarations of the elements enclosing the configuration (<config>,
+ * the datastore nodes), which are not copied with the configuration.
+ */
+struct stream_ns {
+	int count;
+	xmlChar** names;
+	xmlChar** values;
+};
+
+struct validate_frame {
+	const struct schema_node* snode;
+	const xmlChar* name;
+	unsigned long keys; /* found keys of the list entry */
+};
+
+static void stream_ns_collect(struct stream_ns* ns, xmlTextReaderPtr reader) {
+	const xmlChar* name;
+	int i;
+
+	while (xmlTextReaderMoveToNextAttribute(reader) == 1) {
+		if (xmlTextReaderIsNamespaceDecl(reader) != 1) {
+			continue;
+		}
+		name = xmlTextReaderConstName(reader);
+		for (i = 0; i < ns->count; i++) {
+			if (xmlStrEqual(ns->names[i], name)) {
+				break;
+			}
+		}
+		if (i == ns->count) {
+			ns->names = realloc(ns->names, (ns->count + 1) * sizeof(xmlChar*));
+			ns->values = realloc(ns->values, (ns->count + 1) * sizeof(xmlChar*));
+			ns->names[i] = xmlStrdup(name);
+			ns->count++;
+		} else {
+			/* redefined in the inner element */
+			xmlFree(ns->values[i]);
+		}
+		ns->values[i] = xmlStrdup(xmlTextReaderConstValue(reader));
+	}
+	xmlTextReaderMoveToElement(reader);
+}
+
+static void stream_ns_clean(struct stream_ns* ns) {
+	int i;
+
+	for (i = 0; i < ns->count; i++) {
+		xmlFree(ns->names[i]);
+		xmlFree(ns->values[i]);
+	}
+	free(ns->names);
+	free(ns->values);
+	memset(ns, 0, sizeof(struct stream_ns));
+}
+
+/*
+ * Write the start tag of the element the reader is positioned at. Its attributes
+ * are copied except the skip one, the inherited namespace declarations are
+ * added unless the element redefines them.
+ */
+static int stream_start(xmlTextReaderPtr reader, xmlTextWriterPtr writer, const struct stream_ns* ns, const char* skip) {
+	const xmlChar* name;
+	xmlChar* value;
+	int i, ret;
+
+	ret = xmlTextWriterStartElement(writer, xmlTextReaderConstName(reader));
+	while (ret >= 0 && xmlTextReaderMoveToNextAttribute(reader) == 1) {
+		name = xmlTextReaderConstName(reader);
+		if (skip == NULL || !xmlStrEqual(name, BAD_CAST skip)) {
+			ret = xmlTextWriterWriteAttribute(writer, name, xmlTextReaderConstValue(reader));
+		}
+	}
+	xmlTextReaderMoveToElement(reader);
+
+	for (i = 0; ns != NULL && ret >= 0 && i < ns->count; i++) {
+		if ((value = xmlTextReaderGetAttribute(reader, ns->names[i])) != NULL) {
+			xmlFree(value);
+			continue;
+		}
+		ret = xmlTextWriterWriteAttribute(writer, ns->names[i], ns->values[i]);
+	}
+
+	return ret;
+}
+
+/*
+ * Copy the node the reader is positioned at into the writer. Nodes are copied
+ * one by one, so the memory used does not depend on the size of the document.
+ */
+static int stream_copy(xmlTextReaderPtr reader, xmlTextWriterPtr writer, const struct stream_ns* ns) {
+	switch (xmlTextReaderNodeType(reader)) {
+	case XML_READER_TYPE_ELEMENT:
+		if (stream_start(reader, writer, ns, NULL) < 0) {
+			return -1;
+		}
+		if (xmlTextReaderIsEmptyElement(reader) == 1) {
+			return xmlTextWriterEndElement(writer);
+		}
+		return 0;
+	case XML_READER_TYPE_END_ELEMENT:
+		return xmlTextWriterEndElement(writer);
+	case XML_READER_TYPE_TEXT:
+		return xmlTextWriterWriteString(writer, xmlTextReaderConstValue(reader));
+	case XML_READER_TYPE_CDATA:
+		return xmlTextWriterWriteCDATA(writer, xmlTextReaderConstValue(reader));
+	case XML_READER_TYPE_COMMENT:
+		return xmlTextWriterWriteComment(writer, xmlTextReaderConstValue(reader));
+	default:
+		/* whitespaces and other nodes not kept in the datastores */
+		return 0;
+	}
+}
+
+/*
+ * Stream the configuration from the file into the writer. The configuration
+ * is enclosed in the NETCONF <config> (or <data>) element, or it is a single
+ * top-level element.
+ */
+static int import_config(xmlTextWriterPtr writer, const char* path, unsigned long* count) {
+	xmlTextReaderPtr reader;
+	struct stream_ns ns = {0, NULL, NULL};
+	int r, depth, type, top = 0, ret = 0;
+
+	if ((reader = xmlReaderForFile(path, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
+		nc_verb_error("Failed to open file \"%s\"", path);
+		return 1;
+	}
+
+	while ((r = xmlTextReaderRead(reader)) == 1) {
+		depth = xmlTextReaderDepth(reader);
+		type = xmlTextReaderNodeType(reader);
+
+		if (depth == 0 && type == XML_READER_TYPE_ELEMENT && xmlStrEqual(xmlTextReaderConstNamespaceUri(reader), BAD_CAST NC_NS_BASE10) &&
+				(xmlStrEqual(xmlTextReaderConstLocalName(reader), BAD_CAST "config") || xmlStrEqual(xmlTextReaderConstLocalName(reader), BAD_CAST "data"))) {
+			/* the content inherits the namespaces of the enclosing element */
+			top = 1;
+			stream_ns_collect(&ns, reader);
+			continue;
+		}
+		if (depth < top || (depth == 0 && type != XML_READER_TYPE_ELEMENT && type != XML_READER_TYPE_END_ELEMENT)) {
+			continue;
+		}
+
+		if (type == XML_READER_TYPE_ELEMENT) {
+			(*count)++;
+		}
+		if (stream_copy(reader, writer, (depth == top) ? &ns : NULL) < 0) {
+			nc_verb_error("Failed to write the configuration from \"%s\"", path);
+			ret = 1;
+			break;
+		}
+	}
+	if (r == -1) {
+		nc_verb_error("Failed to parse \"%s\" (line %d)", path, xmlTextReaderGetParserLineNumber(reader));
+		ret = 1;
+	}
+
+	stream_ns_clean(&ns);
+	xmlFreeTextReader(reader);
+	return ret;
+}
+
+static char* validate_path(const struct validate_frame* stack, int depth) {
+	char* path = NULL, *aux;
+	int i;
+
+	for (i = 0; i <= depth; i++) {
+		if (asprintf(&aux, "%s/%s", (path == NULL) ? "" : path, (char*) stack[i].name) == -1) {
+			break;
+		}
+		free(path);
+		path = aux;
+	}
+
+	return path;
+}
+
+static int validate_end(const struct validate_frame* stack, int depth) {
+	const struct schema_node* snode = stack[depth].snode;
+	char* path;
+	int i, ret = 0;
+
+	if (snode == NULL || snode->type != SCHEMA_LIST) {
+		return 0;
+	}
+
+	for (i = 0; i < snode->keys_count && (size_t) i < sizeof(unsigned long) * 8; i++) {
+		if (!(stack[depth].keys & (1UL << i))) {
+			path = validate_path(stack, depth);
+			nc_verb_error("List entry %s misses the key \"%s\"", path, snode->keys[i]);
+			free(path);
+			ret++;
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * Check the datastore content in the file against the consolidated data models
+ * of the datastores - all the elements must be defined as configuration data
+ * and the list entries must contain their keys.
+ */
+static int import_validate(const char* path, const char* part) {
+	xmlTextReaderPtr reader;
+	struct ncds_ds_list* item;
+	struct validate_frame* stack = NULL, *aux;
+	const struct schema_node* snode, *parent;
+	const xmlChar* name;
+	char* node_path;
+	int r, i, depth, empty, size = 0, errors = 0;
+
+	if (ncds.datastores == NULL) {
+		nc_verb_error("No datastores to validate the configuration against");
+		return 1;
+	}
+	for (item = ncds.datastores; item != NULL; item = item->next) {
+		if (schema_get(item->datastore->ext_model) == NULL) {
+			nc_verb_error("Datastore \"%s\" is not consolidated", item->datastore->data_model->name);
+			return 1;
+		}
+	}
+
+	if ((reader = xmlReaderForFile(path, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
+		nc_verb_error("Failed to open file \"%s\"", path);
+		return 1;
+	}
+
+	r = xmlTextReaderRead(reader);
+	while (r == 1 && errors < IMPORT_MAX_ERRORS) {
+		/* depth in the configuration, the datastores and datastore nodes are above */
+		depth = xmlTextReaderDepth(reader) - 2;
+		empty = xmlTextReaderIsEmptyElement(reader);
+
+		if (depth < 0) {
+			if (depth == -1 && xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT &&
+					!xmlStrEqual(xmlTextReaderConstLocalName(reader), BAD_CAST part)) {
+				/* only the imported datastore is checked */
+				r = xmlTextReaderNext(reader);
+			} else {
+				r = xmlTextReaderRead(reader);
+			}
+			continue;
+		}
+
+		if (xmlTextReaderNodeType(reader) == XML_READER_TYPE_END_ELEMENT) {
+			errors += validate_end(stack, depth);
+			r = xmlTextReaderRead(reader);
+			continue;
+		} else if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) {
+			r = xmlTextReaderRead(reader);
+			continue;
+		}
+
+		if (depth >= size) {
+			if ((aux = realloc(stack, (depth + 16) * sizeof(struct validate_frame))) == NULL) {
+				nc_verb_error("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+				errors++;
+				break;
+			}
+			stack = aux;
+			size = depth + 16;
+		}
+		name = xmlTextReaderConstLocalName(reader);
+		stack[depth].name = name;
+		stack[depth].snode = NULL;
+		stack[depth].keys = 0;
+
+		snode = NULL;
+		if (depth == 0) {
+			for (item = ncds.datastores; item != NULL; item = item->next) {
+				if (xmlStrEqual(xmlTextReaderConstNamespaceUri(reader), BAD_CAST item->datastore->data_model->ns) &&
+						(snode = xmlHashLookup(schema_get(item->datastore->ext_model)->roots, name)) != NULL) {
+					break;
+				}
+			}
+		} else {
+			parent = stack[depth - 1].snode;
+			if (parent->children != NULL) {
+				snode = xmlHashLookup(parent->children, name);
+			}
+			if (snode != NULL && parent->type == SCHEMA_LIST) {
+				for (i = 0; i < parent->keys_count && (size_t) i < sizeof(unsigned long) * 8; i++) {
+					if (xmlStrEqual(parent->keys[i], name)) {
+						stack[depth - 1].keys |= (1UL << i);
+					}
+				}
+			}
+		}
+
+		if (snode == NULL || (snode->flags & SCHEMA_CONFIG_FALSE)) {
+			node_path = validate_path(stack, depth);
+			if (snode == NULL) {
+				nc_verb_error("Element %s is not defined in the data models", node_path);
+			} else {
+				nc_verb_error("Element %s is not a configuration data node", node_path);
+			}
+			free(node_path);
+			errors++;
+			/* do not check its content */
+			r = xmlTextReaderNext(reader);
+			continue;
+		}
+		stack[depth].snode = snode;
+
+		if (empty) {
+			errors += validate_end(stack, depth);
+		} else if (snode->type == SCHEMA_ANYXML) {
+			r = xmlTextReaderNext(reader);
+			continue;
+		}
+		r = xmlTextReaderRead(reader);
+	}
+	if (r == -1) {
+		nc_verb_error("Failed to parse \"%s\" (line %d)", path, xmlTextReaderGetParserLineNumber(reader));
+		errors++;
+	} else if (errors >= IMPORT_MAX_ERRORS) {
+		nc_verb_error("Too many errors, validation stopped");
+	}
+
+	free(stack);
+	xmlFreeTextReader(reader);
+	return (errors > 0) ? 1 : 0;
+}
+
+/*
+ * Check that the journal of the datastore file has no records of the current
+ * generation, which are not written into the file itself yet.
+ */
+static int journal_check(const char* path, unsigned long generation) {
+	FILE* journal;
+	xmlDocPtr doc;
+	xmlChar* gen;
+	char* journal_path, *data;
+	int len, ret = 0;
+
+	if (asprintf(&journal_path, "%s%s", path, NCDS_JOURNAL_SUFFIX) == -1) {
+		nc_verb_error("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return 1;
+	}
+	if ((journal = fopen(journal_path, "r")) == NULL) {
+		free(journal_path);
+		return 0;
+	}
+
+	while (ret == 0 && fscanf(journal, "%d", &len) == 1 && fgetc(journal) == '\n' && len > 0) {
+		if ((data = malloc(len)) == NULL) {
+			break;
+		}
+		if (fread(data, 1, len, journal) != (size_t) len || fgetc(journal) != '\n') {
+			/* incomplete record */
+			free(data);
+			break;
+		}
+		if ((doc = xmlReadMemory(data, len, NULL, NULL, NC_XMLREAD_OPTIONS)) != NULL) {
+			gen = xmlGetProp(xmlDocGetRootElement(doc), BAD_CAST "generation");
+			if (((gen == NULL) ? 0 : strtoul((char*) gen, NULL, 10)) == generation) {
+				nc_verb_error("Journal \"%s\" contains changes not written into \"%s\", close the datastore first", journal_path, path);
+				ret = 1;
+			}
+			xmlFree(gen);
+			xmlFreeDoc(doc);
+		}
+		free(data);
+	}
+
+	fclose(journal);
+	free(journal_path);
+	return ret;
+}
+
+/*
+ * Lock the datastore file the same way the processes using the datastore do,
+ * see LOCK_() in datastore_file.c. The signals are blocked while the lock is
+ * held, so the tool cannot leave the datastore locked.
+ */
+static int shared_lock(struct ds_shared_s* shared, int write, sigset_t* sigset) {
+	struct timespec timeout;
+	sigset_t fullsigset;
+	int r;
+
+	sigfillset(&fullsigset);
+	sigprocmask(SIG_SETMASK, &fullsigset, sigset);
+	clock_gettime(CLOCK_REALTIME, &timeout);
+	timeout.tv_sec += NCDS_LOCK_TIMEOUT;
+	if (write) {
+		r = pthread_rwlock_timedwrlock(&(shared->rwlock), &timeout);
+	} else {
+		r = pthread_rwlock_timedrdlock(&(shared->rwlock), &timeout);
+	}
+	if (r != 0) {
+		sigprocmask(SIG_SETMASK, sigset, NULL);
+		nc_verb_error("Failed to lock the datastore file (%s)", strerror(r));
+		return 1;
+	}
+
+	return 0;
+}
+
+static void shared_unlock(struct ds_shared_s* shared, const sigset_t* sigset) {
+	pthread_rwlock_unlock(&(shared->rwlock));
+	sigprocmask(SIG_SETMASK, sigset, NULL);
+}
+
+/*
+ * Get the file storing the datastore. In the split layout (see
+ * ncds_file_set_layout()), the startup and candidate datastores are stored in
+ * the <path>.startup and <path>.candidate files and the datastore file keeps
+ * only their empty elements. The index of the file in the shared data of the
+ * datastore lock is returned in index, split is set in the split layout.
+ */
+static char* part_path(const char* path, const char* part, int* index, int* split) {
+	const char* names[] = {"running", "startup", "candidate"};
+	struct stat st;
+	char* aux;
+	size_t len;
+	int i;
+
+	*index = 0;
+	*split = 0;
+	for (i = 1; i < NCDS_FILE_PARTS; i++) {
+		/* the lock is named according to the datastore file, not its parts */
+		len = strlen(path) - strlen(names[i]);
+		if (strlen(path) > strlen(names[i]) + 1 && path[len - 1] == '.' && strcmp(path + len, names[i]) == 0) {
+			aux = strndupa(path, len - 1);
+			if (stat(aux, &st) == 0) {
+				nc_verb_error("\"%s\" is a part of the datastore file \"%s\", use the datastore file", path, aux);
+				return NULL;
+			}
+		}
+
+		if (asprintf(&aux, "%s.%s", path, names[i]) == -1) {
+			nc_verb_error("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+			return NULL;
+		}
+		if (stat(aux, &st) == 0) {
+			*split = 1;
+			if (strcmp(part, names[i]) == 0) {
+				*index = i;
+				return aux;
+			}
+		}
+		free(aux);
+	}
+
+	return strdup(path);
+}
+
+int cmd_import(const char* arg) {
+	char* argv, *ptr, *input, *path, *output = NULL, *tmp = NULL, *journal = NULL;
+	const char* part = "running";
+	char generation[24];
+	xmlChar* gen;
+	xmlTextReaderPtr reader = NULL;
+	xmlTextWriterPtr writer = NULL;
+	struct ds_shared_s* shared = NULL;
+	sem_t* sem = NULL;
+	sigset_t sigset;
+	struct stat st;
+	unsigned long count = 0, rewrites = 0, changes = 0;
+	int r, depth, type, index, split, validate = 0, found = 0, candidate, exists, ret = 1;
+
+	argv = strdupa(arg);
+	strtok(argv, " ");
+	input = strtok(NULL, " ");
+	path = strtok(NULL, " ");
+	if (input == NULL || path == NULL) {
+		cmd_import_help();
+		return 1;
+	}
+	while ((ptr = strtok(NULL, " ")) != NULL) {
+		if (strcmp(ptr, "--validate") == 0) {
+			validate = 1;
+		} else if (strcmp(ptr, "running") == 0 || strcmp(ptr, "startup") == 0 || strcmp(ptr, "candidate") == 0) {
+			part = ptr;
+		} else {
+			cmd_import_help();
+			return 1;
+		}
+	}
+
+	if ((output = part_path(path, part, &index, &split)) == NULL) {
+		return 1;
+	}
+
+	/*
+	 * the processes using the datastore may change the file meanwhile, the
+	 * counters of the changes tell whether the read content is still current
+	 */
+	if ((shared = ncds_file_shared_open(path, &sem)) == NULL) {
+		nc_verb_error("Failed to open the lock of \"%s\"", path);
+		goto cleanup;
+	}
+	if (shared_lock(shared, 0, &sigset) != 0) {
+		goto cleanup;
+	}
+	rewrites = shared->parts[index].rewrites;
+	changes = shared->parts[index].changes;
+	shared_unlock(shared, &sigset);
+
+	/* the other datastores of an existing file are kept */
+	exists = (stat(output, &st) == 0);
+	if (exists) {
+		reader = xmlReaderForFile(output, NULL, NC_XMLREAD_OPTIONS);
+	} else {
+		reader = xmlReaderForMemory(IMPORT_FRAME, strlen(IMPORT_FRAME), NULL, NULL, NC_XMLREAD_OPTIONS);
+	}
+	if (reader == NULL) {
+		nc_verb_error("Failed to open file \"%s\"", output);
+		goto cleanup;
+	}
+
+	if (asprintf(&tmp, "%s%s", output, NCDS_TMP_SUFFIX) == -1) {
+		nc_verb_error("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		tmp = NULL;
+		goto cleanup;
+	}
+	if (asprintf(&journal, "%s%s", output, NCDS_JOURNAL_SUFFIX) == -1) {
+		nc_verb_error("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		journal = NULL;
+		goto cleanup;
+	}
+	if ((writer = xmlNewTextWriterFilename(tmp, 0)) == NULL) {
+		nc_verb_error("Failed to open file \"%s\" (%s)", tmp, strerror(errno));
+		goto cleanup;
+	}
+	xmlTextWriterSetIndent(writer, 1);
+	xmlTextWriterSetIndentString(writer, BAD_CAST "  ");
+	if (xmlTextWriterStartDocument(writer, "1.0", "UTF-8", NULL) < 0) {
+		goto write_error;
+	}
+
+	r = xmlTextReaderRead(reader);
+	while (r == 1) {
+		depth = xmlTextReaderDepth(reader);
+		type = xmlTextReaderNodeType(reader);
+
+		if (depth == 0 && type == XML_READER_TYPE_ELEMENT) {
+			if (!xmlStrEqual(xmlTextReaderConstLocalName(reader), BAD_CAST "datastores") || xmlTextReaderIsEmptyElement(reader)) {
+				nc_verb_error("\"%s\" is not a file datastore", output);
+				goto cleanup;
+			}
+			/*
+			 * the journal is truncated, it must not hold changes of the kept
+			 * datastores, in the split layout it holds only the replaced one
+			 */
+			gen = xmlTextReaderGetAttribute(reader, BAD_CAST "generation");
+			if (exists && !split && journal_check(output, (gen == NULL) ? 0 : strtoul((char*) gen, NULL, 10)) != 0) {
+				xmlFree(gen);
+				goto cleanup;
+			}
+			/* start a new generation, so the journal records of the replaced content are not applied */
+			snprintf(generation, sizeof(generation), "%lu", ((gen == NULL) ? 0 : strtoul((char*) gen, NULL, 10)) + 1);
+			xmlFree(gen);
+			if (stream_start(reader, writer, NULL, "generation") < 0 ||
+					xmlTextWriterWriteAttribute(writer, BAD_CAST "generation", BAD_CAST generation) < 0) {
+				goto write_error;
+			}
+		} else if (depth == 1 && type == XML_READER_TYPE_ELEMENT && xmlStrEqual(xmlTextReaderConstLocalName(reader), BAD_CAST part)) {
+			found = 1;
+			/*
+			 * the imported candidate is not known to match running, so it is
+			 * modified and it cannot be locked until it is committed or discarded
+			 */
+			candidate = (strcmp(part, "candidate") == 0);
+			if (stream_start(reader, writer, NULL, candidate ? "modified" : NULL) < 0 ||
+					(candidate && xmlTextWriterWriteAttribute(writer, BAD_CAST "modified", BAD_CAST "true") < 0)) {
+				goto write_error;
+			}
+			if (import_config(writer, input, &count) != 0) {
+				goto cleanup;
+			}
+			if (xmlTextWriterEndElement(writer) < 0) {
+				goto write_error;
+			}
+			/* skip the replaced content */
+			r = xmlTextReaderNext(reader);
+			continue;
+		} else if (depth > 0 || type == XML_READER_TYPE_END_ELEMENT) {
+			if (stream_copy(reader, writer, NULL) < 0) {
+				goto write_error;
+			}
+		}
+		r = xmlTextReaderRead(reader);
+	}
+	if (r == -1) {
+		nc_verb_error("Failed to parse \"%s\" (line %d)", output, xmlTextReaderGetParserLineNumber(reader));
+		goto cleanup;
+	}
+	if (!found) {
+		nc_verb_error("\"%s\" does not contain the %s datastore", output, part);
+		goto cleanup;
+	}
+	if (xmlTextWriterEndDocument(writer) < 0) {
+		goto write_error;
+	}
+	xmlFreeTextWriter(writer);
+	writer = NULL;
+	xmlFreeTextReader(reader);
+	reader = NULL;
+
+	/* validated once, when the whole configuration is written */
+	if (validate && import_validate(tmp, part) != 0) {
+		nc_verb_error("Imported configuration is not valid, \"%s\" was not changed", output);
+		goto cleanup;
+	}
+
+	if (exists && chmod(tmp, st.st_mode & 07777) == -1) {
+		nc_verb_warning("Failed to set permissions of \"%s\" (%s)", tmp, strerror(errno));
+	}
+
+	/* replace the file as the processes using the datastore do when they rewrite it */
+	if (shared_lock(shared, 1, &sigset) != 0) {
+		goto cleanup;
+	}
+	if (shared->parts[index].rewrites != rewrites || shared->parts[index].changes != changes) {
+		shared_unlock(shared, &sigset);
+		nc_verb_error("\"%s\" was changed by another process during the import, try it again", output);
+		goto cleanup;
+	}
+	if (rename(tmp, output) == -1) {
+		shared_unlock(shared, &sigset);
+		nc_verb_error("Failed to replace \"%s\" (%s)", output, strerror(errno));
+		goto cleanup;
+	}
+	/* the processes keep the journal opened, so it is not removed */
+	if (truncate(journal, 0) == -1 && errno != ENOENT) {
+		nc_verb_warning("Failed to truncate the journal \"%s\" (%s)", journal, strerror(errno));
+	}
+	/* let the processes reload the file */
+	shared->parts[index].rewrites++;
+	shared_unlock(shared, &sigset);
+	nc_verb_verbose("Imported %lu configuration elements into the %s datastore in \"%s\"", count, part, output);
+	ret = 0;
+	goto cleanup;
+
+write_error:
+	nc_verb_error("Failed to write into file \"%s\"", tmp);
+
+cleanup:
+	if (writer != NULL) {
+		xmlFreeTextWriter(writer);
+	}
+	if (reader != NULL) {
+		xmlFreeTextReader(reader);
+	}
+	if (ret != 0 && tmp != NULL) {
+		unlink(tmp);
+	}
+	if (shared != NULL) {
+		munmap(shared, sizeof(struct ds_shared_s));
+	}
+	if (sem != NULL) {
+		sem_close(sem);
+	}
+	free(output);
+	free(tmp);
+	free(journal);
+	return ret;
+}
+
+int cmd_export(const char* arg) {
+	char* argv, *ptr, *path, *file, *output = NULL;
+	const char* part = "running";
+	xmlChar* gen;
+	xmlTextReaderPtr reader = NULL;
+	xmlTextWriterPtr writer = NULL;
+	struct stream_ns ns = {0, NULL, NULL};
+	unsigned long count = 0;
+	int r, depth, type, index, split, found = 0, ret = 1;
+
+	argv = strdupa(arg);
+	strtok(argv, " ");
+	if ((path = strtok(NULL, " ")) == NULL) {
+		cmd_export_help();
+		return 1;
+	}
+	if ((ptr = strtok(NULL, " ")) != NULL) {
+		if (strcmp(ptr, "running") == 0 || strcmp(ptr, "startup") == 0 || strcmp(ptr, "candidate") == 0) {
+			part = ptr;
+			output = strtok(NULL, " ");
+		} else {
+			output = ptr;
+		}
+	}
+
+	if ((file = part_path(path, part, &index, &split)) == NULL) {
+		return 1;
+	}
+	path = strdupa(file);
+	free(file);
+
+	if ((reader = xmlReaderForFile(path, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
+		nc_verb_error("Failed to open file \"%s\"", path);
+		return 1;
+	}
+	if (output == NULL) {
+		writer = xmlNewTextWriter(xmlOutputBufferCreateFile(stdout, NULL));
+	} else {
+		writer = xmlNewTextWriterFilename(output, 0);
+	}
+	if (writer == NULL) {
+		nc_verb_error("Failed to open file \"%s\" (%s)", (output == NULL) ? "stdout" : output, strerror(errno));
+		goto cleanup;
+	}
+	xmlTextWriterSetIndent(writer, 1);
+	xmlTextWriterSetIndentString(writer, BAD_CAST "  ");
+	if (xmlTextWriterStartDocument(writer, "1.0", "UTF-8", NULL) < 0 ||
+			xmlTextWriterStartElement(writer, BAD_CAST "config") < 0 ||
+			xmlTextWriterWriteAttribute(writer, BAD_CAST "xmlns", BAD_CAST NC_NS_BASE10) < 0) {
+		goto write_error;
+	}
+
+	r = xmlTextReaderRead(reader);
+	while (r == 1) {
+		depth = xmlTextReaderDepth(reader);
+		type = xmlTextReaderNodeType(reader);
+
+		if (depth == 0 && type == XML_READER_TYPE_ELEMENT) {
+			if (!xmlStrEqual(xmlTextReaderConstLocalName(reader), BAD_CAST "datastores")) {
+				nc_verb_error("\"%s\" is not a file datastore", path);
+				goto cleanup;
+			}
+			gen = xmlTextReaderGetAttribute(reader, BAD_CAST "generation");
+			if (journal_check(path, (gen == NULL) ? 0 : strtoul((char*) gen, NULL, 10)) != 0) {
+				xmlFree(gen);
+				goto cleanup;
+			}
+			xmlFree(gen);
+			stream_ns_collect(&ns, reader);
+		} else if (depth == 1 && type == XML_READER_TYPE_ELEMENT) {
+			if (!xmlStrEqual(xmlTextReaderConstLocalName(reader), BAD_CAST part)) {
+				r = xmlTextReaderNext(reader);
+				continue;
+			}
+			found = 1;
+			stream_ns_collect(&ns, reader);
+		} else if (depth > 1) {
+			if (type == XML_READER_TYPE_ELEMENT) {
+				count++;
+			}
+			if (stream_copy(reader, writer, (depth == 2) ? &ns : NULL) < 0) {
+				goto write_error;
+			}
+		}
+		r = xmlTextReaderRead(reader);
+	}
+	if (r == -1) {
+		nc_verb_error("Failed to parse \"%s\" (line %d)", path, xmlTextReaderGetParserLineNumber(reader));
+		goto cleanup;
+	}
+	if (!found) {
+		nc_verb_error("\"%s\" does not contain the %s datastore", path, part);
+		goto cleanup;
+	}
+	if (xmlTextWriterEndDocument(writer) < 0) {
+		goto write_error;
+	}
+	nc_verb_verbose("Exported %lu configuration elements from the %s datastore in \"%s\"", count, part, path);
+	ret = 0;
+	goto cleanup;
+
+write_error:
+	nc_verb_error("Failed to write into file \"%s\"", (output == NULL) ? "stdout" : output);
+
+cleanup:
+	if (writer != NULL) {
+		xmlFreeTextWriter(writer);
+	}
+	if (ret != 0 && output != NULL) {
+		unlink(output);
+	}
+	xmlFreeTextReader(reader);
+	stream_ns_clean(&ns);
+	return ret;
+}
+
 int cmd_quit(const char* UNUSED(arg)) {
 	done = 1;
 	ncds_cleanall();
@@ -560,6 +1360,8 @@ COMMAND commands[] = {
 		{"consolidate", cmd_consolidate, NULL, "Consolidate datastores"},
 		{"feature", cmd_feature, cmd_feature_help, "Manage datastore/model features"},
 		{"verb", cmd_verb, cmd_verb_help, "Change verbosity"},
+		{"import", cmd_import, cmd_import_help, "Load a configuration into a file datastore"},
+		{"export", cmd_export, cmd_export_help, "Dump a file datastore configuration"},
 		{"quit", cmd_quit, NULL, "Quit the program"},
 /* synonyms for previous commands */
 		{"?", cmd_help, NULL, "Display commands description"},
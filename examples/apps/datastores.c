@@ -0,0 +1,862 @@
+/*
+ * datastores.c
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <libnetconf.h>
+
+#define ARGUMENTS "d:hkv"
+
+/* exit status of a check not available in this build */
+#define CHECK_SKIPPED 77
+
+#define NS "urn:cesnet:libnetconf:example:datastores"
+#define PL_NS "urn:ietf:params:xml:ns:netconf:partial-lock:1.0"
+#define NACM_NS "urn:ietf:params:xml:ns:yang:ietf-netconf-acm"
+
+/* data model of the checked datastores */
+static const char* model =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<module name=\"example-ds\" xmlns=\"urn:ietf:params:xml:ns:yang:yin:1\" xmlns:ex=\"" NS "\">\n"
+	"  <namespace uri=\"" NS "\"/>\n"
+	"  <prefix value=\"ex\"/>\n"
+	"  <revision date=\"2014-06-01\"/>\n"
+	"  <grouping name=\"counters\">\n"
+	"    <leaf name=\"limit\"><type name=\"uint32\"/><default value=\"10\"/></leaf>\n"
+	"    <leaf name=\"descr\"><type name=\"string\"/></leaf>\n"
+	"  </grouping>\n"
+	"  <container name=\"top\">\n"
+	"    <list name=\"item\">\n"
+	"      <key value=\"name\"/>\n"
+	"      <leaf name=\"name\"><type name=\"string\"/></leaf>\n"
+	"      <uses name=\"counters\"/>\n"
+	"    </list>\n"
+	"    <leaf-list name=\"tag\"><type name=\"string\"/><ordered-by value=\"user\"/></leaf-list>\n"
+	"    <leaf name=\"mode\"><type name=\"string\"/></leaf>\n"
+	"  </container>\n"
+	"</module>\n";
+
+/*
+ * the file datastores' locks are named according to the datastore paths and
+ * persist in the system, so the fixed working directory is used by default
+ */
+static const char* workdir = "/tmp/libnetconf-datastores";
+static char* model_path = NULL;
+static int verbose = 0;
+static int cache_hit = 0;
+static int init_flags = NC_INIT_DATASTORES | NC_INIT_SINGLELAYER;
+static ncds_id ds_id = -1;
+
+static void clb_print(NC_VERB_LEVEL level, const char* msg)
+{
+	if (strncmp(msg, "Data models consolidated from the cache entry", 45) == 0) {
+		cache_hit = 1;
+	}
+	if (!verbose && level != NC_VERB_ERROR) {
+		return;
+	}
+
+	switch (level) {
+	case NC_VERB_ERROR:
+		fprintf(stderr, "libnetconf ERROR: %s\n", msg);
+		break;
+	case NC_VERB_WARNING:
+		fprintf(stderr, "libnetconf WARNING: %s\n", msg);
+		break;
+	case NC_VERB_VERBOSE:
+		fprintf(stderr, "libnetconf VERBOSE: %s\n", msg);
+		break;
+	case NC_VERB_DEBUG:
+		fprintf(stderr, "libnetconf DEBUG: %s\n", msg);
+		break;
+	}
+}
+
+static void usage(char* progname)
+{
+	printf("Usage: %s [-hkv] [-d dir] [check ...]\n", progname);
+	printf(" -d dir   working directory to create, %s by default\n", workdir);
+	printf(" -h       display help\n");
+	printf(" -k       keep the working directory with the datastore files\n");
+	printf(" -v       print libnetconf messages\n\n");
+	printf("Checks: sqlite shm transaction partial-lock nacm model-cache (all by default)\n");
+}
+
+static char* path(const char* name)
+{
+	char* p = NULL;
+
+	if (asprintf(&p, "%s/%s", workdir, name) == -1) {
+		return (NULL);
+	}
+	return (p);
+}
+
+static int write_file(const char* name, const char* content)
+{
+	FILE* f;
+	char* p;
+	int ret = EXIT_FAILURE;
+
+	if ((p = path(name)) != NULL && (f = fopen(p, "w")) != NULL) {
+		if (fputs(content, f) >= 0) {
+			ret = EXIT_SUCCESS;
+		}
+		fclose(f);
+	}
+	free(p);
+	return (ret);
+}
+
+static char* read_file(const char* name)
+{
+	FILE* f;
+	char* p, *content = NULL;
+	long size;
+
+	if ((p = path(name)) != NULL && (f = fopen(p, "r")) != NULL) {
+		if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0 &&
+				(content = calloc(1, size + 1)) != NULL && fread(content, 1, size, f) != (size_t)size) {
+			free(content);
+			content = NULL;
+		}
+		fclose(f);
+	}
+	free(p);
+	return (content);
+}
+
+/*
+ * Initiate libnetconf with a single datastore of the example model, the
+ * datastore file (path prefix, database) is placed into the working directory.
+ */
+static struct nc_session* open_datastore(NCDS_TYPE type, const char* name, const char* cache)
+{
+	struct ncds_ds* ds;
+	struct nc_cpblts* cpblts;
+	struct nc_session* session;
+	char* p;
+	int ret = EXIT_SUCCESS;
+
+	nc_callback_print(clb_print);
+	nc_verbosity(NC_VERB_VERBOSE);
+	if (nc_init(init_flags) == -1) {
+		fprintf(stderr, "libnetconf initiation failed.\n");
+		return (NULL);
+	}
+
+	if ((ds = ncds_new(type, model_path, NULL)) == NULL) {
+		return (NULL);
+	}
+	p = path(name);
+	switch (type) {
+	case NCDS_TYPE_FILE:
+		ret = ncds_file_set_path(ds, p);
+		break;
+	case NCDS_TYPE_SHM:
+		if ((ret = ncds_shm_set_name(ds, name)) == EXIT_SUCCESS) {
+			ret = ncds_shm_set_path(ds, p);
+		}
+		break;
+	case NCDS_TYPE_SQLITE:
+		ret = ncds_sqlite_set_path(ds, p);
+		break;
+	default:
+		break;
+	}
+	free(p);
+	if (ret != EXIT_SUCCESS || (ds_id = ncds_init(ds)) <= 0) {
+		ncds_free(ds);
+		return (NULL);
+	}
+
+	if (cache != NULL && ncds_set_model_cache(cache) != 0) {
+		return (NULL);
+	}
+	if (ncds_consolidate() != 0) {
+		return (NULL);
+	}
+
+	cpblts = nc_session_get_cpblts_default();
+	session = nc_session_dummy("1", "example", NULL, cpblts);
+	nc_cpblts_free(cpblts);
+
+	return (session);
+}
+
+static void close_datastore(struct nc_session* session)
+{
+	nc_session_free(session);
+	nc_close();
+}
+
+static struct nc_session* open_session(const char* sid)
+{
+	struct nc_cpblts* cpblts;
+	struct nc_session* session;
+
+	cpblts = nc_session_get_cpblts_default();
+	session = nc_session_dummy(sid, "example", NULL, cpblts);
+	nc_cpblts_free(cpblts);
+
+	return (session);
+}
+
+/*
+ * Apply the request and return the type of the reply, the error message is
+ * printed if the error is not expected.
+ */
+static NC_REPLY_TYPE apply(struct nc_session* session, nc_rpc* rpc, int expect_error)
+{
+	nc_reply* reply;
+	NC_REPLY_TYPE type = NC_REPLY_UNKNOWN;
+
+	if (rpc == NULL) {
+		return (NC_REPLY_UNKNOWN);
+	}
+	reply = ncds_apply_rpc2all(session, rpc, NULL);
+	nc_rpc_free(rpc);
+	if (reply != NULL && reply != NCDS_RPC_NOT_APPLICABLE) {
+		type = nc_reply_get_type(reply);
+		if (type == NC_REPLY_ERROR && (!expect_error || verbose)) {
+			fprintf(stderr, "rpc-error: %s\n", nc_reply_get_errormsg(reply));
+		}
+		nc_reply_free(reply);
+	}
+	return (type);
+}
+
+static NC_REPLY_TYPE edit(struct nc_session* session, NC_EDIT_DEFOP_TYPE defop, const char* config)
+{
+	return (apply(session, nc_rpc_editconfig(NC_DATASTORE_RUNNING, NC_DATASTORE_CONFIG, defop,
+			NC_EDIT_ERROPT_NOTSET, NC_EDIT_TESTOPT_NOTSET, config), 0));
+}
+
+static NC_REPLY_TYPE edit_denied(struct nc_session* session, const char* config)
+{
+	return (apply(session, nc_rpc_editconfig(NC_DATASTORE_RUNNING, NC_DATASTORE_CONFIG, NC_EDIT_DEFOP_MERGE,
+			NC_EDIT_ERROPT_NOTSET, NC_EDIT_TESTOPT_NOTSET, config), 1));
+}
+
+/*
+ * Get the content of the running datastore, optionally filtered by the subtree
+ * filter. Returns an empty string for an empty datastore, NULL on error.
+ */
+static char* get_config(struct nc_session* session, const char* subtree)
+{
+	struct nc_filter* filter = NULL;
+	nc_rpc* rpc;
+	nc_reply* reply;
+	char* data = NULL;
+
+	if (subtree != NULL) {
+		filter = nc_filter_new(NC_FILTER_SUBTREE, subtree);
+	}
+	rpc = nc_rpc_getconfig(NC_DATASTORE_RUNNING, filter);
+	nc_filter_free(filter);
+	if (rpc == NULL) {
+		return (NULL);
+	}
+	reply = ncds_apply_rpc2all(session, rpc, NULL);
+	nc_rpc_free(rpc);
+	if (reply != NULL && reply != NCDS_RPC_NOT_APPLICABLE) {
+		if (nc_reply_get_type(reply) == NC_REPLY_DATA && (data = nc_reply_get_data(reply)) == NULL) {
+			data = strdup("");
+		}
+		nc_reply_free(reply);
+	}
+	return (data);
+}
+
+static int contains(struct nc_session* session, const char* text)
+{
+	char* data;
+	int ret;
+
+	data = get_config(session, NULL);
+	ret = (data != NULL && strstr(data, text) != NULL);
+	free(data);
+	return (ret);
+}
+
+/*
+ * Run the sequence of changes and store the resulting content into the file,
+ * the result is the same for all the datastore implementations.
+ */
+static int parity_run(NCDS_TYPE type, const char* name)
+{
+	struct nc_session* session;
+	char* data, *result = NULL, *aux;
+	int i, ret = EXIT_FAILURE;
+	const char* edits[] = {
+		"<top xmlns=\"" NS "\"><item><name>a</name><descr>first</descr></item><item><name>b</name></item>"
+			"<item><name>c</name><limit>3</limit></item><tag>x</tag><tag>y</tag><mode>on</mode></top>",
+		"<top xmlns=\"" NS "\"><item><name>b</name><limit>7</limit></item></top>",
+		"<top xmlns=\"" NS "\" xmlns:nc=\"urn:ietf:params:xml:ns:netconf:base:1.0\">"
+			"<item nc:operation=\"delete\"><name>a</name></item><mode nc:operation=\"remove\"/></top>",
+		"<top xmlns=\"" NS "\" xmlns:nc=\"urn:ietf:params:xml:ns:netconf:base:1.0\" xmlns:yang=\"urn:ietf:params:xml:ns:yang:1\">"
+			"<tag nc:operation=\"create\" yang:insert=\"first\">z</tag></top>",
+		"<top xmlns=\"" NS "\" xmlns:nc=\"urn:ietf:params:xml:ns:netconf:base:1.0\">"
+			"<item nc:operation=\"replace\"><name>c</name><descr>last</descr></item></top>",
+		NULL
+	};
+	/*
+	 * the order of the different siblings is not significant and differs
+	 * between the datastores, so each kind of the nodes is got separately
+	 */
+	const char* filters[] = {
+		"<top xmlns=\"" NS "\"><item/></top>",
+		"<top xmlns=\"" NS "\"><item><name>b</name></item></top>",
+		"<top xmlns=\"" NS "\"><tag/></top>",
+		"<top xmlns=\"" NS "\"><mode/></top>",
+		NULL
+	};
+
+	if ((session = open_datastore(type, name, NULL)) == NULL) {
+		return ((type == NCDS_TYPE_SQLITE) ? CHECK_SKIPPED : EXIT_FAILURE);
+	}
+
+	for (i = 0; edits[i] != NULL; i++) {
+		if (edit(session, NC_EDIT_DEFOP_MERGE, edits[i]) != NC_REPLY_OK) {
+			goto cleanup;
+		}
+	}
+	for (i = 0; filters[i] != NULL; i++) {
+		if ((data = get_config(session, filters[i])) == NULL) {
+			goto cleanup;
+		}
+		if (asprintf(&aux, "%s%s\n--\n", (result != NULL) ? result : "", data) == -1) {
+			free(data);
+			goto cleanup;
+		}
+		free(data);
+		free(result);
+		result = aux;
+	}
+	if (asprintf(&data, "%s.out", name) != -1) {
+		ret = write_file(data, result);
+		free(data);
+	}
+
+cleanup:
+	free(result);
+	close_datastore(session);
+	return (ret);
+}
+
+/*
+ * Run the function in a child process, so each datastore is initiated in
+ * a fresh libnetconf instance.
+ */
+static pid_t run_child(int (*func)(NCDS_TYPE, const char*), NCDS_TYPE type, const char* name)
+{
+	pid_t pid;
+
+	if ((pid = fork()) == 0) {
+		exit(func(type, name));
+	}
+	return (pid);
+}
+
+static int wait_child(pid_t pid)
+{
+	int status;
+
+	if (pid == -1 || waitpid(pid, &status, 0) == -1 || !WIFEXITED(status)) {
+		return (EXIT_FAILURE);
+	}
+	return (WEXITSTATUS(status));
+}
+
+/*
+ * The SQLite datastore gives the same results of the <edit-config> and
+ * <get-config> (with and without subtree filters) as the file datastore.
+ */
+static int check_sqlite(void)
+{
+	char* file_result, *sqlite_result;
+	int ret;
+
+	if ((ret = wait_child(run_child(parity_run, NCDS_TYPE_FILE, "parity.xml"))) != EXIT_SUCCESS) {
+		return (ret);
+	}
+	if ((ret = wait_child(run_child(parity_run, NCDS_TYPE_SQLITE, "parity.db"))) != EXIT_SUCCESS) {
+		return (ret);
+	}
+
+	file_result = read_file("parity.xml.out");
+	sqlite_result = read_file("parity.db.out");
+	ret = (file_result != NULL && sqlite_result != NULL && strcmp(file_result, sqlite_result) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+	if (ret != EXIT_SUCCESS) {
+		fprintf(stderr, "file datastore:\n%s\nSQLite datastore:\n%s\n", file_result, sqlite_result);
+	}
+	free(file_result);
+	free(sqlite_result);
+
+	return (ret);
+}
+
+static int shm_pipe[2][2];
+
+static int shm_writer(NCDS_TYPE type, const char* name)
+{
+	struct nc_session* session;
+	char c = 0;
+	int ret = EXIT_FAILURE;
+
+	if ((session = open_datastore(type, name, NULL)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	if (edit(session, NC_EDIT_DEFOP_REPLACE, "<top xmlns=\"" NS "\"><item><name>writer</name></item></top>") == NC_REPLY_OK &&
+			write(shm_pipe[0][1], &c, 1) == 1 &&
+			read(shm_pipe[1][0], &c, 1) == 1 && c == 1 &&
+			contains(session, "<name>reader</name>")) {
+		ret = EXIT_SUCCESS;
+	}
+	close_datastore(session);
+	return (ret);
+}
+
+static int shm_reader(NCDS_TYPE type, const char* name)
+{
+	struct nc_session* session;
+	char c = 0;
+	int ret = EXIT_FAILURE;
+
+	if ((session = open_datastore(type, name, NULL)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	if (read(shm_pipe[0][0], &c, 1) == 1 && contains(session, "<name>writer</name>") &&
+			edit(session, NC_EDIT_DEFOP_MERGE, "<top xmlns=\"" NS "\"><item><name>reader</name></item></top>") == NC_REPLY_OK) {
+		c = 1;
+		ret = EXIT_SUCCESS;
+	}
+	/* let the writer finish in any case */
+	if (write(shm_pipe[1][1], &c, 1) != 1) {
+		ret = EXIT_FAILURE;
+	}
+	close_datastore(session);
+	return (ret);
+}
+
+/*
+ * Two processes share the shared memory datastore, each of them reads the
+ * change made by the other one.
+ */
+static int check_shm(void)
+{
+	pid_t writer, reader;
+	int ret;
+
+	if (pipe(shm_pipe[0]) == -1 || pipe(shm_pipe[1]) == -1) {
+		return (EXIT_FAILURE);
+	}
+	writer = run_child(shm_writer, NCDS_TYPE_SHM, "shm-example");
+	reader = run_child(shm_reader, NCDS_TYPE_SHM, "shm-example");
+	ret = wait_child(reader);
+	if (ret != EXIT_SUCCESS) {
+		/* unblock the writer waiting for the first change */
+		close(shm_pipe[0][0]);
+	}
+	if (wait_child(writer) != EXIT_SUCCESS) {
+		ret = EXIT_FAILURE;
+	}
+
+	return (ret);
+}
+
+static int txn_run(NCDS_TYPE type, const char* name)
+{
+	struct nc_session* session;
+	struct ncds_txn* txn;
+	nc_reply* reply;
+	nc_rpc* rpc;
+	char* before = NULL, *after = NULL;
+	int ret = EXIT_FAILURE;
+
+	if ((session = open_datastore(type, name, NULL)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	if (edit(session, NC_EDIT_DEFOP_MERGE, "<top xmlns=\"" NS "\"><item><name>a</name></item><mode>off</mode></top>") != NC_REPLY_OK ||
+			(before = get_config(session, NULL)) == NULL) {
+		goto cleanup;
+	}
+
+	/* the second edit fails (the item already exists), the first one is reverted */
+	txn = ncds_txn_begin(session);
+	rpc = nc_rpc_editconfig(NC_DATASTORE_RUNNING, NC_DATASTORE_CONFIG, NC_EDIT_DEFOP_MERGE, NC_EDIT_ERROPT_NOTSET, NC_EDIT_TESTOPT_NOTSET,
+			"<top xmlns=\"" NS "\"><item><name>b</name></item><mode>on</mode></top>");
+	reply = ncds_txn_apply(txn, rpc);
+	nc_rpc_free(rpc);
+	if (reply == NULL || reply == NCDS_RPC_NOT_APPLICABLE || nc_reply_get_type(reply) != NC_REPLY_OK) {
+		ncds_txn_abort(txn);
+		goto cleanup;
+	}
+	nc_reply_free(reply);
+	rpc = nc_rpc_editconfig(NC_DATASTORE_RUNNING, NC_DATASTORE_CONFIG, NC_EDIT_DEFOP_MERGE, NC_EDIT_ERROPT_NOTSET, NC_EDIT_TESTOPT_NOTSET,
+			"<top xmlns=\"" NS "\" xmlns:nc=\"urn:ietf:params:xml:ns:netconf:base:1.0\"><item nc:operation=\"create\"><name>a</name></item></top>");
+	reply = ncds_txn_apply(txn, rpc);
+	nc_rpc_free(rpc);
+	if (reply == NULL || reply == NCDS_RPC_NOT_APPLICABLE || nc_reply_get_type(reply) != NC_REPLY_ERROR) {
+		ncds_txn_abort(txn);
+		goto cleanup;
+	}
+	nc_reply_free(reply);
+	/* the rolled back transaction cannot be committed */
+	reply = ncds_txn_commit(txn);
+	if (reply == NULL || nc_reply_get_type(reply) != NC_REPLY_ERROR) {
+		goto cleanup;
+	}
+	nc_reply_free(reply);
+	if ((after = get_config(session, NULL)) == NULL || strcmp(before, after) != 0) {
+		fprintf(stderr, "the failed transaction was not rolled back:\n%s\n", after);
+		goto cleanup;
+	}
+	free(after);
+
+	/* the aborted transaction is reverted as well */
+	txn = ncds_txn_begin(session);
+	rpc = nc_rpc_editconfig(NC_DATASTORE_RUNNING, NC_DATASTORE_CONFIG, NC_EDIT_DEFOP_MERGE, NC_EDIT_ERROPT_NOTSET, NC_EDIT_TESTOPT_NOTSET,
+			"<top xmlns=\"" NS "\"><item><name>c</name></item></top>");
+	reply = ncds_txn_apply(txn, rpc);
+	nc_rpc_free(rpc);
+	if (reply != NULL && reply != NCDS_RPC_NOT_APPLICABLE) {
+		nc_reply_free(reply);
+	}
+	ncds_txn_abort(txn);
+	if ((after = get_config(session, NULL)) == NULL || strcmp(before, after) != 0) {
+		fprintf(stderr, "the aborted transaction was not rolled back:\n%s\n", after);
+		goto cleanup;
+	}
+
+	/* and the committed one is kept */
+	txn = ncds_txn_begin(session);
+	rpc = nc_rpc_editconfig(NC_DATASTORE_RUNNING, NC_DATASTORE_CONFIG, NC_EDIT_DEFOP_MERGE, NC_EDIT_ERROPT_NOTSET, NC_EDIT_TESTOPT_NOTSET,
+			"<top xmlns=\"" NS "\"><item><name>d</name></item></top>");
+	reply = ncds_txn_apply(txn, rpc);
+	nc_rpc_free(rpc);
+	if (reply != NULL && reply != NCDS_RPC_NOT_APPLICABLE) {
+		nc_reply_free(reply);
+	}
+	reply = ncds_txn_commit(txn);
+	if (reply == NULL || nc_reply_get_type(reply) != NC_REPLY_OK) {
+		goto cleanup;
+	}
+	nc_reply_free(reply);
+	if (contains(session, "<name>d</name>")) {
+		ret = EXIT_SUCCESS;
+	}
+
+cleanup:
+	free(before);
+	free(after);
+	close_datastore(session);
+	return (ret);
+}
+
+/*
+ * A failed edit of a transaction reverts all its changes, as well as
+ * ncds_txn_abort() does.
+ */
+static int check_transaction(void)
+{
+	return (wait_child(run_child(txn_run, NCDS_TYPE_FILE, "transaction.xml")));
+}
+
+static int plock_run(NCDS_TYPE type, const char* name)
+{
+	struct nc_session* owner, *other;
+	nc_rpc* rpc;
+	nc_reply* reply;
+	char* data = NULL, *unlock = NULL, *id;
+	unsigned int lock_id;
+	int ret = EXIT_FAILURE;
+	const char* lock = "<partial-lock xmlns=\"" PL_NS "\"><select xmlns:ex=\"" NS "\">/ex:top/ex:item[ex:name='a']</select></partial-lock>";
+
+	if ((owner = open_datastore(type, name, NULL)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	other = open_session("2");
+
+	if (edit(owner, NC_EDIT_DEFOP_MERGE, "<top xmlns=\"" NS "\"><item><name>a</name></item><item><name>b</name></item></top>") != NC_REPLY_OK) {
+		goto cleanup;
+	}
+
+	/* lock the item a, the reply contains the lock-id needed for unlocking */
+	if ((rpc = nc_rpc_generic(lock)) == NULL) {
+		goto cleanup;
+	}
+	reply = ncds_apply_rpc2all(owner, rpc, NULL);
+	nc_rpc_free(rpc);
+	if (reply != NULL && reply != NCDS_RPC_NOT_APPLICABLE) {
+		if (nc_reply_get_type(reply) == NC_REPLY_DATA) {
+			data = nc_reply_get_data(reply);
+		}
+		nc_reply_free(reply);
+	}
+	if (data == NULL || (id = strstr(data, "<lock-id")) == NULL || (id = strchr(id, '>')) == NULL || sscanf(id, ">%u<", &lock_id) != 1 ||
+			asprintf(&unlock, "<partial-unlock xmlns=\"" PL_NS "\"><lock-id>%u</lock-id></partial-unlock>", lock_id) == -1) {
+		fprintf(stderr, "partial lock failed: %s\n", (data != NULL) ? data : "no data");
+		unlock = NULL;
+		goto cleanup;
+	}
+
+	/* the locked node cannot be changed by another session ... */
+	if (edit_denied(other, "<top xmlns=\"" NS "\"><item><name>a</name><limit>1</limit></item></top>") != NC_REPLY_ERROR) {
+		fprintf(stderr, "the partially locked node was changed by another session\n");
+		goto cleanup;
+	}
+	/* ... nor locked again */
+	if (apply(other, nc_rpc_generic(lock), 1) != NC_REPLY_ERROR) {
+		fprintf(stderr, "the partially locked node was locked by another session\n");
+		goto cleanup;
+	}
+	/* the rest of the datastore stays available */
+	if (edit(other, NC_EDIT_DEFOP_MERGE, "<top xmlns=\"" NS "\"><item><name>b</name><limit>2</limit></item></top>") != NC_REPLY_OK) {
+		goto cleanup;
+	}
+	/* the lock owner can change the node */
+	if (edit(owner, NC_EDIT_DEFOP_MERGE, "<top xmlns=\"" NS "\"><item><name>a</name><limit>3</limit></item></top>") != NC_REPLY_OK) {
+		goto cleanup;
+	}
+	/* the node is released with the lock */
+	if (apply(owner, nc_rpc_generic(unlock), 0) != NC_REPLY_OK ||
+			edit(other, NC_EDIT_DEFOP_MERGE, "<top xmlns=\"" NS "\"><item><name>a</name><limit>4</limit></item></top>") != NC_REPLY_OK) {
+		goto cleanup;
+	}
+	ret = EXIT_SUCCESS;
+
+cleanup:
+	free(data);
+	free(unlock);
+	nc_session_free(other);
+	close_datastore(owner);
+	return (ret);
+}
+
+/*
+ * The partial lock (RFC 5717) protects only the selected nodes against the
+ * other sessions.
+ */
+static int check_plock(void)
+{
+	return (wait_child(run_child(plock_run, NCDS_TYPE_FILE, "partial-lock.xml")));
+}
+
+static int nacm_run(NCDS_TYPE type, const char* name)
+{
+	struct nc_session* session;
+	int ret = EXIT_FAILURE;
+	const char* group = "<nacm xmlns=\"" NACM_NS "\"><groups><group><name>lnc-datastores-example</name>"
+			"<user-name>example</user-name></group></groups></nacm>";
+	const char* removal = "<nacm xmlns=\"" NACM_NS "\" xmlns:nc=\"urn:ietf:params:xml:ns:netconf:base:1.0\"><groups>"
+			"<group nc:operation=\"delete\"><name>lnc-datastores-example</name></group></groups></nacm>";
+
+	init_flags |= NC_INIT_NACM;
+	if ((session = open_datastore(type, name, NULL)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	/* the NACM datastore is shared by the whole system, so the group is removed at the end */
+	if (edit(session, NC_EDIT_DEFOP_MERGE, group) != NC_REPLY_OK) {
+		goto cleanup;
+	}
+	if (!contains(session, "lnc-datastores-example")) {
+		fprintf(stderr, "the NACM group was not stored\n");
+		edit(session, NC_EDIT_DEFOP_MERGE, removal);
+		goto cleanup;
+	}
+	if (edit(session, NC_EDIT_DEFOP_MERGE, removal) != NC_REPLY_OK || contains(session, "lnc-datastores-example")) {
+		goto cleanup;
+	}
+	ret = EXIT_SUCCESS;
+
+cleanup:
+	close_datastore(session);
+	return (ret);
+}
+
+/*
+ * The configuration of the internal modules (NACM) is applied to the internal
+ * datastores by ncds_apply_rpc2all() together with the other datastores.
+ */
+static int check_nacm(void)
+{
+	return (wait_child(run_child(nacm_run, NCDS_TYPE_FILE, "nacm.xml")));
+}
+
+static int cache_run(NCDS_TYPE type, const char* name)
+{
+	struct nc_session* session;
+	char* cache, *consolidated, *result;
+	int ret = EXIT_FAILURE;
+
+	cache = path("cache");
+	if ((session = open_datastore(type, name, cache)) != NULL) {
+		if ((consolidated = ncds_get_model(ds_id, 0)) != NULL) {
+			if (asprintf(&result, "%s.%s", name, cache_hit ? "hit" : "miss") != -1) {
+				ret = write_file(result, consolidated);
+				free(result);
+			}
+			free(consolidated);
+		}
+		close_datastore(session);
+	}
+	free(cache);
+
+	return (ret);
+}
+
+/*
+ * The data model consolidated from the cache entry (hit) is the same as the
+ * model consolidated from scratch (miss).
+ */
+static int check_cache(void)
+{
+	char* miss, *hit, *p;
+	int ret;
+
+	p = path("cache");
+	if (p == NULL || mkdir(p, 0700) == -1) {
+		free(p);
+		return (EXIT_FAILURE);
+	}
+	free(p);
+
+	if ((ret = wait_child(run_child(cache_run, NCDS_TYPE_FILE, "model-cache.xml"))) != EXIT_SUCCESS ||
+			(ret = wait_child(run_child(cache_run, NCDS_TYPE_FILE, "model-cache.xml"))) != EXIT_SUCCESS) {
+		return (ret);
+	}
+
+	miss = read_file("model-cache.xml.miss");
+	hit = read_file("model-cache.xml.hit");
+	if (miss == NULL || hit == NULL) {
+		fprintf(stderr, "the model cache was %s\n", (miss == NULL) ? "not missed first" : "not used");
+		ret = EXIT_FAILURE;
+	} else if (strcmp(miss, hit) != 0) {
+		fprintf(stderr, "the cached model differs:\n%s\n--\n%s\n", miss, hit);
+		ret = EXIT_FAILURE;
+	}
+	free(miss);
+	free(hit);
+
+	return (ret);
+}
+
+static struct {
+	const char* name;
+	int (*func)(void);
+} checks[] = {
+	{"sqlite", check_sqlite},
+	{"shm", check_shm},
+	{"transaction", check_transaction},
+	{"partial-lock", check_plock},
+	{"nacm", check_nacm},
+	{"model-cache", check_cache},
+	{NULL, NULL}
+};
+
+int main(int argc, char* argv[])
+{
+	int c, i, j, keep = 0, ret, failed = 0;
+
+	while ((c = getopt(argc, argv, ARGUMENTS)) != -1) {
+		switch (c) {
+		case 'd': /* Working directory */
+			workdir = optarg;
+			break;
+		case 'h': /* Show help */
+			usage(argv[0]);
+			return (EXIT_SUCCESS);
+		case 'k': /* Keep the working directory */
+			keep = 1;
+			break;
+		case 'v': /* Verbose operation */
+			verbose = 1;
+			break;
+		default:
+			fprintf(stderr, "unknown argument -%c", optopt);
+			usage(argv[0]);
+			return (EXIT_FAILURE);
+		}
+	}
+
+	if (mkdir(workdir, 0700) == -1) {
+		fprintf(stderr, "Unable to create the working directory %s (%s).\n", workdir, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	model_path = path("example-ds.yin");
+	if (write_file("example-ds.yin", model) != EXIT_SUCCESS) {
+		fprintf(stderr, "Unable to write the data model.\n");
+		return (EXIT_FAILURE);
+	}
+
+	for (i = 0; checks[i].name != NULL; i++) {
+		for (j = optind; j < argc && strcmp(argv[j], checks[i].name) != 0; j++);
+		if (optind < argc && j == argc) {
+			continue;
+		}
+
+		fflush(stdout);
+		ret = checks[i].func();
+		printf("%-14s %s\n", checks[i].name, (ret == EXIT_SUCCESS) ? "OK" : (ret == CHECK_SKIPPED) ? "SKIPPED" : "FAILED");
+		if (ret != EXIT_SUCCESS && ret != CHECK_SKIPPED) {
+			failed = 1;
+		}
+	}
+
+	if (keep) {
+		printf("The datastore files are kept in %s\n", workdir);
+	} else if (fork() == 0) {
+		execlp("rm", "rm", "-rf", workdir, (char*) NULL);
+		_exit(EXIT_FAILURE);
+	} else {
+		wait(NULL);
+	}
+	free(model_path);
+
+	return (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
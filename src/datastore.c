@@ -44,6 +44,7 @@
 #include <errno.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <assert.h>
@@ -51,6 +52,7 @@
 #include <dirent.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -80,9 +82,14 @@
 #include "datastore_xml.h"
 #include "nacm.h"
 #include "datastore/edit_config.h"
+#include "datastore/schema.h"
 #include "datastore/datastore_internal.h"
 #include "datastore/file/datastore_file.h"
 #include "datastore/empty/datastore_empty.h"
+#include "datastore/shm/datastore_shm.h"
+#ifdef ENABLE_SQLITE
+#	include "datastore/sqlite/datastore_sqlite.h"
+#endif
 #include "datastore/custom/datastore_custom_private.h"
 #include "transapi/transapi_internal.h"
 #include "config.h"
@@ -103,6 +110,8 @@
 #include "../models/ietf-netconf.xxd"
 #include "../models/notifications.xxd"
 #include "../models/libnetconf-notifications.xxd"
+#include "../models/libnetconf-transactions.xxd"
+#include "../models/ietf-netconf-partial-lock.xxd"
 #include "../models/ietf-inet-types.xxd"
 #include "../models/ietf-yang-types.xxd"
 
@@ -143,10 +152,25 @@ struct ncds {
 struct ncds_ds *nacm_ds = NULL; /* for NACM subsystem */
 static struct ncds ncds = {NULL, NULL, 0, 0};
 static struct model_list *models_list = NULL;
+/* hash indexes over the models_list, see models_index_add() */
+static xmlHashTablePtr models_ns_index = NULL;
+static xmlHashTablePtr models_name_index = NULL;
+static xmlHashTablePtr models_op_index = NULL;
+static xmlHashTablePtr models_notif_index = NULL;
 static struct transapi_list* augment_tapi_list = NULL;
 static char** models_dirs = NULL;
-
-static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, const nc_rpc* rpc, struct nc_filter* shared_filter);
+/* directory for the cache of the consolidated data models, NULL if disabled */
+static char* model_cache_dir = NULL;
+/* resolve data models and load validators on their first use, see ncds_set_lazy_consolidation() */
+static int lazy_consolidation = 0;
+
+static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, const nc_rpc* rpc, struct nc_filter* shared_filter, struct ncds_txn* txn);
+static struct nc_err* txn_ds_add(struct ncds_txn* txn, struct ncds_ds* ds, NC_DATASTORE target);
+static struct nc_err* txn_ds_check(struct ncds_ds* ds);
+static struct nc_err* plock_check_lock(const struct nc_session* session);
+static struct nc_err* plock_check_change(struct ncds_ds* ds, const struct nc_session* session, NC_OP op, NC_EDIT_DEFOP_TYPE defop,
+		NC_DATASTORE source, const char* config);
+static void plock_release(const char* session_id);
 static char* get_state_nacm(const char* UNUSED(model), const char* UNUSED(running), struct nc_err ** UNUSED(e));
 static char* get_state_monitoring(const char* UNUSED(model), const char* UNUSED(running), struct nc_err ** UNUSED(e));
 static int get_model_info(xmlXPathContextPtr model_ctxt, char **name, char **version, char **ns, char **prefix, char ***rpcs, char ***notifs);
@@ -154,19 +178,26 @@ static struct data_model* get_model(const char* module, const char* version);
 static int ncds_features_parse(struct data_model* model);
 static int ncds_update_uses_groupings(struct data_model* model);
 static int ncds_update_uses_augments(struct data_model* model);
+static void data_model_lock_init(struct data_model* model);
+static int data_model_resolve(struct data_model* model);
 static void ncds_ds_model_free(struct data_model* model);
+static int models_index_add(struct data_model* model);
+static void models_index_remove(struct data_model* model);
+static void models_index_free(void);
 static xmlDocPtr ncxml_merge(const xmlDocPtr first, const xmlDocPtr second, const xmlDocPtr data_model);
 extern int first_after_close;
 
-static int ncds_update_features();
+static int ncds_update_features(int datastores);
 static int feature_check(xmlNodePtr node, struct data_model* model);
-static struct model_feature** get_features_from_prefix(struct data_model* model, char* prefix);
+static struct data_model* get_model_from_prefix(struct data_model* model, char* prefix);
+static struct model_feature* feature_get(struct data_model* model, const char* name);
 
 #ifndef DISABLE_NOTIFICATIONS
 static char* get_state_notifications(const char* UNUSED(model), const char* UNUSED(running), struct nc_err ** UNUSED(e));
 #endif
 
 static struct ncds_ds *datastores_get_ds(ncds_id id);
+static void ds_routes_invalidate(void);
 
 #ifndef DISABLE_YANGFORMAT
 /* XSL stylesheet for transformation from YIN to YANG format */
@@ -195,6 +226,7 @@ static struct ncds_ds* ncds_fill_func(NCDS_TYPE type)
 		ds->func.copyconfig = ncds_custom_copyconfig;
 		ds->func.deleteconfig = ncds_custom_deleteconfig;
 		ds->func.editconfig = ncds_custom_editconfig;
+		ds->func.getconfig_filtered = ncds_custom_getconfig_filtered;
 		break;
 	case NCDS_TYPE_FILE:
 		if ((ds = (struct ncds_ds*) calloc(1, sizeof(struct ncds_ds_file))) == NULL ) {
@@ -212,7 +244,55 @@ static struct ncds_ds* ncds_fill_func(NCDS_TYPE type)
 		ds->func.copyconfig = ncds_file_copyconfig;
 		ds->func.deleteconfig = ncds_file_deleteconfig;
 		ds->func.editconfig = ncds_file_editconfig;
+		ds->func.flush = ncds_file_flush;
+		ds->func.defer = ncds_file_defer;
+		ds->func.commit = ncds_file_commit;
+		ds->func.get_plocks = ncds_file_get_plocks;
+		ds->func.update_plocks = ncds_file_update_plocks;
+		((struct ncds_ds_file*) ds)->rollback.levels = NCDS_ROLLBACK_LEVELS;
+		((struct ncds_ds_file*) ds)->rollback.max_size = NCDS_ROLLBACK_MAX_SIZE;
+		break;
+	case NCDS_TYPE_SHM:
+		if ((ds = (struct ncds_ds*) calloc(1, sizeof(struct ncds_ds_shm))) == NULL ) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (NULL );
+		}
+		ds->func.init = ncds_shm_init;
+		ds->func.free = ncds_shm_free;
+		ds->func.was_changed = ncds_shm_changed;
+		ds->func.rollback = ncds_shm_rollback;
+		ds->func.get_lockinfo = ncds_shm_lockinfo;
+		ds->func.lock = ncds_shm_lock;
+		ds->func.unlock = ncds_shm_unlock;
+		ds->func.getconfig = ncds_shm_getconfig;
+		ds->func.copyconfig = ncds_shm_copyconfig;
+		ds->func.deleteconfig = ncds_shm_deleteconfig;
+		ds->func.editconfig = ncds_shm_editconfig;
+		break;
+#ifdef ENABLE_SQLITE
+	case NCDS_TYPE_SQLITE:
+		if ((ds = (struct ncds_ds*) calloc(1, sizeof(struct ncds_ds_sqlite))) == NULL ) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (NULL );
+		}
+		ds->func.init = ncds_sqlite_init;
+		ds->func.free = ncds_sqlite_free;
+		ds->func.was_changed = ncds_sqlite_changed;
+		ds->func.rollback = ncds_sqlite_rollback;
+		ds->func.get_lockinfo = ncds_sqlite_lockinfo;
+		ds->func.lock = ncds_sqlite_lock;
+		ds->func.unlock = ncds_sqlite_unlock;
+		ds->func.getconfig = ncds_sqlite_getconfig;
+		ds->func.copyconfig = ncds_sqlite_copyconfig;
+		ds->func.deleteconfig = ncds_sqlite_deleteconfig;
+		ds->func.editconfig = ncds_sqlite_editconfig;
+		ds->func.getconfig_filtered = ncds_sqlite_getconfig_filtered;
 		break;
+#else
+	case NCDS_TYPE_SQLITE:
+		ERROR("SQLite datastore is not available, libnetconf was compiled without --enable-sqlite.");
+		return (NULL);
+#endif
 	case NCDS_TYPE_EMPTY:
 		if ((ds = (struct ncds_ds*) calloc(1, sizeof(struct ncds_ds_empty))) == NULL ) {
 			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
@@ -237,15 +317,23 @@ static struct ncds_ds* ncds_fill_func(NCDS_TYPE type)
 	return (ds);
 }
 
+#ifndef ENABLE_SQLITE
+API int ncds_sqlite_set_path(struct ncds_ds* UNUSED(datastore), const char* UNUSED(path))
+{
+	ERROR("%s: SQLite datastore is not available, libnetconf was compiled without --enable-sqlite.", __func__);
+	return (EXIT_FAILURE);
+}
+#endif
+
 #ifndef DISABLE_NOTIFICATIONS
-#define INTERNAL_DS_COUNT 10
+#define INTERNAL_DS_COUNT 12
 #define MONITOR_DS_INDEX 3
 #define NOTIF_DS_INDEX_L 4
 #define NOTIF_DS_INDEX_H 7
 #define WD_DS_INDEX 8
 #define NACM_DS_INDEX 9
 #else
-#define INTERNAL_DS_COUNT 6
+#define INTERNAL_DS_COUNT 8
 #define MONITOR_DS_INDEX 3
 #define WD_DS_INDEX 4
 #define NACM_DS_INDEX 5
@@ -270,7 +358,9 @@ int ncds_sysinit(int flags)
 			libnetconf_notifications_yin,
 #endif
 			ietf_netconf_with_defaults_yin,
-			ietf_netconf_acm_yin
+			ietf_netconf_acm_yin,
+			libnetconf_transactions_yin,
+			ietf_netconf_partial_lock_yin
 	};
 	unsigned int model_len[INTERNAL_DS_COUNT] = {
 			ietf_inet_types_yin_len,
@@ -284,7 +374,9 @@ int ncds_sysinit(int flags)
 			libnetconf_notifications_yin_len,
 #endif
 			ietf_netconf_with_defaults_yin_len,
-			ietf_netconf_acm_yin_len
+			ietf_netconf_acm_yin_len,
+			libnetconf_transactions_yin_len,
+			ietf_netconf_partial_lock_yin_len
 	};
 	char* (*get_state_funcs[INTERNAL_DS_COUNT])(const char* model, const char* running, struct nc_err ** e) = {
 			NULL, /* ietf-inet-types */
@@ -298,7 +390,9 @@ int ncds_sysinit(int flags)
 			NULL, /* libnetconf-notifications */
 #endif
 			NULL, /* ietf-netconf-with-defaults */
-			get_state_nacm /* NACM status data */
+			get_state_nacm, /* NACM status data */
+			NULL, /* libnetconf-transactions */
+			NULL /* ietf-netconf-partial-lock */
 	};
 	struct ds_desc internal_ds_desc[INTERNAL_DS_COUNT] = {
 			{NCDS_TYPE_EMPTY, NULL},
@@ -312,7 +406,9 @@ int ncds_sysinit(int flags)
 			{NCDS_TYPE_EMPTY, NULL}, /* libnetconf-notifications */
 #endif
 			{NCDS_TYPE_EMPTY, NULL},
-			{NCDS_TYPE_FILE, NC_WORKINGDIR_PATH"/datastore-acm.xml"}
+			{NCDS_TYPE_FILE, NC_WORKINGDIR_PATH"/datastore-acm.xml"},
+			{NCDS_TYPE_EMPTY, NULL}, /* libnetconf-transactions */
+			{NCDS_TYPE_EMPTY, NULL} /* ietf-netconf-partial-lock */
 	};
 #ifndef DISABLE_VALIDATION
 	char* relaxng_validators[INTERNAL_DS_COUNT] = {
@@ -327,7 +423,9 @@ int ncds_sysinit(int flags)
 			NULL, /* libnetconf-notifications */
 #endif
 			NULL, /* ietf-netconf-with-defaults */
-			NC_WORKINGDIR_PATH"/ietf-netconf-acm-config.rng" /* NACM RelaxNG schema */
+			NC_WORKINGDIR_PATH"/ietf-netconf-acm-config.rng", /* NACM RelaxNG schema */
+			NULL, /* libnetconf-transactions */
+			NULL /* ietf-netconf-partial-lock */
 	};
 	char* schematron_validators[INTERNAL_DS_COUNT] = {
 			NULL, /* ietf-inet-types */
@@ -341,7 +439,9 @@ int ncds_sysinit(int flags)
 			NULL, /* libnetconf-notifications */
 #endif
 			NULL, /* ietf-netconf-with-defaults */
-			NC_WORKINGDIR_PATH"/ietf-netconf-acm-schematron.xsl" /* NACM Schematron XSL stylesheet */
+			NC_WORKINGDIR_PATH"/ietf-netconf-acm-schematron.xsl", /* NACM Schematron XSL stylesheet */
+			NULL, /* libnetconf-transactions */
+			NULL /* ietf-netconf-partial-lock */
 	};
 #endif
 
@@ -392,6 +492,7 @@ int ncds_sysinit(int flags)
 			internal_ds_count--;
 			return (EXIT_FAILURE);
 		}
+		data_model_lock_init(ds->data_model);
 
 		ds->data_model->xml = xmlReadMemory ((char*)model[i], model_len[i], NULL, NULL, NC_XMLREAD_OPTIONS);
 		if (ds->data_model->xml == NULL ) {
@@ -437,9 +538,11 @@ int ncds_sysinit(int flags)
 		/* resolve uses statements in groupings and augments definitions */
 		ncds_update_uses_groupings(ds->data_model);
 		ncds_update_uses_augments(ds->data_model);
+		ds->data_model->resolved = 1;
 
 		ds->last_access = 0;
 		ds->get_state = get_state_funcs[i];
+		pthread_rwlock_init(&ds->lock, NULL);
 
 		/* update internal model lists */
 		list_item = malloc(sizeof(struct model_list));
@@ -452,6 +555,7 @@ int ncds_sysinit(int flags)
 		list_item->model = ds->data_model;
 		list_item->next = models_list;
 		models_list = list_item;
+		models_index_add(ds->data_model);
 
 #ifndef DISABLE_VALIDATION
 		/* set validation */
@@ -517,6 +621,9 @@ void ncds_startup_internal(void)
 	for (ds_iter = ncds.datastores; ds_iter != NULL ; ds_iter = ds_iter->next) {
 		/* apply startup to running */
 		ds_iter->datastore->func.copyconfig(ds_iter->datastore, NULL, NULL, NC_DATASTORE_RUNNING, NC_DATASTORE_STARTUP, NULL, &e);
+		if (ds_iter->datastore->func.flush != NULL) {
+			ds_iter->datastore->func.flush(ds_iter->datastore);
+		}
 		nc_err_free(e);
 		e = NULL;
 	}
@@ -582,11 +689,322 @@ static struct ncds_ds *datastores_detach_ds(ncds_id id)
 		retval = ds_iter->datastore;
 		free(ds_iter);
 		ncds.count--;
+
+		/* routing index refers to the removed list item */
+		ds_routes_invalidate();
 	}
 
 	return retval;
 }
 
+/*
+ * Routing index of the datastores used by ncds_apply_rpc2all(). It maps the
+ * namespaces of the top-level configuration data (and the namespaces of the
+ * modules augmenting them or providing transAPI modules to them) to the
+ * datastores handling such data. The index is built by ncds_consolidate()
+ * and dropped whenever the set of datastores or models changes. Without the
+ * index, all the datastores are visited.
+ */
+struct ds_route {
+	/* position of the datastore in the ncds.datastores list */
+	int pos;
+	struct ncds_ds_list *item;
+};
+
+struct ds_routes {
+	int count;
+	struct ds_route *list;
+};
+
+static xmlHashTablePtr ds_routes_index = NULL;
+/*
+ * route to the NCDS_INTERNAL_ID datastore, used by <get> and <get-config>, the
+ * namespaces of the other internal datastores route to it as well since it
+ * applies the requests to all of them
+ */
+static struct ds_route ds_routes_internal = {0, NULL};
+
+static void ds_routes_free(void *payload, const xmlChar *UNUSED(name))
+{
+	struct ds_routes *routes = (struct ds_routes*) payload;
+
+	if (routes != NULL) {
+		free(routes->list);
+		free(routes);
+	}
+}
+
+/**
+ * @brief Drop the datastores routing index. It is rebuilt by the following
+ * ncds_consolidate().
+ */
+static void ds_routes_invalidate(void)
+{
+	if (ds_routes_index != NULL) {
+		xmlHashFree(ds_routes_index, ds_routes_free);
+		ds_routes_index = NULL;
+	}
+	ds_routes_internal.item = NULL;
+}
+
+static int ds_routes_add(const char* ns, struct ncds_ds_list *item, int pos)
+{
+	struct ds_routes *routes;
+	struct ds_route *aux;
+
+	if ((routes = xmlHashLookup(ds_routes_index, BAD_CAST ns)) == NULL) {
+		if ((routes = calloc(1, sizeof(struct ds_routes))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (EXIT_FAILURE);
+		}
+		if (xmlHashAddEntry(ds_routes_index, BAD_CAST ns, routes) != 0) {
+			free(routes);
+			return (EXIT_FAILURE);
+		}
+	} else if (routes->list[routes->count - 1].item == item) {
+		/* datastores are processed one by one, so the duplicity can be only at the end */
+		return (EXIT_SUCCESS);
+	}
+
+	if ((aux = realloc(routes->list, (routes->count + 1) * sizeof(struct ds_route))) == NULL) {
+		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	routes->list = aux;
+	routes->list[routes->count].pos = pos;
+	routes->list[routes->count].item = item;
+	routes->count++;
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Build the datastores routing index from the consolidated
+ * (extended) data models of the datastores.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE, in the second case the index is not
+ * available and all the datastores are visited by ncds_apply_rpc2all().
+ */
+static int ds_routes_build(void)
+{
+	struct ncds_ds_list *ds_iter;
+	struct ncds_ds *ds;
+	struct transapi_list *tapi_iter;
+	xmlXPathContextPtr ctxt;
+	xmlXPathObjectPtr augments;
+	xmlChar *ns;
+	int pos, i, ret = EXIT_SUCCESS;
+
+	ds_routes_invalidate();
+
+	if ((ds_routes_index = xmlHashCreate(ncds.count + 1)) == NULL) {
+		ERROR("%s: creating hash table failed.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	for (pos = 0, ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next, pos++) {
+		if (ds_iter->datastore != NULL && ds_iter->datastore->id == NCDS_INTERNAL_ID) {
+			ds_routes_internal.pos = pos;
+			ds_routes_internal.item = ds_iter;
+			break;
+		}
+	}
+
+	for (pos = 0, ds_iter = ncds.datastores; ds_iter != NULL && ret == EXIT_SUCCESS; ds_iter = ds_iter->next, pos++) {
+		ds = ds_iter->datastore;
+		if (ds == NULL) {
+			continue;
+		}
+		/* internal datastores are not visited by ncds_apply_rpc2all(), they are reached via NCDS_INTERNAL_ID */
+		if (ds->id > 0 && ds->id < internal_ds_count) {
+			if (ds_routes_internal.item != NULL && ds->data_model != NULL && ds->data_model->ns != NULL) {
+				ret = ds_routes_add(ds->data_model->ns, ds_routes_internal.item, ds_routes_internal.pos);
+			}
+			continue;
+		}
+
+		if (ds->data_model == NULL || ds->data_model->ns == NULL) {
+			/* such a datastore accepts everything, so we are not able to route */
+			VERB("Datastore %d has no namespace, routing index disabled.", ds->id);
+			ret = EXIT_FAILURE;
+			break;
+		}
+		ret = ds_routes_add(ds->data_model->ns, ds_iter, pos);
+
+		/* modules providing transAPI to the datastore (including augments) */
+		for (tapi_iter = ds->transapis; tapi_iter != NULL && ret == EXIT_SUCCESS; tapi_iter = tapi_iter->next) {
+			if (tapi_iter->tapi != NULL && tapi_iter->tapi->model != NULL && tapi_iter->tapi->model->ns != NULL) {
+				ret = ds_routes_add(tapi_iter->tapi->model->ns, ds_iter, pos);
+			}
+		}
+
+		/* modules augmenting the datastore's data model */
+		if (ret != EXIT_SUCCESS || ds->ext_model == NULL) {
+			continue;
+		}
+		if ((ctxt = xmlXPathNewContext(ds->ext_model)) == NULL) {
+			ERROR("%s: Creating XPath context failed.", __func__);
+			ret = EXIT_FAILURE;
+			break;
+		}
+		if (xmlXPathRegisterNs(ctxt, BAD_CAST NC_NS_YIN_ID, BAD_CAST NC_NS_YIN) != 0 ||
+				(augments = xmlXPathEvalExpression(BAD_CAST "//"NC_NS_YIN_ID":augment", ctxt)) == NULL) {
+			ERROR("%s: Evaluating XPath expression failed.", __func__);
+			xmlXPathFreeContext(ctxt);
+			ret = EXIT_FAILURE;
+			break;
+		}
+		for (i = 0; augments->nodesetval != NULL && i < augments->nodesetval->nodeNr && ret == EXIT_SUCCESS; i++) {
+			if ((ns = xmlGetNsProp(augments->nodesetval->nodeTab[i], BAD_CAST "ns", BAD_CAST "libnetconf")) != NULL) {
+				ret = ds_routes_add((char*) ns, ds_iter, pos);
+				xmlFree(ns);
+			}
+		}
+		xmlXPathFreeObject(augments);
+		xmlXPathFreeContext(ctxt);
+	}
+
+	if (ret != EXIT_SUCCESS) {
+		ds_routes_invalidate();
+	}
+	return (ret);
+}
+
+static int ds_route_cmp(const void *a, const void *b)
+{
+	return (((const struct ds_route*) a)->pos - ((const struct ds_route*) b)->pos);
+}
+
+static int ds_routes_collect(const xmlChar* ns, struct ds_route **found, int *count)
+{
+	struct ds_routes *routes;
+	struct ds_route *aux;
+
+	if (ns == NULL || (routes = xmlHashLookup(ds_routes_index, ns)) == NULL) {
+		return (EXIT_SUCCESS);
+	}
+
+	if ((aux = realloc(*found, (*count + routes->count) * sizeof(struct ds_route))) == NULL) {
+		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	*found = aux;
+	memcpy(&((*found)[*count]), routes->list, routes->count * sizeof(struct ds_route));
+	*count += routes->count;
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Get the list of datastores affected by the RPC according to the
+ * routing index.
+ *
+ * @param[in] rpc RPC to route.
+ * @param[in] op Operation of the RPC.
+ * @param[in] filter Filter of the \<get\> or \<get-config\> RPC.
+ * @return NULL if the RPC cannot be routed and all the datastores are supposed
+ * to be visited, NULL-terminated list (possibly empty) of the datastores list
+ * items in the order of the ncds.datastores list otherwise. Caller is
+ * supposed to free the returned array.
+ */
+static struct ncds_ds_list **ds_routes_get(const nc_rpc* rpc, NC_OP op, const struct nc_filter *filter)
+{
+	struct ds_route *found = NULL, *aux;
+	struct ncds_ds_list **retval;
+	xmlXPathObjectPtr query = NULL;
+	xmlNodePtr node;
+	char *s;
+	int count = 0, i, j, ret = EXIT_SUCCESS;
+
+	if (ds_routes_index == NULL) {
+		return (NULL);
+	}
+
+	switch (op) {
+	case NC_OP_GET:
+	case NC_OP_GETCONFIG:
+		if (filter == NULL || filter->type != NC_FILTER_SUBTREE || filter->subtree_filter == NULL) {
+			return (NULL);
+		}
+		for (node = filter->subtree_filter->children; node != NULL && ret == EXIT_SUCCESS; node = node->next) {
+			/* namespace wildcard mechanism, see rpc_get_prefilter() */
+			s = NULL;
+			if (node->ns == NULL || node->ns->href == NULL ||
+					strcmp((char *)node->ns->href, NC_NS_BASE10) == 0 ||
+					strlen(s = nc_clrwspace((char*)(node->ns->href))) == 0) {
+				free(s);
+				free(found);
+				return (NULL);
+			}
+			free(s);
+			ret = ds_routes_collect(node->ns->href, &found, &count);
+		}
+		/* internal datastore always provides (possibly empty) data reply */
+		if (ret == EXIT_SUCCESS && ds_routes_internal.item != NULL) {
+			if ((aux = realloc(found, (count + 1) * sizeof(struct ds_route))) == NULL) {
+				ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+				ret = EXIT_FAILURE;
+			} else {
+				found = aux;
+				found[count++] = ds_routes_internal;
+			}
+		}
+		break;
+	case NC_OP_EDITCONFIG:
+	case NC_OP_COPYCONFIG:
+		/* only the config data directly in the RPC can be routed */
+		if (op == NC_OP_EDITCONFIG) {
+			query = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":edit-config/"NC_NS_BASE10_ID":config/*", rpc->ctxt);
+		} else {
+			query = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":copy-config/"NC_NS_BASE10_ID":source/"NC_NS_BASE10_ID":config/*", rpc->ctxt);
+		}
+		if (query == NULL || xmlXPathNodeSetIsEmpty(query->nodesetval)) {
+			/* empty config (deleting everything), URL or datastore as the source */
+			xmlXPathFreeObject(query);
+			return (NULL);
+		}
+		for (i = 0; i < query->nodesetval->nodeNr && ret == EXIT_SUCCESS; i++) {
+			node = query->nodesetval->nodeTab[i];
+			if (node->ns != NULL) {
+				ret = ds_routes_collect(node->ns->href, &found, &count);
+			}
+		}
+		xmlXPathFreeObject(query);
+		if (count == 0) {
+			/* unknown data, let the datastores report it */
+			free(found);
+			return (NULL);
+		}
+		break;
+	case NC_OP_UNKNOWN:
+		if ((s = nc_rpc_get_op_namespace(rpc)) == NULL) {
+			return (NULL);
+		}
+		ret = ds_routes_collect(BAD_CAST s, &found, &count);
+		free(s);
+		break;
+	default:
+		return (NULL);
+	}
+
+	if (ret != EXIT_SUCCESS || (retval = malloc((count + 1) * sizeof(struct ncds_ds_list*))) == NULL) {
+		free(found);
+		return (NULL);
+	}
+
+	/* keep the order of the datastores list and remove duplicities */
+	qsort(found, count, sizeof(struct ds_route), ds_route_cmp);
+	for (i = j = 0; i < count; i++) {
+		if (j == 0 || retval[j - 1] != found[i].item) {
+			retval[j++] = found[i].item;
+		}
+	}
+	retval[j] = NULL;
+	free(found);
+
+	return (retval);
+}
+
 /*
  * type 0 - backup
  * type 1 - restore
@@ -1020,7 +1438,7 @@ API int ncds_device_init(ncds_id *id, struct nc_cpblts *cpblts, int force)
 
 			/* initial copy of startup to running will cause full (re)configuration of module */
 			/* Here is used high level function ncds_apply_rpc to apply startup configuration and use transAPI */
-			reply_msg = ncds_apply_rpc(ds_iter->datastore->id, dummy_session, rpc_msg, NULL);
+			reply_msg = ncds_apply_rpc(ds_iter->datastore->id, dummy_session, rpc_msg, NULL, NULL);
 			if (reply_msg == NULL || (reply_msg != NCDS_RPC_NOT_APPLICABLE && nc_reply_get_type (reply_msg) != NC_REPLY_OK)) {
 				ERROR("Failed perform initial copy of startup to running.");
 				nc_reply_free(reply_msg);
@@ -1646,33 +2064,41 @@ static char* compare_schemas(struct data_model* model, char* name, char* version
 		if (version == NULL || strcmp(version, model->version) == 0) {
 			/* an internal model */
 			if (strncmp(model->path, "internal", 8) == 0) {
-				switch (model->path[9]) {
-				case '0':
+				switch (atoi(model->path + 9)) {
+				case 0:
 					return strndup((char*)ietf_inet_types_yin + 39, ietf_inet_types_yin_len - 39);
-				case '1':
+				case 1:
 					return strndup((char*)ietf_yang_types_yin + 39, ietf_yang_types_yin_len - 39);
-				case '2':
+				case 2:
 					return strndup((char*)ietf_netconf_yin + 39, ietf_netconf_yin_len - 39);
-				case '3':
+				case 3:
 					return strndup((char*)ietf_netconf_monitoring_yin + 39, ietf_netconf_monitoring_yin_len - 39);
 #ifndef DISABLE_NOTIFICATIONS
-				case '4':
+				case 4:
 					return strndup((char*)ietf_netconf_notifications_yin + 39, ietf_netconf_notifications_yin_len - 39);
-				case '5':
+				case 5:
 					return strndup((char*)nc_notifications_yin + 39, nc_notifications_yin_len - 39);
-				case '6':
+				case 6:
 					return strndup((char*)notifications_yin + 39, notifications_yin_len - 39);
-				case '7':
+				case 7:
 					return strndup((char*)libnetconf_notifications_yin + 39, libnetconf_notifications_yin_len - 39);
-				case '8':
+				case 8:
 					return strndup((char*)ietf_netconf_with_defaults_yin + 39, ietf_netconf_with_defaults_yin_len - 39);
-				case '9':
+				case 9:
 					return strndup((char*)ietf_netconf_acm_yin + 39, ietf_netconf_acm_yin_len - 39);
+				case 10:
+					return strndup((char*)libnetconf_transactions_yin + 39, libnetconf_transactions_yin_len - 39);
+				case 11:
+					return strndup((char*)ietf_netconf_partial_lock_yin + 39, ietf_netconf_partial_lock_yin_len - 39);
 #else
-				case '4':
+				case 4:
 					return strndup((char*)ietf_netconf_with_defaults_yin + 39, ietf_netconf_with_defaults_yin_len - 39);
-				case '5':
+				case 5:
 					return strndup((char*)ietf_netconf_acm_yin + 39, ietf_netconf_acm_yin_len - 39);
+				case 6:
+					return strndup((char*)libnetconf_transactions_yin + 39, libnetconf_transactions_yin_len - 39);
+				case 7:
+					return strndup((char*)ietf_netconf_partial_lock_yin + 39, ietf_netconf_partial_lock_yin_len - 39);
 #endif
 				default:
 					ERROR("%s: internal (%s:%d)", __func__, __FILE__, __LINE__);
@@ -2142,6 +2568,53 @@ API struct ncds_ds* ncds_new_transapi_static(NCDS_TYPE type, const char* model_p
 	return (ds);
 }
 
+/**
+ * @brief Prepare the lock for the (lazy) resolution of the data model. The
+ * lock is recursive since resolving the model can resolve the imported models
+ * which can (in case of invalid circular import) get back to the model itself.
+ */
+static void data_model_lock_init(struct data_model* model)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&model->resolve_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+/**
+ * @brief Resolve uses statements in groupings and augments of the data model,
+ * if not already done. In the lazy mode, this is postponed from the model
+ * loading to the first use of the model's groupings or augments.
+ *
+ * @param[in] model Data model to resolve.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int data_model_resolve(struct data_model* model)
+{
+	int ret = EXIT_SUCCESS;
+
+	if (model == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&model->resolve_lock);
+	if (!model->resolved) {
+		/* set the flag before the resolution to stop the recursion */
+		model->resolved = 1;
+		if (ncds_update_uses_groupings(model) != EXIT_SUCCESS) {
+			ret = EXIT_FAILURE;
+		}
+		if (ncds_update_uses_augments(model) != EXIT_SUCCESS) {
+			ret = EXIT_FAILURE;
+		}
+	}
+	pthread_mutex_unlock(&model->resolve_lock);
+
+	return (ret);
+}
+
 static struct data_model* data_model_new(const char* model_path)
 {
 	struct data_model *model = NULL;
@@ -2198,59 +2671,202 @@ static struct data_model* data_model_new(const char* model_path)
 		return (NULL);
 	}
 	model->path = strdup(model_path);
+	data_model_lock_init(model);
 	ncds_features_parse(model);
 
 	/* resolve uses statements in groupings and augments */
-	ncds_update_uses_groupings(model);
-	ncds_update_uses_augments(model);
+	if (!lazy_consolidation) {
+		data_model_resolve(model);
+	}
 
 	return (model);
 }
 
-static int data_model_enlink(struct data_model** model)
+/**
+ * @brief Remove model's RPCs and notifications from the (namespace, name)
+ * hash indexes.
+ */
+static void models_index_ns_drop(struct data_model* model)
 {
-	struct model_list *listitem;
+	int i;
 
-	if (model == NULL || *model == NULL) {
-		ERROR("%s: invalid parameter.", __func__);
-		return (EXIT_FAILURE);
+	for (i = 0; model->rpcs != NULL && model->rpcs[i] != NULL; i++) {
+		if (xmlHashLookup2(models_op_index, BAD_CAST model->ns, BAD_CAST model->rpcs[i]) == model) {
+			xmlHashRemoveEntry2(models_op_index, BAD_CAST model->ns, BAD_CAST model->rpcs[i], NULL);
+		}
+	}
+	for (i = 0; model->notifs != NULL && model->notifs[i] != NULL; i++) {
+		if (xmlHashLookup2(models_notif_index, BAD_CAST model->ns, BAD_CAST model->notifs[i]) == model) {
+			xmlHashRemoveEntry2(models_notif_index, BAD_CAST model->ns, BAD_CAST model->notifs[i], NULL);
+		}
 	}
+	xmlHashRemoveEntry(models_ns_index, BAD_CAST model->ns, NULL);
+}
 
-	/* check duplicity */
-	for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
-		if (listitem->model &&
-			strcmp(listitem->model->name, (*model)->name) == 0 &&
-			strcmp(listitem->model->version, (*model)->version) == 0) {
-			/* module already found */
-			VERB("Module to enlink \"%s\" already exists.", (*model)->name);
-			ncds_ds_model_free(*model);
-			*model = listitem->model;
-			return (EXIT_SUCCESS);
+/**
+ * @brief Make the model the one returned by the namespace based lookups -
+ * ncds_get_model_data(), ncds_get_model_operation() and
+ * ncds_get_model_notification().
+ */
+static void models_index_ns_set(struct data_model* model)
+{
+	struct data_model* old;
+	int i;
+
+	if (model->ns == NULL) {
+		return;
+	}
+
+	if ((old = xmlHashLookup(models_ns_index, BAD_CAST model->ns)) != NULL) {
+		models_index_ns_drop(old);
+	}
+
+	xmlHashUpdateEntry(models_ns_index, BAD_CAST model->ns, model, NULL);
+	for (i = 0; model->rpcs != NULL && model->rpcs[i] != NULL; i++) {
+		xmlHashUpdateEntry2(models_op_index, BAD_CAST model->ns, BAD_CAST model->rpcs[i], model, NULL);
+	}
+	for (i = 0; model->notifs != NULL && model->notifs[i] != NULL; i++) {
+		xmlHashUpdateEntry2(models_notif_index, BAD_CAST model->ns, BAD_CAST model->notifs[i], model, NULL);
+	}
+}
+
+/**
+ * @brief Add the model into the registry hash indexes. The model is supposed
+ * to be the first item of the models_list, so it overrides any previously
+ * registered model with the same namespace, name or revision the same way as
+ * the models_list is searched.
+ */
+static int models_index_add(struct data_model* model)
+{
+	if (models_ns_index == NULL) {
+		models_ns_index = xmlHashCreate(32);
+		models_name_index = xmlHashCreate(32);
+		models_op_index = xmlHashCreate(64);
+		models_notif_index = xmlHashCreate(32);
+		if (models_ns_index == NULL || models_name_index == NULL || models_op_index == NULL || models_notif_index == NULL) {
+			ERROR("%s: creating hash table failed.", __func__);
+			models_index_free();
+			return (EXIT_FAILURE);
 		}
 	}
 
-	/* update internal model lists */
-	listitem = malloc(sizeof(struct model_list));
-	if (listitem == NULL) {
-		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
-		return (EXIT_FAILURE);
+	models_index_ns_set(model);
+	if (model->name != NULL) {
+		/* key (name, NULL) is any revision of the module */
+		xmlHashUpdateEntry2(models_name_index, BAD_CAST model->name, NULL, model, NULL);
+		if (model->version != NULL) {
+			xmlHashUpdateEntry2(models_name_index, BAD_CAST model->name, BAD_CAST model->version, model, NULL);
+		}
 	}
-	listitem->model = *model;
-	listitem->next = models_list;
-	models_list = listitem;
 
 	return (EXIT_SUCCESS);
 }
 
-static int match_module_node(char* path_module, char* module, char* name, xmlNodePtr *node)
+/**
+ * @brief Remove the model from the registry hash indexes. The model is
+ * supposed to be already removed from the models_list, so the indexes are
+ * pointed to the following matching models in the models_list, if any.
+ */
+static void models_index_remove(struct data_model* model)
 {
-	char* name_aux;
+	struct model_list* listitem;
 
-	if (path_module == NULL || module == NULL || name == NULL || node == NULL) {
-		return (0);
+	if (models_ns_index == NULL) {
+		return;
 	}
 
-	if (strcmp(module, path_module) == 0) {
+	if (model->ns != NULL && xmlHashLookup(models_ns_index, BAD_CAST model->ns) == model) {
+		models_index_ns_drop(model);
+		for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
+			if (listitem->model->ns != NULL && strcmp(listitem->model->ns, model->ns) == 0) {
+				models_index_ns_set(listitem->model);
+				break;
+			}
+		}
+	}
+
+	if (model->name == NULL) {
+		return;
+	}
+	if (xmlHashLookup2(models_name_index, BAD_CAST model->name, NULL) == model) {
+		xmlHashRemoveEntry2(models_name_index, BAD_CAST model->name, NULL, NULL);
+		for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
+			if (listitem->model->name != NULL && strcmp(listitem->model->name, model->name) == 0) {
+				xmlHashAddEntry2(models_name_index, BAD_CAST model->name, NULL, listitem->model);
+				break;
+			}
+		}
+	}
+	if (model->version != NULL && xmlHashLookup2(models_name_index, BAD_CAST model->name, BAD_CAST model->version) == model) {
+		xmlHashRemoveEntry2(models_name_index, BAD_CAST model->name, BAD_CAST model->version, NULL);
+		for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
+			if (listitem->model->name != NULL && strcmp(listitem->model->name, model->name) == 0 &&
+					listitem->model->version != NULL && strcmp(listitem->model->version, model->version) == 0) {
+				xmlHashAddEntry2(models_name_index, BAD_CAST model->name, BAD_CAST model->version, listitem->model);
+				break;
+			}
+		}
+	}
+}
+
+static void models_index_free(void)
+{
+	xmlHashFree(models_ns_index, NULL);
+	xmlHashFree(models_name_index, NULL);
+	xmlHashFree(models_op_index, NULL);
+	xmlHashFree(models_notif_index, NULL);
+	models_ns_index = NULL;
+	models_name_index = NULL;
+	models_op_index = NULL;
+	models_notif_index = NULL;
+}
+
+static int data_model_enlink(struct data_model** model)
+{
+	struct model_list *listitem;
+	struct data_model* found;
+
+	if (model == NULL || *model == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	/* check duplicity */
+	if (models_name_index != NULL && (*model)->name != NULL && (*model)->version != NULL &&
+			(found = xmlHashLookup2(models_name_index, BAD_CAST (*model)->name, BAD_CAST (*model)->version)) != NULL) {
+		/* module already found */
+		VERB("Module to enlink \"%s\" already exists.", (*model)->name);
+		ncds_ds_model_free(*model);
+		*model = found;
+		return (EXIT_SUCCESS);
+	}
+
+	/* update internal model lists */
+	listitem = malloc(sizeof(struct model_list));
+	if (listitem == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	listitem->model = *model;
+	listitem->next = models_list;
+	models_list = listitem;
+	models_index_add(*model);
+
+	/* new model can augment some datastore, routing must be rebuilt by ncds_consolidate() */
+	ds_routes_invalidate();
+
+	return (EXIT_SUCCESS);
+}
+
+static int match_module_node(char* path_module, char* module, char* name, xmlNodePtr *node)
+{
+	char* name_aux;
+
+	if (path_module == NULL || module == NULL || name == NULL || node == NULL) {
+		return (0);
+	}
+
+	if (strcmp(module, path_module) == 0) {
 		/* we have the match - move into the specified element */
 		while (*node != NULL ) {
 			if (xmlStrcmp((*node)->name, BAD_CAST "container") == 0 ||
@@ -2387,19 +3003,26 @@ static struct data_model* get_model(const char* module, const char* version)
 		return (NULL);
 	}
 
-	for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
-		if (listitem->model && strcmp(listitem->model->name, module) == 0) {
-			if (version != NULL) {
-				if (strcmp(listitem->model->version, version) == 0) {
-					/* module found */
-					return (listitem->model);
+	if (models_name_index != NULL) {
+		/* (module, NULL) key matches any revision */
+		if ((model = xmlHashLookup2(models_name_index, BAD_CAST module, BAD_CAST version)) != NULL) {
+			return (model);
+		}
+	} else {
+		for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
+			if (listitem->model && strcmp(listitem->model->name, module) == 0) {
+				if (version != NULL) {
+					if (strcmp(listitem->model->version, version) == 0) {
+						/* module found */
+						return (listitem->model);
+					} else {
+						/* module version does not match */
+						continue;
+					}
 				} else {
-					/* module version does not match */
-					continue;
+					/* module found - specific version is not required */
+					return (listitem->model);
 				}
-			} else {
-				/* module found - specific version is not required */
-				return (listitem->model);
 			}
 		}
 	}
@@ -2543,6 +3166,9 @@ static int import_groupings(const char* module_name, xmlXPathContextPtr model_ct
 			}
 			free(module);
 
+			/* the imported groupings must be already resolved */
+			data_model_resolve(model);
+
 			/* import grouping definitions */
 			if ((groupings = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_YIN_ID":module//"NC_NS_YIN_ID":grouping", model->ctxt)) != NULL ) {
 				/* add prefix into the grouping names and add imported grouping into the overall data model */
@@ -3206,11 +3832,24 @@ static int ncds_update_refine(struct ncds_ds *ds)
 
 static int ncds_update_augment_absolute(struct data_model *augment)
 {
+	xmlNodePtr node;
+
 	if (augment == NULL) {
 		ERROR("%s: invalid parameter augment.", __func__);
 		return (EXIT_FAILURE);
 	}
 
+	if (!augment->resolved) {
+		/* resolve (lazily loaded) model only if it really augments something */
+		for (node = xmlDocGetRootElement(augment->xml)->children; node != NULL; node = node->next) {
+			if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, BAD_CAST "augment") == 0 &&
+					node->ns != NULL && xmlStrcmp(node->ns->href, BAD_CAST NC_NS_YIN) == 0) {
+				data_model_resolve(augment);
+				break;
+			}
+		}
+	}
+
 	return(_update_model(1, augment->ctxt, augment->prefix, augment->name, augment->ns, augment->transapi, 0));
 }
 
@@ -3522,6 +4161,14 @@ static int ncds_features_parse(struct data_model* model)
 			}
 			/* by default, all features are disabled */
 			model->features[i]->enabled = 0;
+
+			/* index the feature for feature_get(), the first definition wins */
+			if (model->features_index == NULL) {
+				model->features_index = xmlHashCreate(features->nodesetval->nodeNr);
+			}
+			if (model->features_index != NULL) {
+				xmlHashAddEntry(model->features_index, BAD_CAST model->features[i]->name, model->features[i]);
+			}
 		}
 		model->features[i] = NULL; /* list terminating NULL byte */
 
@@ -3534,10 +4181,40 @@ static int ncds_features_parse(struct data_model* model)
 	return (EXIT_SUCCESS);
 }
 
+/**
+ * @brief Get the feature structure of the given model.
+ *
+ * @param[in] model Data model defining the feature.
+ * @param[in] name Name of the feature.
+ * @return Feature structure or NULL if the model does not define such a feature.
+ */
+static struct model_feature* feature_get(struct data_model* model, const char* name)
+{
+	struct model_feature* feature;
+	int i;
+
+	if (model->features == NULL) {
+		return (NULL);
+	}
+
+	if (model->features_index != NULL && (feature = xmlHashLookup(model->features_index, BAD_CAST name)) != NULL) {
+		return (feature);
+	}
+
+	/* not indexed */
+	for (i = 0; model->features[i] != NULL; i++) {
+		if (strcmp(model->features[i]->name, name) == 0) {
+			return (model->features[i]);
+		}
+	}
+
+	return (NULL);
+}
+
 API int ncds_feature_isenabled(const char* module, const char* feature)
 {
 	struct data_model* model;
-	int i;
+	struct model_feature* f;
 
 	if (module == NULL || feature == NULL) {
 		ERROR("%s: invalid parameter %s", __func__, (module==NULL)?"module":"feature");
@@ -3548,12 +4225,8 @@ API int ncds_feature_isenabled(const char* module, const char* feature)
 		return (-1);
 	}
 
-	if (model->features != NULL) {
-		for (i = 0; model->features[i] != NULL; i++) {
-			if (strcmp(model->features[i]->name, feature) == 0) {
-				return(model->features[i]->enabled);
-			}
-		}
+	if ((f = feature_get(model, feature)) != NULL) {
+		return (f->enabled);
 	}
 	return (-1);
 }
@@ -3561,7 +4234,7 @@ API int ncds_feature_isenabled(const char* module, const char* feature)
 static inline int _feature_switch(const char* module, const char* feature, int value)
 {
 	struct data_model* model;
-	int i;
+	struct model_feature* f;
 
 	if (module == NULL || feature == NULL) {
 		ERROR("%s: invalid parameter %s", __func__, (module==NULL)?"module":"feature");
@@ -3572,13 +4245,9 @@ static inline int _feature_switch(const char* module, const char* feature, int v
 		return (EXIT_FAILURE);
 	}
 
-	if (model->features != NULL) {
-		for (i = 0; model->features[i] != NULL; i++) {
-			if (strcmp(model->features[i]->name, feature) == 0) {
-				model->features[i]->enabled = value;
-				return (EXIT_SUCCESS);
-			}
-		}
+	if ((f = feature_get(model, feature)) != NULL) {
+		f->enabled = value;
+		return (EXIT_SUCCESS);
 	}
 
 	return (EXIT_FAILURE);
@@ -3843,111 +4512,545 @@ static void transapis_cleanup(struct transapi_list **list, int force)
 	}
 }
 
-API int ncds_consolidate(void)
+/* format version of the model cache files, change it with every format change */
+#define MODEL_CACHE_FORMAT "1"
+
+static void model_cache_hash(unsigned long long *hash, const void* data, size_t len)
+{
+	const unsigned char *p = data;
+	size_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < len; i++) {
+		*hash ^= p[i];
+		*hash *= 0x100000001b3ULL;
+	}
+	/* separate the items */
+	*hash ^= 0xff;
+	*hash *= 0x100000001b3ULL;
+}
+
+static void model_cache_hash_str(unsigned long long *hash, const char* str)
+{
+	model_cache_hash(hash, str ? str : "", str ? strlen(str) : 0);
+}
+
+/**
+ * @brief Compute the key of the model cache entry describing the current
+ * (not yet consolidated) state of the data models and datastores.
+ *
+ * @param[out] key Hexadecimal string of the key, 17 bytes are required.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int model_cache_key(char* key)
 {
-	int ret, changes;
+	unsigned long long hash = 0xcbf29ce484222325ULL;
 	struct ncds_ds_list *ds_iter;
-	struct model_list* listitem;
-	struct transapi_list *tapi_iter;
+	struct model_list *listitem;
+	xmlChar *dump;
+	int i, len;
+
+	model_cache_hash_str(&hash, MODEL_CACHE_FORMAT);
 
-	/* cleanup all datastore's properties built by previous ncds_consolidate() */
 	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
-		transapis_cleanup(&(ds_iter->datastore->transapis), 0);
+		model_cache_hash_str(&hash, ds_iter->datastore->data_model->name);
+	}
 
-		if (ds_iter->datastore->ext_model != ds_iter->datastore->data_model->xml) {
-			xmlFreeDoc(ds_iter->datastore->ext_model);
-			ds_iter->datastore->ext_model = ds_iter->datastore->data_model->xml;
+	for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
+		model_cache_hash_str(&hash, listitem->model->name);
+		model_cache_hash_str(&hash, listitem->model->version);
+		model_cache_hash_str(&hash, listitem->model->path);
+		model_cache_hash_str(&hash, listitem->model->transapi != NULL ? "transapi" : NULL);
+		for (i = 0; listitem->model->features != NULL && listitem->model->features[i] != NULL; i++) {
+			model_cache_hash_str(&hash, listitem->model->features[i]->name);
+			model_cache_hash_str(&hash, listitem->model->features[i]->enabled ? "1" : "0");
 		}
 
-		yinmodel_free(ds_iter->datastore->ext_model_tree);
-		ds_iter->datastore->ext_model_tree = NULL;
+		xmlDocDumpMemory(listitem->model->xml, &dump, &len);
+		if (dump == NULL) {
+			return (EXIT_FAILURE);
+		}
+		model_cache_hash(&hash, dump, len);
+		xmlFree(dump);
 	}
-	/* set ref_count of all transAPIs to 0 to recount it in ncds_update_augment() */
-	for (tapi_iter = augment_tapi_list; tapi_iter != NULL; tapi_iter = tapi_iter->next) {
-		tapi_iter->ref_count = 0;
+
+	snprintf(key, 17, "%016llx", hash);
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Check that the data model file was not changed since it was stored
+ * into the cache entry.
+ */
+static int model_cache_dep_check(xmlNodePtr dep)
+{
+	xmlChar *path, *mtime, *size;
+	struct stat st;
+	char buf[64];
+	int ret = EXIT_FAILURE;
+
+	path = xmlGetProp(dep, BAD_CAST "path");
+	mtime = xmlGetProp(dep, BAD_CAST "mtime");
+	size = xmlGetProp(dep, BAD_CAST "size");
+	if (path == NULL || mtime == NULL || size == NULL || stat((char*)path, &st) == -1) {
+		goto cleanup;
 	}
 
-	ncds_update_features();
+	snprintf(buf, sizeof(buf), "%ld", (long)st.st_mtime);
+	if (xmlStrcmp(mtime, BAD_CAST buf) != 0) {
+		goto cleanup;
+	}
+	snprintf(buf, sizeof(buf), "%lld", (long long)st.st_size);
+	if (xmlStrcmp(size, BAD_CAST buf) != 0) {
+		goto cleanup;
+	}
 
-	/* process uses statements in the configuration datastores */
-	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
-		if (ds_iter->datastore != NULL && ncds_update_uses_ds(ds_iter->datastore) != EXIT_SUCCESS) {
-			ERROR("Preparing configuration data models failed.");
-			return (EXIT_FAILURE);
+	/* make sure the model is loaded as it would be by the consolidation */
+	if (read_model((char*)path) != NULL) {
+		ret = EXIT_SUCCESS;
+	}
+
+cleanup:
+	xmlFree(path);
+	xmlFree(mtime);
+	xmlFree(size);
+	return (ret);
+}
+
+/**
+ * @brief Replace the consolidation of the datastores' extended data models
+ * by the cache entry content.
+ *
+ * @param[in] key Key of the cache entry.
+ * @return EXIT_SUCCESS if the cache entry was applied, EXIT_FAILURE if there
+ * is no valid cache entry (nothing is changed in such a case).
+ */
+static int model_cache_load(const char* key)
+{
+	char* path = NULL;
+	xmlDocPtr cache = NULL, *ext_models = NULL;
+	xmlNodePtr node, child, dsnode;
+	xmlChar* name;
+	struct ncds_ds_list *ds_iter;
+	struct data_model* model;
+	int i, count, ret = EXIT_FAILURE;
+
+	if (asprintf(&path, "%s/%s.xml", model_cache_dir, key) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	if (access(path, R_OK) != 0) {
+		/* no cache entry */
+		free(path);
+		return (EXIT_FAILURE);
+	}
+	cache = xmlReadFile(path, NULL, NC_XMLREAD_OPTIONS);
+	if (cache == NULL || (node = xmlDocGetRootElement(cache)) == NULL ||
+			xmlStrcmp(node->name, BAD_CAST "model-cache") != 0) {
+		WARN("Invalid data model cache entry %s.", path);
+		goto cleanup;
+	}
+
+	/* check the dependencies, there can be models loaded during the consolidation */
+	for (node = node->children; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, BAD_CAST "dependency") == 0 &&
+				model_cache_dep_check(node) != EXIT_SUCCESS) {
+			VERB("Data model cache entry %s is outdated.", path);
+			goto cleanup;
 		}
 	}
 
-	/* augment statement processing - absolute paths to modify other (datastore's extended models) data models */
-	do {
-		ret = 0;
-		changes = 0;
-		for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
-			if (listitem->model != NULL && (ret = ncds_update_augment_absolute(listitem->model)) == -1) {
-				ERROR("Augmenting configuration data models failed.");
-				return (EXIT_FAILURE);
-			}
+	/* prepare the extended models of all the datastores */
+	for (count = 0, ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next, count++);
+	if ((ext_models = calloc(count, sizeof(xmlDocPtr))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+		goto cleanup;
+	}
+	dsnode = xmlDocGetRootElement(cache)->children;
+	for (i = 0, ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next, i++) {
+		for (; dsnode != NULL && (dsnode->type != XML_ELEMENT_NODE || xmlStrcmp(dsnode->name, BAD_CAST "datastore") != 0); dsnode = dsnode->next);
+		if (dsnode == NULL) {
+			goto cleanup;
+		}
+		name = xmlGetProp(dsnode, BAD_CAST "model");
+		if (name == NULL || xmlStrcmp(name, BAD_CAST ds_iter->datastore->data_model->name) != 0) {
+			xmlFree(name);
+			goto cleanup;
+		}
+		xmlFree(name);
 
-			if (ret == 1) {
-				changes = 1;
+		for (child = dsnode->children; child != NULL; child = child->next) {
+			if (child->type == XML_ELEMENT_NODE && child->ns != NULL &&
+					xmlStrcmp(child->ns->href, BAD_CAST NC_NS_YIN) == 0) {
+				break;
 			}
 		}
-	} while (changes);
-
-	/* augment statement processing - relative paths to modify always the data model (datastore's extended model) itself */
-	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
-		if (ds_iter->datastore->ext_model != NULL && ncds_update_augment_relative(ds_iter->datastore) == -1) {
-			ERROR("Augmenting configuration data models failed.");
-			return (EXIT_FAILURE);
+		if (child == NULL || (ext_models[i] = xmlNewDoc(BAD_CAST "1.0")) == NULL) {
+			goto cleanup;
 		}
-		/* clean datastore's extended models from augment definitions */
-		ncds_update_augment_cleanup(ds_iter->datastore);
+		xmlDocSetRootElement(ext_models[i], xmlDocCopyNode(child, ext_models[i], 1));
+		dsnode = dsnode->next;
+	}
 
-		/* resolve refines */
-		ncds_update_refine(ds_iter->datastore);
+	/* apply the cache entry */
+	for (i = 0, ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next, i++) {
+		if (ds_iter->datastore->ext_model != ds_iter->datastore->data_model->xml) {
+			xmlFreeDoc(ds_iter->datastore->ext_model);
+		}
+		ds_iter->datastore->ext_model = ext_models[i];
+		ext_models[i] = NULL;
 	}
+	/* connect the transAPI modules of the augment models */
+	for (dsnode = xmlDocGetRootElement(cache)->children; dsnode != NULL; dsnode = dsnode->next) {
+		if (dsnode->type != XML_ELEMENT_NODE || xmlStrcmp(dsnode->name, BAD_CAST "datastore") != 0) {
+			continue;
+		}
+		name = xmlGetProp(dsnode, BAD_CAST "model");
+		for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+			if (xmlStrcmp(name, BAD_CAST ds_iter->datastore->data_model->name) == 0) {
+				break;
+			}
+		}
+		xmlFree(name);
 
-	/* parse models to get aux structure for TransAPI's internal purposes */
-	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
-		/* when using transapi */
-		if (ds_iter->datastore->transapis != NULL) {
-			if (ncds_update_callbacks(ds_iter->datastore) != EXIT_SUCCESS) {
-				ERROR("Preparing transAPI failed.");
-				return (EXIT_FAILURE);
+		for (child = dsnode->children; ds_iter != NULL && child != NULL; child = child->next) {
+			if (child->type != XML_ELEMENT_NODE || xmlStrcmp(child->name, BAD_CAST "transapi") != 0) {
+				continue;
+			}
+			name = xmlGetProp(child, BAD_CAST "module");
+			if ((model = get_model((char*)name, NULL)) != NULL && model->transapi != NULL) {
+				ncds_transapi_enlink(ds_iter->datastore, model->transapi);
 			}
+			xmlFree(name);
 		}
 	}
 
-	transapis_cleanup(&(augment_tapi_list), 0);
-	return (EXIT_SUCCESS);
+	VERB("Data models consolidated from the cache entry %s.", path);
+	ret = EXIT_SUCCESS;
+
+cleanup:
+	if (ext_models != NULL) {
+		for (i = 0; i < count; i++) {
+			xmlFreeDoc(ext_models[i]);
+		}
+		free(ext_models);
+	}
+	xmlFreeDoc(cache);
+	free(path);
+
+	return (ret);
 }
 
 /**
- * @brief Check if the given root element is part of the given data model.
- *
- * Currently, the checking is based only on namespace!
+ * @brief Replace the namespace in the subtree.
  *
- * @param[in] root The node to be checked.
- * @param[in] data_model The data model structure to check if the root belongs to it
- * @return 1 if root belongs to the data model namespace, 0 if not
+ * @param[in] node Root of the subtree.
+ * @param[in] old Namespace to replace.
+ * @param[in] new Namespace to use instead of the old one.
  */
-static int is_model_root(xmlNodePtr root, struct data_model *data_model)
+static void model_ns_replace(xmlNodePtr node, xmlNsPtr old, xmlNsPtr new)
 {
-	assert(root);
-	assert(data_model);
+	xmlAttrPtr attr;
+	xmlNodePtr child;
 
-	if (root->type != XML_ELEMENT_NODE) {
-		return 0;
+	if (node->ns == old) {
+		node->ns = new;
 	}
-
-	if (data_model->ns == NULL) {
-		ERROR("Invalid configuration data model '%s'- namespace is missing.", data_model->name);
-		return 0;
+	for (attr = node->properties; attr != NULL; attr = attr->next) {
+		if (attr->ns == old) {
+			attr->ns = new;
+		}
 	}
-
-	if (root->ns == NULL || xmlStrcmp(root->ns->href, BAD_CAST (data_model->ns)) != 0) {
-		return 0;
-	} else {
-		return 1;
+	for (child = node->children; child != NULL; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE) {
+			model_ns_replace(child, old, new);
+		}
+	}
+}
+
+/**
+ * @brief Remove the namespace definitions already declared by an ancestor.
+ * Copying the groupings and augments into the data model duplicates them,
+ * the models loaded from the model cache are cleaned by XML_PARSE_NSCLEAN.
+ *
+ * @param[in] node Element node with a parent element.
+ */
+static void model_ns_clean(xmlNodePtr node)
+{
+	xmlNsPtr ns, inherited, prev = NULL;
+	xmlNodePtr child;
+
+	for (ns = node->nsDef; ns != NULL; ) {
+		inherited = xmlSearchNs(node->doc, node->parent, ns->prefix);
+		if (inherited != NULL && xmlStrEqual(inherited->href, ns->href)) {
+			/* redundant definition - remove it */
+			model_ns_replace(node, ns, inherited);
+			if (prev == NULL) {
+				node->nsDef = ns->next;
+				xmlFreeNs(ns);
+				ns = node->nsDef;
+			} else {
+				prev->next = ns->next;
+				xmlFreeNs(ns);
+				ns = prev->next;
+			}
+		} else {
+			prev = ns;
+			ns = ns->next;
+		}
+	}
+
+	for (child = node->children; child != NULL; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE) {
+			model_ns_clean(child);
+		}
+	}
+}
+
+/**
+ * @brief Store the consolidated datastores' extended data models into the
+ * model cache.
+ *
+ * @param[in] key Key of the cache entry computed before the consolidation.
+ */
+static void model_cache_store(const char* key)
+{
+	char *path = NULL, *tmppath = NULL, buf[64];
+	xmlDocPtr cache;
+	xmlNodePtr root, node;
+	struct ncds_ds_list *ds_iter;
+	struct model_list *listitem;
+	struct transapi_list *tapi_iter;
+	struct stat st;
+
+	if ((cache = xmlNewDoc(BAD_CAST "1.0")) == NULL) {
+		return;
+	}
+	root = xmlNewNode(NULL, BAD_CAST "model-cache");
+	xmlDocSetRootElement(cache, root);
+	xmlNewProp(root, BAD_CAST "key", BAD_CAST key);
+
+	for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
+		if (listitem->model->path == NULL || stat(listitem->model->path, &st) == -1) {
+			continue;
+		}
+		node = xmlNewChild(root, NULL, BAD_CAST "dependency", NULL);
+		xmlNewProp(node, BAD_CAST "path", BAD_CAST listitem->model->path);
+		snprintf(buf, sizeof(buf), "%ld", (long)st.st_mtime);
+		xmlNewProp(node, BAD_CAST "mtime", BAD_CAST buf);
+		snprintf(buf, sizeof(buf), "%lld", (long long)st.st_size);
+		xmlNewProp(node, BAD_CAST "size", BAD_CAST buf);
+	}
+
+	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+		node = xmlNewChild(root, NULL, BAD_CAST "datastore", NULL);
+		xmlNewProp(node, BAD_CAST "model", BAD_CAST ds_iter->datastore->data_model->name);
+		/* transAPI modules of the augment models (base module has non-zero ref_count) */
+		for (tapi_iter = ds_iter->datastore->transapis; tapi_iter != NULL; tapi_iter = tapi_iter->next) {
+			if (tapi_iter->ref_count != 0) {
+				continue;
+			}
+			for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
+				if (listitem->model->transapi == tapi_iter->tapi) {
+					xmlNewProp(xmlNewChild(node, NULL, BAD_CAST "transapi", NULL), BAD_CAST "module", BAD_CAST listitem->model->name);
+					break;
+				}
+			}
+		}
+		xmlAddChild(node, xmlDocCopyNode(xmlDocGetRootElement(ds_iter->datastore->ext_model), cache, 1));
+	}
+
+	/* write the entry atomically */
+	if (asprintf(&path, "%s/%s.xml", model_cache_dir, key) == -1 ||
+			asprintf(&tmppath, "%s/.%s.xml.%d", model_cache_dir, key, getpid()) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+	} else if (xmlSaveFile(tmppath, cache) == -1 || rename(tmppath, path) == -1) {
+		WARN("Storing data model cache entry %s failed (%s).", path, strerror(errno));
+		unlink(tmppath);
+	}
+
+	free(path);
+	free(tmppath);
+	xmlFreeDoc(cache);
+}
+
+API int ncds_set_model_cache(const char* path)
+{
+	free(model_cache_dir);
+	model_cache_dir = NULL;
+
+	if (path == NULL) {
+		/* cache disabled */
+		return (EXIT_SUCCESS);
+	}
+
+	if (access(path, R_OK | W_OK | X_OK) != 0) {
+		ERROR("Data model cache directory \'%s\' is not accessible (%s).", path, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+
+	if ((model_cache_dir = strdup(path)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+API void ncds_set_lazy_consolidation(int enable)
+{
+	lazy_consolidation = enable ? 1 : 0;
+}
+
+API int ncds_consolidate(void)
+{
+	int ret, changes, cached = 0;
+	struct ncds_ds_list *ds_iter;
+	struct model_list* listitem;
+	struct transapi_list *tapi_iter;
+	xmlNodePtr node;
+	char cache_key[17] = "";
+
+	/* cleanup all datastore's properties built by previous ncds_consolidate() */
+	for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
+		schema_detach(listitem->model->xml);
+	}
+	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+		transapis_cleanup(&(ds_iter->datastore->transapis), 0);
+
+		schema_detach(ds_iter->datastore->ext_model);
+		if (ds_iter->datastore->ext_model != ds_iter->datastore->data_model->xml) {
+			xmlFreeDoc(ds_iter->datastore->ext_model);
+			ds_iter->datastore->ext_model = ds_iter->datastore->data_model->xml;
+		}
+
+		yinmodel_free(ds_iter->datastore->ext_model_tree);
+		ds_iter->datastore->ext_model_tree = NULL;
+	}
+	/* set ref_count of all transAPIs to 0 to recount it in ncds_update_augment() */
+	for (tapi_iter = augment_tapi_list; tapi_iter != NULL; tapi_iter = tapi_iter->next) {
+		tapi_iter->ref_count = 0;
+	}
+
+	/* try to get the consolidated extended models from the cache */
+	if (model_cache_dir != NULL && model_cache_key(cache_key) == EXIT_SUCCESS) {
+		cached = (model_cache_load(cache_key) == EXIT_SUCCESS);
+	}
+
+	ncds_update_features(!cached);
+
+	/* process uses statements in the configuration datastores */
+	for (ds_iter = ncds.datastores; !cached && ds_iter != NULL; ds_iter = ds_iter->next) {
+		if (ds_iter->datastore != NULL && ncds_update_uses_ds(ds_iter->datastore) != EXIT_SUCCESS) {
+			ERROR("Preparing configuration data models failed.");
+			return (EXIT_FAILURE);
+		}
+	}
+
+	/* augment statement processing - absolute paths to modify other (datastore's extended models) data models */
+	if (!cached) {
+		do {
+			ret = 0;
+			changes = 0;
+			for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
+				if (listitem->model != NULL && (ret = ncds_update_augment_absolute(listitem->model)) == -1) {
+					ERROR("Augmenting configuration data models failed.");
+					return (EXIT_FAILURE);
+				}
+
+				if (ret == 1) {
+					changes = 1;
+				}
+			}
+		} while (changes);
+	}
+
+	/* augment statement processing - relative paths to modify always the data model (datastore's extended model) itself */
+	for (ds_iter = ncds.datastores; !cached && ds_iter != NULL; ds_iter = ds_iter->next) {
+		if (ds_iter->datastore->ext_model != NULL && ncds_update_augment_relative(ds_iter->datastore) == -1) {
+			ERROR("Augmenting configuration data models failed.");
+			return (EXIT_FAILURE);
+		}
+		/* clean datastore's extended models from augment definitions */
+		ncds_update_augment_cleanup(ds_iter->datastore);
+
+		/* resolve refines */
+		ncds_update_refine(ds_iter->datastore);
+
+		/* make the model the same as the one loaded from the model cache */
+		if ((node = xmlDocGetRootElement(ds_iter->datastore->ext_model)) != NULL) {
+			for (node = node->children; node != NULL; node = node->next) {
+				if (node->type == XML_ELEMENT_NODE) {
+					model_ns_clean(node);
+				}
+			}
+		}
+	}
+
+	/* parse models to get aux structure for TransAPI's internal purposes */
+	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+		/* when using transapi */
+		if (ds_iter->datastore->transapis != NULL) {
+			if (ncds_update_callbacks(ds_iter->datastore) != EXIT_SUCCESS) {
+				ERROR("Preparing transAPI failed.");
+				return (EXIT_FAILURE);
+			}
+		}
+	}
+
+	transapis_cleanup(&(augment_tapi_list), 0);
+
+	if (!cached && cache_key[0] != '\0') {
+		model_cache_store(cache_key);
+	}
+
+	/* compile the final (extended) data models for mapping data nodes to their definitions */
+	for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
+		if (schema_attach(listitem->model->xml) != EXIT_SUCCESS) {
+			WARN("Compiling data model \"%s\" failed.", listitem->model->name);
+		}
+	}
+	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+		if (schema_attach(ds_iter->datastore->ext_model) != EXIT_SUCCESS) {
+			WARN("Compiling extended data model of the datastore %d failed.", ds_iter->datastore->id);
+		}
+	}
+
+	/* map namespaces of the (extended) data models to the datastores */
+	if (ds_routes_build() != EXIT_SUCCESS) {
+		WARN("Datastores routing index not available, requests will be passed to all datastores.");
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Check if the given root element is part of the given data model.
+ *
+ * Currently, the checking is based only on namespace!
+ *
+ * @param[in] root The node to be checked.
+ * @param[in] data_model The data model structure to check if the root belongs to it
+ * @return 1 if root belongs to the data model namespace, 0 if not
+ */
+static int is_model_root(xmlNodePtr root, struct data_model *data_model)
+{
+	assert(root);
+	assert(data_model);
+
+	if (root->type != XML_ELEMENT_NODE) {
+		return 0;
+	}
+
+	if (data_model->ns == NULL) {
+		ERROR("Invalid configuration data model '%s'- namespace is missing.", data_model->name);
+		return 0;
+	}
+
+	if (root->ns == NULL || xmlStrcmp(root->ns->href, BAD_CAST (data_model->ns)) != 0) {
+		return 0;
+	} else {
+		return 1;
 	}
 }
 
@@ -4058,8 +5161,61 @@ static void relaxng_error_callback(void *error, const char * msg, ...)
  * EXIT_FAILURE - validation failed
  * EXIT_RPC_NOT_APPLICABLE - RelaxNG scheme not defined
  */
+/**
+ * @brief Parse validators of the datastore postponed by ncds_new() (in the
+ * lazy mode until the first validation). It changes the datastore's
+ * validators, so it MUST be called with the datastore's write lock held
+ * (or before the datastore is published), see validators_loaded().
+ *
+ * @param[in] ds Datastore to prepare validators for.
+ */
+static void validators_load(struct ncds_ds *ds)
+{
+	xmlRelaxNGParserCtxtPtr rng_ctxt;
+
+	if (ds->validators.rng_path != NULL) {
+		rng_ctxt = xmlRelaxNGNewParserCtxt(ds->validators.rng_path);
+		if ((ds->validators.rng_schema = xmlRelaxNGParse(rng_ctxt)) == NULL) {
+			WARN("Failed to parse Relax NG schema (%s)", ds->validators.rng_path);
+		} else if ((ds->validators.rng = xmlRelaxNGNewValidCtxt(ds->validators.rng_schema)) == NULL) {
+			WARN("Failed to create validation context (%s)", ds->validators.rng_path);
+			xmlRelaxNGFree(ds->validators.rng_schema);
+			ds->validators.rng_schema = NULL;
+		} else {
+			DBG("%s: Relax NG validator set (%s)", __func__, ds->validators.rng_path);
+		}
+		xmlRelaxNGFreeParserCtxt(rng_ctxt);
+		free(ds->validators.rng_path);
+		ds->validators.rng_path = NULL;
+	}
+
+	if (ds->validators.schematron_path != NULL) {
+		if ((ds->validators.schematron = xsltParseStylesheetFile(BAD_CAST ds->validators.schematron_path)) == NULL) {
+			WARN("Failed to parse Schematron stylesheet (%s)", ds->validators.schematron_path);
+		} else {
+			DBG("%s: Schematron validator set (%s)", __func__, ds->validators.schematron_path);
+		}
+		free(ds->validators.schematron_path);
+		ds->validators.schematron_path = NULL;
+	}
+}
+
+/**
+ * @brief Check that validators_load() has nothing to do, so the validation
+ * can run under the datastore's read lock. It MUST be called with the
+ * datastore's lock held.
+ *
+ * @param[in] ds Datastore to check.
+ * @return 1 if the validators are loaded, 0 otherwise.
+ */
+static int validators_loaded(struct ncds_ds *ds)
+{
+	return (ds->validators.rng_path == NULL && ds->validators.schematron_path == NULL);
+}
+
 static int validate_ds(struct ncds_ds *ds, xmlDocPtr doc, struct nc_err **error)
 {
+	xmlRelaxNGValidCtxtPtr rng;
 	int ret = 0;
 	int retval = EXIT_RPC_NOT_APPLICABLE;
 	xmlDocPtr sch_result;
@@ -4080,12 +5236,22 @@ static int validate_ds(struct ncds_ds *ds, xmlDocPtr doc, struct nc_err **error)
 		/* RelaxNG validation */
 		DBG("RelaxNG validation on subdatastore %d", ds->id);
 
-		xmlRelaxNGSetValidErrors(ds->validators.rng,
+		/*
+		 * the validation context keeps the error information, so it cannot be
+		 * shared by the concurrent validations, only the parsed schema can
+		 */
+		if ((rng = xmlRelaxNGNewValidCtxt(ds->validators.rng_schema)) == NULL) {
+			ERROR("Failed to create validation context (datastore %d)", ds->id);
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			return (EXIT_FAILURE);
+		}
+		xmlRelaxNGSetValidErrors(rng,
 			(xmlRelaxNGValidityErrorFunc) relaxng_error_callback,
 			(xmlRelaxNGValidityWarningFunc) relaxng_error_callback,
 			error);
 
-		ret = xmlRelaxNGValidateDoc(ds->validators.rng, doc);
+		ret = xmlRelaxNGValidateDoc(rng, doc);
+		xmlRelaxNGFreeValidCtxt(rng);
 		if (ret > 0) {
 			VERB("subdatastore %d fails to validate", ds->id);
 			if (*error == NULL) {
@@ -4196,6 +5362,7 @@ static int apply_rpc_validate_(struct ncds_ds* ds, const struct nc_session* sess
 	xmlNodePtr root, node;
 	xmlNsPtr ns;
 
+	validators_load(ds);
 	if (!ds->validators.rng && !ds->validators.rng_schema && !ds->validators.schematron) {
 		/* validation not supported by this datastore */
 		return (EXIT_RPC_NOT_APPLICABLE);
@@ -4287,6 +5454,7 @@ static int apply_rpc_validate(struct ncds_ds* ds, const struct nc_session* sessi
 	char *config;
 	NC_DATASTORE source;
 
+	validators_load(ds);
 	if (!ds->validators.rng && !ds->validators.rng_schema && !ds->validators.schematron) {
 		/* validation not supported by this datastore */
 		return (EXIT_RPC_NOT_APPLICABLE);
@@ -4340,6 +5508,8 @@ API int ncds_set_validation(struct ncds_ds* ds, int enable, const char* relaxng,
 		xmlRelaxNGFreeValidCtxt(ds->validators.rng);
 		xmlRelaxNGFree(ds->validators.rng_schema);
 		xsltFreeStylesheet(ds->validators.schematron);
+		free(ds->validators.rng_path);
+		free(ds->validators.schematron_path);
 		memset(&(ds->validators), 0, sizeof(struct model_validators));
 	} else if (nc_init_flags & NC_INIT_VALIDATE) { /* && enable == 1 */
 		/* enable and reset validators */
@@ -4388,12 +5558,17 @@ API int ncds_set_validation(struct ncds_ds* ds, int enable, const char* relaxng,
 			xmlRelaxNGFreeValidCtxt(ds->validators.rng);
 			ds->validators.rng = rng;
 			rng = NULL;
+			/* drop the postponed default validator */
+			free(ds->validators.rng_path);
+			ds->validators.rng_path = NULL;
 			DBG("%s: Relax NG validator set (%s)", __func__, relaxng);
 		}
 		if (schxsl) {
 			xsltFreeStylesheet(ds->validators.schematron);
 			ds->validators.schematron = schxsl;
 			schxsl = NULL;
+			free(ds->validators.schematron_path);
+			ds->validators.schematron_path = NULL;
 			DBG("%s: Schematron validator set (%s)", __func__, schematron);
 		}
 
@@ -4435,6 +5610,18 @@ API int ncds_set_validation2(struct ncds_ds* ds, int enable, const char* relaxng
 }
 #endif
 
+API int ncds_set_concurrent_reads(struct ncds_ds* ds, int enable)
+{
+	if (ds == NULL) {
+		ERROR("%s: invalid datastore.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	ds->concurrent_reads = enable ? 1 : 0;
+
+	return (EXIT_SUCCESS);
+}
+
 static struct ncds_ds* ncds_new_internal(NCDS_TYPE type, const char * model_path)
 {
 	int ret;
@@ -4444,7 +5631,6 @@ static struct ncds_ds* ncds_new_internal(NCDS_TYPE type, const char * model_path
 
 #ifndef DISABLE_VALIDATION
 	char *path_rng = NULL, *path_sch = NULL;
-	xmlRelaxNGParserCtxtPtr rng_ctxt;
 #endif
 
 	if (model_path == NULL) {
@@ -4513,39 +5699,32 @@ static struct ncds_ds* ncds_new_internal(NCDS_TYPE type, const char * model_path
 		if (eaccess(path_rng, R_OK) == -1) {
 			WARN("Missing RelaxNG schema for validation (%s - %s).", path_rng, strerror(errno));
 		} else {
-			rng_ctxt = xmlRelaxNGNewParserCtxt(path_rng);
-			if ((ds->validators.rng_schema = xmlRelaxNGParse(rng_ctxt)) == NULL) {
-				WARN("Failed to parse Relax NG schema (%s)", path_rng);
-			} else if ((ds->validators.rng = xmlRelaxNGNewValidCtxt(ds->validators.rng_schema)) == NULL) {
-				WARN("Failed to create validation context (%s)", path_rng);
-				xmlRelaxNGFree(ds->validators.rng_schema);
-				ds->validators.rng_schema = NULL;
-			} else {
-				DBG("%s: Relax NG validator set (%s)", __func__, path_rng);
-			}
-			xmlRelaxNGFreeParserCtxt(rng_ctxt);
+			ds->validators.rng_path = path_rng;
+			path_rng = NULL;
 		}
 
 		/* prepare validation - Schematron */
 		if (eaccess(path_sch, R_OK) == -1) {
 			WARN("Missing Schematron stylesheet for validation (%s - %s).", path_sch, strerror(errno));
 		} else {
-			if ((ds->validators.schematron = xsltParseStylesheetFile(BAD_CAST path_sch)) == NULL) {
-				WARN("Failed to parse Schematron stylesheet (%s)", path_sch);
-			} else {
-				DBG("%s: Schematron validator set (%s)", __func__, path_sch);
-			}
+			ds->validators.schematron_path = path_sch;
+			path_sch = NULL;
+		}
+
+		/* in the lazy mode, validators are parsed by the first validation */
+		if (!lazy_consolidation) {
+			validators_load(ds);
 		}
 	}
 #endif /* not DISABLE_VALIDATION */
 
 	/* TransAPI structure is set to NULLs */
 
-	ret = pthread_mutex_init(&ds->lock, NULL);
+	ret = pthread_rwlock_init(&ds->lock, NULL);
 	if (ret != 0) {
 		free(ds);
 		ds = NULL;
-		ERROR("Initialization of a mutex failed (%s).", strerror(errno));
+		ERROR("Initialization of a rwlock failed (%s).", strerror(ret));
 		goto cleanup;
 	}
 
@@ -4626,8 +5805,8 @@ static void ncds_ds_model_free(struct data_model* model)
 		}
 		listprev = listitem;
 	}
+	models_index_remove(model);
 
-	free(model->path);
 	free(model->name);
 	free(model->version);
 	free(model->ns);
@@ -4645,6 +5824,7 @@ static void ncds_ds_model_free(struct data_model* model)
 		free(model->notifs);
 	}
 	if (model->xml != NULL) {
+		schema_detach(model->xml);
 		xmlFreeDoc(model->xml);
 	}
 	if (model->ctxt != NULL) {
@@ -4657,6 +5837,9 @@ static void ncds_ds_model_free(struct data_model* model)
 		}
 		free(model->features);
 	}
+	xmlHashFree(model->features_index, NULL);
+	free(model->path);
+	pthread_mutex_destroy(&model->resolve_lock);
 
 	free(model);
 }
@@ -4706,6 +5889,9 @@ API ncds_id ncds_init(struct ncds_ds* datastore)
 	ncds.datastores = item;
 	ncds.count++;
 
+	/* the datastore will be routable after the following ncds_consolidate() */
+	ds_routes_invalidate();
+
 	return datastore->id;
 }
 
@@ -4729,6 +5915,8 @@ void ncds_cleanall()
 	ncds.count = 0;
 	ncds.array_size = 0;
 
+	/* the whole registry is going to be removed, do not maintain the indexes */
+	models_index_free();
 	for (listitem = models_list; listitem != NULL; ) {
 		listnext = listitem->next;
 		ncds_ds_model_free(listitem->model);
@@ -4742,6 +5930,11 @@ void ncds_cleanall()
 	free(models_dirs);
 	models_dirs = NULL;
 
+	free(model_cache_dir);
+	model_cache_dir = NULL;
+
+	ds_routes_invalidate();
+
 	transapis_cleanup(&(augment_tapi_list), 1);
 
 #ifndef DISABLE_YANGFORMAT
@@ -4798,11 +5991,17 @@ API void ncds_free(struct ncds_ds* datastore)
 		xmlRelaxNGFreeValidCtxt(ds->validators.rng);
 		xmlRelaxNGFree(ds->validators.rng_schema);
 		xsltFreeStylesheet(ds->validators.schematron);
+		free(ds->validators.rng_path);
+		free(ds->validators.schematron_path);
 #endif
+		pthread_rwlock_destroy(&ds->lock);
+		free(ds->plocks);
+
 		/* free all implementation specific resources */
 		ds->func.free(ds);
 
 		/* free models */
+		schema_detach(ds->ext_model);
 		if (ds->data_model == NULL || (ds->data_model->xml != ds->ext_model)) {
 			xmlFreeDoc(ds->ext_model);
 		}
@@ -4852,101 +6051,30 @@ API void ncds_free2(ncds_id datastore_id)
  */
 int is_key(xmlNodePtr parent, xmlNodePtr child, keyList keys)
 {
-	xmlChar *str = NULL;
-	char *s, *token;
-	int i, match;
-	xmlNodePtr key_parent, node_parent;
-
 	assert(parent != NULL);
 	assert(child != NULL);
 
-	if (keys == NULL) {
+	if (keys == NULL || keys->nodesetval->nodeNr == 0) {
 		/* there are no keys */
 		return 0;
 	}
 
-	for (i = 0; i < keys->nodesetval->nodeNr; i++) {
-		match = 1;
-		key_parent = keys->nodesetval->nodeTab[i]->parent;
-		node_parent = parent;
-
-		while (1) {
-			if ((str = xmlGetProp(key_parent, BAD_CAST "name")) == NULL) {
-				match = 0;
-				break;
-			}
-			if (xmlStrcmp(str, node_parent->name)) {
-				xmlFree(str);
-				match = 0;
-				break;
-			}
-			xmlFree(str);
+	return (schema_is_key(schema_get(keys->nodesetval->nodeTab[0]->doc), parent, child));
+}
 
-			do {
-				key_parent = key_parent->parent;
-			} while (key_parent && ((xmlStrcmp(key_parent->name, BAD_CAST "augment") == 0)
-					|| (xmlStrcmp(key_parent->name, BAD_CAST "choice") == 0)
-					|| (xmlStrcmp(key_parent->name, BAD_CAST "case") == 0)));
-			node_parent = node_parent->parent;
+static xmlDocPtr ncxml_merge(const xmlDocPtr first, const xmlDocPtr second, const xmlDocPtr data_model)
+{
+	int ret = EXIT_FAILURE;
+	keyList keys;
+	xmlDocPtr result;
+	xmlNodePtr node;
 
-			if ((!key_parent && node_parent) || (key_parent && !node_parent)) {
-				match = 0;
-				break;
-			}
-
-			if (!xmlStrcmp(key_parent->name, BAD_CAST "module") && (node_parent->type == XML_DOCUMENT_NODE)) {
-				/* we have match */
-				break;
-			}
-		}
-
-		if (!match) {
-			continue;
-		}
-
-		/* so the node is in a key's place (list), but is it a key?
-		 * btw, now we don't want to iterate through next key specs,
-		 * so do not use continue from here
-		 */
-
-		/* get the name of the key node(s) from the 'value' attribute in key element in data model */
-		if ((str = xmlGetProp(keys->nodesetval->nodeTab[i], BAD_CAST "value")) == NULL) {
-			continue;
-		}
-
-		/* attribute have the form of space-separated list of key nodes */
-		/* compare all the key node names with the specified child */
-		for (token = s = (char*)str; token != NULL ; s = NULL) {
-			token = strtok(s, " ");
-			if (token == NULL) {
-				break;
-			}
-
-			if (xmlStrcmp(BAD_CAST token, child->name) == 0) {
-				xmlFree(str);
-				return 1;
-			}
-		}
-		xmlFree(str);
-		break;
-	}
-
-	return 0;
-}
-
-static xmlDocPtr ncxml_merge(const xmlDocPtr first, const xmlDocPtr second, const xmlDocPtr data_model)
-{
-	int ret = EXIT_FAILURE;
-	keyList keys;
-	xmlDocPtr result;
-	xmlNodePtr node;
-
-	/* return NULL if both docs are NULL, or the other doc in case on of them is NULL */
-	if (first == NULL) {
-		return (second ? xmlCopyDoc(second, 1) : NULL);
-	} else if (second == NULL) {
-		return (xmlCopyDoc(first, 1));
-	}
+	/* return NULL if both docs are NULL, or the other doc in case on of them is NULL */
+	if (first == NULL) {
+		return (second ? xmlCopyDoc(second, 1) : NULL);
+	} else if (second == NULL) {
+		return (xmlCopyDoc(first, 1));
+	}
 
 	result = xmlCopyDoc(first, 1);
 	if (result == NULL) {
@@ -5014,11 +6142,13 @@ static int attrcmp(xmlNodePtr reference, xmlNodePtr node)
  *
  * \param config        pointer to xmlNode tree to filter
  * \param filter        pointer to NETCONF filter xml tree
+ * \param schema        compiled data model to recognize the list keys, NULL if
+ *                      there is no data model
  *
  * \return              1 if config satisfies the output filter, 0 otherwise
  */
 
-static int ncxml_subtree_filter(xmlNodePtr config, xmlNodePtr filter, keyList keys)
+static int ncxml_subtree_filter(xmlNodePtr config, xmlNodePtr filter, const struct schema* schema)
 {
 	xmlNodePtr config_node;
 	xmlNodePtr filter_node;
@@ -5164,7 +6294,7 @@ filter:
 								if (nomatch) {
 									/* instance does not follow restrictions */
 									return 0;
-								} else if (is_key(config_node->parent, config_node, keys)) {
+								} else if (schema_is_key(schema, config_node->parent, config_node)) {
 									/* go to the next sibling */
 									config_node = config_node->next;
 									continue;
@@ -5186,7 +6316,7 @@ filter:
 							} else {
 								/* recursively process subtree filter */
 								if (filter_node && filter_node->children && (filter_node->children->type == XML_ELEMENT_NODE) && config_node->children && (config_node->children->type == XML_ELEMENT_NODE)) {
-									sibling_in = ncxml_subtree_filter(config_node->children, filter_node->children, keys);
+									sibling_in = ncxml_subtree_filter(config_node->children, filter_node->children, schema);
 								}
 								if (sibling_selection && sibling_in == 0) {
 									if (filter_node) {
@@ -5234,7 +6364,7 @@ filter:
 
 		if (filter_in == 1) {
 			while (config->children && filter_node && filter_node->children && !xmlIsBlankNode(filter_node->children) &&
-					((filter_in = ncxml_subtree_filter(config->children, filter_node->children, keys)) == 0)) {
+					((filter_in = ncxml_subtree_filter(config->children, filter_node->children, schema)) == 0)) {
 				filter_node = filter_node->next;
 				while (filter_node) {
 					if (!strcmp((char *)filter_node->name, (char *)config->name) &&
@@ -5258,7 +6388,7 @@ filter:
 		}
 		/* filter next sibling node */
 		if (config->next != NULL) {
-			if (ncxml_subtree_filter(config->next, filter, keys) == 0) {
+			if (ncxml_subtree_filter(config->next, filter, schema) == 0) {
 				delete = config->next;
 				xmlUnlinkNode(delete);
 				xmlFreeNode(delete);
@@ -5279,7 +6409,7 @@ int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new
 {
 	xmlDocPtr result, data_filtered[2] = {NULL, NULL};
 	xmlNodePtr filter_item, node;
-	keyList keys;
+	struct schema* schema = NULL;
 	int ret = EXIT_FAILURE;
 
 	if (new == NULL || old == NULL || filter == NULL) {
@@ -5293,8 +6423,10 @@ int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new
 			return EXIT_FAILURE;
 		}
 
-		/* get all keys from data model */
-		keys = get_keynode_list(data_model);
+		/* get the compiled data model to recognize the list keys */
+		if (data_model != NULL) {
+			schema = schema_get(data_model);
+		}
 
 		data_filtered[0] = xmlNewDoc(BAD_CAST "1.0");
 		data_filtered[1] = xmlNewDoc(BAD_CAST "1.0");
@@ -5307,7 +6439,7 @@ int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new
 			 */
 			node = filter_item->next;
 			filter_item->next = NULL;
-			ncxml_subtree_filter(data_filtered[0]->children, filter_item, keys);
+			ncxml_subtree_filter(data_filtered[0]->children, filter_item, schema);
 			/* revert change made to the filter doc */
 			filter_item->next = node;
 
@@ -5338,10 +6470,6 @@ int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new
 			}
 		}
 
-		if (keys != NULL) {
-			keyListFree(keys);
-		}
-
 		if (filter->subtree_filter->children != NULL) {
 			if(data_filtered[1] != NULL && data_filtered[1]->children != NULL) {
 				*new = xmlCopyNodeList(data_filtered[1]->children);
@@ -5434,14 +6562,37 @@ static int ncds_is_conflict(const nc_rpc * rpc, const struct nc_session * sessio
 }
 
 /**
+ * @brief Add the replace operation to the roots of the changed subtrees in the
+ * partial configuration provided by the datastore's commit().
+ */
+static void ncds_transapi_replace(xmlNodePtr node)
+{
+	xmlNsPtr ns;
+
+	for (; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		} else if (node->_private == NULL) {
+			ncds_transapi_replace(node->children);
+		} else if ((ns = xmlSearchNsByHref(node->doc, node, BAD_CAST NC_NS_BASE10)) != NULL ||
+				(ns = xmlNewNs(node, BAD_CAST NC_NS_BASE10, BAD_CAST NC_NS_BASE10_ID)) != NULL) {
+			xmlSetNsProp(node, ns, BAD_CAST "operation", BAD_CAST "replace");
+		}
+	}
+}
+
+/**
+ * \param[in] new Running configuration after the change provided by the
+ * datastore's commit(), it is freed. If NULL, the whole running configuration
+ * is read. The partial configuration can be only rolled back by the datastore's
+ * rollback(), so erropt must be NC_EDIT_ERROPT_ROLLBACK.
  * \return NULL on success, error reply with error info else
  */
-static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session* session, xmlDocPtr old, NC_EDIT_ERROPT_TYPE erropt, nc_reply *reply)
+static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session* session, xmlDocPtr old, xmlDocPtr new, NC_EDIT_ERROPT_TYPE erropt, nc_reply *reply)
 {
 	char *new_data;
-	xmlDocPtr new;
 	xmlChar *config;
-	int ret;
+	int ret, partial = (new != NULL);
 	struct nc_err *e = NULL, *e_new;
 	nc_reply *new_reply = NULL;
 	int modified;
@@ -5453,9 +6604,11 @@ static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session
 	}
 
 	/* find differences and call functions */
-	new_data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e);
-	new = read_datastore_data(ds->id, new_data);
-	free(new_data);
+	if (!partial) {
+		new_data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e);
+		new = read_datastore_data(ds->id, new_data);
+		free(new_data);
+	}
 
 	/* add default values */
 	ncdflt_default_values(new, ds->ext_model, NCWD_MODE_IMPL_TAGGED);
@@ -5511,7 +6664,18 @@ static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session
 				modified = 1;
 			}
 		}
-		if (ret || modified) {
+		if (partial && modified) {
+			/* only the changed subtrees are known, replace them */
+			DBG("Updating XML tree after TransAPI callbacks");
+			ncdflt_default_clear(new);
+			ncds_transapi_replace(new->children);
+			xmlDocDumpMemory(new, &config, NULL);
+			if (ds->func.editconfig(ds, session, NULL, NC_DATASTORE_RUNNING, (char*)config, NC_EDIT_DEFOP_MERGE, NC_EDIT_ERROPT_NOTSET, &e) == EXIT_FAILURE) {
+				ERROR("Updating XML tree after transAPI callbacks failed (%s)", e->message);
+				nc_err_free(e);
+			}
+			xmlFree(config);
+		} else if (!partial && (ret || modified)) {
 			DBG("Updating XML tree after TransAPI callbacks");
 			if (!modified) { /* ret only */
 				/* remove default nodes */
@@ -5588,6 +6752,60 @@ static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds
 	return (retval);
 }
 
+/*
+ * Serialize the top-level elements of the subtree filter relevant to the
+ * datastore (the same ones rpc_get_prefilter() checks), so they can be passed
+ * to the datastore implementation. Returns NULL on error.
+ */
+static char* rpc_get_filter_part(const struct nc_filter* filter, const struct ncds_ds* ds)
+{
+	xmlDocPtr doc;
+	xmlNodePtr filter_node, node;
+	xmlBufferPtr buf;
+	char *s, *retval;
+	int wildcard;
+
+	if ((doc = xmlNewDoc(BAD_CAST "1.0")) == NULL || (buf = xmlBufferCreate()) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		xmlFreeDoc(doc);
+		return (NULL);
+	}
+
+	for (filter_node = filter->subtree_filter->children; filter_node != NULL; filter_node = filter_node->next) {
+		if (filter_node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		if (ds->data_model && ds->data_model->ns) {
+			/* XML namespace wildcard mechanism, see rpc_get_prefilter() */
+			s = NULL;
+			wildcard = (filter_node->ns == NULL || filter_node->ns->href == NULL ||
+					strcmp((char *)filter_node->ns->href, NC_NS_BASE10) == 0 ||
+					strlen(s = nc_clrwspace((char*)(filter_node->ns->href))) == 0);
+			free(s);
+			if (!wildcard && xmlStrcmp(BAD_CAST ds->data_model->ns, filter_node->ns->href) != 0) {
+				continue;
+			}
+		}
+
+		/* copy the node to get all its namespaces declared */
+		if ((node = xmlDocCopyNode(filter_node, doc, 1)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			xmlBufferFree(buf);
+			xmlFreeDoc(doc);
+			return (NULL);
+		}
+		xmlDocSetRootElement(doc, node);
+		xmlNodeDump(buf, doc, node, 0, 0);
+	}
+
+	retval = strdup((char *)xmlBufferContent(buf));
+	xmlBufferFree(buf);
+	xmlFreeDoc(doc);
+
+	return (retval);
+}
+
 /**
  * @ingroup store
  * @brief Perform the requested RPC operation on the datastore.
@@ -5597,6 +6815,8 @@ static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds
  * @param[in] session NETCONF session (a dummy session is acceptable) where the
  * \<rpc\> came from. Capabilities checks are done according to this session.
  * @param[in] rpc NETCONF \<rpc\> message specifying requested operation.
+ * @param[in] txn Transaction the \<edit-config\> is part of, NULL if none.
+ * The validation, transAPI and storing the changes are left to the transaction.
  * @return NULL in case of a non-NC_RPC_DATASTORE_* operation type or invalid
  * parameter session or rpc, else \<rpc-reply\> with \<ok\>, \<data\> or
  * \<rpc-error\> according to the type and the result of the requested
@@ -5604,20 +6824,20 @@ static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds
  * datastore (e.g. the namespace does not match), NCDS_RPC_NOT_APPLICABLE
  * is returned.
  */
-static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, const nc_rpc* rpc, struct nc_filter* shared_filter)
+static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, const nc_rpc* rpc, struct nc_filter* shared_filter, struct ncds_txn* txn)
 {
 	struct nc_err* e = NULL;
 	struct ncds_ds* ds = NULL;
 	struct nc_filter *filter = NULL;
 	char* data = NULL, *config, *model = NULL, *data2, *op_name;
 	xmlDocPtr doc1, doc2, doc_merged = NULL;
-	int len, dsid, i;
+	int len, dsid, i, exact;
 	int ret = EXIT_FAILURE;
 	nc_reply* reply = NULL, *old_reply = NULL, *new_reply;
 	xmlBufferPtr resultbuffer;
 	xmlNodePtr aux_node, node;
 	NC_OP op;
-	xmlDocPtr old = NULL;
+	xmlDocPtr old = NULL, new = NULL;
 	char * old_data = NULL;
 	NC_DATASTORE source_ds = 0, target_ds = 0;
 	struct nacm_rpc *nacm_aux;
@@ -5658,22 +6878,59 @@ process_datastore:
 	}
 
 	op = nc_rpc_get_op(rpc);
-	/* if transapi used AND operation will affect running repository => store current running content */
 
-	i = pthread_mutex_lock(&ds->lock);
-	if (i != 0) {
-		ERROR("Failed to lock datastore (%s).", strerror(errno));
-		return (NULL);
+	if (txn != NULL) {
+		/* the transaction keeps the datastore locked until its end */
+		if ((e = txn_ds_add(txn, ds, nc_rpc_get_target(rpc))) != NULL) {
+			if (old_reply != NULL && old_reply != NCDS_RPC_NOT_APPLICABLE) {
+				nc_reply_free(old_reply);
+			}
+			return (nc_reply_error(e));
+		}
+	} else if ((e = txn_ds_check(ds)) != NULL) {
+		if (old_reply != NULL && old_reply != NCDS_RPC_NOT_APPLICABLE) {
+			nc_reply_free(old_reply);
+		}
+		return (nc_reply_error(e));
+	} else {
+		/* read-only operations can run concurrently (if enabled), the others need the datastore exclusively */
+		switch (ds->concurrent_reads ? op : NC_OP_UNKNOWN) {
+		case NC_OP_GET:
+		case NC_OP_GETCONFIG:
+		case NC_OP_GETSCHEMA:
+			i = pthread_rwlock_rdlock(&ds->lock);
+			break;
+		case NC_OP_VALIDATE:
+#ifndef DISABLE_VALIDATION
+			/* the first validation loads the validators, it needs the datastore exclusively */
+			if (nc_rpc_get_source(rpc) != NC_DATASTORE_RUNNING && (i = pthread_rwlock_rdlock(&ds->lock)) == 0) {
+				if (validators_loaded(ds)) {
+					break;
+				}
+				pthread_rwlock_unlock(&ds->lock);
+			}
+#endif
+			/* falls through */
+		default:
+			i = pthread_rwlock_wrlock(&ds->lock);
+			break;
+		}
+		if (i != 0) {
+			ERROR("Failed to lock datastore (%s).", strerror(i));
+			return (NULL);
+		}
 	}
 
-	if (ds->transapis != NULL
-		&& (op == NC_OP_COMMIT || op == NC_OP_COPYCONFIG || (op == NC_OP_EDITCONFIG && (nc_rpc_get_testopt(rpc) != NC_EDIT_TESTOPT_TEST))) &&
+	/* if transapi used AND operation will affect running repository => store current running content */
+	/* the datastore's commit() provides the changed content itself */
+	if (txn == NULL && ds->transapis != NULL
+		&& ((op == NC_OP_COMMIT && ds->func.commit == NULL) || op == NC_OP_COPYCONFIG || (op == NC_OP_EDITCONFIG && (nc_rpc_get_testopt(rpc) != NC_EDIT_TESTOPT_TEST))) &&
 		(nc_rpc_get_target(rpc) == NC_DATASTORE_RUNNING)) {
 
 		old_data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e);
 		old = read_datastore_data(ds->id, old_data);
 		if (old == NULL) {/* cannot get or parse data */
-			pthread_mutex_unlock(&ds->lock);
+			pthread_rwlock_unlock(&ds->lock);
 			if (e == NULL) { /* error not set */
 				e = nc_err_new(NC_ERR_OP_FAILED);
 				nc_err_set(e, NC_ERR_PARAM_MSG, "TransAPI: Failed to get data from RUNNING datastore.");
@@ -5690,7 +6947,12 @@ process_datastore:
 	case NC_OP_UNLOCK:
 		if (op == NC_OP_LOCK) {
 			op_name = "lock";
-			ret = ds->func.lock(ds, session, target_ds = nc_rpc_get_target(rpc), &e);
+			if ((target_ds = nc_rpc_get_target(rpc)) == NC_DATASTORE_RUNNING && (e = plock_check_lock(session)) != NULL) {
+				/* the global lock conflicts with the partial locks */
+				ret = EXIT_FAILURE;
+			} else {
+				ret = ds->func.lock(ds, session, target_ds, &e);
+			}
 		} else { /* NC_OP_UNLOCK */
 			op_name = "unlock";
 			ret = ds->func.unlock(ds, session, target_ds = nc_rpc_get_target(rpc), &e);
@@ -5852,7 +7114,20 @@ process_datastore:
 			break;
 		}
 
-		if ((data = ds->func.getconfig(ds, session, nc_rpc_get_source(rpc), &e)) == NULL) {
+		exact = 0;
+		if (filter != NULL && filter->type == NC_FILTER_SUBTREE && ds->func.getconfig_filtered != NULL) {
+			/* let the datastore select the data itself */
+			if ((config = rpc_get_filter_part(filter, ds)) == NULL) {
+				e = nc_err_new(NC_ERR_OP_FAILED);
+				break;
+			}
+			data = ds->func.getconfig_filtered(ds, session, nc_rpc_get_source(rpc), config, &exact, &e);
+			free(config);
+			config = NULL;
+		} else {
+			data = ds->func.getconfig(ds, session, nc_rpc_get_source(rpc), &e);
+		}
+		if (data == NULL) {
 			if (e == NULL) {
 				ERROR ("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
 				e = nc_err_new(NC_ERR_OP_FAILED);
@@ -5872,6 +7147,10 @@ process_datastore:
 		/* process default values */
 		if (ds && ds->data_model->xml) {
 			ncdflt_default_values(doc_merged, ds->ext_model, rpc->with_defaults);
+			if (rpc->with_defaults & (NCWD_MODE_ALL | NCWD_MODE_ALL_TAGGED | NCWD_MODE_IMPL_TAGGED)) {
+				/* default nodes were added also outside the selected subtrees */
+				exact = 0;
+			}
 		}
 
 		/* NACM */
@@ -5880,7 +7159,7 @@ process_datastore:
 		/* if filter specified, now is good time to apply it */
 		node = NULL;
 		if (doc_merged->children != NULL) {
-			if (filter != NULL) {
+			if (filter != NULL && !exact) {
 				if (ncxml_filter(doc_merged->children, filter, &node, ds->ext_model) != 0) {
 					ERROR("Filter failed.");
 					e = nc_err_new(NC_ERR_BAD_ELEM);
@@ -6028,12 +7307,19 @@ process_datastore:
 			xmlFreeDoc(doc2);
 		}
 apply_editcopyconfig:
+		/* the nodes partially locked by other sessions must stay untouched */
+		if (target_ds == NC_DATASTORE_RUNNING && (e = plock_check_change(ds, session, op, nc_rpc_get_defop(rpc), source_ds, config)) != NULL) {
+			free(config);
+			config = NULL;
+			break;
+		}
+
 		/* perform the operation */
 		if (op == NC_OP_EDITCONFIG) {
 			ret = ds->func.editconfig(ds, session, rpc, target_ds, config, nc_rpc_get_defop(rpc), nc_rpc_get_erropt(rpc), &e);
 #ifndef DISABLE_VALIDATION
-			if (ret == EXIT_SUCCESS && (nc_cpblts_enabled(session, NC_CAP_VALIDATE11_ID) || nc_cpblts_enabled(session, NC_CAP_VALIDATE10_ID))) {
-				/* process test option if set */
+			if (txn == NULL && ret == EXIT_SUCCESS && (nc_cpblts_enabled(session, NC_CAP_VALIDATE11_ID) || nc_cpblts_enabled(session, NC_CAP_VALIDATE10_ID))) {
+				/* process test option if set, the transaction validates the result when committed */
 				switch (testopt = nc_rpc_get_testopt(rpc)) {
 				case NC_EDIT_TESTOPT_TEST:
 				case NC_EDIT_TESTOPT_TESTSET:
@@ -6294,7 +7580,16 @@ apply_editcopyconfig:
 			break;
 		}
 
-		if (nc_cpblts_enabled (session, NC_CAP_CANDIDATE_ID)) {
+		if (nc_cpblts_enabled (session, NC_CAP_CANDIDATE_ID) &&
+				(e = plock_check_change(ds, session, op, NC_EDIT_DEFOP_NOTSET, NC_DATASTORE_CANDIDATE, NULL)) != NULL) {
+			ret = EXIT_FAILURE;
+		} else if (nc_cpblts_enabled (session, NC_CAP_CANDIDATE_ID) && ds->func.commit != NULL) {
+			if (txn == NULL && ds->transapis != NULL) {
+				ret = ds->func.commit(ds, session, rpc, &old, &new, &e);
+			} else {
+				ret = ds->func.commit(ds, session, rpc, NULL, NULL, &e);
+			}
+		} else if (nc_cpblts_enabled (session, NC_CAP_CANDIDATE_ID)) {
 			ret = ds->func.copyconfig (ds, session, rpc, NC_DATASTORE_RUNNING, NC_DATASTORE_CANDIDATE, NULL, &e);
 		} else {
 			e = nc_err_new (NC_ERR_OP_NOT_SUPPORTED);
@@ -6382,7 +7677,7 @@ apply_editcopyconfig:
 		break;
 	default:
 		ERROR("%s: unsupported NETCONF operation requested.", __func__);
-		pthread_mutex_unlock(&ds->lock);
+		pthread_rwlock_unlock(&ds->lock);
 		return (nc_reply_error (nc_err_new (NC_ERR_OP_NOT_SUPPORTED)));
 		break;
 	}
@@ -6418,7 +7713,7 @@ apply_editcopyconfig:
 				}
 				xmlFreeDoc(doc_merged);
 				if (!reply) {
-					return nc_reply_error(nc_err_new(NC_ERR_OP_FAILED));
+					reply = nc_reply_error(nc_err_new(NC_ERR_OP_FAILED));
 				}
 			} else {
 				reply = nc_reply_ok();
@@ -6431,7 +7726,7 @@ apply_editcopyconfig:
 	 * skip transapi if <edit-config> was performed with test-option set
 	 * to test-only value
 	 */
-	if (ds->transapis != NULL && ds->tapi_callbacks_count
+	if (txn == NULL && ds->transapis != NULL && ds->tapi_callbacks_count
 		&& (op == NC_OP_COMMIT || op == NC_OP_COPYCONFIG || (op == NC_OP_EDITCONFIG && (nc_rpc_get_testopt(rpc) != NC_EDIT_TESTOPT_TEST))) &&
 		(nc_rpc_get_target(rpc) == NC_DATASTORE_RUNNING && nc_reply_get_type(reply) == NC_REPLY_OK)) {
 
@@ -6442,15 +7737,30 @@ apply_editcopyconfig:
 			erropt = NC_EDIT_ERROPT_ROLLBACK;
 		}
 
-		if ((new_reply = ncds_apply_transapi(ds, session, old, erropt, NULL)) != NULL) {
+		new_reply = ncds_apply_transapi(ds, session, old, new, erropt, NULL);
+		new = NULL;
+		if (new_reply != NULL) {
 			nc_reply_free(reply);
 			reply = new_reply;
 		}
 	}
 	xmlFreeDoc (old);
 	old = NULL;
+	xmlFreeDoc(new);
+	new = NULL;
 
-	pthread_mutex_unlock(&ds->lock);
+	if (txn == NULL) {
+		pthread_rwlock_unlock(&ds->lock);
+
+		/* wait for storing the changes, other threads can already work with the datastore */
+		if (ds->func.flush != NULL && ds->func.flush(ds) != EXIT_SUCCESS &&
+				reply != NCDS_RPC_NOT_APPLICABLE && nc_reply_get_type(reply) == NC_REPLY_OK) {
+			nc_reply_free(reply);
+			e = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(e, NC_ERR_PARAM_MSG, "Storing the datastore changes failed.");
+			reply = nc_reply_error(e);
+		}
+	}
 
 	if (id == NCDS_INTERNAL_ID) {
 		if (old_reply == NULL) {
@@ -6506,11 +7816,21 @@ static char* serialize_cpblts(const struct nc_cpblts *capabilities)
 	return(retval);
 }
 
-API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc, ncds_id* ids[])
+static nc_reply* txn_rpc(const struct nc_session* session, const nc_rpc* rpc);
+static nc_reply* plock_lock(const struct nc_session* session, const nc_rpc* rpc);
+static nc_reply* plock_unlock(const struct nc_session* session, const nc_rpc* rpc);
+
+/**
+ * @brief Implementation of ncds_apply_rpc2all() also used for the edits of
+ * the transaction.
+ *
+ * @param[in] txn Transaction the \<edit-config\> is part of, NULL if none.
+ */
+static nc_reply* apply_rpc2all(const struct nc_session* session, const nc_rpc* rpc, ncds_id* ids[], struct ncds_txn* txn)
 {
-	struct ncds_ds_list* ds, *ds_rollback;
+	struct ncds_ds_list* ds, *ds_rollback, **routes = NULL;
 	nc_reply *old_reply = NULL, *new_reply = NULL, *reply = NULL;
-	int id_i = 0, transapi = 0;
+	int id_i = 0, transapi = 0, route_i = 0, rollback_i;
 	char *op_name, *op_namespace, *data;
 	xmlDocPtr old;
 	NC_OP op;
@@ -6535,6 +7855,19 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 		free(op_namespace);
 		return (nc_reply_error(nc_err_new (NC_ERR_OP_NOT_SUPPORTED)));
 	}
+	if (txn == NULL && strcmp(op_namespace, NC_NS_LNC_TRANSACTIONS) == 0 && strcmp(op_name, "transaction") == 0) {
+		/* libnetconf's own operation */
+		free(op_namespace);
+		free(op_name);
+		return (txn_rpc(session, rpc));
+	}
+	if (txn == NULL && strcmp(op_namespace, NC_NS_PARTIAL_LOCK) == 0) {
+		/* RFC 5717 operations are handled by the lock manager, not by the datastores */
+		reply = (strcmp(op_name, "partial-lock") == 0) ? plock_lock(session, rpc) : plock_unlock(session, rpc);
+		free(op_namespace);
+		free(op_name);
+		return (reply);
+	}
 	free(op_namespace);
 	free(op_name);
 
@@ -6563,14 +7896,20 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 		break;
 	}
 
-	for (ds = ncds.datastores; ds != NULL; ds = ds->next) {
+	/* get only the affected datastores if possible */
+	if ((routes = ds_routes_get(rpc, op, shared_filter)) != NULL && routes[0] == NULL) {
+		/* no datastore handles the request */
+		reply = NCDS_RPC_NOT_APPLICABLE;
+	}
+
+	for (ds = (routes != NULL) ? routes[0] : ncds.datastores; ds != NULL; ds = (routes != NULL) ? routes[++route_i] : ds->next) {
 		/* skip internal datastores */
 		if (ds->datastore->id > 0 && ds->datastore->id < internal_ds_count) {
 			continue;
 		}
 
 		/* apply RPC on a single datastore */
-		reply = ncds_apply_rpc(ds->datastore->id, session, rpc, shared_filter);
+		reply = ncds_apply_rpc(ds->datastore->id, session, rpc, shared_filter, txn);
 		if (ids != NULL && reply != NCDS_RPC_NOT_APPLICABLE) {
 			ncds.datastores_ids[id_i] = ds->datastore->id;
 			id_i++;
@@ -6582,6 +7921,7 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 			old_reply = reply;
 		} else if (old_reply != NCDS_RPC_NOT_APPLICABLE || reply != NCDS_RPC_NOT_APPLICABLE) {
 			if ((new_reply = nc_reply_merge(2, old_reply, reply)) == NULL) {
+				free(routes);
 				nc_filter_free(shared_filter);
 				shared_filter = NULL;
 				pthread_spin_lock(&server_cpblt_lock);
@@ -6602,13 +7942,16 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 
 		if (reply != NCDS_RPC_NOT_APPLICABLE && nc_reply_get_type(reply) == NC_REPLY_ERROR) {
 			if (req_type == NC_RPC_DATASTORE_WRITE) {
-				if (erropt == NC_EDIT_ERROPT_NOTSET || erropt == NC_EDIT_ERROPT_STOP) {
+				if (txn != NULL || erropt == NC_EDIT_ERROPT_NOTSET || erropt == NC_EDIT_ERROPT_STOP) {
+					/* the failed transaction is rolled back as a whole */
 					goto cleanup;
 				} else if (erropt == NC_EDIT_ERROPT_ROLLBACK) {
 					/* rollback previously changed datastores */
 					/* do not skip internal datastores */
 					target = nc_rpc_get_target(rpc);
-					for (ds_rollback = ncds.datastores; ds_rollback != ds; ds_rollback = ds_rollback->next) {
+					rollback_i = 0;
+					for (ds_rollback = (routes != NULL) ? routes[0] : ncds.datastores; ds_rollback != ds;
+							ds_rollback = (routes != NULL) ? routes[++rollback_i] : ds_rollback->next) {
 						if (ds_rollback->datastore->transapis != NULL && ds_rollback->datastore->tapi_callbacks_count
 								&& (op == NC_OP_COMMIT || op == NC_OP_COPYCONFIG || (op == NC_OP_EDITCONFIG && (nc_rpc_get_testopt(rpc) != NC_EDIT_TESTOPT_TEST)))
 								&& ( target == NC_DATASTORE_RUNNING)) {
@@ -6631,7 +7974,7 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 
 						/* transAPI rollback */
 						if (transapi) {
-							reply = ncds_apply_transapi(ds_rollback->datastore, session, old, erropt, reply);
+							reply = ncds_apply_transapi(ds_rollback->datastore, session, old, NULL, erropt, reply);
 							xmlFreeDoc(old);
 						}
 
@@ -6647,8 +7990,8 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 	}
 
 #ifndef DISABLE_NOTIFICATIONS
-	if (op == NC_OP_EDITCONFIG || op == NC_OP_COPYCONFIG || op == NC_OP_DELETECONFIG || op == NC_OP_COMMIT) {
-		/* log the event */
+	if (txn == NULL && (op == NC_OP_EDITCONFIG || op == NC_OP_COPYCONFIG || op == NC_OP_DELETECONFIG || op == NC_OP_COMMIT)) {
+		/* log the event, the transaction does it when committed */
 		target = nc_rpc_get_target(rpc);
 		if (nc_reply_get_type(reply) == NC_REPLY_OK && (target == NC_DATASTORE_RUNNING || target == NC_DATASTORE_STARTUP)) {
 			ncntf_event_new(-1, NCNTF_BASE_CFG_CHANGE, target, NCNTF_EVENT_BY_USER, session);
@@ -6658,6 +8001,7 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 
 cleanup:
 	/* clean up the common data for calling nc_apply_rpc() */
+	free(routes);
 	nc_filter_free(shared_filter);
 	shared_filter = NULL;
 
@@ -6669,59 +8013,1742 @@ cleanup:
 	return (reply);
 }
 
-API void ncds_break_locks(const struct nc_session* session)
+API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc, ncds_id* ids[])
 {
-	struct ncds_ds_list * ds;
-	struct nc_err * e = NULL;
-	/* maximum is 3 locks (one for every datastore type) */
-	struct nc_session * sessions[3];
-	const struct ncds_lockinfo * lockinfo;
-	int number_sessions = 0, i, j;
-	NC_DATASTORE ds_type[3] = {NC_DATASTORE_CANDIDATE, NC_DATASTORE_RUNNING, NC_DATASTORE_STARTUP};
-	struct nc_cpblts * cpblts;
+	return (apply_rpc2all(session, rpc, ids, NULL));
+}
 
-#ifndef DISABLE_NOTIFICATIONS
-	char *ds_name, *data = NULL;
-	int *flag, flag_r, flag_s, flag_c;
-#endif
+/* seconds to wait for a datastore used by another transaction */
+#define NCDS_TXN_LOCK_TIMEOUT 5
 
-	if (session == NULL) {
-		/* if session NULL, get all sessions that hold lock from first file datastore */
-		ds = ncds.datastores;
-		/* find first file datastore */
-		while (ds != NULL && ds->datastore != NULL && ds->datastore->type != NCDS_TYPE_FILE) {
-			ds = ds->next;
+/**
+ * @brief Datastore changed by a transaction.
+ */
+struct txn_ds {
+	struct ncds_ds* ds;
+	/**
+	 * content of the running, startup and candidate datastore before the
+	 * transaction, NULL if not changed by the transaction
+	 */
+	char* data[3];
+	/**
+	 * running datastore for the transAPI diff, NULL if not needed
+	 */
+	xmlDocPtr old;
+	/**
+	 * the changes of running were already passed to the transAPI modules
+	 */
+	int applied;
+	struct txn_ds* next;
+};
+
+struct ncds_txn {
+	const struct nc_session* session;
+	/**
+	 * thread running the transaction, the owner of the datastore locks
+	 */
+	pthread_t thread;
+	/**
+	 * changed datastores, the last changed first
+	 */
+	struct txn_ds* ds;
+	/**
+	 * an edit failed and the transaction was rolled back
+	 */
+	int failed;
+	struct ncds_txn* next;
+};
+
+/* unfinished transactions, to release them when their session is closed */
+static struct ncds_txn* txn_list = NULL;
+static pthread_mutex_t txn_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Check that the datastore is not held by a transaction of the calling
+ * thread, locking it again would never finish.
+ *
+ * @return NULL if the datastore can be locked, error description else.
+ */
+static struct nc_err* txn_ds_check(struct ncds_ds* ds)
+{
+	struct nc_err* e;
+
+	if (__atomic_load_n(&ds->txn_held, __ATOMIC_ACQUIRE) &&
+			pthread_equal(__atomic_load_n(&ds->txn_thread, __ATOMIC_RELAXED), pthread_self())) {
+		ERROR("Datastore %d is held by an unfinished transaction of this thread.", ds->id);
+		e = nc_err_new(NC_ERR_IN_USE);
+		nc_err_set(e, NC_ERR_PARAM_MSG, "The datastore is held by an unfinished transaction, use ncds_txn_apply() or finish the transaction.");
+		return (e);
+	}
+
+	return (NULL);
+}
+
+static int txn_target_index(NC_DATASTORE target)
+{
+	switch (target) {
+	case NC_DATASTORE_RUNNING:
+		return (0);
+	case NC_DATASTORE_STARTUP:
+		return (1);
+	case NC_DATASTORE_CANDIDATE:
+		return (2);
+	default:
+		return (-1);
+	}
+}
+
+/**
+ * @brief Lock the datastore for the transaction and remember its content
+ * before the first change of the target. Called by ncds_apply_rpc() instead
+ * of locking the datastore.
+ *
+ * @return NULL on success, error description else.
+ */
+static struct nc_err* txn_ds_add(struct ncds_txn* txn, struct ncds_ds* ds, NC_DATASTORE target)
+{
+	struct txn_ds* item;
+	struct nc_err* e = NULL;
+	struct timespec timeout;
+	int i, r;
+
+	if (ds->type == NCDS_TYPE_EMPTY) {
+		/* nothing to change */
+		return (NULL);
+	}
+	if ((i = txn_target_index(target)) == -1) {
+		e = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (e);
+	}
+
+	for (item = txn->ds; item != NULL && item->ds != ds; item = item->next);
+	if (item == NULL) {
+		if ((item = calloc(1, sizeof(struct txn_ds))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (nc_err_new(NC_ERR_OP_FAILED));
 		}
-		if (ds != NULL) {
-			/* if there is one */
-			/* get default capabilities for dummy sessions */
-			cpblts = nc_session_get_cpblts_default();
-			for (i=0; i<3; i++) {
-				if ((lockinfo = ncds_file_lockinfo (ds->datastore, ds_type[i])) != NULL) {
-					if (lockinfo->sid != NULL && strcmp (lockinfo->sid, "") != 0) {
-						/* create dummy session with session ID used to lock datastore */
-						sessions[number_sessions++] = nc_session_dummy(lockinfo->sid, "dummy", NULL, cpblts);
-					}
-				}
+
+		/* do not wait forever for a datastore held by another transaction */
+		clock_gettime(CLOCK_REALTIME, &timeout);
+		timeout.tv_sec += NCDS_TXN_LOCK_TIMEOUT;
+		if ((r = pthread_rwlock_timedwrlock(&ds->lock, &timeout)) != 0) {
+			ERROR("Failed to lock datastore (%s).", strerror(r));
+			free(item);
+			e = nc_err_new(NC_ERR_IN_USE);
+			nc_err_set(e, NC_ERR_PARAM_MSG, "The datastore is being changed by another transaction.");
+			return (e);
+		}
+		__atomic_store_n(&ds->txn_thread, txn->thread, __ATOMIC_RELAXED);
+		__atomic_store_n(&ds->txn_held, 1, __ATOMIC_RELEASE);
+		item->ds = ds;
+		item->next = txn->ds;
+		txn->ds = item;
+
+		/* store all the changes at the end of the transaction */
+		if (ds->func.defer != NULL) {
+			ds->func.defer(ds);
+		}
+	}
+
+	if (item->data[i] == NULL) {
+		/* remember the content for the rollback */
+		if ((item->data[i] = ds->func.getconfig(ds, txn->session, target, &e)) == NULL) {
+			if (e == NULL) {
+				e = nc_err_new(NC_ERR_OP_FAILED);
+			}
+			return (e);
+		}
+		if (target == NC_DATASTORE_RUNNING && ds->transapis != NULL && ds->tapi_callbacks_count) {
+			if ((item->old = read_datastore_data(ds->id, item->data[i])) == NULL) {
+				e = nc_err_new(NC_ERR_OP_FAILED);
+				nc_err_set(e, NC_ERR_PARAM_MSG, "TransAPI: Failed to get data from RUNNING datastore.");
+				return (e);
 			}
-			nc_cpblts_free(cpblts);
 		}
-	} else {
-		/* plain old single session break locks */
-		number_sessions = 1;
-		sessions[0] = (struct nc_session*)session;
 	}
 
-	/* for all prepared sessions */
-	for (i=0; i<number_sessions; i++) {
-		ds = ncds.datastores;
-#ifndef DISABLE_NOTIFICATIONS
-		flag_r = 0;
-		flag_s = 0;
-		flag_c = 0;
-#endif /* DISABLE_NOTIFICATIONS */
-		/* every datastore */
-		while (ds) {
+	return (NULL);
+}
+
+/**
+ * @brief Return the datastores changed by the transaction to their content
+ * before the transaction. The transAPI modules are informed about the reverted
+ * changes they already applied.
+ */
+static void txn_rollback(struct ncds_txn* txn)
+{
+	struct txn_ds* item;
+	struct nc_err* e = NULL;
+	nc_reply* reply;
+	xmlDocPtr cur;
+	char* data;
+	NC_DATASTORE targets[3] = {NC_DATASTORE_RUNNING, NC_DATASTORE_STARTUP, NC_DATASTORE_CANDIDATE};
+	int i;
+
+	for (item = txn->ds; item != NULL; item = item->next) {
+		cur = NULL;
+		if (item->applied) {
+			/* remember the current content for the transAPI diff */
+			data = item->ds->func.getconfig(item->ds, txn->session, NC_DATASTORE_RUNNING, &e);
+			cur = read_datastore_data(item->ds->id, data);
+			free(data);
+			nc_err_free(e);
+			e = NULL;
+		}
+
+		for (i = 0; i < 3; i++) {
+			if (item->data[i] == NULL) {
+				continue;
+			}
+			if (item->ds->func.copyconfig(item->ds, txn->session, NULL, targets[i], NC_DATASTORE_CONFIG, item->data[i], &e) == EXIT_FAILURE) {
+				ERROR("Reverting the transaction changes failed (%s).", (e != NULL && e->message != NULL) ? e->message : "unknown error");
+			}
+			nc_err_free(e);
+			e = NULL;
+		}
+
+		if (item->applied) {
+			if (cur != NULL && (reply = ncds_apply_transapi(item->ds, txn->session, cur, NULL, NC_EDIT_ERROPT_ROLLBACK, NULL)) != NULL) {
+				ERROR("Reverting the transaction changes of the device failed.");
+				nc_reply_free(reply);
+			}
+			xmlFreeDoc(cur);
+			item->applied = 0;
+		}
+	}
+}
+
+/**
+ * @brief Store the changes and unlock the datastores of the transaction.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE if storing the changes failed.
+ */
+static int txn_end(struct ncds_txn* txn)
+{
+	struct txn_ds* item;
+	int i, ret = EXIT_SUCCESS;
+
+	for (item = txn->ds; item != NULL; item = item->next) {
+		if (item->ds->func.flush != NULL && item->ds->func.flush(item->ds) != EXIT_SUCCESS) {
+			ret = EXIT_FAILURE;
+		}
+	}
+	while ((item = txn->ds) != NULL) {
+		txn->ds = item->next;
+		__atomic_store_n(&item->ds->txn_held, 0, __ATOMIC_RELEASE);
+		pthread_rwlock_unlock(&item->ds->lock);
+		for (i = 0; i < 3; i++) {
+			free(item->data[i]);
+		}
+		xmlFreeDoc(item->old);
+		free(item);
+	}
+
+	return (ret);
+}
+
+API struct ncds_txn* ncds_txn_begin(const struct nc_session* session)
+{
+	struct ncds_txn* txn;
+
+	if (session == NULL) {
+		ERROR("%s: invalid parameter session", __func__);
+		return (NULL);
+	}
+
+	if ((txn = calloc(1, sizeof(struct ncds_txn))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	txn->session = session;
+	txn->thread = pthread_self();
+
+	pthread_mutex_lock(&txn_list_lock);
+	txn->next = txn_list;
+	txn_list = txn;
+	pthread_mutex_unlock(&txn_list_lock);
+
+	return (txn);
+}
+
+static void txn_free(struct ncds_txn* txn)
+{
+	struct ncds_txn** iter;
+
+	pthread_mutex_lock(&txn_list_lock);
+	for (iter = &txn_list; *iter != NULL && *iter != txn; iter = &((*iter)->next));
+	if (*iter != NULL) {
+		*iter = txn->next;
+	}
+	pthread_mutex_unlock(&txn_list_lock);
+
+	free(txn);
+}
+
+/**
+ * @brief Roll back the unfinished transactions of the closed session and
+ * release their datastores. The transactions stay failed until they are freed
+ * by ncds_txn_commit() or ncds_txn_abort(). The datastore locks can be released
+ * only by the thread running the transaction.
+ *
+ * @param[in] session Closed session, NULL for all the sessions.
+ */
+static void txn_release(const struct nc_session* session)
+{
+	struct ncds_txn* txn;
+
+	pthread_mutex_lock(&txn_list_lock);
+	for (txn = txn_list; txn != NULL; txn = txn->next) {
+		if (txn->failed || (session != NULL && txn->session != session)) {
+			continue;
+		}
+		if (!pthread_equal(txn->thread, pthread_self())) {
+			ERROR("%s: transaction of the closed session is run by another thread, its datastores stay locked.", __func__);
+			continue;
+		}
+		WARN("Rolling back the unfinished transaction of the closed session.");
+		txn_rollback(txn);
+		txn_end(txn);
+		txn->failed = 1;
+	}
+	pthread_mutex_unlock(&txn_list_lock);
+}
+
+API nc_reply* ncds_txn_apply(struct ncds_txn* txn, const nc_rpc* rpc)
+{
+	nc_reply* reply;
+	struct nc_err* e;
+
+	if (txn == NULL || rpc == NULL) {
+		ERROR("%s: invalid parameter %s", __func__, (txn==NULL)?"txn":"rpc");
+		return (NULL);
+	}
+
+	if (txn->failed) {
+		e = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(e, NC_ERR_PARAM_MSG, "The transaction was already rolled back.");
+		return (nc_reply_error(e));
+	}
+	if (nc_rpc_get_op(rpc) != NC_OP_EDITCONFIG) {
+		e = nc_err_new(NC_ERR_OP_NOT_SUPPORTED);
+		nc_err_set(e, NC_ERR_PARAM_MSG, "Only the <edit-config> operation can be applied in a transaction.");
+		return (nc_reply_error(e));
+	}
+
+	reply = apply_rpc2all(txn->session, rpc, NULL, txn);
+	if (reply == NULL || (reply != NCDS_RPC_NOT_APPLICABLE && nc_reply_get_type(reply) == NC_REPLY_ERROR)) {
+		/* keep the transaction atomic */
+		txn_rollback(txn);
+		txn_end(txn);
+		txn->failed = 1;
+	}
+
+	return (reply);
+}
+
+API nc_reply* ncds_txn_commit(struct ncds_txn* txn)
+{
+	struct txn_ds* item;
+	struct nc_err* e = NULL;
+	nc_reply* reply = NULL;
+#ifndef DISABLE_VALIDATION
+	NC_DATASTORE targets[3] = {NC_DATASTORE_RUNNING, NC_DATASTORE_STARTUP, NC_DATASTORE_CANDIDATE};
+	int i;
+#endif
+#ifndef DISABLE_NOTIFICATIONS
+	int changed[3] = {0, 0, 0};
+#endif
+
+	if (txn == NULL) {
+		ERROR("%s: invalid parameter txn", __func__);
+		return (NULL);
+	}
+
+	if (txn->failed) {
+		e = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(e, NC_ERR_PARAM_MSG, "The transaction was already rolled back.");
+		txn_free(txn);
+		return (nc_reply_error(e));
+	}
+
+#ifndef DISABLE_VALIDATION
+	/* validate the result of all the edits */
+	if (nc_cpblts_enabled(txn->session, NC_CAP_VALIDATE11_ID) || nc_cpblts_enabled(txn->session, NC_CAP_VALIDATE10_ID)) {
+		for (item = txn->ds; item != NULL && reply == NULL; item = item->next) {
+			for (i = 0; i < 3; i++) {
+				if (item->data[i] != NULL && apply_rpc_validate_(item->ds, txn->session, targets[i], NULL, &e) == EXIT_FAILURE) {
+					reply = nc_reply_error((e != NULL) ? e : nc_err_new(NC_ERR_OP_FAILED));
+					e = NULL;
+					break;
+				}
+			}
+		}
+	}
+#endif
+
+	/* pass the changes of running to the device at once */
+	for (item = txn->ds; item != NULL && reply == NULL; item = item->next) {
+		if (item->old != NULL) {
+			reply = ncds_apply_transapi(item->ds, txn->session, item->old, NULL, NC_EDIT_ERROPT_ROLLBACK, NULL);
+			/* failed transAPI already reverted its own changes */
+			item->applied = (reply == NULL);
+		}
+	}
+
+	if (reply != NULL) {
+		txn_rollback(txn);
+		txn_end(txn);
+		txn_free(txn);
+		return (reply);
+	}
+
+#ifndef DISABLE_NOTIFICATIONS
+	for (item = txn->ds; item != NULL; item = item->next) {
+		changed[0] |= (item->data[0] != NULL);
+		changed[1] |= (item->data[1] != NULL);
+		changed[2] |= (item->data[2] != NULL);
+	}
+#endif
+
+	if (txn_end(txn) != EXIT_SUCCESS) {
+		e = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(e, NC_ERR_PARAM_MSG, "Storing the datastore changes failed.");
+		reply = nc_reply_error(e);
+	} else {
+		reply = nc_reply_ok();
+	}
+
+#ifndef DISABLE_NOTIFICATIONS
+	/* log the events */
+	if (changed[0]) {
+		ncntf_event_new(-1, NCNTF_BASE_CFG_CHANGE, NC_DATASTORE_RUNNING, NCNTF_EVENT_BY_USER, txn->session);
+	}
+	if (changed[1]) {
+		ncntf_event_new(-1, NCNTF_BASE_CFG_CHANGE, NC_DATASTORE_STARTUP, NCNTF_EVENT_BY_USER, txn->session);
+	}
+#endif
+
+	txn_free(txn);
+	return (reply);
+}
+
+API void ncds_txn_abort(struct ncds_txn* txn)
+{
+	if (txn == NULL) {
+		return;
+	}
+
+	txn_rollback(txn);
+	txn_end(txn);
+	txn_free(txn);
+}
+
+/**
+ * @brief Build \<edit-config\> request from the \<edit\> item of the
+ * \<transaction\> operation.
+ */
+static nc_rpc* txn_rpc_edit(const struct nc_session* session, xmlNodePtr edit, struct nc_err** e)
+{
+	xmlDocPtr doc;
+	xmlNodePtr root, op, node, target = NULL, defop = NULL, config = NULL;
+	xmlNsPtr ns;
+	xmlChar* value;
+	nc_rpc* rpc;
+
+	for (node = edit->children; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (xmlStrcmp(node->name, BAD_CAST "target") == 0) {
+			target = node;
+		} else if (xmlStrcmp(node->name, BAD_CAST "default-operation") == 0) {
+			defop = node;
+		} else if (xmlStrcmp(node->name, BAD_CAST "config") == 0) {
+			config = node;
+		} else {
+			*e = nc_err_new(NC_ERR_UNKNOWN_ELEM);
+			nc_err_set(*e, NC_ERR_PARAM_INFO_BADELEM, (char*)node->name);
+			return (NULL);
+		}
+	}
+	if (target == NULL || config == NULL) {
+		*e = nc_err_new(NC_ERR_MISSING_ELEM);
+		nc_err_set(*e, NC_ERR_PARAM_INFO_BADELEM, (target == NULL) ? "target" : "config");
+		return (NULL);
+	}
+	value = xmlNodeGetContent(target);
+	if (value == NULL || (xmlStrcmp(value, BAD_CAST "running") && xmlStrcmp(value, BAD_CAST "startup") && xmlStrcmp(value, BAD_CAST "candidate"))) {
+		xmlFree(value);
+		*e = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*e, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (NULL);
+	}
+
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	root = xmlNewNode(NULL, BAD_CAST "rpc");
+	xmlDocSetRootElement(doc, root);
+	ns = xmlNewNs(root, BAD_CAST NC_NS_BASE10, NULL);
+	xmlSetNs(root, ns);
+	xmlNewProp(root, BAD_CAST "message-id", BAD_CAST "transaction");
+	op = xmlNewChild(root, ns, BAD_CAST "edit-config", NULL);
+
+	xmlNewChild(xmlNewChild(op, ns, BAD_CAST "target", NULL), ns, value, NULL);
+	xmlFree(value);
+	if (defop != NULL) {
+		value = xmlNodeGetContent(defop);
+		xmlNewChild(op, ns, BAD_CAST "default-operation", value);
+		xmlFree(value);
+	}
+	node = xmlNewChild(op, ns, BAD_CAST "config", NULL);
+	xmlAddChildList(node, xmlDocCopyNodeList(doc, config->children));
+
+	/* the document is consumed by the rpc */
+	if ((rpc = ncxml_rpc_build(doc, session)) == NULL) {
+		*e = nc_err_new(NC_ERR_INVALID_VALUE);
+		nc_err_set(*e, NC_ERR_PARAM_MSG, "Invalid <edit> item of the transaction.");
+	}
+
+	return (rpc);
+}
+
+/**
+ * @brief Process the \<transaction\> operation of the libnetconf-transactions
+ * module.
+ */
+static nc_reply* txn_rpc(const struct nc_session* session, const nc_rpc* rpc)
+{
+	struct ncds_txn* txn;
+	xmlNodePtr content, op_node, edit;
+	struct nc_err* e = NULL;
+	nc_rpc* edit_rpc;
+	nc_reply* reply = NULL;
+
+	if ((txn = ncds_txn_begin(session)) == NULL) {
+		return (nc_reply_error(nc_err_new(NC_ERR_OP_FAILED)));
+	}
+
+	content = ncxml_rpc_get_op_content(rpc);
+	for (op_node = content; op_node != NULL && op_node->type != XML_ELEMENT_NODE; op_node = op_node->next);
+	for (edit = (op_node != NULL) ? op_node->children : NULL; edit != NULL && reply == NULL; edit = edit->next) {
+		if (edit->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (xmlStrcmp(edit->name, BAD_CAST "edit") != 0) {
+			e = nc_err_new(NC_ERR_UNKNOWN_ELEM);
+			nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, (char*)edit->name);
+			reply = nc_reply_error(e);
+			break;
+		}
+
+		if ((edit_rpc = txn_rpc_edit(session, edit, &e)) == NULL) {
+			reply = nc_reply_error(e);
+			break;
+		}
+		reply = ncds_txn_apply(txn, edit_rpc);
+		nc_rpc_free(edit_rpc);
+		if (reply == NCDS_RPC_NOT_APPLICABLE) {
+			reply = NULL;
+		} else if (reply != NULL && nc_reply_get_type(reply) != NC_REPLY_ERROR) {
+			nc_reply_free(reply);
+			reply = NULL;
+		} else if (reply == NULL) {
+			reply = nc_reply_error(nc_err_new(NC_ERR_OP_FAILED));
+		}
+	}
+	xmlFreeNodeList(content);
+
+	if (reply != NULL) {
+		ncds_txn_abort(txn);
+	} else {
+		reply = ncds_txn_commit(txn);
+	}
+
+	return (reply);
+}
+
+/*
+ * Partial locks of the running datastore (RFC 5717). The locks are kept in
+ * the shared state of the datastore next to its global lock when the
+ * datastore implementation provides it (func.get_plocks), so all the
+ * processes working with the datastore respect them. Otherwise, they are kept
+ * only in the memory of the process.
+ */
+
+/**
+ * @brief Single node locked by the partial lock.
+ */
+struct plock_node {
+	ncds_id ds;
+	/**
+	 * @brief Path of the node used to find overlapping locks and changes,
+	 * "/{namespace}name[{namespace}key='value']..."
+	 */
+	char* path;
+	/**
+	 * @brief instance-identifier of the node, the nN prefixes refer to the
+	 * lock's namespaces.
+	 */
+	char* iid;
+};
+
+struct plock {
+	uint32_t id;
+	char* session_id;
+	/**
+	 * @brief NULL terminated list of namespaces used in the instance-identifiers,
+	 * item i is bound to the prefix n(i+1).
+	 */
+	char** ns;
+	struct plock_node* nodes;
+	int count;
+	struct plock* next;
+};
+
+/**
+ * @brief Arguments of the callbacks changing the partial locks of a datastore.
+ */
+struct plock_update {
+	/**
+	 * @brief Datastore being changed.
+	 */
+	struct ncds_ds* ds;
+	/**
+	 * @brief Lock being granted.
+	 */
+	struct plock* lock;
+	/**
+	 * @brief ID of the lock being released, 0 for all the locks of the session.
+	 */
+	uint32_t id;
+	/**
+	 * @brief Session whose locks are released, NULL for all the sessions.
+	 */
+	const char* session_id;
+	/**
+	 * @brief Error preventing the change.
+	 */
+	struct nc_err* e;
+	/**
+	 * @brief Set if some lock was released.
+	 */
+	int found;
+};
+
+/* lock IDs when the shared information is not available and the locks kept by the process */
+static uint32_t plock_last_id = 0;
+static pthread_mutex_t plock_mut = PTHREAD_MUTEX_INITIALIZER;
+
+static void plock_free(struct plock* lock)
+{
+	struct plock* next;
+	int i;
+
+	for (; lock != NULL; lock = next) {
+		next = lock->next;
+		for (i = 0; i < lock->count; i++) {
+			free(lock->nodes[i].path);
+			free(lock->nodes[i].iid);
+		}
+		free(lock->nodes);
+		for (i = 0; lock->ns != NULL && lock->ns[i] != NULL; i++) {
+			free(lock->ns[i]);
+		}
+		free(lock->ns);
+		free(lock->session_id);
+		free(lock);
+	}
+}
+
+/**
+ * @brief Check whether the datastore can hold partial locks.
+ */
+static int plock_ds_lockable(const struct ncds_ds* ds)
+{
+	return (!(ds->id > 0 && ds->id < internal_ds_count) && ds->type != NCDS_TYPE_EMPTY);
+}
+
+/**
+ * @brief Serialize the partial locks of a datastore.
+ *
+ * @param[in] locks List of the locks.
+ * @param[in] id Datastore whose nodes are stored, the other nodes are skipped.
+ * @return Serialized locks, empty string if there are none, NULL on error.
+ */
+static char* plock_dump(const struct plock* locks, ncds_id id)
+{
+	xmlDocPtr doc;
+	xmlNodePtr root, lnode, node;
+	xmlBufferPtr buf;
+	char num[16], *data;
+	int i, j;
+
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	xmlDocSetRootElement(doc, root = xmlNewNode(NULL, BAD_CAST "partial-locks"));
+	for (; locks != NULL; locks = locks->next) {
+		lnode = NULL;
+		for (i = 0; i < locks->count; i++) {
+			if (locks->nodes[i].ds != id) {
+				continue;
+			}
+			if (lnode == NULL) {
+				lnode = xmlNewChild(root, NULL, BAD_CAST "partial-lock", NULL);
+				snprintf(num, sizeof(num), "%u", locks->id);
+				xmlNewProp(lnode, BAD_CAST "id", BAD_CAST num);
+				xmlNewProp(lnode, BAD_CAST "session", BAD_CAST locks->session_id);
+				for (j = 0; locks->ns != NULL && locks->ns[j] != NULL; j++) {
+					xmlNewTextChild(lnode, NULL, BAD_CAST "ns", BAD_CAST locks->ns[j]);
+				}
+			}
+			node = xmlNewChild(lnode, NULL, BAD_CAST "node", NULL);
+			xmlNewProp(node, BAD_CAST "path", BAD_CAST locks->nodes[i].path);
+			xmlNewProp(node, BAD_CAST "iid", BAD_CAST locks->nodes[i].iid);
+		}
+	}
+
+	if (root->children == NULL) {
+		xmlFreeDoc(doc);
+		return (strdup(""));
+	}
+	buf = xmlBufferCreate();
+	xmlNodeDump(buf, doc, root, 0, 0);
+	data = strdup((char*) xmlBufferContent(buf));
+	xmlBufferFree(buf);
+	xmlFreeDoc(doc);
+
+	return (data);
+}
+
+/**
+ * @brief Parse the serialized partial locks of a datastore.
+ *
+ * @param[in] data Serialized locks, NULL if there are none.
+ * @param[in] id Datastore the locks belong to.
+ * @param[out] locks List of the locks.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int plock_parse(const char* data, ncds_id id, struct plock** locks)
+{
+	struct plock* lock, **last = locks;
+	xmlDocPtr doc;
+	xmlNodePtr lnode, node;
+	xmlChar* value;
+	int ns_count;
+
+	*locks = NULL;
+	if (data == NULL || strisempty(data)) {
+		return (EXIT_SUCCESS);
+	}
+	if ((doc = xmlReadMemory(data, strlen(data), NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
+		ERROR("%s: invalid partial locks of the datastore %d.", __func__, id);
+		return (EXIT_FAILURE);
+	}
+
+	for (lnode = xmlDocGetRootElement(doc)->children; lnode != NULL; lnode = lnode->next) {
+		if (lnode->type != XML_ELEMENT_NODE || !xmlStrEqual(lnode->name, BAD_CAST "partial-lock")) {
+			continue;
+		}
+		if ((lock = calloc(1, sizeof(struct plock))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			xmlFreeDoc(doc);
+			plock_free(*locks);
+			*locks = NULL;
+			return (EXIT_FAILURE);
+		}
+		*last = lock;
+		last = &lock->next;
+
+		value = xmlGetProp(lnode, BAD_CAST "id");
+		lock->id = (value != NULL) ? strtoul((char*) value, NULL, 10) : 0;
+		xmlFree(value);
+		lock->session_id = (char*) xmlGetProp(lnode, BAD_CAST "session");
+
+		ns_count = 0;
+		lock->ns = calloc(1, sizeof(char*));
+		for (node = lnode->children; node != NULL; node = node->next) {
+			if (node->type != XML_ELEMENT_NODE) {
+				continue;
+			}
+			if (xmlStrEqual(node->name, BAD_CAST "ns")) {
+				lock->ns = realloc(lock->ns, (ns_count + 2) * sizeof(char*));
+				lock->ns[ns_count++] = (char*) xmlNodeGetContent(node);
+				lock->ns[ns_count] = NULL;
+			} else if (xmlStrEqual(node->name, BAD_CAST "node")) {
+				lock->nodes = realloc(lock->nodes, (lock->count + 1) * sizeof(struct plock_node));
+				lock->nodes[lock->count].ds = id;
+				lock->nodes[lock->count].path = (char*) xmlGetProp(node, BAD_CAST "path");
+				lock->nodes[lock->count].iid = (char*) xmlGetProp(node, BAD_CAST "iid");
+				lock->count++;
+			}
+		}
+	}
+	xmlFreeDoc(doc);
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Get the partial locks of the running datastore.
+ *
+ * @param[in] ds Datastore whose locks are read.
+ * @param[out] locks List of the locks.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int plock_get(struct ncds_ds* ds, struct plock** locks)
+{
+	char* data = NULL;
+	int ret;
+
+	*locks = NULL;
+	if (ds->func.get_plocks != NULL) {
+		if (ds->func.get_plocks(ds, &data) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+		ret = plock_parse(data, ds->id, locks);
+		free(data);
+	} else {
+		pthread_mutex_lock(&plock_mut);
+		ret = plock_parse(ds->plocks, ds->id, locks);
+		pthread_mutex_unlock(&plock_mut);
+	}
+
+	return (ret);
+}
+
+/**
+ * @brief Change the partial locks of the running datastore atomically.
+ *
+ * @param[in] ds Datastore whose locks are changed.
+ * @param[in] update Callback returning the new serialized locks, NULL to keep the current ones.
+ * @param[in] arg Argument of the callback.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int plock_update(struct ncds_ds* ds, char* (*update)(const char* locks, void* arg), void* arg)
+{
+	char* data;
+
+	if (ds->func.update_plocks != NULL) {
+		return (ds->func.update_plocks(ds, update, arg));
+	}
+
+	pthread_mutex_lock(&plock_mut);
+	if ((data = update(ds->plocks, arg)) != NULL) {
+		free(ds->plocks);
+		ds->plocks = data;
+	}
+	pthread_mutex_unlock(&plock_mut);
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Update callback removing the released locks.
+ */
+static char* plock_update_release(const char* data, void* arg)
+{
+	struct plock_update* u = (struct plock_update*) arg;
+	struct plock *locks, *lock, **prev;
+	char* retval = NULL;
+	int found = 0;
+
+	if (plock_parse(data, u->ds->id, &locks) != EXIT_SUCCESS) {
+		return (NULL);
+	}
+	for (prev = &locks; (lock = *prev) != NULL;) {
+		if ((u->id == 0 || lock->id == u->id) && (u->session_id == NULL || strcmp(lock->session_id, u->session_id) == 0)) {
+			*prev = lock->next;
+			lock->next = NULL;
+			plock_free(lock);
+			found = 1;
+		} else {
+			prev = &lock->next;
+		}
+	}
+	if (found) {
+		u->found = 1;
+		retval = plock_dump(locks, u->ds->id);
+	}
+	plock_free(locks);
+
+	return (retval);
+}
+
+/**
+ * @brief Release the partial locks held by the session.
+ *
+ * @param[in] session_id ID of the session, NULL to release all the locks.
+ */
+static void plock_release(const char* session_id)
+{
+	struct ncds_ds_list* item;
+	struct plock_update u;
+
+	for (item = ncds.datastores; item != NULL; item = item->next) {
+		if (!plock_ds_lockable(item->datastore)) {
+			continue;
+		}
+		memset(&u, 0, sizeof(u));
+		u.ds = item->datastore;
+		u.session_id = session_id;
+		plock_update(item->datastore, plock_update_release, &u);
+	}
+}
+
+/**
+ * @brief Append the quoted value of the XPath predicate.
+ */
+static void plock_path_value(xmlBufferPtr path, xmlBufferPtr iid, const xmlChar* value)
+{
+	const char* quote = (xmlStrchr(value, '\'') == NULL) ? "'" : "\"";
+
+	xmlBufferCCat(path, quote);
+	xmlBufferCat(path, value);
+	xmlBufferCCat(path, quote);
+	if (iid != NULL) {
+		xmlBufferCCat(iid, quote);
+		xmlBufferCat(iid, value);
+		xmlBufferCCat(iid, quote);
+	}
+}
+
+/**
+ * @brief Append the namespace qualified name of the node.
+ */
+static void plock_path_name(xmlBufferPtr path, xmlBufferPtr iid, char*** ns, xmlNodePtr node)
+{
+	const char* href = (node->ns != NULL) ? (const char*)node->ns->href : "";
+	char prefix[16];
+	int i;
+
+	xmlBufferCCat(path, "{");
+	xmlBufferCCat(path, href);
+	xmlBufferCCat(path, "}");
+	xmlBufferCat(path, node->name);
+
+	if (iid != NULL) {
+		for (i = 0; (*ns) != NULL && (*ns)[i] != NULL && strcmp((*ns)[i], href) != 0; i++);
+		if ((*ns) == NULL || (*ns)[i] == NULL) {
+			*ns = realloc(*ns, (i + 2) * sizeof(char*));
+			(*ns)[i] = strdup(href);
+			(*ns)[i + 1] = NULL;
+		}
+		snprintf(prefix, sizeof(prefix), "n%d:", i + 1);
+		xmlBufferCCat(iid, prefix);
+		xmlBufferCat(iid, node->name);
+	}
+}
+
+/**
+ * @brief Build the path of the configuration data node.
+ *
+ * The list instances are identified by their keys and the leaf-list
+ * instances by their values. Without the compiled schema, the path identifies
+ * all the instances of the list.
+ *
+ * @param[in] schema Compiled schema of the node's data model, NULL if not available.
+ * @param[in] node Configuration data element.
+ * @param[out] path Buffer for the path used to compare the locked nodes.
+ * @param[out] iid Buffer for the instance-identifier, NULL if not needed.
+ * @param[in,out] ns Namespaces of the instance-identifier's prefixes.
+ */
+static void plock_path(const struct schema* schema, xmlNodePtr node, xmlBufferPtr path, xmlBufferPtr iid, char*** ns)
+{
+	struct schema_node* snode;
+	xmlNodePtr key;
+	xmlChar* value;
+	int i;
+
+	if (node->parent != NULL && node->parent->type == XML_ELEMENT_NODE) {
+		plock_path(schema, node->parent, path, iid, ns);
+	}
+
+	xmlBufferCCat(path, "/");
+	if (iid != NULL) {
+		xmlBufferCCat(iid, "/");
+	}
+	plock_path_name(path, iid, ns, node);
+
+	if (schema == NULL || (snode = schema_find(schema, node)) == NULL) {
+		return;
+	}
+	if (snode->type == SCHEMA_LIST) {
+		for (i = 0; i < snode->keys_count; i++) {
+			for (key = node->children; key != NULL; key = key->next) {
+				if (key->type == XML_ELEMENT_NODE && xmlStrEqual(key->name, snode->keys[i])) {
+					break;
+				}
+			}
+			if (key == NULL) {
+				continue;
+			}
+			xmlBufferCCat(path, "[");
+			if (iid != NULL) {
+				xmlBufferCCat(iid, "[");
+			}
+			plock_path_name(path, iid, ns, key);
+			xmlBufferCCat(path, "=");
+			if (iid != NULL) {
+				xmlBufferCCat(iid, "=");
+			}
+			value = xmlNodeGetContent(key);
+			plock_path_value(path, iid, value);
+			xmlFree(value);
+			xmlBufferCCat(path, "]");
+			if (iid != NULL) {
+				xmlBufferCCat(iid, "]");
+			}
+		}
+	} else if (snode->type == SCHEMA_LEAFLIST) {
+		xmlBufferCCat(path, "[.=");
+		if (iid != NULL) {
+			xmlBufferCCat(iid, "[.=");
+		}
+		value = xmlNodeGetContent(node);
+		plock_path_value(path, iid, value);
+		xmlFree(value);
+		xmlBufferCCat(path, "]");
+		if (iid != NULL) {
+			xmlBufferCCat(iid, "]");
+		}
+	}
+}
+
+/**
+ * @brief Check whether one of the paths identifies a node inside the subtree
+ * identified by the other path (or the same node).
+ */
+static int plock_path_overlap(const char* a, const char* b)
+{
+	size_t len;
+
+	if (strlen(a) > strlen(b)) {
+		return (plock_path_overlap(b, a));
+	}
+	len = strlen(a);
+	return (strncmp(a, b, len) == 0 && (b[len] == '\0' || b[len] == '/' || b[len] == '['));
+}
+
+/**
+ * @brief Find the node locked by another session overlapping with the path.
+ *
+ * @param[in] locks Partial locks of the datastore.
+ * @param[in] session_id Session whose locks are not taken into account.
+ * @param[in] id Datastore of the path.
+ * @param[in] path Path of the node, NULL to match any node in the datastore.
+ * @return The lock with the overlapping node, NULL if there is none.
+ */
+static struct plock* plock_find(struct plock* locks, const char* session_id, ncds_id id, const char* path)
+{
+	struct plock* lock;
+	int i;
+
+	for (lock = locks; lock != NULL; lock = lock->next) {
+		if (strcmp(lock->session_id, session_id) == 0) {
+			continue;
+		}
+		for (i = 0; i < lock->count; i++) {
+			if (lock->nodes[i].ds == id && (path == NULL || plock_path_overlap(lock->nodes[i].path, path))) {
+				return (lock);
+			}
+		}
+	}
+	return (NULL);
+}
+
+static struct nc_err* plock_err_in_use(const struct plock* lock)
+{
+	struct nc_err* e;
+
+	e = nc_err_new(NC_ERR_IN_USE);
+	nc_err_set(e, NC_ERR_PARAM_INFO_SID, lock->session_id);
+	nc_err_set(e, NC_ERR_PARAM_MSG, "The requested change affects nodes partially locked by another session.");
+	return (e);
+}
+
+static struct nc_err* plock_err_read(void)
+{
+	struct nc_err* e;
+
+	e = nc_err_new(NC_ERR_OP_FAILED);
+	nc_err_set(e, NC_ERR_PARAM_MSG, "Reading the partial locks of the datastore failed.");
+	return (e);
+}
+
+/**
+ * @brief Check the global lock of the running datastore against the partial
+ * locks of other sessions in any of the datastores.
+ */
+static struct nc_err* plock_check_lock(const struct nc_session* session)
+{
+	struct ncds_ds_list* item;
+	struct nc_err* e = NULL;
+	struct plock* locks, *lock;
+
+	for (item = ncds.datastores; item != NULL && e == NULL; item = item->next) {
+		if (!plock_ds_lockable(item->datastore)) {
+			continue;
+		}
+		if (plock_get(item->datastore, &locks) != EXIT_SUCCESS) {
+			return (plock_err_read());
+		}
+		for (lock = locks; lock != NULL && strcmp(lock->session_id, session->session_id) == 0; lock = lock->next);
+		if (lock != NULL) {
+			e = nc_err_new(NC_ERR_LOCK_DENIED);
+			nc_err_set(e, NC_ERR_PARAM_INFO_SID, lock->session_id);
+			nc_err_set(e, NC_ERR_PARAM_MSG, "Parts of the running datastore are partially locked by another session.");
+		}
+		plock_free(locks);
+	}
+
+	return (e);
+}
+
+static int plock_tree_equal(xmlNodePtr a, xmlNodePtr b)
+{
+	if (a == NULL || b == NULL) {
+		return (a == b);
+	}
+	if (a->type != b->type || !xmlStrEqual(a->name, b->name)) {
+		return (0);
+	}
+	if (a->type == XML_ELEMENT_NODE) {
+		if (!xmlStrEqual((a->ns != NULL) ? a->ns->href : NULL, (b->ns != NULL) ? b->ns->href : NULL)) {
+			return (0);
+		}
+	} else if (!xmlStrEqual(a->content, b->content)) {
+		return (0);
+	}
+
+	for (a = a->children, b = b->children; a != NULL && b != NULL; a = a->next, b = b->next) {
+		if (!plock_tree_equal(a, b)) {
+			return (0);
+		}
+	}
+	return (a == NULL && b == NULL);
+}
+
+/**
+ * @brief Get the node identified by the locked node's instance-identifier.
+ */
+static xmlNodePtr plock_node_get(const struct plock* lock, const struct plock_node* node, xmlDocPtr doc)
+{
+	xmlXPathContextPtr ctxt;
+	xmlXPathObjectPtr result;
+	xmlNodePtr retval = NULL;
+	char prefix[16];
+	int i;
+
+	if (doc == NULL || (ctxt = xmlXPathNewContext(doc)) == NULL) {
+		return (NULL);
+	}
+	for (i = 0; lock->ns[i] != NULL; i++) {
+		snprintf(prefix, sizeof(prefix), "n%d", i + 1);
+		xmlXPathRegisterNs(ctxt, BAD_CAST prefix, BAD_CAST lock->ns[i]);
+	}
+	result = xmlXPathEvalExpression(BAD_CAST node->iid, ctxt);
+	if (result != NULL && !xmlXPathNodeSetIsEmpty(result->nodesetval)) {
+		retval = result->nodesetval->nodeTab[0];
+	}
+	xmlXPathFreeObject(result);
+	xmlXPathFreeContext(ctxt);
+
+	return (retval);
+}
+
+/**
+ * @brief Check that the new content of the running datastore keeps the nodes
+ * partially locked by other sessions unchanged.
+ */
+static struct nc_err* plock_check_content(struct ncds_ds* ds, const struct nc_session* session, struct plock* locks, xmlDocPtr new)
+{
+	struct nc_err* e = NULL;
+	struct plock* lock;
+	xmlDocPtr running;
+	char* data;
+	int i;
+
+	if ((data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e)) == NULL) {
+		return ((e != NULL) ? e : nc_err_new(NC_ERR_OP_FAILED));
+	}
+	running = read_datastore_data(ds->id, data);
+	free(data);
+
+	for (lock = locks; lock != NULL && e == NULL; lock = lock->next) {
+		if (strcmp(lock->session_id, session->session_id) == 0) {
+			continue;
+		}
+		for (i = 0; i < lock->count; i++) {
+			if (lock->nodes[i].ds == ds->id &&
+					!plock_tree_equal(plock_node_get(lock, &lock->nodes[i], new), plock_node_get(lock, &lock->nodes[i], running))) {
+				e = plock_err_in_use(lock);
+				break;
+			}
+		}
+	}
+	xmlFreeDoc(running);
+
+	return (e);
+}
+
+/**
+ * @brief Find the nodes changed by the \<edit-config\> content that are
+ * partially locked by another session.
+ *
+ * @param[in] locks Partial locks of the datastore.
+ * @param[in] schema Compiled schema of the datastore, NULL if not available.
+ * @param[in] id Datastore being edited.
+ * @param[in] node First node of the edit content on the level.
+ * @param[in] psnode Schema node of the parent, NULL on the top level.
+ * @param[in] defop Operation inherited from the parent node.
+ */
+static struct plock* plock_edit_find(struct plock* locks, const struct nc_session* session, const struct schema* schema, ncds_id id,
+		xmlNodePtr node, const struct schema_node* psnode, NC_EDIT_DEFOP_TYPE defop)
+{
+	struct schema_node* snode;
+	struct plock* lock = NULL;
+	xmlNodePtr child, target;
+	xmlBufferPtr path;
+	xmlChar* operation;
+	NC_EDIT_DEFOP_TYPE op;
+	int i, changed;
+
+	for (; node != NULL && lock == NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (psnode != NULL && psnode->type == SCHEMA_LIST) {
+			/* keys only identify the list instance */
+			for (i = 0; i < psnode->keys_count && !xmlStrEqual(node->name, psnode->keys[i]); i++);
+			if (i < psnode->keys_count) {
+				continue;
+			}
+		}
+		snode = (schema != NULL) ? schema_find(schema, node) : NULL;
+
+		op = defop;
+		changed = 0;
+		if ((operation = xmlGetNsProp(node, BAD_CAST "operation", BAD_CAST NC_NS_BASE10)) != NULL) {
+			if (xmlStrEqual(operation, BAD_CAST "merge")) {
+				op = NC_EDIT_DEFOP_MERGE;
+			} else {
+				/* replace, create, delete, remove */
+				changed = 1;
+			}
+			xmlFree(operation);
+		}
+		if (!changed && op == NC_EDIT_DEFOP_MERGE) {
+			/* merged leaves change the node, containers only their content */
+			for (child = node->children; child != NULL && child->type != XML_ELEMENT_NODE; child = child->next);
+			if (snode != NULL) {
+				changed = (snode->type != SCHEMA_CONTAINER && snode->type != SCHEMA_LIST) || child == NULL;
+			} else {
+				changed = (child == NULL);
+			}
+		}
+
+		if (!changed) {
+			lock = plock_edit_find(locks, session, schema, id, node->children, snode, op);
+			continue;
+		}
+
+		/* moving the ordered-by user instance changes the order of its siblings */
+		target = node;
+		if (snode != NULL && (snode->flags & SCHEMA_ORDERED_USER) && node->parent != NULL && node->parent->type == XML_ELEMENT_NODE) {
+			target = node->parent;
+		}
+		path = xmlBufferCreate();
+		plock_path(schema, target, path, NULL, NULL);
+		lock = plock_find(locks, session->session_id, id, (const char*)xmlBufferContent(path));
+		xmlBufferFree(path);
+	}
+
+	return (lock);
+}
+
+/**
+ * @brief Check the change of the running datastore against the partial locks
+ * of other sessions.
+ *
+ * @param[in] ds Datastore being changed.
+ * @param[in] session Session changing the datastore.
+ * @param[in] op Operation changing the running datastore.
+ * @param[in] defop Default operation of the \<edit-config\>.
+ * @param[in] source Source datastore of \<copy-config\> or \<commit\>.
+ * @param[in] config Configuration data of \<edit-config\> or \<copy-config\>, NULL if the source is a datastore.
+ * @return Error to return, NULL if the change is allowed.
+ */
+static struct nc_err* plock_check_change(struct ncds_ds* ds, const struct nc_session* session, NC_OP op, NC_EDIT_DEFOP_TYPE defop,
+		NC_DATASTORE source, const char* config)
+{
+	struct nc_err* e = NULL;
+	struct plock* locks, *lock;
+	xmlDocPtr doc;
+	char* data = NULL;
+
+	if (plock_get(ds, &locks) != EXIT_SUCCESS) {
+		return (plock_err_read());
+	}
+	if (plock_find(locks, session->session_id, ds->id, NULL) == NULL) {
+		/* no node of the datastore is locked by another session */
+		plock_free(locks);
+		return (NULL);
+	}
+
+	if (config == NULL) {
+		if ((config = data = ds->func.getconfig(ds, session, source, &e)) == NULL) {
+			plock_free(locks);
+			return ((e != NULL) ? e : nc_err_new(NC_ERR_OP_FAILED));
+		}
+	}
+	doc = read_datastore_data(ds->id, config);
+	free(data);
+	if (doc == NULL) {
+		plock_free(locks);
+		e = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(e, NC_ERR_PARAM_MSG, "Invalid configuration data.");
+		return (e);
+	}
+
+	if (op == NC_OP_EDITCONFIG && defop != NC_EDIT_DEFOP_REPLACE) {
+		if ((lock = plock_edit_find(locks, session, schema_get(ds->ext_model), ds->id, doc->children, NULL,
+				(defop == NC_EDIT_DEFOP_NONE) ? NC_EDIT_DEFOP_NONE : NC_EDIT_DEFOP_MERGE)) != NULL) {
+			e = plock_err_in_use(lock);
+		}
+	} else {
+		/* the content is replaced */
+		e = plock_check_content(ds, session, locks, doc);
+	}
+	xmlFreeDoc(doc);
+	plock_free(locks);
+
+	return (e);
+}
+
+/**
+ * @brief Add the selected nodes left in the data after the access control
+ * pruning to the lock.
+ *
+ * @param[in] ds Datastore of the data.
+ * @param[in,out] lock Lock to extend.
+ * @param[in] node Subtree of the data.
+ * @param[in] mark Mark of the selected nodes (their _private pointer).
+ * @return Number of the selected nodes found in the subtree.
+ */
+static int plock_select_add(struct ncds_ds* ds, struct plock* lock, xmlNodePtr node, const void* mark)
+{
+	xmlNodePtr child;
+	xmlBufferPtr path, iid;
+	int j, count = 0;
+
+	if (node->_private == mark) {
+		count++;
+		path = xmlBufferCreate();
+		iid = xmlBufferCreate();
+		plock_path(schema_get(ds->ext_model), node, path, iid, &lock->ns);
+		for (j = 0; j < lock->count && (lock->nodes[j].ds != ds->id || strcmp(lock->nodes[j].path, (char*)xmlBufferContent(path)) != 0); j++);
+		if (j == lock->count) {
+			lock->nodes = realloc(lock->nodes, (lock->count + 1) * sizeof(struct plock_node));
+			lock->nodes[lock->count].ds = ds->id;
+			lock->nodes[lock->count].path = strdup((char*)xmlBufferContent(path));
+			lock->nodes[lock->count].iid = strdup((char*)xmlBufferContent(iid));
+			lock->count++;
+		}
+		xmlBufferFree(path);
+		xmlBufferFree(iid);
+	}
+	for (child = node->children; child != NULL; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE) {
+			count += plock_select_add(ds, lock, child, mark);
+		}
+	}
+
+	return (count);
+}
+
+/**
+ * @brief Add the nodes selected by the XPath expression in the running
+ * datastores to the lock. All the selected nodes must be readable by the
+ * session (RFC 5717), otherwise the access is denied.
+ */
+static struct nc_err* plock_select(const struct nc_session* session, const struct nacm_rpc* nacm, struct plock* lock, xmlNodePtr select)
+{
+	struct ncds_ds_list* item;
+	struct ncds_ds* ds;
+	const struct ncds_lockinfo* lockinfo;
+	struct nc_err* e = NULL;
+	xmlXPathContextPtr ctxt;
+	xmlXPathObjectPtr result;
+	xmlNsPtr* nslist;
+	xmlNodePtr node;
+	xmlDocPtr doc;
+	xmlChar* expr;
+	char* data;
+	int i, selected, readable;
+
+	expr = xmlNodeGetContent(select);
+	nslist = xmlGetNsList(select->doc, select);
+
+	for (item = ncds.datastores; item != NULL && e == NULL; item = item->next) {
+		ds = item->datastore;
+		if (!plock_ds_lockable(ds)) {
+			continue;
+		}
+		if ((e = txn_ds_check(ds)) != NULL) {
+			break;
+		}
+
+		if (ds->concurrent_reads) {
+			pthread_rwlock_rdlock(&ds->lock);
+		} else {
+			pthread_rwlock_wrlock(&ds->lock);
+		}
+		lockinfo = ds->func.get_lockinfo(ds, NC_DATASTORE_RUNNING);
+		if (lockinfo != NULL && lockinfo->sid != NULL && strcmp(lockinfo->sid, "") != 0 && strcmp(lockinfo->sid, session->session_id) != 0) {
+			e = nc_err_new(NC_ERR_LOCK_DENIED);
+			nc_err_set(e, NC_ERR_PARAM_INFO_SID, lockinfo->sid);
+			pthread_rwlock_unlock(&ds->lock);
+			break;
+		}
+		data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e);
+		pthread_rwlock_unlock(&ds->lock);
+		if (data == NULL) {
+			if (e == NULL) {
+				e = nc_err_new(NC_ERR_OP_FAILED);
+			}
+			break;
+		}
+		doc = read_datastore_data(ds->id, data);
+		free(data);
+		if (doc == NULL || doc->children == NULL) {
+			xmlFreeDoc(doc);
+			continue;
+		}
+
+		ctxt = xmlXPathNewContext(doc);
+		for (i = 0; nslist != NULL && nslist[i] != NULL; i++) {
+			if (nslist[i]->prefix != NULL) {
+				xmlXPathRegisterNs(ctxt, nslist[i]->prefix, nslist[i]->href);
+			}
+		}
+		selected = 0;
+		if ((result = xmlXPathEvalExpression(expr, ctxt)) == NULL || result->type != XPATH_NODESET) {
+			e = nc_err_new(NC_ERR_INVALID_VALUE);
+			nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, "select");
+			nc_err_set(e, NC_ERR_PARAM_MSG, "The select expression is not a valid XPath expression selecting a node set.");
+		}
+		for (i = 0; e == NULL && result->nodesetval != NULL && i < result->nodesetval->nodeNr; i++) {
+			if (result->nodesetval->nodeTab[i]->type != XML_ELEMENT_NODE) {
+				e = nc_err_new(NC_ERR_INVALID_VALUE);
+				nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, "select");
+				nc_err_set(e, NC_ERR_PARAM_MSG, "The select expression selects other than configuration data nodes.");
+				break;
+			}
+			/* mark the node, the node set is not valid after the pruning */
+			result->nodesetval->nodeTab[i]->_private = lock;
+			selected++;
+		}
+		xmlXPathFreeObject(result);
+		xmlXPathFreeContext(ctxt);
+
+		if (e == NULL && selected > 0) {
+			/* drop the data the session is not allowed to read */
+			nacm_check_data_read(doc, nacm);
+			for (readable = 0, node = doc->children; node != NULL; node = node->next) {
+				if (node->type == XML_ELEMENT_NODE) {
+					readable += plock_select_add(ds, lock, node, lock);
+				}
+			}
+			if (readable != selected) {
+				e = nc_err_new(NC_ERR_ACCESS_DENIED);
+				nc_err_set(e, NC_ERR_PARAM_MSG, "Some of the selected nodes are not accessible.");
+			}
+		}
+		xmlFreeDoc(doc);
+	}
+
+	xmlFree(nslist);
+	xmlFree(expr);
+	return (e);
+}
+
+/**
+ * @brief Update callback adding the granted lock, unless its nodes overlap
+ * with the nodes locked by another session.
+ */
+static char* plock_update_grant(const char* data, void* arg)
+{
+	struct plock_update* u = (struct plock_update*) arg;
+	struct plock *locks, *other = NULL;
+	char* retval;
+	int i;
+
+	if (plock_parse(data, u->ds->id, &locks) != EXIT_SUCCESS) {
+		u->e = plock_err_read();
+		return (NULL);
+	}
+
+	for (i = 0; i < u->lock->count && other == NULL; i++) {
+		if (u->lock->nodes[i].ds == u->ds->id) {
+			other = plock_find(locks, u->lock->session_id, u->ds->id, u->lock->nodes[i].path);
+		}
+	}
+	if (other != NULL) {
+		u->e = nc_err_new(NC_ERR_LOCK_DENIED);
+		nc_err_set(u->e, NC_ERR_PARAM_INFO_SID, other->session_id);
+		nc_err_set(u->e, NC_ERR_PARAM_MSG, "Some of the selected nodes are already partially locked by another session.");
+		plock_free(locks);
+		return (NULL);
+	}
+
+	/* the granted lock is added to the stored ones only for the dump */
+	u->lock->next = locks;
+	retval = plock_dump(u->lock, u->ds->id);
+	u->lock->next = NULL;
+	plock_free(locks);
+
+	return (retval);
+}
+
+/**
+ * @brief Process the \<partial-lock\> operation of the
+ * ietf-netconf-partial-lock module.
+ */
+static nc_reply* plock_lock(const struct nc_session* session, const nc_rpc* rpc)
+{
+	struct ncds_ds_list* item, *granted;
+	struct plock* lock;
+	struct plock_update u;
+	struct nc_err* e = NULL;
+	xmlNodePtr op_node, select;
+	xmlChar* iid;
+	char *data = NULL, *aux;
+	nc_reply* reply;
+	int i, j;
+
+	if ((lock = calloc(1, sizeof(struct plock))) == NULL) {
+		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+		return (nc_reply_error(nc_err_new(NC_ERR_OP_FAILED)));
+	}
+
+	for (op_node = xmlDocGetRootElement(rpc->doc)->children; op_node != NULL && op_node->type != XML_ELEMENT_NODE; op_node = op_node->next);
+	for (select = (op_node != NULL) ? op_node->children : NULL; select != NULL && e == NULL; select = select->next) {
+		if (select->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (xmlStrcmp(select->name, BAD_CAST "select") != 0) {
+			e = nc_err_new(NC_ERR_UNKNOWN_ELEM);
+			nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, (char*)select->name);
+			break;
+		}
+		e = plock_select(session, rpc->nacm, lock, select);
+	}
+	if (e == NULL && lock->count == 0) {
+		e = nc_err_new(NC_ERR_INVALID_VALUE);
+		nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, "select");
+		nc_err_set(e, NC_ERR_PARAM_MSG, "The select expressions do not select any node of the running datastore.");
+	}
+	if (e != NULL) {
+		plock_free(lock);
+		return (nc_reply_error(e));
+	}
+
+	/* lock IDs are unique among all the processes sharing the datastores */
+	if (nc_info != NULL) {
+		pthread_rwlock_wrlock(&(nc_info->lock));
+		if ((lock->id = ++nc_info->last_plock_id) == 0) {
+			lock->id = ++nc_info->last_plock_id;
+		}
+		pthread_rwlock_unlock(&(nc_info->lock));
+	} else {
+		pthread_mutex_lock(&plock_mut);
+		lock->id = ++plock_last_id;
+		pthread_mutex_unlock(&plock_mut);
+	}
+	lock->session_id = strdup(session->session_id);
+
+	/* grant the lock in all the datastores with the selected nodes */
+	memset(&u, 0, sizeof(u));
+	u.lock = lock;
+	for (granted = ncds.datastores; granted != NULL && u.e == NULL; granted = granted->next) {
+		for (i = 0; i < lock->count && lock->nodes[i].ds != granted->datastore->id; i++);
+		if (i == lock->count) {
+			continue;
+		}
+		u.ds = granted->datastore;
+		if (plock_update(granted->datastore, plock_update_grant, &u) != EXIT_SUCCESS && u.e == NULL) {
+			u.e = plock_err_read();
+		}
+	}
+	if (u.e != NULL) {
+		/* release the lock in the datastores where it was already granted */
+		e = u.e;
+		memset(&u, 0, sizeof(u));
+		u.id = lock->id;
+		u.session_id = lock->session_id;
+		for (item = ncds.datastores; item != NULL && item != granted; item = item->next) {
+			u.ds = item->datastore;
+			for (i = 0; i < lock->count && lock->nodes[i].ds != item->datastore->id; i++);
+			if (i < lock->count) {
+				plock_update(item->datastore, plock_update_release, &u);
+			}
+		}
+		plock_free(lock);
+		return (nc_reply_error(e));
+	}
+
+	if (asprintf(&data, "<lock-id xmlns=\"%s\">%u</lock-id>", NC_NS_PARTIAL_LOCK, lock->id) == -1) {
+		data = NULL;
+	}
+	for (i = 0; data != NULL && i < lock->count; i++) {
+		aux = data;
+		if (asprintf(&data, "%s<locked-node xmlns=\"%s\"", aux, NC_NS_PARTIAL_LOCK) == -1) {
+			data = NULL;
+		}
+		free(aux);
+		for (j = 0; data != NULL && lock->ns[j] != NULL; j++) {
+			aux = data;
+			if (asprintf(&data, "%s xmlns:n%d=\"%s\"", aux, j + 1, lock->ns[j]) == -1) {
+				data = NULL;
+			}
+			free(aux);
+		}
+		aux = data;
+		iid = xmlEncodeSpecialChars(NULL, BAD_CAST lock->nodes[i].iid);
+		if (data != NULL && asprintf(&data, "%s>%s</locked-node>", aux, (char*)iid) == -1) {
+			data = NULL;
+		}
+		xmlFree(iid);
+		free(aux);
+	}
+	VERB("Session %s partially locked %d node(s) with lock-id %u.", session->session_id, lock->count, lock->id);
+	plock_free(lock);
+	if (data == NULL) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (nc_reply_error(nc_err_new(NC_ERR_OP_FAILED)));
+	}
+
+	reply = nc_reply_custom(data);
+	free(data);
+	return (reply);
+}
+
+/**
+ * @brief Process the \<partial-unlock\> operation of the
+ * ietf-netconf-partial-lock module.
+ */
+static nc_reply* plock_unlock(const struct nc_session* session, const nc_rpc* rpc)
+{
+	struct ncds_ds_list* item;
+	struct plock_update u;
+	struct nc_err* e;
+	xmlNodePtr op_node, node;
+	xmlChar* value;
+	char* end;
+	unsigned long id;
+
+	for (op_node = xmlDocGetRootElement(rpc->doc)->children; op_node != NULL && op_node->type != XML_ELEMENT_NODE; op_node = op_node->next);
+	for (node = (op_node != NULL) ? op_node->children : NULL; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, BAD_CAST "lock-id") == 0) {
+			break;
+		}
+	}
+	if (node == NULL) {
+		e = nc_err_new(NC_ERR_MISSING_ELEM);
+		nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, "lock-id");
+		return (nc_reply_error(e));
+	}
+	value = xmlNodeGetContent(node);
+	errno = 0;
+	id = strtoul((char*)value, &end, 10);
+	if (errno != 0 || end == (char*)value || *end != '\0' || id == 0 || id > UINT32_MAX) {
+		xmlFree(value);
+		e = nc_err_new(NC_ERR_INVALID_VALUE);
+		nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, "lock-id");
+		return (nc_reply_error(e));
+	}
+	xmlFree(value);
+
+	memset(&u, 0, sizeof(u));
+	u.id = id;
+	u.session_id = session->session_id;
+	for (item = ncds.datastores; item != NULL; item = item->next) {
+		if (!plock_ds_lockable(item->datastore)) {
+			continue;
+		}
+		u.ds = item->datastore;
+		if (plock_update(item->datastore, plock_update_release, &u) != EXIT_SUCCESS) {
+			return (nc_reply_error(plock_err_read()));
+		}
+	}
+	if (!u.found) {
+		e = nc_err_new(NC_ERR_INVALID_VALUE);
+		nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, "lock-id");
+		nc_err_set(e, NC_ERR_PARAM_MSG, "The session does not hold a partial lock with the given lock-id.");
+		return (nc_reply_error(e));
+	}
+
+	return (nc_reply_ok());
+}
+
+API void ncds_break_locks(const struct nc_session* session)
+{
+	struct ncds_ds_list * ds;
+	struct nc_err * e = NULL;
+	/* maximum is 3 locks (one for every datastore type) */
+	struct nc_session * sessions[3];
+	const struct ncds_lockinfo * lockinfo;
+	int number_sessions = 0, i, j;
+	NC_DATASTORE ds_type[3] = {NC_DATASTORE_CANDIDATE, NC_DATASTORE_RUNNING, NC_DATASTORE_STARTUP};
+	struct nc_cpblts * cpblts;
+
+#ifndef DISABLE_NOTIFICATIONS
+	char *ds_name, *data = NULL;
+	int *flag, flag_r, flag_s, flag_c;
+#endif
+
+	/* unfinished transactions keep the datastores locked */
+	txn_release(session);
+
+	/* partial locks, all of them if the locks of all sessions are broken */
+	plock_release((session != NULL) ? session->session_id : NULL);
+
+	if (session == NULL) {
+		/* if session NULL, get all sessions that hold lock from first file datastore */
+		ds = ncds.datastores;
+		/* find first file datastore */
+		while (ds != NULL && ds->datastore != NULL && ds->datastore->type != NCDS_TYPE_FILE) {
+			ds = ds->next;
+		}
+		if (ds != NULL) {
+			/* if there is one */
+			/* get default capabilities for dummy sessions */
+			cpblts = nc_session_get_cpblts_default();
+			for (i=0; i<3; i++) {
+				if ((lockinfo = ncds_file_lockinfo (ds->datastore, ds_type[i])) != NULL) {
+					if (lockinfo->sid != NULL && strcmp (lockinfo->sid, "") != 0) {
+						/* create dummy session with session ID used to lock datastore */
+						sessions[number_sessions++] = nc_session_dummy(lockinfo->sid, "dummy", NULL, cpblts);
+					}
+				}
+			}
+			nc_cpblts_free(cpblts);
+		}
+	} else {
+		/* plain old single session break locks */
+		number_sessions = 1;
+		sessions[0] = (struct nc_session*)session;
+	}
+
+	/* for all prepared sessions */
+	for (i=0; i<number_sessions; i++) {
+		ds = ncds.datastores;
+#ifndef DISABLE_NOTIFICATIONS
+		flag_r = 0;
+		flag_s = 0;
+		flag_c = 0;
+#endif /* DISABLE_NOTIFICATIONS */
+		/* every datastore */
+		while (ds) {
 			if (ds->datastore && ds->datastore->type != NCDS_TYPE_EMPTY) {
 				/* and every datastore type */
 				for (j=0; j<3; j++) {
@@ -6769,6 +9796,10 @@ API void ncds_break_locks(const struct nc_session* session)
 					}
 				}
 			}
+			if (session != NULL && ds->datastore && ds->datastore->type == NCDS_TYPE_FILE) {
+				/* the closed session's private candidate is not needed anymore */
+				ncds_file_private_free(ds->datastore, session);
+			}
 			ds = ds->next;
 #ifndef DISABLE_NOTIFICATIONS
 			flag = 0;
@@ -6788,54 +9819,29 @@ API void ncds_break_locks(const struct nc_session* session)
 
 const struct data_model* ncds_get_model_data(const char* namespace)
 {
-	struct model_list* listitem;
-	struct data_model *model = NULL;
-
 	if (namespace == NULL) {
 		return (NULL);
 	}
 
-	for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
-		if (listitem->model->ns != NULL && strcmp(listitem->model->ns, namespace) == 0) {
-			/* namespace matches */
-			model = listitem->model;
-			break;
-		}
-	}
-
-	if (model != NULL) {
-		/* model found */
-		return (model);
-	}
-
-	/* model not found */
-	return (NULL);
+	/* returns NULL if the model is not found */
+	return (xmlHashLookup(models_ns_index, BAD_CAST namespace));
 }
 
 const struct data_model* ncds_get_model_operation(const char* operation, const char* namespace)
 {
-	const struct data_model *model = NULL;
-	int i;
-
 	if (operation == NULL || namespace == NULL) {
 		return (NULL);
 	}
 
-	model = ncds_get_model_data(namespace);
-	if (model != NULL && model->rpcs != NULL ) {
-		for (i = 0; model->rpcs[i] != NULL ; i++) {
-			if (strcmp(model->rpcs[i], operation) == 0) {
-				/* operation definition found */
-				return (model);
-			}
-		}
-	}
-
-	/* oepration definition not found */
-	return (NULL);
+	/* returns NULL if the operation definition is not found */
+	return (xmlHashLookup2(models_op_index, BAD_CAST namespace, BAD_CAST operation));
 }
 
-static int ncds_update_features()
+/**
+ * @param[in] datastores Non-zero to process also the datastores' extended
+ * models, zero to process only the data models.
+ */
+static int ncds_update_features(int datastores)
 {
 	struct model_list* listitem;
 	xmlNodePtr node, next;
@@ -6852,7 +9858,7 @@ static int ncds_update_features()
 		}
 	}
 
-	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next){
+	for (ds_iter = ncds.datastores; datastores && ds_iter != NULL; ds_iter = ds_iter->next){
 		if (ds_iter->datastore->ext_model == ds_iter->datastore->data_model->xml){
 			ds_iter->datastore->ext_model = xmlCopyDoc(ds_iter->datastore->data_model->xml, 1);
 		}
@@ -6882,9 +9888,8 @@ static int feature_check(xmlNodePtr node, struct data_model* model)
 	char* name;
 	char* prefix;
 	char* feature_str;
-	int i;
-
-	struct model_feature **features = NULL;
+	struct data_model* feature_model;
+	struct model_feature* feature;
 
 	if (node == NULL || model == NULL) {
 		ERROR("%s: invalid parameter.", __func__);
@@ -6898,33 +9903,25 @@ static int feature_check(xmlNodePtr node, struct data_model* model)
 				continue;
 			}
 
-			features = NULL;
 			name = NULL;
 			prefix = NULL;
 			feature_str = NULL;
 			if ((name = strchr(fname, ':')) == NULL){
 				feature_str = fname;
-				features = model->features;
+				feature_model = model;
 			}
 			else{
 				prefix = fname;
 				name[0] = 0;
 				feature_str = &(name[1]);
-				features = get_features_from_prefix(model,prefix);
+				feature_model = get_model_from_prefix(model,prefix);
 			}
 
-			if (!(features == NULL || features[0] == NULL)){
-				/* check if the feature is enabled or not */
-				for (i = 0; features[i] != NULL; i++){
-					if (strcmp(features[i]->name, feature_str) == 0){
-						if (features[i]->enabled == 0){
-							free(fname);
-							/* remove the node */
-							return (1);
-						}
-						break;
-					}
-				}
+			/* check if the feature is enabled or not */
+			if (feature_model != NULL && (feature = feature_get(feature_model, feature_str)) != NULL && feature->enabled == 0){
+				free(fname);
+				/* remove the node */
+				return (1);
 			}
 			free(fname);
 			/* ignore any following if-feature statements */
@@ -6945,7 +9942,7 @@ static int feature_check(xmlNodePtr node, struct data_model* model)
 	return (0);
 }
 
-static struct model_feature** get_features_from_prefix(struct data_model* model, char* prefix)
+static struct data_model* get_model_from_prefix(struct data_model* model, char* prefix)
 {
 	char* import_model_str = NULL;
 	xmlXPathObjectPtr imports = NULL;
@@ -6957,7 +9954,7 @@ static struct model_feature** get_features_from_prefix(struct data_model* model,
 	}
 
 	if (strcmp(prefix, model->prefix) == 0){
-		return model->features;
+		return model;
 	}
 	else{
 		/* get all <import> nodes for their prefix specification to be used with augment statement */
@@ -6976,32 +9973,16 @@ static struct model_feature** get_features_from_prefix(struct data_model* model,
 
 		import_model = get_model(import_model_str, NULL);
 		free(import_model_str);
-		if(import_model == NULL){
-			return NULL;
-		}
-		return import_model->features;
+		return import_model;
 	}
 }
 
 const struct data_model* ncds_get_model_notification(const char* notification, const char* namespace)
 {
-	const struct data_model *model = NULL;
-	int i;
-
 	if (notification == NULL || namespace == NULL) {
 		return (NULL);
 	}
 
-	model = ncds_get_model_data(namespace);
-	if (model != NULL && model->notifs != NULL ) {
-		for (i = 0; model->notifs[i] != NULL ; i++) {
-			if (strcmp(model->notifs[i], notification) == 0) {
-				/* notification definition found */
-				return (model);
-			}
-		}
-	}
-
-	/* notification definition not found */
-	return (NULL);
+	/* returns NULL if the notification definition is not found */
+	return (xmlHashLookup2(models_notif_index, BAD_CAST namespace, BAD_CAST notification));
 }
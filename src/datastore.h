@@ -55,7 +55,9 @@ typedef enum {
 	NCDS_TYPE_ERROR = -1, /**< virtual enum value for internal purposes */
 	NCDS_TYPE_EMPTY, /**< No real datastore. For read-only devices. */
 	NCDS_TYPE_FILE, /**< Datastores implemented as files */
-	NCDS_TYPE_CUSTOM /**< User-defined datastore */
+	NCDS_TYPE_CUSTOM, /**< User-defined datastore */
+	NCDS_TYPE_SHM, /**< Datastores kept in the shared memory */
+	NCDS_TYPE_SQLITE /**< Datastores stored in the SQLite database, available only with --enable-sqlite */
 } NCDS_TYPE;
 
 /**
@@ -125,6 +127,19 @@ extern char error_area;
  * To finish changes made to the datastores (adding augment data models,
  * enabling and disabling features, etc.), server MUST call ncds_consolidate()
  * function.
+ * To shorten the server start with many data models, the result of the
+ * consolidation can be cached on disk - see ncds_set_model_cache().
+ * Similarly, with ncds_set_lazy_consolidation() only the basic information
+ * about the data models is read when they are added and the rest of the work
+ * (resolving groupings and augments, parsing validators) is postponed until
+ * it is really needed.
+ *
+ * By default, every operation gets the datastore exclusively. With
+ * ncds_set_concurrent_reads(), read-only operations (\<get\>,
+ * \<get-config\>, \<get-schema\> and \<validate\> of other than the running
+ * datastore) share the datastore, so they can be processed concurrently by
+ * several threads. The file datastore shares its file among processes in the
+ * same way.
  *
  * As a next step, device controlled by the server should be initialized. This
  * should includes copying startup configuration data into the running
@@ -141,6 +156,17 @@ extern char error_area;
  *
  *   ncds_file_set_path() to set file to store datastore content.
  *
+ * - \ref shmds (*NCDS_TYPE_SHM*)
+ *
+ *   ncds_shm_set_name() to set name of the shared memory objects storing
+ *   the datastore content, ncds_shm_set_path() to set files storing the
+ *   content on the disk.
+ *
+ * - \ref sqliteds (*NCDS_TYPE_SQLITE*)
+ *
+ *   ncds_sqlite_set_path() to set the database file storing the datastore
+ *   content.
+ *
  * - \ref customds (*NCDS_TYPE_CUSTOM*)
  *
  *   This type of datastore implementation is provided by the server, not by
@@ -150,6 +176,11 @@ extern char error_area;
  *   datastore. In this case, server is required to implement functions
  *   from #ncds_custom_funcs structure.
  *
+ *   ncds_custom_set_getconfig_filtered() optionally sets a function applying
+ *   the subtree filter of the get-config request in the datastore and
+ *   ncds_custom_set_editconfig_changes() a function applying the list of
+ *   changes made by the edit-config operation instead of the whole operation.
+ *
  */
 
 /**
@@ -372,6 +403,24 @@ int ncds_add_augment_transapi(const char* model_path, const char* callbacks_path
  */
 int ncds_set_validation(struct ncds_ds* ds, int enable, const char* relaxng, const char* schematron);
 
+/**
+ * @ingroup store
+ * @brief Let the read-only operations (\<get\>, \<get-config\>,
+ * \<get-schema\> and \<validate\> of other than the running datastore) on the
+ * specified datastore run concurrently.
+ *
+ * It is disabled by default, so all the operations on the datastore are
+ * serialized. Enable it only if the state data callback and, in case of the
+ * custom datastore, its getconfig() callback are thread-safe. The built-in
+ * datastore implementations are thread-safe.
+ *
+ * @param[in] ds Datastore structure to be configured.
+ * @param[in] enable 1 to share the datastore among the read-only operations,
+ * 0 to serialize all the operations.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_set_concurrent_reads(struct ncds_ds* ds, int enable);
+
 /**
  * @defgroup fileds File Datastore
  * @ingroup store
@@ -395,6 +444,220 @@ int ncds_set_validation(struct ncds_ds* ds, int enable, const char* relaxng, con
  */
 int ncds_file_set_path(struct ncds_ds* datastore, const char* path);
 
+/**
+ * @ingroup fileds
+ * @brief Layout of the file datastore files.
+ */
+typedef enum {
+	NCDS_FILE_LAYOUT_SINGLE, /**< all the datastores in the single file (default) */
+	NCDS_FILE_LAYOUT_SPLIT /**< running in the datastore file, startup and candidate in the *.startup and *.candidate files */
+} NCDS_FILE_LAYOUT;
+
+/**
+ * @ingroup fileds
+ * @brief Set layout of the file datastore files.
+ *
+ * In the split layout, each of the running, startup and candidate datastores
+ * is stored in its own file. A change of one datastore then rewrites only its
+ * file and the other processes reload only the changed datastore. When the
+ * split layout is set for an existing single datastore file, the startup and
+ * candidate datastores are moved into their files by ncds_init(). All the
+ * processes sharing the datastore files MUST use the same layout.
+ *
+ * The function MUST be called before ncds_init().
+ *
+ * @param[in] datastore File datastore structure to be configured.
+ * @param[in] layout Layout of the datastore files.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_file_set_layout(struct ncds_ds* datastore, NCDS_FILE_LAYOUT layout);
+
+/**
+ * @ingroup fileds
+ * @brief Durability of the changes made in the file datastore.
+ */
+typedef enum {
+	NCDS_FILE_SYNC_NONE, /**< changes are written, but not flushed to the disk (default) */
+	NCDS_FILE_SYNC_COMMIT, /**< each change is flushed to the disk before it is confirmed */
+	NCDS_FILE_SYNC_GROUP /**< changes made at the same time share a single flush to the disk */
+} NCDS_FILE_SYNC;
+
+/**
+ * @ingroup fileds
+ * @brief Statistics of writing the file datastore changes to the disk.
+ */
+struct ncds_file_stats {
+	unsigned long commits; /**< number of the written changes */
+	unsigned long checkpoints; /**< number of rewrites of the whole datastore file */
+	unsigned long fsyncs; /**< number of fsync() calls */
+	unsigned long batch_max; /**< maximal number of changes flushed by a single fsync() */
+	unsigned long long latency_total; /**< sum of the changes write latencies (in microseconds) */
+	unsigned long latency_max; /**< maximal change write latency (in microseconds) */
+};
+
+/**
+ * @ingroup fileds
+ * @brief Set durability of the changes made in the file datastore.
+ *
+ * With #NCDS_FILE_SYNC_NONE, a change can be lost on a power failure even if
+ * it was already confirmed. #NCDS_FILE_SYNC_COMMIT flushes every change before
+ * confirming it, so a burst of changes is limited by the disk latency. In the
+ * #NCDS_FILE_SYNC_GROUP mode, the first change waiting for the flush waits
+ * additionally for the \p window time and then it flushes all the changes
+ * made by the threads of the process in the meantime.
+ *
+ * In both flushing modes, the whole datastore file is rewritten by writing
+ * a temporary file and renaming it, so the file is always consistent.
+ *
+ * @param[in] datastore File datastore structure to be configured.
+ * @param[in] mode Durability mode.
+ * @param[in] window Group commit window in microseconds, used only in the
+ * #NCDS_FILE_SYNC_GROUP mode.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_file_set_sync(struct ncds_ds* datastore, NCDS_FILE_SYNC mode, unsigned int window);
+
+/**
+ * @ingroup fileds
+ * @brief Get statistics of writing the file datastore changes to the disk.
+ *
+ * Statistics cover the changes made by the calling process.
+ *
+ * @param[in] datastore File datastore structure.
+ * @param[out] stats Structure to be filled with the statistics.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_file_get_stats(struct ncds_ds* datastore, struct ncds_file_stats* stats);
+
+/**
+ * @ingroup fileds
+ * @brief Set the size of the file datastore rollback history.
+ *
+ * For each change of the datastore, only the reverse delta of the changed
+ * parts is remembered. ncds_rollback() undoes the most recent change and its
+ * repeated calls undo the older ones. The oldest changes are forgotten when
+ * there are more than \p levels of them or when they take more than
+ * \p max_size bytes, but the most recent change can always be rolled back.
+ * The history is discarded when the datastore is changed by another process.
+ * By default, 10 changes in 1 MB are kept.
+ *
+ * @param[in] datastore File datastore structure to be configured.
+ * @param[in] levels Maximal number of the changes which can be rolled back,
+ * 0 disables the rollback.
+ * @param[in] max_size Memory limit (in bytes) of the rollback history.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_file_set_rollback(struct ncds_ds* datastore, unsigned int levels, size_t max_size);
+
+/**
+ * @ingroup fileds
+ * @brief Use a private candidate datastore for each session.
+ *
+ * The private candidate of a session starts as the current running datastore
+ * and other sessions do not see its changes, so the operators do not have to
+ * lock the candidate to work concurrently. Only the subtrees changed by the
+ * session and the paths to them are copied from the running datastore, the
+ * rest is shared with it. The commit applies only the subtrees changed by the session
+ * to the current running datastore. If another session changed the same
+ * subtrees in the running datastore in the meantime, the commit fails with
+ * the operation-failed error and the session can discard its changes. The
+ * private candidates are not stored in the datastore file and they are freed
+ * when the session is closed.
+ *
+ * The private candidates require the compiled schema of the datastore.
+ * Disabling the private candidates drops their uncommitted changes.
+ *
+ * @param[in] datastore File datastore structure to be configured.
+ * @param[in] enable Non-zero to use the private candidates, zero to share the
+ * candidate by all the sessions (default).
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_file_set_private_candidate(struct ncds_ds* datastore, int enable);
+
+/**
+ * @defgroup shmds Shared Memory Datastore
+ * @ingroup store
+ * @brief Specific functions for NCDS_TYPE_SHM type of datastore implementation.
+ *
+ * The datastores are kept in the POSIX shared memory, so all the processes
+ * using the datastore of the same name share a single copy of its content.
+ * The content of each datastore (running, startup, candidate) is stored
+ * serialized in its own shared memory object and a change publishes a new
+ * object instead of rewriting the current one. Therefore, reading does not
+ * wait for the writers (neither of the other processes nor of the same
+ * process) and no process has to reload the datastore after another process
+ * changed it. Reading still copies the content, because the caller gets its
+ * own string.
+ *
+ * Each published content is also written into the datastore file (see
+ * ncds_shm_set_path()) before the change is visible. When the shared memory
+ * objects do not exist (e.g. after the system restart), the first process
+ * initiating the datastore loads the content from these files.
+ */
+
+/**
+ * @ingroup shmds
+ * @brief Set the name of the shared memory objects storing the datastore.
+ *
+ * All the processes accessing the same datastore MUST use the same name.
+ * If not set, the name of the datastore's data model is used. The function
+ * MUST be called before ncds_init().
+ *
+ * @param[in] datastore Shared memory datastore structure to be configured.
+ * @param[in] name Name of the datastore, it cannot contain slashes.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_shm_set_name(struct ncds_ds* datastore, const char* name);
+
+/**
+ * @ingroup shmds
+ * @brief Set the files storing the content of the shared memory datastore.
+ *
+ * The running, startup and candidate datastores are stored in the
+ * \<path\>.running, \<path\>.startup and \<path\>.candidate files. If not
+ * set, the path is NC_WORKINGDIR_PATH/datastore-shm-\<name\>. All the
+ * processes accessing the same datastore MUST use the same path. The function
+ * MUST be called before ncds_init().
+ *
+ * @param[in] datastore Shared memory datastore structure to be configured.
+ * @param[in] path Path prefix of the datastore files, NULL to keep the content
+ * only in the shared memory (it is lost when the system is restarted).
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_shm_set_path(struct ncds_ds* datastore, const char* path);
+
+/**
+ * @defgroup sqliteds SQLite Datastore
+ * @ingroup store
+ * @brief Specific functions for NCDS_TYPE_SQLITE type of datastore implementation.
+ *
+ * The datastores are stored in the SQLite database file. The configuration
+ * is split into records - each container and list entry is a separate record
+ * identified by its key path and holding its leaves, leaf-lists and anyxml
+ * nodes. Therefore, \<edit-config\> reads and writes only the records it
+ * changes and \<get-config\> with a subtree filter selecting list entries by
+ * their keys reads only the selected records instead of parsing the whole
+ * datastore. The database can be shared by several processes, readers do not
+ * wait for the writers.
+ *
+ * This datastore type is available only if libnetconf was compiled with
+ * --enable-sqlite configure's option. Otherwise, ncds_new() fails for
+ * NCDS_TYPE_SQLITE and ncds_sqlite_set_path() always fails.
+ */
+
+/**
+ * @ingroup sqliteds
+ * @brief Set the path of the database file storing the datastore.
+ *
+ * The file is created if it does not exist. The function MUST be called
+ * before ncds_init().
+ *
+ * @param[in] datastore SQLite datastore structure to be configured.
+ * @param[in] path Path to the database file.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_sqlite_set_path(struct ncds_ds* datastore, const char* path);
+
 /**
  * @ingroup store
  * @brief Activate datastore structure for use.
@@ -453,6 +716,13 @@ void ncds_free2(ncds_id datastore_id);
  *
  * **This function IS NOT thread safety.**
  *
+ * The \<partial-lock\> and \<partial-unlock\> operations (RFC 5717) are
+ * processed here as well. Only the nodes the session is allowed to read can be
+ * locked. The file datastores keep the partial locks in the datastore files next
+ * to the global lock, so they are respected by all the processes sharing the
+ * files, the other datastore types keep them only in the process. The locks of
+ * the session are released by ncds_break_locks().
+ *
  * @param[in] session NETCONF session (a dummy session is acceptable) where the
  * \<rpc\> came from. Capabilities checks are done according to this session.
  * @param[in] rpc NETCONF \<rpc\> message specifying requested operation.
@@ -470,6 +740,79 @@ void ncds_free2(ncds_id datastore_id);
  */
 nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc, ncds_id* ids[]);
 
+/**
+ * @ingroup store
+ * @brief Transaction of several configuration changes.
+ */
+struct ncds_txn;
+
+/**
+ * @ingroup store
+ * @brief Start a transaction of several \<edit-config\> operations.
+ *
+ * Changes applied by ncds_txn_apply() are written into the datastores
+ * immediately, but the validation, the transAPI callbacks and storing the
+ * changes persistently are done only once for each changed datastore in
+ * ncds_txn_commit(). If any of the edits or the commit fails, all the
+ * datastores are returned to their content before the transaction.
+ *
+ * The datastores changed by the transaction stay locked for other threads of
+ * the process until the end of the transaction, so all the functions of the
+ * transaction MUST be called by the same thread. Until the transaction is
+ * finished, the other operations on its datastores (ncds_apply_rpc2all()
+ * outside of the transaction) fail in this thread with the in-use error
+ * instead of waiting for the locks. A transaction not finished when its
+ * session is closed by nc_session_free() in the thread running the
+ * transaction is rolled back and its datastores are released, the structure
+ * still has to be freed by ncds_txn_abort().
+ *
+ * libnetconf also provides the \<transaction\> operation from the
+ * libnetconf-transactions module, which applies the \<edit\> items of the
+ * request as a single transaction via ncds_apply_rpc2all().
+ *
+ * @param[in] session NETCONF session (a dummy session is acceptable) performing
+ * the changes. Capabilities and access control checks are done according to
+ * this session.
+ * @return Transaction structure, NULL on error.
+ */
+struct ncds_txn* ncds_txn_begin(const struct nc_session* session);
+
+/**
+ * @ingroup store
+ * @brief Apply the \<edit-config\> operation within the transaction.
+ *
+ * The test-option of the request is ignored, the result is validated by
+ * ncds_txn_commit(). When the operation fails, all the changes of the
+ * transaction are reverted and the following calls of ncds_txn_apply() and
+ * ncds_txn_commit() fail.
+ *
+ * @param[in] txn Transaction from ncds_txn_begin().
+ * @param[in] rpc \<edit-config\> request.
+ * @return \<rpc-reply\> with \<ok\> or \<rpc-error\>, NCDS_RPC_NOT_APPLICABLE
+ * if the request does not affect any datastore, NULL on invalid parameter.
+ */
+nc_reply* ncds_txn_apply(struct ncds_txn* txn, const nc_rpc* rpc);
+
+/**
+ * @ingroup store
+ * @brief Finish the transaction. The changed datastores are validated, the
+ * transAPI callbacks are called and the changes are stored. On error, all the
+ * changes of the transaction are reverted. The transaction structure is freed.
+ *
+ * @param[in] txn Transaction from ncds_txn_begin().
+ * @return \<rpc-reply\> with \<ok\> or \<rpc-error\>, NULL on invalid parameter.
+ */
+nc_reply* ncds_txn_commit(struct ncds_txn* txn);
+
+/**
+ * @ingroup store
+ * @brief Revert all the changes of the transaction and free the transaction
+ * structure.
+ *
+ * @param[in] txn Transaction from ncds_txn_begin().
+ */
+void ncds_txn_abort(struct ncds_txn* txn);
+
 /**
  * @ingroup store
  * @brief Undo the last change performed on the specified datastore.
@@ -482,6 +825,8 @@ int ncds_rollback(ncds_id id);
  * @ingroup store
  * @brief Remove all the locks that the given session is holding.
  *
+ * Partial locks of the session are released as well.
+ *
  * @param[in] session Session holding locks to remove
  */
 void ncds_break_locks(const struct nc_session* session);
@@ -603,6 +948,39 @@ int ncds_feature_isenabled(const char* module, const char* feature);
  */
 int ncds_consolidate(void);
 
+/**
+ * @ingroup store
+ * @brief Set the directory where ncds_consolidate() stores the consolidated
+ * data models and from where it loads them on the next start.
+ *
+ * The cache entry is identified by the content of all the loaded data models,
+ * their enabled features and the created datastores. If nothing of these (nor
+ * any data model imported during the consolidation) changed, the stored
+ * extended data models are used instead of resolving the uses, augment and
+ * refine statements again. By default, the cache is disabled.
+ *
+ * @param[in] path Directory path, NULL to disable the cache.
+ * @return 0 on success, non-zero on error.
+ */
+int ncds_set_model_cache(const char* path);
+
+/**
+ * @ingroup store
+ * @brief Switch the lazy processing of the data models.
+ *
+ * In the lazy mode, ncds_add_model(), ncds_new() and other functions adding
+ * data models read only the information needed for the NETCONF \<hello\>
+ * message (name, revision, namespace, RPCs and notifications). The uses
+ * statements in groupings and augments are resolved when the model is imported
+ * or applied during ncds_consolidate() and the datastore's RelaxNG and
+ * Schematron validators are parsed by the first \<validate\> operation (or
+ * edit with the test-option). By default, the lazy mode is disabled. The
+ * setting affects only the data models and datastores added after the call.
+ *
+ * @param[in] enable 1 to enable the lazy mode, 0 to disable it.
+ */
+void ncds_set_lazy_consolidation(int enable);
+
 #ifdef __cplusplus
 }
 #endif
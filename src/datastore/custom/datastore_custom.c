@@ -48,6 +48,7 @@
 #include <semaphore.h>
 
 #include <libxml/tree.h>
+#include <libxml/hash.h>
 
 #include "../../netconf_internal.h"
 #include "../../error.h"
@@ -58,6 +59,7 @@
 #include "datastore_custom_private.h"
 #include "datastore_custom.h"
 #include "../edit_config.h"
+#include "../schema.h"
 
 static struct ncds_lockinfo lockinfo_running = {NC_DATASTORE_RUNNING, NULL, NULL};
 static struct ncds_lockinfo lockinfo_startup = {NC_DATASTORE_STARTUP, NULL, NULL};
@@ -95,6 +97,18 @@ API void ncds_custom_set_data(struct ncds_ds* ds, void *custom_data, const struc
 	c_ds->callbacks = callbacks;
 }
 
+API void ncds_custom_set_getconfig_filtered(struct ncds_ds* ds, char *(*getconfig_filtered)(void *data, NC_DATASTORE target, const char *filter, int *exact, struct nc_err **error)) {
+	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
+
+	c_ds->getconfig_filtered = getconfig_filtered;
+}
+
+API void ncds_custom_set_editconfig_changes(struct ncds_ds* ds, int (*editconfig_changes)(void *data, NC_DATASTORE target, const struct ncds_change *changes, int count, struct nc_err **error)) {
+	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
+
+	c_ds->editconfig_changes = editconfig_changes;
+}
+
 int ncds_custom_was_changed(struct ncds_ds* ds) {
 	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
 
@@ -369,6 +383,17 @@ char* ncds_custom_getconfig(struct ncds_ds* ds, const struct nc_session* UNUSED(
 	return c_ds->callbacks->getconfig(c_ds->data, source, error);
 }
 
+char* ncds_custom_getconfig_filtered(struct ncds_ds* ds, const struct nc_session* UNUSED(session), NC_DATASTORE source, const char* filter, int* exact, struct nc_err** error) {
+	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
+
+	*exact = 0;
+	if (c_ds->getconfig_filtered == NULL) {
+		return c_ds->callbacks->getconfig(c_ds->data, source, error);
+	}
+
+	return c_ds->getconfig_filtered(c_ds->data, source, filter, exact, error);
+}
+
 int ncds_custom_copyconfig(struct ncds_ds *ds, const struct nc_session* UNUSED(session), const nc_rpc* UNUSED(rpc), NC_DATASTORE target, NC_DATASTORE source, char * config, struct nc_err **error) {
 	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
 
@@ -385,10 +410,410 @@ int ncds_custom_deleteconfig(struct ncds_ds * ds, const struct nc_session* UNUSE
 	return c_ds->callbacks->deleteconfig(c_ds->data, target, error);
 }
 
+/**
+ * @brief List of the changes passed to the editconfig_changes callback.
+ */
+struct custom_changes {
+	struct ncds_change* list;
+	int count;
+	int size;
+	/**
+	 * @brief Document for serializing the changed subtrees.
+	 */
+	xmlDocPtr doc;
+};
+
+static void custom_changes_free(struct custom_changes* changes)
+{
+	int i;
+
+	for (i = 0; i < changes->count; i++) {
+		free((char*)changes->list[i].schema_path);
+		free((char*)changes->list[i].path);
+		free((char*)changes->list[i].keys);
+		free((char*)changes->list[i].after);
+		free((char*)changes->list[i].data);
+	}
+	free(changes->list);
+	xmlFreeDoc(changes->doc);
+}
+
+/**
+ * @brief Serialize the subtree with all the namespaces it uses.
+ */
+static char* custom_dump(xmlDocPtr doc, xmlNodePtr node)
+{
+	xmlBufferPtr buf;
+	xmlNodePtr copy;
+	char* retval = NULL;
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		return (NULL);
+	}
+	if ((copy = xmlDocCopyNode(node, doc, 1)) != NULL) {
+		xmlNodeDump(buf, doc, copy, 0, 0);
+		retval = strdup((char*)xmlBufferContent(buf));
+		xmlFreeNode(copy);
+	}
+	xmlBufferFree(buf);
+
+	return (retval);
+}
+
+/**
+ * @brief Get the key predicates identifying the list or leaf-list entry.
+ *
+ * @return Predicates, empty string for other nodes, NULL on error.
+ */
+static char* custom_keys(const struct schema_node* snode, xmlNodePtr node)
+{
+	xmlBufferPtr buf;
+	xmlNodePtr child;
+	xmlChar* value;
+	char* retval;
+	int i;
+
+	if (snode == NULL || (snode->type != SCHEMA_LIST && snode->type != SCHEMA_LEAFLIST)) {
+		return (strdup(""));
+	}
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		return (NULL);
+	}
+	for (i = 0; snode->type == SCHEMA_LEAFLIST ? i < 1 : i < snode->keys_count; i++) {
+		if (snode->type == SCHEMA_LEAFLIST) {
+			xmlBufferCCat(buf, "[.=");
+			value = xmlNodeGetContent(node);
+		} else {
+			for (child = node->children; child != NULL; child = child->next) {
+				if (child->type == XML_ELEMENT_NODE && xmlStrEqual(child->name, snode->keys[i])) {
+					break;
+				}
+			}
+			xmlBufferCCat(buf, "[");
+			xmlBufferCat(buf, snode->keys[i]);
+			xmlBufferCCat(buf, "=");
+			value = (child != NULL) ? xmlNodeGetContent(child) : NULL;
+		}
+		if (value != NULL && xmlStrchr(value, '\'') != NULL) {
+			xmlBufferCCat(buf, "\"");
+			xmlBufferCat(buf, value);
+			xmlBufferCCat(buf, "\"]");
+		} else {
+			xmlBufferCCat(buf, "'");
+			xmlBufferCat(buf, (value != NULL) ? value : BAD_CAST "");
+			xmlBufferCCat(buf, "']");
+		}
+		xmlFree(value);
+	}
+	retval = strdup((char*)xmlBufferContent(buf));
+	xmlBufferFree(buf);
+
+	return (retval);
+}
+
+static int custom_change_add(struct custom_changes* changes, NCDS_CHANGE_OP op, const char* schema_path, const char* path, const char* keys, const char* after, xmlNodePtr node)
+{
+	struct ncds_change* change;
+
+	if (changes->count == changes->size) {
+		if ((change = realloc(changes->list, (changes->size + 32) * sizeof(struct ncds_change))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (EXIT_FAILURE);
+		}
+		changes->list = change;
+		changes->size += 32;
+	}
+
+	change = &(changes->list[changes->count++]);
+	memset(change, 0, sizeof(struct ncds_change));
+	change->op = op;
+	if ((change->schema_path = strdup(schema_path)) == NULL || (change->path = strdup(path)) == NULL ||
+			(change->keys = strdup(keys)) == NULL || (after != NULL && (change->after = strdup(after)) == NULL) ||
+			(node != NULL && (change->data = custom_dump(changes->doc, node)) == NULL)) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static const struct schema_node* custom_schema_node(const struct schema* schema, const struct schema_node* parent, xmlNodePtr node)
+{
+	if (schema == NULL) {
+		return (NULL);
+	} else if (parent == NULL) {
+		return (xmlHashLookup(schema->roots, node->name));
+	} else if (parent->children == NULL) {
+		return (NULL);
+	}
+	return (xmlHashLookup(parent->children, node->name));
+}
+
+/**
+ * @brief Get the previous entry of the same list or leaf-list.
+ *
+ * @param paired Skip the entries without their counterpart in the other
+ * document.
+ */
+static xmlNodePtr custom_prev_entry(xmlNodePtr node, int paired)
+{
+	xmlNodePtr prev;
+
+	for (prev = node->prev; prev != NULL; prev = prev->prev) {
+		if (prev->type == XML_ELEMENT_NODE && xmlStrEqual(prev->name, node->name) && (!paired || prev->_private != NULL)) {
+			break;
+		}
+	}
+
+	return (prev);
+}
+
+/**
+ * @brief Compare the lists of sibling nodes and add their differences into
+ * the change list. The nodes present in both lists are paired by their
+ * _private pointers.
+ *
+ * @param changes Change list to fill.
+ * @param schema Schema of the datastore, NULL if not available.
+ * @param parent Schema node of the parent, NULL for the top level nodes.
+ * @param old First node of the original list.
+ * @param new First node of the changed list.
+ * @param schema_path Schema path of the parent.
+ * @param path Instance path of the parent.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int custom_diff(struct custom_changes* changes, const struct schema* schema, const struct schema_node* parent, xmlNodePtr old, xmlNodePtr new, const char* schema_path, const char* path)
+{
+	xmlHashTablePtr hash;
+	xmlNodePtr node, equiv, prev;
+	const struct schema_node* snode;
+	char *keys = NULL, *after = NULL, *spath = NULL, *npath = NULL, *a = NULL, *b = NULL;
+	int retval = EXIT_FAILURE, moved;
+
+	/* pair the nodes by their names and keys */
+	if ((hash = xmlHashCreate(16)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	for (node = old; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE) {
+			if ((keys = custom_keys(custom_schema_node(schema, parent, node), node)) == NULL) {
+				goto cleanup;
+			}
+			xmlHashAddEntry2(hash, node->name, BAD_CAST keys, node);
+			free(keys);
+		}
+	}
+	for (node = new; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE) {
+			if ((keys = custom_keys(custom_schema_node(schema, parent, node), node)) == NULL) {
+				goto cleanup;
+			}
+			if ((equiv = xmlHashLookup2(hash, node->name, BAD_CAST keys)) != NULL && equiv->_private == NULL) {
+				equiv->_private = node;
+				node->_private = equiv;
+			}
+			free(keys);
+		}
+	}
+	keys = NULL;
+
+	/* deleted nodes */
+	for (node = old; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE || node->_private != NULL) {
+			continue;
+		}
+		snode = custom_schema_node(schema, parent, node);
+		if ((keys = custom_keys(snode, node)) == NULL ||
+				asprintf(&spath, "%s/%s", schema_path, (char*)node->name) == -1 ||
+				asprintf(&npath, "%s/%s%s", path, (char*)node->name, keys) == -1 ||
+				custom_change_add(changes, NCDS_CHANGE_DELETE, spath, npath, keys, NULL, NULL) != EXIT_SUCCESS) {
+			goto cleanup;
+		}
+		free(keys);
+		free(spath);
+		free(npath);
+		keys = spath = npath = NULL;
+	}
+
+	/* created, moved and changed nodes in their new order */
+	for (node = new; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		snode = custom_schema_node(schema, parent, node);
+		if ((keys = custom_keys(snode, node)) == NULL ||
+				asprintf(&spath, "%s/%s", schema_path, (char*)node->name) == -1 ||
+				asprintf(&npath, "%s/%s%s", path, (char*)node->name, keys) == -1) {
+			goto cleanup;
+		}
+		prev = NULL;
+		if (snode != NULL && (snode->flags & SCHEMA_ORDERED_USER)) {
+			prev = custom_prev_entry(node, 0);
+			if ((after = (prev != NULL) ? custom_keys(snode, prev) : strdup("")) == NULL) {
+				goto cleanup;
+			}
+		}
+
+		if ((equiv = node->_private) == NULL) {
+			if (custom_change_add(changes, NCDS_CHANGE_CREATE, spath, npath, keys, after, node) != EXIT_SUCCESS) {
+				goto cleanup;
+			}
+		} else {
+			if (after != NULL) {
+				/* the entry stays in place if it follows the same entry as before */
+				moved = (prev == NULL) ? (custom_prev_entry(equiv, 1) != NULL) : (prev->_private != custom_prev_entry(equiv, 1));
+				if (moved && custom_change_add(changes, NCDS_CHANGE_MOVE, spath, npath, keys, after, NULL) != EXIT_SUCCESS) {
+					goto cleanup;
+				}
+			}
+
+			if (snode != NULL && (snode->type == SCHEMA_CONTAINER || snode->type == SCHEMA_LIST)) {
+				if (custom_diff(changes, schema, snode, equiv->children, node->children, spath, npath) != EXIT_SUCCESS) {
+					goto cleanup;
+				}
+			} else if (snode == NULL || snode->type != SCHEMA_LEAFLIST) {
+				/* leaf, anyxml or unknown node, compare the whole content */
+				if ((a = custom_dump(changes->doc, equiv)) == NULL || (b = custom_dump(changes->doc, node)) == NULL) {
+					goto cleanup;
+				}
+				if (strcmp(a, b) != 0 && custom_change_add(changes, NCDS_CHANGE_REPLACE, spath, npath, keys, NULL, node) != EXIT_SUCCESS) {
+					goto cleanup;
+				}
+				free(a);
+				free(b);
+				a = b = NULL;
+			}
+		}
+		free(keys);
+		free(after);
+		free(spath);
+		free(npath);
+		keys = after = spath = npath = NULL;
+	}
+	retval = EXIT_SUCCESS;
+
+cleanup:
+	xmlHashFree(hash, NULL);
+	free(keys);
+	free(after);
+	free(spath);
+	free(npath);
+	free(a);
+	free(b);
+
+	return (retval);
+}
+
+/**
+ * @brief Parse the serialized configuration data with possibly multiple
+ * top level elements.
+ */
+static xmlDocPtr custom_read(const char* data)
+{
+	xmlDocPtr doc;
+	xmlNodePtr root, node;
+	const char* datap = data;
+	char* config;
+
+	if (strncmp(data, "<?xml", 5) == 0) {
+		if ((datap = strchr(data, '>')) == NULL) {
+			return (NULL);
+		}
+		++datap;
+	}
+	if (asprintf(&config, "<config>%s</config>", datap) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	doc = xmlReadMemory(config, strlen(config), NULL, NULL, NC_XMLREAD_OPTIONS);
+	free(config);
+	if (doc == NULL) {
+		return (NULL);
+	}
+
+	/* get off the root config element */
+	root = xmlDocGetRootElement(doc);
+	while ((node = root->children) != NULL) {
+		xmlUnlinkNode(node);
+		xmlAddNextSibling(doc->last, node);
+	}
+	xmlUnlinkNode(root);
+	xmlFreeNode(root);
+
+	return (doc);
+}
+
+/**
+ * @brief Perform the editconfig operation on the content provided by the
+ * getconfig callback and pass the resulting changes to the editconfig_changes
+ * callback.
+ */
+static int custom_edit(struct ncds_ds_custom* c_ds, const nc_rpc* rpc, NC_DATASTORE target, const char* config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err** error)
+{
+	struct custom_changes changes = {NULL, 0, 0, NULL};
+	xmlDocPtr old = NULL, new = NULL, config_doc = NULL;
+	char* data;
+	int retval = EXIT_FAILURE;
+
+	if ((data = c_ds->callbacks->getconfig(c_ds->data, target, error)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	old = custom_read(data);
+	free(data);
+	if (old == NULL) {
+		ERROR("%s: Reading the datastore content failed.", __func__);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Invalid datastore content.");
+		goto cleanup;
+	}
+	if ((config_doc = custom_read(config)) == NULL) {
+		ERROR("%s: Reading xml data failed!", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
+		goto cleanup;
+	}
+
+	/* perform the edit on a copy of the content */
+	if ((new = xmlCopyDoc(old, 1)) == NULL || (changes.doc = xmlNewDoc(BAD_CAST "1.0")) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		goto cleanup;
+	}
+	if (edit_config(new, config_doc, (struct ncds_ds*)c_ds, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error) != EXIT_SUCCESS) {
+		goto cleanup;
+	}
+
+	if (custom_diff(&changes, schema_get(c_ds->ds.ext_model), NULL, old->children, new->children, "", "") != EXIT_SUCCESS) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		goto cleanup;
+	}
+
+	if (changes.count == 0) {
+		retval = EXIT_SUCCESS;
+	} else {
+		retval = c_ds->editconfig_changes(c_ds->data, target, changes.list, changes.count, error);
+	}
+
+cleanup:
+	custom_changes_free(&changes);
+	xmlFreeDoc(config_doc);
+	xmlFreeDoc(new);
+	xmlFreeDoc(old);
+
+	return (retval);
+}
+
 int ncds_custom_editconfig(struct ncds_ds *ds, const struct nc_session* UNUSED(session), const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error) {
 	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
 
 	/* TODO - check locks */
 
+	if (c_ds->editconfig_changes != NULL) {
+		return custom_edit(c_ds, rpc, target, config, defop, errop, error);
+	}
+
 	return c_ds->callbacks->editconfig(c_ds->data, rpc, target, config, defop, errop, error);
 }
@@ -55,6 +55,51 @@ struct nc_err;
  * @{
  */
 
+/**
+ * \brief Type of a change passed to the callback set by ncds_custom_set_editconfig_changes().
+ */
+typedef enum {
+	NCDS_CHANGE_CREATE, /**< the node was created */
+	NCDS_CHANGE_DELETE, /**< the node was deleted */
+	NCDS_CHANGE_REPLACE, /**< the value of the leaf or the content of the anyxml node was changed */
+	NCDS_CHANGE_MOVE /**< the entry of the ordered-by user list or leaf-list was moved */
+} NCDS_CHANGE_OP;
+
+/**
+ * \brief A single change of the data store content.
+ */
+struct ncds_change {
+	/**
+	 * \brief What happened to the node.
+	 */
+	NCDS_CHANGE_OP op;
+	/**
+	 * \brief Schema path of the node, e.g. "/cfg/item/value".
+	 */
+	const char *schema_path;
+	/**
+	 * \brief Path of the node instance, e.g. "/cfg/item[name='a']/value".
+	 */
+	const char *path;
+	/**
+	 * \brief Key predicates identifying the list entry (e.g. "[name='a']")
+	 * or the leaf-list entry (e.g. "[.='a']"), empty for other nodes.
+	 */
+	const char *keys;
+	/**
+	 * \brief Key predicates of the preceding entry of the ordered-by user
+	 * list or leaf-list for #NCDS_CHANGE_CREATE and #NCDS_CHANGE_MOVE, empty
+	 * if the entry is the first one. NULL for the other nodes.
+	 */
+	const char *after;
+	/**
+	 * \brief Serialized new subtree of the node, NULL for #NCDS_CHANGE_DELETE
+	 * and #NCDS_CHANGE_MOVE (the changes of the moved entry's content follow
+	 * the move).
+	 */
+	const char *data;
+};
+
 /**
  * \brief Public callbacks for the data store.
  *
@@ -203,6 +248,50 @@ struct ncds_custom_funcs {
  */
 void ncds_custom_set_data(struct ncds_ds* datastore, void *custom_data, const struct ncds_custom_funcs *callbacks);
 
+/**
+ * \brief Set the optional callback getting the content of the config selected
+ * by a subtree filter.
+ *
+ * If not set, the getconfig callback is used and the filter is applied by
+ * libnetconf. The filter passed to the callback contains the serialized
+ * top-level elements of the request's subtree filter that belong to this data
+ * store's namespace (or do not specify any namespace). The returned data must
+ * contain at least all the nodes selected by the filter. If they contain only
+ * the selected nodes, the callback sets exact to non-zero and libnetconf does
+ * not filter them again. The ownership of the returned string is passed onto
+ * the caller.
+ *
+ * Call after ncds_custom_set_data(), but before initializing the data store.
+ * \param datastore Custom datastore to set the callback for.
+ * \param getconfig_filtered The callback, NULL to unset it. Its parameters are
+ * the user data, the datastore to read data from, the serialized subtree filter
+ * elements, the exact flag (preset to 0) and the error to set on failure. It
+ * returns the serialized content of the datastore, NULL on error.
+ */
+void ncds_custom_set_getconfig_filtered(struct ncds_ds* datastore, char *(*getconfig_filtered)(void *data, NC_DATASTORE target, const char *filter, int *exact, struct nc_err **error));
+
+/**
+ * \brief Set the optional callback applying the changes made by the
+ * editconfig operation.
+ *
+ * If set, it is used instead of the editconfig callback. libnetconf gets the
+ * current content by the getconfig callback, performs the editconfig operation
+ * on it including the access control and passes the resulting changes to this
+ * callback. The changes are ordered so they can be applied one by one -
+ * deletions of the nodes precede the creations on the same level and the
+ * entries of the ordered-by user lists are created or moved in their new
+ * order. Nested changes follow the change of their parent and no changes are
+ * passed for the descendants of the created or deleted nodes.
+ *
+ * Call after ncds_custom_set_data(), but before initializing the data store.
+ * \param datastore Custom datastore to set the callback for.
+ * \param editconfig_changes The callback, NULL to unset it. Its parameters are
+ * the user data, the datastore part to modify, the list of the changes, the
+ * number of the changes (never 0) and the error to set on failure. It returns
+ * EXIT_SUCCESS or EXIT_FAILURE.
+ */
+void ncds_custom_set_editconfig_changes(struct ncds_ds* datastore, int (*editconfig_changes)(void *data, NC_DATASTORE target, const struct ncds_change *changes, int count, struct nc_err **error));
+
 /** @}*/
 
 #ifdef __cplusplus
@@ -41,6 +41,7 @@
 
 #include "../../netconf_internal.h"
 #include "../datastore_internal.h"
+#include "datastore_custom.h"
 
 /**
  * @brief Custom datastore implementation-specific ncds_ds structure.
@@ -52,6 +53,14 @@ struct ncds_ds_custom {
 	 */
 	void *data;
 	const struct ncds_custom_funcs *callbacks;
+	/**
+	 * @brief Optional callback set by ncds_custom_set_getconfig_filtered()
+	 */
+	char *(*getconfig_filtered)(void *data, NC_DATASTORE target, const char *filter, int *exact, struct nc_err **error);
+	/**
+	 * @brief Optional callback set by ncds_custom_set_editconfig_changes()
+	 */
+	int (*editconfig_changes)(void *data, NC_DATASTORE target, const struct ncds_change *changes, int count, struct nc_err **error);
 };
 
 /**
@@ -91,6 +100,22 @@ int ncds_custom_rollback(struct ncds_ds* ds);
  */
 char* ncds_custom_getconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error);
 
+/**
+ * @brief Get configuration data selected by a subtree filter from the custom
+ * datastore. Falls back to the getconfig callback if the getconfig_filtered
+ * callback is not set.
+ *
+ * @param[in] ds Custom datastore structure (struct ncds_ds_custom) from which
+ * the data will be obtained.
+ * @param[in] session Session originating the request.
+ * @param[in] source Datastore (running, startup, candidate) to get the data from.
+ * @param[in] filter Serialized subtree filter elements.
+ * @param[out] exact Set to non-zero if the data contain only the selected nodes.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return NULL on error, resulting data on success.
+ */
+char* ncds_custom_getconfig_filtered(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, const char* filter, int* exact, struct nc_err** error);
+
 /**
  * @brief Get lock information about the specified NETCONF datastore
  * @param[in] ds Custom datastore structure that will be checked.
@@ -167,6 +167,84 @@ struct ncds_funcs {
 	 * @return EXIT_SUCCESS or EXIT_FAILURE
 	 */
 	int (*editconfig)(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error);
+	/**
+	 * @brief Wait until the changes made by the calling thread are stored
+	 * persistently. Optional, it is called without the datastore lock, so
+	 * the changes of concurrent threads can be stored together.
+	 *
+	 * @param ds Changed datastore
+	 *
+	 * @return EXIT_SUCCESS or EXIT_FAILURE
+	 */
+	int (*flush)(struct ncds_ds* ds);
+	/**
+	 * @brief Postpone storing of the following changes persistently until
+	 * flush() is called. Optional, it is called by a transaction holding the
+	 * datastore lock to store all its changes at once.
+	 *
+	 * @param ds Datastore to be changed
+	 *
+	 * @return EXIT_SUCCESS or EXIT_FAILURE
+	 */
+	int (*defer)(struct ncds_ds* ds);
+	/**
+	 * @brief Commit the candidate datastore into the running datastore.
+	 * Optional, copyconfig() is used if not set. The implementation can
+	 * apply only the changed parts of the candidate and provide them for
+	 * the TransAPI modules.
+	 *
+	 * @param ds Datastore to commit
+	 * @param session Session requesting the commit
+	 * @param rpc RPC message with the request. RPC message is used only for access control. If rpc is NULL access control is skipped.
+	 * @param old Running configuration before the commit, NULL if not
+	 * required. It may contain only the changed subtrees and their ancestors,
+	 * roots of the subtrees are marked by a non-NULL _private pointer.
+	 * @param new Running configuration after the commit in the same form
+	 * as the old one, NULL if not required.
+	 * @param error Netconf error structure
+	 *
+	 * @return EXIT_SUCCESS or EXIT_FAILURE
+	 */
+	int (*commit)(struct ncds_ds* ds, const struct nc_session* session, const nc_rpc* rpc, xmlDocPtr* old, xmlDocPtr* new, struct nc_err** error);
+	/**
+	 * @brief Get configuration data selected by a subtree filter.
+	 * Optional, getconfig() is used if not set.
+	 *
+	 * @param[in] ds Datastore structure from which the data will be obtained.
+	 * @param[in] session Session originating the request.
+	 * @param[in] target Datastore (running, startup, candidate) to get the data from.
+	 * @param[in] filter Serialized top-level subtree filter elements relevant
+	 * to the datastore.
+	 * @param[out] exact Set to non-zero when the returned data contain only
+	 * the selected nodes and the generic filter need not be applied.
+	 * @param[out] error NETCONF error structure describing the experienced error.
+	 * @return NULL on error, resulting data on success.
+	 */
+	char* (*getconfig_filtered)(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, const char* filter, int* exact, struct nc_err** error);
+	/**
+	 * @brief Get the partial locks (RFC 5717) of the running datastore kept
+	 * in the shared state of the datastore next to its global lock.
+	 * Optional, the partial locks are kept only by the process if not set,
+	 * update_plocks() must be set as well.
+	 *
+	 * @param[in] ds Datastore whose partial locks are read.
+	 * @param[out] locks Serialized partial locks, NULL if there are none.
+	 * @return EXIT_SUCCESS or EXIT_FAILURE
+	 */
+	int (*get_plocks)(struct ncds_ds* ds, char** locks);
+	/**
+	 * @brief Change the partial locks (RFC 5717) of the running datastore
+	 * kept in the shared state of the datastore. The datastore stays locked
+	 * for the whole update, so the changes of several processes do not mix.
+	 *
+	 * @param[in] ds Datastore whose partial locks are changed.
+	 * @param[in] update Callback getting the current serialized partial locks
+	 * (NULL if there are none) and returning the new ones to store, NULL to
+	 * keep the current locks.
+	 * @param[in] arg Argument of the update callback.
+	 * @return EXIT_SUCCESS or EXIT_FAILURE
+	 */
+	int (*update_plocks)(struct ncds_ds* ds, char* (*update)(const char* locks, void* arg), void* arg);
 };
 
 struct model_feature {
@@ -180,6 +258,12 @@ struct model_validators {
 	xmlRelaxNGPtr rng_schema;
 	xsltStylesheetPtr schematron;
 	int (*callback)(const xmlDocPtr, struct nc_err **);
+	/**
+	 * @brief Paths to the RelaxNG and Schematron schemas not yet loaded, in
+	 * the lazy mode they are parsed on the first validation.
+	 */
+	char* rng_path;
+	char* schematron_path;
 };
 #endif
 
@@ -230,10 +314,24 @@ struct data_model {
 	 * @brief The list of enabled features defined in the model
 	 */
 	struct model_feature** features;
+	/**
+	 * @brief The features hashed by their names, see feature_get()
+	 */
+	xmlHashTablePtr features_index;
 	/**
 	 * @brief Link with the appropriate transAPI module, if exists
 	 */
 	struct transapi_internal* transapi;
+	/**
+	 * @brief Flag if the uses statements in groupings and augments were
+	 * already resolved, in the lazy mode it is done on the first use of the
+	 * model (see ncds_set_lazy_consolidation()).
+	 */
+	int resolved;
+	/**
+	 * @brief Lock protecting the (lazy) resolution of the model
+	 */
+	pthread_mutex_t resolve_lock;
 };
 
 /*
@@ -326,9 +424,22 @@ struct ncds_ds {
 	 */
 	time_t last_access;
 	/**
-	 * @brief Lock for serialized access/modification of the datastore.
+	 * @brief Lock for the access/modification of the datastore. Read-only
+	 * operations share the datastore, the modifying ones get it exclusively.
 	 */
-	pthread_mutex_t lock;
+	pthread_rwlock_t lock;
+	/**
+	 * @brief Flag if the read-only operations share the lock, set by
+	 * ncds_set_concurrent_reads(), otherwise they get it exclusively.
+	 */
+	int concurrent_reads;
+	/**
+	 * @brief Flag if the lock is held by a transaction (ncds_txn_begin()) and
+	 * the thread running the transaction. Both are accessed atomically, they
+	 * are read without the lock.
+	 */
+	int txn_held;
+	pthread_t txn_thread;
 	/**
 	 * @brief Pointer to a callback function implementing the retrieval of the
 	 * device status data.
@@ -373,6 +484,11 @@ struct ncds_ds {
 	 */
 	struct clbk *tapi_callbacks;
 	int tapi_callbacks_count;
+	/**
+	 * @brief Serialized partial locks of the running datastore kept by the
+	 * process when the implementation does not share them (func.get_plocks)
+	 */
+	char* plocks;
 };
 
 #endif /* NC_DATASTORE_INTERNAL_H_ */
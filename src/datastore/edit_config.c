@@ -51,6 +51,7 @@
 #include <libxml/xpathInternals.h>
 
 #include "edit_config.h"
+#include "schema.h"
 #include "datastore_internal.h"
 #include "../netconf.h"
 #include "../netconf_internal.h"
@@ -58,8 +59,6 @@
 
 static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 
-#define XPATH_BUFFER 1024
-
 #define NC_EDIT_OP_MERGE_STRING "merge"
 #define NC_EDIT_OP_CREATE_STRING "create"
 #define NC_EDIT_OP_DELETE_STRING "delete"
@@ -83,6 +82,8 @@ typedef enum {
 /* from datastore.c */
 int is_key(xmlNodePtr parent, xmlNodePtr child, keyList keys);
 
+static void nc_clear_namespaces(xmlNodePtr node);
+
 int nc_nscmp(xmlNodePtr reference, xmlNodePtr node)
 {
 	int in_ns = 1;
@@ -198,59 +199,36 @@ keyList get_keynode_list(xmlDocPtr model)
 	return ((keyList)result);
 }
 
-/* get the key nodes from the xml document */
-static int find_key_elems(xmlNodePtr modelnode, xmlNodePtr node, int all, xmlNodePtr **result)
+/* get the key nodes from the xml document according to the compiled list definition */
+static int schema_key_elems(const struct schema_node* snode, xmlNodePtr node, int all, xmlNodePtr **result)
 {
-	xmlChar *str = NULL;
-	char* s, *token;
-	unsigned int i, c;
+	int i, j;
+	xmlNodePtr key;
 
-	/* get the name of the key node(s) from the 'value' attribute in key element in data model */
-	if ((str = xmlGetProp(modelnode, BAD_CAST "value")) == NULL) {
-		return EXIT_FAILURE;
+	*result = NULL;
+	if (snode == NULL || snode->keys_count == 0) {
+		return (EXIT_SUCCESS);
 	}
 
-	/* attribute have the form of space-separated list of key nodes */
-	/* get the number of keys */
-	for (i = 0, c = 1; i < strlen((char*)str); i++) {
-		if (str[i] == ' ') {
-			c++;
-		}
-	}
-	/* allocate sufficient array of pointers to key nodes */
-	*result = (xmlNodePtr*)calloc(c + 1, sizeof(xmlNodePtr));
+	*result = (xmlNodePtr*)calloc(snode->keys_count + 1, sizeof(xmlNodePtr));
 	if (*result == NULL) {
-		xmlFree(str);
 		return (EXIT_FAILURE);
 	}
 
-	/* and now process all key nodes defined in attribute value list */
-	for (i = 0, s = (char*)str; i < c; i++, s = NULL) {
-		token = strtok(s, " ");
-		if (token == NULL) {
-			break;
-		}
-
-		/* get key nodes in original xml tree - all keys are needed */
-		(*result)[i] = node->children;
-		while (((*result)[i] != NULL) && strcmp(token, (char*) ((*result)[i])->name)) {
-			(*result)[i] = ((*result)[i])->next;
-		}
-		if ((*result)[i] == NULL) {
+	for (i = 0, j = 0; i < snode->keys_count; i++) {
+		for (key = node->children; key != NULL && !xmlStrEqual(key->name, snode->keys[i]); key = key->next);
+		if (key == NULL) {
 			if (all) {
-				xmlFree(str);
 				free(*result);
 				*result = NULL;
 				return (EXIT_FAILURE);
-			} else {
-				i--;
 			}
+			continue;
 		}
+		(*result)[j++] = key;
 	}
 
-	xmlFree(str);
-
-	return EXIT_SUCCESS;
+	return (EXIT_SUCCESS);
 }
 
 /**
@@ -265,66 +243,18 @@ static int find_key_elems(xmlNodePtr modelnode, xmlNodePtr node, int all, xmlNod
  */
 static int get_keys(keyList keys, xmlNodePtr node, int all, xmlNodePtr **result)
 {
-	xmlChar *str = NULL;
-	int j, match;
-	xmlNodePtr key_parent, node_parent;
-
 	assert(keys != NULL);
 	assert(node != NULL);
 	assert(result != NULL);
 
 	*result = NULL;
 
-	for (j = 0; j < keys->nodesetval->nodeNr; j++) {
-		/* get corresponding key definition from the data model */
-		// name = xmlGetNsProp (keys->nodesetval->nodeTab[i]->parent, BAD_CAST "name", BAD_CAST NC_NS_YIN);
-		match = 1;
-		key_parent = keys->nodesetval->nodeTab[j]->parent;
-		node_parent = node;
-
-		while (1) {
-			if ((str = xmlGetProp(key_parent, BAD_CAST "name")) == NULL) {
-				match = 0;
-				break;
-			}
-			if (xmlStrcmp(str, node_parent->name)) {
-				xmlFree(str);
-				match = 0;
-				break;
-			}
-			xmlFree(str);
-
-			do {
-				key_parent = key_parent->parent;
-			} while (key_parent && ((xmlStrcmp(key_parent->name, BAD_CAST "augment") == 0)
-                    || (xmlStrcmp(key_parent->name, BAD_CAST "choice") == 0)
-                    || (xmlStrcmp(key_parent->name, BAD_CAST "case") == 0)));
-			node_parent = node_parent->parent;
-
-			if ((!key_parent && node_parent) || (key_parent && !node_parent)) {
-				match = 0;
-				break;
-			}
-
-			if (!xmlStrcmp(key_parent->name, BAD_CAST "module") && (node_parent->type == XML_DOCUMENT_NODE)) {
-				break;
-			}
-		}
-
-		if (!match) {
-			continue;
-		}
-
-		/*
-		 * now we have key values for the appropriate node which was
-		 * specified as function parameter, so there will be no other
-		 * run in this for loop - no continue command is allowed from
-		 * now to the end of the loop
-		 */
-		return find_key_elems(keys->nodesetval->nodeTab[j], node, all, result);
+	if (keys->nodesetval->nodeNr == 0) {
+		/* there is no list in the data model */
+		return (EXIT_SUCCESS);
 	}
 
-	return (EXIT_SUCCESS);
+	return (schema_key_elems(schema_find(schema_get(keys->nodesetval->nodeTab[0]->doc), node), node, all, result));
 }
 
 
@@ -349,56 +279,24 @@ static xmlNodePtr is_partof_choice(xmlNodePtr node)
 }
 
 /**
- * @brief Check if the given node in the YIN data model defines list or leaf-list
+ * @brief Check if the given data node is an instance of list or leaf-list
  * ordered by user. In such a case, specific YANG attributes "insert", "value"
  * and "key" can appear.
  *
- * @param[in] node Model's node to check
+ * @param[in] node Data node to check.
+ * @param[in] model Configuration data model for the document of the given node.
  * @return 1 if the node is user ordered list, </br>
  * 2 if the node is user ordered leaf-list, </br>
  * 0 otherwise
  */
-static int is_user_ordered_list(xmlNodePtr node)
+static int is_user_ordered(xmlNodePtr node, xmlDocPtr model)
 {
-	xmlNodePtr child;
-	xmlChar *prop;
-	int ret = 0;
-
-	if (node == NULL) {
-		return (0);
-	}
+	struct schema_node* snode;
 
-	if (xmlStrcmp(node->name, BAD_CAST "list") == 0) {
-		ret = 1;
-	} else if (xmlStrcmp(node->name, BAD_CAST "leaf-list") == 0) {
-		ret = 2;
-	} else {
+	if ((snode = schema_find(schema_get(model), node)) == NULL || !(snode->flags & SCHEMA_ORDERED_USER)) {
 		return (0);
 	}
-
-	for (child = node->children; child != NULL; child = child->next) {
-		if (child->type != XML_ELEMENT_NODE) {
-			continue;
-		}
-		if (xmlStrcmp(child->name, BAD_CAST "ordered-by") != 0) {
-			continue;
-		}
-
-		prop = xmlGetProp(child, BAD_CAST "value");
-		if (prop != NULL) {
-			if (xmlStrcmp(prop, BAD_CAST "user") == 0) {
-				xmlFree(prop);
-				break; /* for */
-			}
-			xmlFree(prop);
-		}
-	}
-
-	if (child == NULL) {
-		return (0);
-	} else {
-		return (ret);
-	}
+	return (snode->type == SCHEMA_LIST ? 1 : 2);
 }
 
 /**
@@ -526,93 +424,456 @@ int matching_elements(xmlNodePtr node1, xmlNodePtr node2, keyList keys, int leaf
 	return 1;
 }
 
-static xmlNodePtr find_element_model_compare(xmlNodePtr node, xmlNodePtr model_node)
+/**
+ * @brief Find model's equivalent of the node
+ * @param[in] node XML element which we want to find in the model
+ * @param[in] model Configuration data model (YIN format)
+ * @return model's equivalent of the node, NULL if no such element is found.
+ */
+xmlNodePtr find_element_model(xmlNodePtr node, xmlDocPtr model)
 {
-	xmlNodePtr aux, retval;
-	xmlChar* name;
+	struct schema_node* snode;
 
-	if (xmlStrcmp(model_node->name, BAD_CAST "choice") == 0 ||
-	    xmlStrcmp(model_node->name, BAD_CAST "case") == 0 ||
-	    xmlStrcmp(model_node->name, BAD_CAST "augment") == 0) {
-		for (aux = model_node->children; aux != NULL; aux = aux->next) {
-			retval = find_element_model_compare(node, aux);
-			if (retval != NULL) {
-				return (retval);
-			}
+	if (node == NULL || node->parent == NULL) {
+		return (NULL);
+	}
+
+	snode = schema_find(schema_get(model), node);
+	return (snode != NULL ? snode->yin : NULL);
+}
+
+/**
+ * @brief Get the default value of the node if a default value is defined in the model
+ * @param[in] node XML element whose default value we want to get
+ * @param[in] model Configuration data model for the document of the given node.
+ * @return Default value of the node, NULL if no default value is defined or found.
+ */
+static xmlChar* get_default_value(xmlNodePtr node, xmlDocPtr model)
+{
+	struct schema_node* snode;
+
+	snode = schema_find(schema_get(model), node);
+	return ((snode != NULL && snode->dflt != NULL) ? xmlStrdup(snode->dflt) : NULL);
+}
+
+/*
+ * Index of the children of the configuration data nodes touched by a single
+ * edit-config. Children are hashed by their name extended by the key values
+ * in case of list instances and by the value in case of leaf-list items, so
+ * the equivalent of an edit node is found without scanning all its siblings.
+ * The index is attached to the edited document (its _private pointer) for the
+ * time of edit_config() and the table of a parent is built on the first lookup
+ * among its children. Parents whose children cannot be distinguished this way
+ * (duplicates, leaf-list items without a value) are marked to be scanned
+ * linearly as before.
+ *
+ * The table of a parent is kept on the parent node itself (its _private
+ * pointer, the table of the document node is kept by the index), so a node
+ * allocated at the address of a freed one never gets its table. The tables
+ * are owned by the index, when a parent is removed from the configuration
+ * data, its table is only detached from it and the edit operations
+ * referencing it know that the parent is gone.
+ */
+struct equiv_parent {
+	xmlNodePtr node; /* indexed parent, NULL when it was removed */
+	xmlHashTablePtr children;
+	int linear;
+	struct equiv_parent* next;
+};
+
+struct equiv_index {
+	const struct schema* schema;
+	struct equiv_parent* root;    /* table of the document node */
+	struct equiv_parent* parents; /* all the tables */
+};
+
+static struct equiv_index* equiv_index_get(xmlNodePtr node)
+{
+	if (node == NULL || node->doc == NULL) {
+		return (NULL);
+	}
+	return ((struct equiv_index*)(node->doc->_private));
+}
+
+/* get the table of the parent's children if it was already built */
+static struct equiv_parent* equiv_parent_find(struct equiv_index* idx, xmlNodePtr parent)
+{
+	if (parent->type == XML_DOCUMENT_NODE) {
+		return (idx->root);
+	}
+	return ((struct equiv_parent*)(parent->_private));
+}
+
+/* forget the parent's children, they are searched linearly from now on */
+static void equiv_parent_clear(struct equiv_parent* p)
+{
+	if (p->children != NULL) {
+		xmlHashFree(p->children, NULL);
+		p->children = NULL;
+	}
+	p->linear = 1;
+}
+
+/**
+ * \brief Get the key of the element in the index of its parent.
+ *
+ * \param[in] schema Compiled data model.
+ * \param[in] node Element to get the key of.
+ * \param[in] leaf Expected leaf-list flag of the node, -1 to take it from the schema.
+ * \param[out] linear Set to 1 if no key can be assigned to the node and its
+ * siblings have to be searched linearly.
+ * \return Key of the node, NULL if the node is not indexed.
+ */
+static char* equiv_key(const struct schema* schema, xmlNodePtr node, int leaf, int* linear)
+{
+	const struct schema_node* snode;
+	xmlNodePtr key;
+	xmlChar* content;
+	char *value, *aux, *result = NULL;
+	int i;
+
+	*linear = 0;
+	if (node->type != XML_ELEMENT_NODE) {
+		return (NULL);
+	}
+
+	snode = schema_find(schema, node);
+	if (leaf != -1 && leaf != (snode != NULL && snode->type == SCHEMA_LEAFLIST)) {
+		*linear = 1;
+		return (NULL);
+	}
+
+	if (snode != NULL && snode->type == SCHEMA_LEAFLIST) {
+		/* leaf-list items are identified by their value */
+		if (node->children == NULL || node->children->type != XML_TEXT_NODE || node->children->content == NULL) {
+			*linear = 1;
+			return (NULL);
 		}
-	} else {
-		name = xmlGetProp(model_node, BAD_CAST "name");
-		if (name == NULL) {
+		value = nc_clrwspace((char*)(node->children->content));
+		if (value == NULL || asprintf(&result, "%s\x1e%s", (char*)(node->name), value) == -1) {
+			result = NULL;
+		}
+		free(value);
+		return (result);
+	}
+
+	if ((result = strdup((char*)(node->name))) == NULL || snode == NULL || snode->type != SCHEMA_LIST) {
+		return (result);
+	}
+
+	/* list instances are identified by their key values */
+	for (i = 0; i < snode->keys_count; i++) {
+		for (key = node->children; key != NULL && !xmlStrEqual(key->name, snode->keys[i]); key = key->next);
+		if (key == NULL || (content = xmlNodeGetContent(key)) == NULL) {
+			free(result);
 			return (NULL);
 		}
+		value = nc_clrwspace((char*)content);
+		xmlFree(content);
 
-		if (xmlStrcmp(node->name, name) == 0) {
-			xmlFree(name);
-			return (model_node);
+		aux = result;
+		if (value == NULL || asprintf(&result, "%s\x1f%s", aux, value) == -1) {
+			result = NULL;
+		}
+		free(aux);
+		free(value);
+		if (result == NULL) {
+			return (NULL);
 		}
-		xmlFree(name);
 	}
 
+	return (result);
+}
+
+/* stop using the index of the parent, e.g. when the keys of its children change */
+static void equiv_parent_linear(struct equiv_index* idx, xmlNodePtr parent)
+{
+	struct equiv_parent* p;
+
+	if ((p = equiv_parent_find(idx, parent)) != NULL) {
+		equiv_parent_clear(p);
+	}
+}
+
+/* get the index of the parent's children, build it if it does not exist yet */
+static struct equiv_parent* equiv_parent_get(struct equiv_index* idx, xmlNodePtr parent)
+{
+	struct equiv_parent* p;
+	xmlNodePtr child;
+	char* key;
+	int linear;
+
+	if ((p = equiv_parent_find(idx, parent)) != NULL) {
+		return (p);
+	}
+
+	if ((p = calloc(1, sizeof(struct equiv_parent))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	if ((p->children = xmlHashCreate(16)) == NULL) {
+		free(p);
+		return (NULL);
+	}
+	for (child = parent->children; child != NULL && !p->linear; child = child->next) {
+		if ((key = equiv_key(idx->schema, child, -1, &linear)) != NULL) {
+			if (xmlHashAddEntry(p->children, BAD_CAST key, child) != 0) {
+				/* the children are not unique */
+				linear = 1;
+			}
+			free(key);
+		}
+		p->linear = linear;
+	}
+	if (p->linear) {
+		equiv_parent_clear(p);
+	}
+
+	p->node = parent;
+	p->next = idx->parents;
+	idx->parents = p;
+	if (parent->type == XML_DOCUMENT_NODE) {
+		idx->root = p;
+	} else {
+		parent->_private = p;
+	}
+	return (p);
+}
+
+/**
+ * \brief Search for the parent's child with the given key (see equiv_key()) in the index.
+ *
+ * \param[out] node Found child, NULL if there is no such child.
+ * \return 0 if the index was used, 1 if the children must be searched linearly.
+ */
+static int equiv_lookup_key(xmlNodePtr parent, const char* key, xmlNodePtr* node)
+{
+	struct equiv_index* idx;
+	struct equiv_parent* p;
+
+	if ((idx = equiv_index_get(parent)) == NULL || (p = equiv_parent_get(idx, parent)) == NULL || p->linear) {
+		return (1);
+	}
+
+	*node = xmlHashLookup(p->children, BAD_CAST key);
+	return (0);
+}
+
+/**
+ * \brief Search for the parent's child matching the edit node in the index.
+ *
+ * \param[out] node Found child, NULL if there is no such child.
+ * \return 0 if the index was used, 1 if the children must be searched linearly.
+ */
+static int equiv_lookup(xmlNodePtr parent, xmlNodePtr edit, keyList keys, int leaf, xmlNodePtr* node)
+{
+	struct equiv_index* idx;
+	char* key;
+	int linear, ret;
+
+	if ((idx = equiv_index_get(parent)) == NULL || (!leaf && keys == NULL)) {
+		return (1);
+	}
+	if ((key = equiv_key(idx->schema, edit, leaf, &linear)) == NULL) {
+		return (1);
+	}
+	ret = equiv_lookup_key(parent, key, node);
+	free(key);
+	return (ret);
+}
+
+/**
+ * \brief Find the child of orig_parent matching the edit node.
+ */
+static xmlNodePtr equiv_child(xmlNodePtr orig_parent, xmlNodePtr edit, keyList keys, int leaf)
+{
+	xmlNodePtr node;
+
+	if (equiv_lookup(orig_parent, edit, keys, leaf, &node) == 0 &&
+			(node == NULL || matching_elements(edit, node, keys, leaf) != 0)) {
+		return (node);
+	}
+
+	for (node = orig_parent->children; node != NULL; node = node->next) {
+		if (matching_elements(edit, node, keys, leaf) != 0) {
+			return (node);
+		}
+	}
 	return (NULL);
 }
 
+/* only a single child of the parent can match an edit node */
+static int equiv_unique(xmlNodePtr parent)
+{
+	struct equiv_index* idx;
+	struct equiv_parent* p;
+
+	if ((idx = equiv_index_get(parent)) == NULL) {
+		return (0);
+	}
+	return ((p = equiv_parent_find(idx, parent)) != NULL && !p->linear);
+}
+
+/* if the node is a key of a list instance, the instance's key changes */
+static void equiv_key_change(struct equiv_index* idx, xmlNodePtr node)
+{
+	const struct schema_node* snode;
+	int i;
+
+	if (node->parent == NULL || node->parent->type != XML_ELEMENT_NODE || node->parent->parent == NULL) {
+		return;
+	}
+	if ((snode = schema_find(idx->schema, node->parent)) == NULL || snode->type != SCHEMA_LIST) {
+		return;
+	}
+	for (i = 0; i < snode->keys_count; i++) {
+		if (xmlStrEqual(node->name, snode->keys[i])) {
+			equiv_parent_linear(idx, node->parent->parent);
+			return;
+		}
+	}
+}
+
 /**
- * @brief Go recursively in the YIN model and find model's equivalent of the node
- * @param[in] node XML element which we want to find in the model
- * @param[in] model Configuration data model (YIN format)
- * @return model's equivalent of the node, NULL if no such element is found.
+ * \brief Add the element just inserted into the configuration data into the
+ * index of its parent.
  */
-xmlNodePtr find_element_model(xmlNodePtr node, xmlDocPtr model)
+static void equiv_link(xmlNodePtr node)
 {
-	xmlNodePtr mparent, aux, retval;
+	struct equiv_index* idx;
+	struct equiv_parent* p;
+	char* key;
+	int linear;
 
-	if (node == NULL || node->parent == NULL) {
-		return (NULL);
+	if (node == NULL || node->type != XML_ELEMENT_NODE || node->parent == NULL || (idx = equiv_index_get(node)) == NULL) {
+		return;
 	}
 
-	if (node->parent->type != XML_DOCUMENT_NODE) {
-		mparent = find_element_model(node->parent, model);
-	} else {
-		mparent = xmlDocGetRootElement(model);
+	equiv_key_change(idx, node);
+	if (node->parent->type == XML_DOCUMENT_NODE) {
+		/* setting a root element may replace the previous one */
+		equiv_parent_linear(idx, node->parent);
+		return;
 	}
-	if (mparent == NULL) {
-		return (NULL);
+
+	if ((p = equiv_parent_find(idx, node->parent)) == NULL || p->linear) {
+		return;
 	}
+	key = equiv_key(idx->schema, node, -1, &linear);
+	if (linear || (key != NULL && xmlHashAddEntry(p->children, BAD_CAST key, node) != 0)) {
+		equiv_parent_linear(idx, node->parent);
+	}
+	free(key);
+}
 
-	for (aux = mparent->children; aux != NULL; aux = aux->next) {
-		retval = find_element_model_compare(node, aux);
-		if (retval != NULL) {
-			return (retval);
+/* detach the tables of the subtree's nodes, the nodes are going to be removed */
+static void equiv_drop(xmlNodePtr node)
+{
+	struct equiv_parent* p;
+	xmlNodePtr child;
+
+	for (child = node->children; child != NULL; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE) {
+			equiv_drop(child);
 		}
 	}
+	if ((p = (struct equiv_parent*)(node->_private)) != NULL) {
+		equiv_parent_clear(p);
+		p->node = NULL;
+		node->_private = NULL;
+	}
+}
 
-	return (NULL);
+/**
+ * \brief Remove the element from the index before it is unlinked from the
+ * configuration data.
+ */
+static void equiv_unlink(xmlNodePtr node)
+{
+	struct equiv_index* idx;
+	struct equiv_parent* p;
+	char* key;
+	int linear;
+
+	if (node == NULL || node->type != XML_ELEMENT_NODE || (idx = equiv_index_get(node)) == NULL) {
+		return;
+	}
+
+	equiv_drop(node);
+	if (node->parent == NULL) {
+		return;
+	}
+	equiv_key_change(idx, node);
+
+	if ((p = equiv_parent_find(idx, node->parent)) == NULL || p->linear) {
+		return;
+	}
+	if ((key = equiv_key(idx->schema, node, -1, &linear)) != NULL) {
+		if (xmlHashLookup(p->children, BAD_CAST key) == node) {
+			xmlHashRemoveEntry(p->children, BAD_CAST key, NULL);
+		} else {
+			/* the key has changed since the node was indexed */
+			equiv_parent_linear(idx, node->parent);
+		}
+		free(key);
+	}
 }
 
 /**
- * @brief Get the default value of the node if a default value is defined in the model
- * @param[in] node XML element whose default value we want to get
- * @param[in] model Configuration data model for the document of the given node.
- * @return Default value of the node, NULL if no default value is defined or found.
+ * \brief Attach the index of the equivalent nodes to the configuration data
+ * document. Nothing is done if the data model is not compiled.
+ *
+ * \return 1 if the index was attached, 0 otherwise.
  */
-static xmlChar* get_default_value(xmlNodePtr node, xmlDocPtr model)
+static int equiv_index_new(xmlDocPtr doc, xmlDocPtr model)
 {
-	xmlNodePtr mnode, aux;
-	xmlChar* value = NULL;
+	struct equiv_index* idx;
 
-	mnode = find_element_model(node, model);
-	if (mnode == NULL) {
-		return (NULL);
+	if (doc->_private != NULL || schema_get(model) == NULL) {
+		return (0);
+	}
+	if ((idx = malloc(sizeof(struct equiv_index))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (0);
 	}
+	idx->schema = schema_get(model);
+	idx->root = NULL;
+	idx->parents = NULL;
+	doc->_private = idx;
+	return (1);
+}
 
-	for (aux = mnode->children; aux != NULL; aux = aux->next) {
-		if (xmlStrcmp(aux->name, BAD_CAST "default") == 0) {
-			value = xmlGetNsProp(aux, BAD_CAST "value", BAD_CAST NC_NS_YIN);
-			break;
+static void equiv_index_free(xmlDocPtr doc)
+{
+	struct equiv_index* idx = (struct equiv_index*)(doc->_private);
+	struct equiv_parent* p;
+
+	while ((p = idx->parents) != NULL) {
+		idx->parents = p->next;
+		if (p->node != NULL && p->node->type != XML_DOCUMENT_NODE) {
+			p->node->_private = NULL;
 		}
+		equiv_parent_clear(p);
+		free(p);
 	}
+	free(idx);
+	doc->_private = NULL;
+}
+
+/**
+ * \brief Find the child of orig_parent equivalent to the edit node.
+ */
+static xmlNodePtr equiv_resolve(xmlNodePtr orig_parent, xmlNodePtr edit, xmlDocPtr model, keyList keys)
+{
+	struct schema_node* snode;
+	int leaf;
 
-	return (value);
+	/* leaf-list items are matched also by their text content */
+	snode = schema_find(schema_get(model), edit);
+	leaf = (snode != NULL && snode->type == SCHEMA_LEAFLIST);
+
+	/* element check */
+	return (equiv_child(orig_parent, edit, keys, leaf));
 }
 
 /**
@@ -626,8 +887,7 @@ static xmlChar* get_default_value(xmlNodePtr node, xmlDocPtr model)
  */
 xmlNodePtr find_element_equiv(xmlDocPtr orig_doc, xmlNodePtr edit, xmlDocPtr model, keyList keys)
 {
-	xmlNodePtr orig_parent, node, model_def;
-	int leaf = 0;
+	xmlNodePtr orig_parent;
 
 	if (edit == NULL || orig_doc == NULL) {
 		return (NULL);
@@ -647,164 +907,231 @@ xmlNodePtr find_element_equiv(xmlDocPtr orig_doc, xmlNodePtr edit, xmlDocPtr mod
 		return (NULL);
 	}
 
-	model_def = find_element_model(edit, model);
-	if (model_def != NULL && xmlStrcmp(model_def->name, BAD_CAST "leaf-list") == 0) {
-		/* check also children text element when checking elements matching */
-		leaf = 1;
-	}
-
-	/* element check */
-	node = orig_parent->children;
-	while (node != NULL) {
-		/* compare edit and node */
-		if (matching_elements(edit, node, keys, leaf) == 0) {
-			/* non matching nodes */
-			node = node->next;
-			continue;
-		} else {
-			/* matching nodes found */
-			return (node);
-		}
-	}
-
-	/* no corresponding node found */
-	return (NULL);
+	return (equiv_resolve(orig_parent, edit, model, keys));
 }
 
 /**
- * \brief Get the list of elements with the specified selected edit-config's operation.
+ * \brief Find an equivalent of the given edit node on orig_doc document, start
+ * with the already known equivalent of its parent.
  *
- * \param[in] op edit-config's operation type to search for.
- * \param[in] edit XML document covering edit-config's \<config\> element. The
- *                 elements with specified operation will be searched for in
- *                 this document.
+ * \param[in] orig_parent Equivalent of the edit node's parent, NULL if it is
+ * not known and it must be searched from the root.
  */
-static xmlXPathObjectPtr get_operation_elements(NC_EDIT_OP_TYPE op, xmlDocPtr edit)
+static xmlNodePtr find_element_equiv_in(xmlDocPtr orig_doc, xmlNodePtr orig_parent, xmlNodePtr edit, xmlDocPtr model, keyList keys)
 {
-	xmlXPathContextPtr edit_ctxt = NULL;
-	xmlXPathObjectPtr operation_nodes = NULL;
-	xmlChar xpath[XPATH_BUFFER];
-	char *opstring;
+	if (orig_parent == NULL) {
+		return (find_element_equiv(orig_doc, edit, model, keys));
+	}
+	return (equiv_resolve(orig_parent, edit, model, keys));
+}
 
-	assert(edit != NULL);
+/*
+ * Edit node with explicitly specified edit-config's operation. The nodes are
+ * collected by edit_ops_walk() in the document order and all the following
+ * stages work with this list instead of searching the edit document again.
+ */
+struct edit_op {
+	xmlNodePtr node;
+	NC_EDIT_OP_TYPE op;
+	int supreme;   /* index of the closest ancestor with an operation, -1 if none */
+	int redundant; /* the same operation as the supreme one, performed with it */
+	int done;      /* the node was performed or removed from the edit document */
+	struct equiv_parent* parent; /* index of the parent's equivalent found by edit_ops_walk(), NULL if none */
+};
 
-	switch (op) {
-	case NC_EDIT_OP_MERGE:
-		opstring = NC_EDIT_OP_MERGE_STRING;
-		break;
-	case NC_EDIT_OP_REPLACE:
-		opstring = NC_EDIT_OP_REPLACE_STRING;
-		break;
-	case NC_EDIT_OP_CREATE:
-		opstring = NC_EDIT_OP_CREATE_STRING;
-		break;
-	case NC_EDIT_OP_DELETE:
-		opstring = NC_EDIT_OP_DELETE_STRING;
-		break;
-	case NC_EDIT_OP_REMOVE:
-		opstring = NC_EDIT_OP_REMOVE_STRING;
-		break;
-	default:
-		ERROR("Unsupported edit operation %d (%s:%d).", op, __FILE__, __LINE__);
-		return (NULL);
-	}
+struct edit_ops {
+	struct edit_op* list;
+	int count;
+	int size;
+};
 
-	/* create xpath evaluation context */
-	edit_ctxt = xmlXPathNewContext(edit);
-	if (edit_ctxt == NULL) {
-		ERROR("Creating the XPath evaluation context failed (%s:%d).", __FILE__, __LINE__);
-		return (NULL);
-	}
+static void edit_ops_free(struct edit_ops* ops)
+{
+	free(ops->list);
+	ops->list = NULL;
+	ops->count = ops->size = 0;
+}
 
-	if (xmlXPathRegisterNs(edit_ctxt, BAD_CAST NC_NS_BASE_ID, BAD_CAST NC_NS_BASE) != 0) {
-		xmlXPathFreeContext(edit_ctxt);
-		ERROR("Registering a namespace for XPath failed (%s:%d).", __FILE__, __LINE__);
-		return (NULL);
+/**
+ * \brief Check that the node with the operation from the list is still in
+ * the edit document - neither it nor any of its ancestors with an operation
+ * was already performed.
+ */
+static int edit_op_alive(const struct edit_ops* ops, int i)
+{
+	for (; i != -1; i = ops->list[i].supreme) {
+		if (ops->list[i].done) {
+			return (0);
+		}
 	}
+	return (1);
+}
 
-	if (snprintf((char*)xpath, XPATH_BUFFER, "//*[@%s:operation='%s']", NC_NS_BASE_ID, opstring) <= 0) {
-		xmlXPathFreeContext(edit_ctxt);
-		ERROR("Preparing the XPath query failed (%s:%d).", __FILE__, __LINE__);
-		return (NULL);
+/**
+ * \brief Get the index of the next node from the list to perform the operation
+ * op on, starting with the index i.
+ *
+ * \return Index of the node, -1 if there is no other such node.
+ */
+static int edit_op_next(const struct edit_ops* ops, int i, NC_EDIT_OP_TYPE op)
+{
+	for (; i < ops->count; i++) {
+		if (ops->list[i].op == op && !ops->list[i].redundant && edit_op_alive(ops, i)) {
+			return (i);
+		}
 	}
-	operation_nodes = xmlXPathEvalExpression(BAD_CAST xpath, edit_ctxt);
-
-	/* clean up */
-	xmlXPathFreeContext(edit_ctxt);
+	return (-1);
+}
 
-	return (operation_nodes);
+/**
+ * \brief Get the equivalent of the operation node's parent found by
+ * edit_ops_walk(), NULL if it was not found or it was removed since then.
+ */
+static xmlNodePtr edit_op_parent(const struct edit_op* op)
+{
+	return ((op->parent != NULL) ? op->parent->node : NULL);
 }
 
 /**
- * \brief Check edit-config's node operations hierarchy.
+ * \brief Walk the edit-config's \<config\> subtree, collect the nodes with an
+ * operation and check the operations hierarchy.
  *
  * In case of the removal ("remove" and "delete") operations, the supreme operation
- * (including the default operation) cannot be the creation ("create or "replace")
- * operation.
+ * (including the default operation "replace") cannot be the creation ("create"
+ * or "replace") operation. In case of the creation operations, the supreme
+ * operation cannot be a removal operation.
+ *
+ * Operations duplicating the supreme operation (including the default
+ * operation) are removed from the edit document, they are performed as part
+ * of the supreme operation.
  *
- * In case of the creation operations, the supreme operation cannot be a removal
- * operation.
+ * The equivalents of the edit nodes in the indexed configuration data are
+ * resolved top-down during the walk, each operation node keeps the equivalent
+ * of its parent, so it is not searched from the root again.
  *
- * \param[in] edit XML node from edit-config's \<config\> whose hierarchy
- *                 (supreme operations) will be checked.
+ * \param[in,out] ops List of the nodes with an operation to extend.
+ * \param[in] node Element to walk.
+ * \param[in] orig_parent Equivalent of the node's parent in the indexed
+ * configuration data, NULL if there is none or the data are not indexed.
+ * \param[in] supreme_op Operation applied to the node's parent.
+ * \param[in] supreme Index of the closest ancestor in ops, -1 if none.
+ * \param[in] creating Some ancestor has a creation operation.
+ * \param[in] removing Some ancestor has a removal operation.
  * \param[in] defop Default edit-config's operation for this edit-config call.
- * \param[out] err NETCONF error structure.
- * \return On error, non-zero is returned and err structure is filled. Zero is
+ * \param[in] model Configuration data model.
+ * \param[in] keys List of the key elements from the configuration data model.
+ * \param[out] error NETCONF error structure.
+ * \return On error, non-zero is returned and error structure is filled. Zero is
  * returned on success.
  */
-static int check_edit_ops_hierarchy(xmlNodePtr edit, NC_EDIT_DEFOP_TYPE defop, struct nc_err **error)
+static int edit_ops_walk(struct edit_ops* ops, xmlNodePtr node, xmlNodePtr orig_parent, NC_EDIT_OP_TYPE supreme_op, int supreme,
+		int creating, int removing, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, struct nc_err** error)
 {
-	xmlNodePtr parent;
-	NC_EDIT_OP_TYPE op, parent_op;
+	struct equiv_index* idx;
+	struct edit_op* aux;
+	xmlNodePtr child, orig_node = NULL;
+	NC_EDIT_OP_TYPE op;
 
-	assert(error != NULL);
+	if (orig_parent != NULL && (idx = equiv_index_get(orig_parent)) != NULL) {
+		orig_node = equiv_resolve(orig_parent, node, model, keys);
+	} else {
+		idx = NULL;
+	}
 
-	op = get_operation(edit, NC_EDIT_DEFOP_NOTSET, error);
-	if (op == (NC_EDIT_OP_TYPE)NC_EDIT_DEFOP_NOTSET) {
-		/* no operation defined for this node */
-		return EXIT_SUCCESS;
-	} else if (op == NC_EDIT_OP_ERROR) {
-		return EXIT_FAILURE;
-	} else if (op == NC_EDIT_OP_DELETE || op == NC_EDIT_OP_REMOVE) {
-		if (defop == NC_EDIT_DEFOP_REPLACE) {
+	op = get_operation(node, NC_EDIT_DEFOP_NOTSET, error);
+	if (op == NC_EDIT_OP_ERROR) {
+		return (EXIT_FAILURE);
+	} else if (op != NC_EDIT_OP_NOTSET) {
+		/* check the hierarchy */
+		if (((op == NC_EDIT_OP_DELETE || op == NC_EDIT_OP_REMOVE) && (defop == NC_EDIT_DEFOP_REPLACE || creating)) ||
+				((op == NC_EDIT_OP_CREATE || op == NC_EDIT_OP_REPLACE) && removing)) {
 			if (error != NULL) {
 				*error = nc_err_new(NC_ERR_OP_FAILED);
 			}
-			return EXIT_FAILURE;
+			return (EXIT_FAILURE);
 		}
 
-		/* check parent elements for operation compatibility */
-		parent = edit->parent;
-		while (parent->type != XML_DOCUMENT_NODE) {
-			parent_op = get_operation(parent, NC_EDIT_DEFOP_NOTSET, error);
-			if (parent_op == NC_EDIT_OP_ERROR) {
-				return EXIT_FAILURE;
-			} else if (parent_op == NC_EDIT_OP_CREATE || parent_op == NC_EDIT_OP_REPLACE) {
+		if (ops->count == ops->size) {
+			ops->size = (ops->size == 0) ? 16 : ops->size * 2;
+			if ((aux = realloc(ops->list, ops->size * sizeof(struct edit_op))) == NULL) {
+				ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
 				if (error != NULL) {
 					*error = nc_err_new(NC_ERR_OP_FAILED);
 				}
-				return EXIT_FAILURE;
+				return (EXIT_FAILURE);
 			}
-			parent = parent->parent;
+			ops->list = aux;
 		}
-	} else if (op == NC_EDIT_OP_CREATE || op == NC_EDIT_OP_REPLACE) {
-		/* check parent elements for operation compatibility */
-		parent = edit->parent;
-		while (parent->type != XML_DOCUMENT_NODE) {
-			parent_op = get_operation(parent, NC_EDIT_DEFOP_NOTSET, error);
-			if (parent_op == NC_EDIT_OP_ERROR) {
-				return EXIT_FAILURE;
-			} else if (parent_op == NC_EDIT_OP_DELETE || parent_op == NC_EDIT_OP_REMOVE) {
-				if (error != NULL) {
-					*error = nc_err_new(NC_ERR_OP_FAILED);
-				}
-				return EXIT_FAILURE;
-			}
-			parent = parent->parent;
+		aux = &ops->list[ops->count];
+		aux->node = node;
+		aux->op = op;
+		aux->supreme = supreme;
+		aux->redundant = (op == supreme_op);
+		aux->done = 0;
+		aux->parent = (idx != NULL) ? equiv_parent_get(idx, orig_parent) : NULL;
+		supreme = ops->count++;
+
+		if (aux->redundant) {
+			/* operation duplicity -> remove subordinate duplicated operation */
+			xmlRemoveProp(xmlHasNsProp(node, BAD_CAST NC_EDIT_ATTR_OP, BAD_CAST NC_NS_BASE));
+			nc_clear_namespaces(node);
 		}
+
+		supreme_op = op;
+		creating |= (op == NC_EDIT_OP_CREATE || op == NC_EDIT_OP_REPLACE);
+		removing |= (op == NC_EDIT_OP_DELETE || op == NC_EDIT_OP_REMOVE);
 	}
 
-	return EXIT_SUCCESS;
+	for (child = node->children; child != NULL; child = child->next) {
+		if (child->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (edit_ops_walk(ops, child, orig_node, supreme_op, supreme, creating, removing, defop, model, keys, error) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * \brief Collect the nodes with an operation from the whole edit document in a
+ * single pass, see edit_ops_walk().
+ */
+static int edit_ops_collect(struct edit_ops* ops, xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, struct nc_err** error)
+{
+	xmlNodePtr root;
+	NC_EDIT_OP_TYPE op;
+
+	/* use defop as root's supreme operation */
+	switch (defop) {
+	case NC_EDIT_DEFOP_NOTSET:
+	case NC_EDIT_DEFOP_MERGE:
+		op = NC_EDIT_OP_MERGE;
+		break;
+	case NC_EDIT_DEFOP_REPLACE:
+		op = NC_EDIT_OP_REPLACE;
+		break;
+	case NC_EDIT_DEFOP_NONE:
+		op = NC_EDIT_OP_NOTSET;
+		break;
+	default:
+		if (error != NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+		}
+		return (EXIT_FAILURE);
+	}
+
+	for (root = edit_doc->children; root != NULL; root = root->next) {
+		if (root->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (edit_ops_walk(ops, root, (xmlNodePtr)orig_doc, op, -1, 0, 0, defop, model, keys, error) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+	}
+
+	return (EXIT_SUCCESS);
 }
 
 /**
@@ -816,67 +1143,38 @@ static int check_edit_ops_hierarchy(xmlNodePtr edit, NC_EDIT_DEFOP_TYPE defop, s
  * In case of the "delete" operation, if the configuration data does not exist, the
  * "data-missing" error is generated.
  *
- * Operation hierarchy check check_edit_ops_hierarchy() is also applied.
+ * The operations hierarchy was already checked by edit_ops_walk().
  *
  * \param[in] op Operation type to check (only the "delete" and "create" operation
  * types are valid).
- * \param[in] defop Default edit-config's operation for this edit-config call.
  * \param[in] orig Original configuration document to edit.
- * \param[in] edit XML document covering edit-config's \<config\> element
- * supposed to edit the orig configuration data.
+ * \param[in,out] ops List of the edit nodes with an operation.
  * \param[in] model XML form (YIN) of the configuration data model appropriate
  * to the given repo.
+ * \param[in] keys List of the key elements from the configuration data model.
  * \param[out] err NETCONF error structure.
  * \return On error, non-zero is returned and an err structure is filled. Zero is
  * returned on success.
  */
-static int check_edit_ops(NC_CHECK_EDIT_OP op, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr orig, xmlDocPtr edit, xmlDocPtr model, struct nc_err **error)
+static int check_edit_ops(NC_CHECK_EDIT_OP op, xmlDocPtr orig, struct edit_ops* ops, xmlDocPtr model, keyList keys, struct nc_err **error)
 {
-	xmlXPathObjectPtr operation_nodes = NULL;
 	xmlNodePtr node_to_process = NULL, n;
-	keyList keys;
 	xmlChar *defval = NULL, *value = NULL;
 	int i;
 
 	assert(orig != NULL);
-	assert(edit != NULL);
+	assert(ops != NULL);
 	assert(error != NULL);
 
-	keys = get_keynode_list(model);
-
-	operation_nodes = get_operation_elements((NC_EDIT_OP_TYPE)op, edit);
-	if (operation_nodes == NULL) {
-		if (error != NULL) {
-			*error = nc_err_new(NC_ERR_OP_FAILED);
-		}
-		if (keys != NULL) {
-			keyListFree(keys);
-		}
-		return EXIT_FAILURE;
-	}
-
-	if (xmlXPathNodeSetIsEmpty(operation_nodes->nodesetval)) {
-		xmlXPathFreeObject(operation_nodes);
-		if (keys != NULL) {
-			keyListFree(keys);
-		}
-		return EXIT_SUCCESS;
-	}
-
 	*error = NULL;
-	for (i = 0; i < operation_nodes->nodesetval->nodeNr; i++) {
-		node_to_process = operation_nodes->nodesetval->nodeTab[i];
-
-		if (check_edit_ops_hierarchy(node_to_process, defop, error) != EXIT_SUCCESS) {
-			xmlXPathFreeObject(operation_nodes);
-			if (keys != NULL) {
-				keyListFree(keys);
-			}
-			return EXIT_FAILURE;
+	for (i = 0; i < ops->count; i++) {
+		if (ops->list[i].op != (NC_EDIT_OP_TYPE)op || !edit_op_alive(ops, i)) {
+			continue;
 		}
+		node_to_process = ops->list[i].node;
 
 		/* \todo namespace handlings */
-		n = find_element_equiv(orig, node_to_process, model, keys);
+		n = find_element_equiv_in(orig, edit_op_parent(&ops->list[i]), node_to_process, model, keys);
 		if (op == NC_CHECK_EDIT_DELETE && n == NULL) {
 			if (ncdflt_get_basic_mode() == NCWD_MODE_ALL) {
 				/* A valid 'delete' operation attribute for a
@@ -913,6 +1211,7 @@ static int check_edit_ops(NC_CHECK_EDIT_OP op, NC_EDIT_DEFOP_TYPE defop, xmlDocP
 					 */
 					xmlUnlinkNode(node_to_process);
 					xmlFreeNode(node_to_process);
+					ops->list[i].done = 1;
 				}
 				xmlFree(defval);
 				defval = NULL;
@@ -956,6 +1255,7 @@ static int check_edit_ops(NC_CHECK_EDIT_OP op, NC_EDIT_DEFOP_TYPE defop, xmlDocP
 					 * allow recreate it by the new one with
 					 * the default value
 					 */
+					equiv_unlink(n);
 					xmlUnlinkNode(n);
 					xmlFreeNode(n);
 				}
@@ -972,16 +1272,12 @@ static int check_edit_ops(NC_CHECK_EDIT_OP op, NC_EDIT_DEFOP_TYPE defop, xmlDocP
 			}
 		}
 	}
-	xmlXPathFreeObject(operation_nodes);
 	if (defval != NULL) {
 		xmlFree(defval);
 	}
 	if (value != NULL) {
 		xmlFree(value);
 	}
-	if (keys != NULL) {
-		keyListFree(keys);
-	}
 
 	if (*error != NULL) {
 		return (EXIT_FAILURE);
@@ -1002,6 +1298,7 @@ static int edit_delete(xmlNodePtr node)
 
 	VERB("Deleting the node %s (%s:%d)", (char*)node->name, __FILE__, __LINE__);
 	if (node != NULL) {
+		equiv_unlink(node);
 		xmlUnlinkNode(node);
 		xmlFreeNode(node);
 	}
@@ -1013,19 +1310,20 @@ static int edit_delete(xmlNodePtr node)
  * \brief Perform edit-config's "remove" operation on the selected node.
  *
  * \param[in] orig_doc Original configuration document to edit.
+ * \param[in] orig_parent Equivalent of the edit node's parent, NULL if not known.
  * \param[in] edit_node Node from the edit-config's \<config\> element with
  * the specified "remove" operation.
  * \param[in] keys  List of the key elements from the configuration data model.
  *
  * \return Zero on success, non-zero otherwise.
  */
-static int edit_remove(xmlDocPtr orig_doc, xmlNodePtr edit_node, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
+static int edit_remove(xmlDocPtr orig_doc, xmlNodePtr orig_parent, xmlNodePtr edit_node, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	xmlNodePtr old;
 	char *msg = NULL;
 	int ret;
 
-	old = find_element_equiv(orig_doc, edit_node, model, keys);
+	old = find_element_equiv_in(orig_doc, orig_parent, edit_node, model, keys);
 
 	if (old == NULL) {
 		ret = EXIT_SUCCESS;
@@ -1037,7 +1335,7 @@ static int edit_remove(xmlDocPtr orig_doc, xmlNodePtr edit_node, xmlDocPtr model
 			edit_delete(old);
 
 			/* in case of list, it can be possible to apply the node repeatedly */
-			while ((old = find_element_equiv(orig_doc, edit_node, model, keys)) != NULL) {
+			while ((old = find_element_equiv_in(orig_doc, orig_parent, edit_node, model, keys)) != NULL) {
 				edit_delete(old);
 			}
 
@@ -1148,20 +1446,138 @@ static int parse_instance_predicate(const char* predicate, char **prefix, char *
 				free(*prefix);
 				*prefix = NULL;
 			}
-			return(-1);
+			return(-1);
+		}
+		j++;
+		i = j;
+		while (e[i] != '"' && e[i] != '\'') {
+			i++;
+		}
+		e[i] = 0;
+		if (value != NULL) {
+			*value = strdup(&(e[j]));
+		}
+		free(p);
+		return (0);
+	}
+}
+
+/* check that the node is an instance of the same list as the edit node */
+static int ref_list_instance(xmlNodePtr node, xmlNodePtr edit_node)
+{
+	if (node->type != XML_ELEMENT_NODE) {
+		return (0);
+	}
+	if (node->ns == NULL || xmlStrcmp(node->ns->href, edit_node->ns->href) != 0) {
+		return (0);
+	}
+	return (xmlStrcmp(node->name, edit_node->name) == 0);
+}
+
+/**
+ * \brief Check that the list instance is referenced by the key predicates
+ * from the edit node's "key" attribute.
+ *
+ * \return 1 if the node matches, 0 if it does not, -1 on error.
+ */
+static int ref_list_match(xmlNodePtr node, xmlNodePtr edit_node, struct key_predicate** keys, struct nc_err **error)
+{
+	xmlNodePtr keynode = NULL;
+	char* s;
+	int i;
+
+	if (!ref_list_instance(node, edit_node)) {
+		return (0);
+	}
+
+	/* check key elements of this node */
+	for (i = 0; keys[i] != NULL; i++) {
+		if (keys[i]->position != 0) {
+			/* this should not happen */
+			if (error != NULL) {
+				*error = nc_err_new(NC_ERR_BAD_ATTR);
+				nc_err_set(*error, NC_ERR_PARAM_INFO_BADATTR, "key");
+				nc_err_set(*error, NC_ERR_PARAM_MSG, "Invalid mixing of the \"key\" attribute content to insert list item");
+			}
+			return (-1);
+		}
+		for (keynode = node->children; keynode != NULL; keynode = keynode->next) {
+			if (keynode->ns == NULL || keynode->ns->href == NULL) {
+				continue;
+			}
+
+			if (xmlStrcmp(keynode->ns->href, BAD_CAST (keys[i]->href)) != 0) {
+				continue;
+			}
+
+			if (xmlStrcmp(keynode->name, BAD_CAST(keys[i]->name)) != 0) {
+				continue;
+			}
+
+			if (keynode->children == NULL || keynode->children->type != XML_TEXT_NODE) {
+				continue;
+			}
+
+			s = nc_clrwspace((char*)(keynode->children->content));
+			if (s == NULL || strcmp(s, keys[i]->value) != 0) {
+				free(s);
+				continue;
+			}
+			free(s);
+
+			/* we have the match */
+			break;
 		}
-		j++;
-		i = j;
-		while (e[i] != '"' && e[i] != '\'') {
-			i++;
+		if (keynode == NULL) {
+			/* key not found */
+			return (0);
 		}
-		e[i] = 0;
-		if (value != NULL) {
-			*value = strdup(&(e[j]));
+	}
+
+	return (keynode != NULL);
+}
+
+/**
+ * \brief Get the key of the list instance referenced by the key predicates
+ * in the index of the parent's children, see equiv_key().
+ *
+ * \return Key of the referenced instance, NULL if the parent is not indexed or
+ * the predicates do not specify exactly all the list keys.
+ */
+static char* ref_list_key(xmlNodePtr parent, xmlNodePtr edit_node, struct key_predicate** keys)
+{
+	struct equiv_index* idx;
+	const struct schema_node* snode;
+	char *key, *aux;
+	int i, j;
+
+	if ((idx = equiv_index_get(parent)) == NULL ||
+			(snode = schema_find(idx->schema, edit_node)) == NULL || snode->type != SCHEMA_LIST) {
+		return (NULL);
+	}
+	for (j = 0; keys[j] != NULL; j++) {
+		if (keys[j]->position != 0) {
+			return (NULL);
+		}
+	}
+	if (j != snode->keys_count || (key = strdup((char*)(edit_node->name))) == NULL) {
+		return (NULL);
+	}
+
+	/* the key values in the order of the schema */
+	for (i = 0; i < snode->keys_count; i++) {
+		for (j = 0; keys[j] != NULL && !xmlStrEqual(BAD_CAST (keys[j]->name), snode->keys[i]); j++);
+		aux = key;
+		if (keys[j] == NULL || asprintf(&key, "%s\x1f%s", aux, keys[j]->value) == -1) {
+			key = NULL;
+		}
+		free(aux);
+		if (key == NULL) {
+			return (NULL);
 		}
-		free(p);
-		return (0);
 	}
+
+	return (key);
 }
 
 static xmlNodePtr get_ref_list(xmlNodePtr parent, xmlNodePtr edit_node, struct nc_err **error)
@@ -1169,8 +1585,8 @@ static xmlNodePtr get_ref_list(xmlNodePtr parent, xmlNodePtr edit_node, struct n
 	xmlChar *ref;
 	xmlNsPtr ns;
 	char *s, *token;
-	int i, j;
-	xmlNodePtr retval, node, keynode;
+	int i, j, r;
+	xmlNodePtr retval, node;
 	struct key_predicate** keys;
 
 	if ((ref = xmlGetNsProp(edit_node, BAD_CAST "key", BAD_CAST NC_NS_YANG)) == NULL) {
@@ -1207,7 +1623,7 @@ static xmlNodePtr get_ref_list(xmlNodePtr parent, xmlNodePtr edit_node, struct n
 			break;
 		}
 
-		keys[j] = malloc(sizeof(struct key_predicate));
+		keys[j] = calloc(1, sizeof(struct key_predicate));
 		if (keys[j] == NULL) {
 			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
 			retval = NULL;
@@ -1274,20 +1690,25 @@ static xmlNodePtr get_ref_list(xmlNodePtr parent, xmlNodePtr edit_node, struct n
 
 	/* search for the referenced node */
 	retval = NULL;
-	j = 1;
-	for (node = parent->children; node != NULL; node = node->next) {
-		if (node->type != XML_ELEMENT_NODE) {
-			continue;
-		}
-		if (node->ns == NULL || xmlStrcmp(node->ns->href, edit_node->ns->href) != 0) {
-			continue;
-		}
-		if (xmlStrcmp(node->name, edit_node->name) != 0) {
-			continue;
+	if ((s = ref_list_key(parent, edit_node, keys)) != NULL) {
+		/* all the keys are specified, use the index of the list instances */
+		r = equiv_lookup_key(parent, s, &node);
+		free(s);
+		if (r == 0) {
+			if (node != NULL && (r = ref_list_match(node, edit_node, keys, error)) == 1) {
+				retval = node;
+			}
+			goto cleanup;
 		}
+	}
 
+	j = 1;
+	for (node = parent->children; node != NULL; node = node->next) {
 		/* reference specified as position */
 		if (keys[0]->position > 0) {
+			if (!ref_list_instance(node, edit_node)) {
+				continue;
+			}
 			if (keys[0]->position == j) {
 				retval = node;
 				break;
@@ -1296,52 +1717,10 @@ static xmlNodePtr get_ref_list(xmlNodePtr parent, xmlNodePtr edit_node, struct n
 			continue;
 		}
 
-		/* check key elements of this node */
-		keynode = NULL;
-		for (i = 0; keys[i] != NULL; i++) {
-			if (keys[i]->position != 0) {
-				/* this should not happen */
-				if (error != NULL) {
-					*error = nc_err_new(NC_ERR_BAD_ATTR);
-					nc_err_set(*error, NC_ERR_PARAM_INFO_BADATTR, "key");
-					nc_err_set(*error, NC_ERR_PARAM_MSG, "Invalid mixing of the \"key\" attribute content to insert list item");
-				}
-				retval = NULL;
-				goto cleanup;
-			}
-			for (keynode = node->children; keynode != NULL; keynode = keynode->next) {
-				if (keynode->ns == NULL || keynode->ns->href == NULL) {
-					continue;
-				}
-
-				if (xmlStrcmp(keynode->ns->href, BAD_CAST (keys[i]->href)) != 0) {
-					continue;
-				}
-
-				if (xmlStrcmp(keynode->name, BAD_CAST(keys[i]->name)) != 0) {
-					continue;
-				}
-
-				if (keynode->children == NULL || keynode->children->type != XML_TEXT_NODE) {
-					continue;
-				}
-
-				s = nc_clrwspace((char*)(keynode->children->content));
-				if (s == NULL || strcmp(s, keys[i]->value) != 0) {
-					free(s);
-					continue;
-				}
-				free(s);
-
-				/* we have the match */
-				break;
-			}
-			if (keynode == NULL) {
-				/* key not found */
-				break;
-			}
-		}
-		if (keynode != NULL) {
+		if ((r = ref_list_match(node, edit_node, keys, error)) == -1) {
+			retval = NULL;
+			goto cleanup;
+		} else if (r == 1) {
 			if (retval == NULL) {
 				retval = node;
 			} else {
@@ -1374,6 +1753,7 @@ static xmlNodePtr get_ref_leaflist(xmlNodePtr parent, xmlNodePtr edit_node, stru
 {
 	xmlChar *ref;
 	char *s;
+	int r;
 	xmlNodePtr retval;
 
 	if ((ref = xmlGetNsProp(edit_node, BAD_CAST "value", BAD_CAST NC_NS_YANG)) == NULL) {
@@ -1388,6 +1768,16 @@ static xmlNodePtr get_ref_leaflist(xmlNodePtr parent, xmlNodePtr edit_node, stru
 	xmlRemoveProp(xmlHasNsProp(edit_node, BAD_CAST "value", BAD_CAST NC_NS_YANG));
 	VERB("Reference value for leaf-list is \"%s\" (%s:%d)", ref, __FILE__, __LINE__);
 
+	/* use the index of the leaf-list items, if any */
+	if (asprintf(&s, "%s\x1e%s", (char*)(edit_node->name), (char*)ref) != -1) {
+		r = equiv_lookup_key(parent, s, &retval);
+		free(s);
+		if (r == 0) {
+			xmlFree(ref);
+			return (retval);
+		}
+	}
+
 	/* search for the referenced node */
 	for (retval = parent->children; retval != NULL; retval = retval->next) {
 		if (xmlStrcmp(retval->name, edit_node->name) != 0 ||
@@ -1473,31 +1863,59 @@ static void nc_clear_namespaces(xmlNodePtr node)
 	}
 }
 
+/**
+ * \brief Unlink the edit node from the edit document and pass it to the
+ * configuration data document instead of copying it, the edit document is
+ * discarded after the edit-config anyway. The namespaces used in the subtree
+ * are reconciled with the ones declared in the scope of the new parent.
+ *
+ * \param[in] parent Future parent of the node in the configuration data.
+ * \param[in] edit_node Node from the edit document to move.
+ * \return The unlinked node owned by the parent's document, NULL on error.
+ */
+static xmlNodePtr edit_graft(xmlNodePtr parent, xmlNodePtr edit_node)
+{
+	xmlUnlinkNode(edit_node);
+	if (xmlDOMWrapAdoptNode(NULL, edit_node->doc, edit_node, parent->doc, (parent->type == XML_DOCUMENT_NODE) ? NULL : parent, 0) != 0) {
+		ERROR("%s: Moving the node %s failed (%s:%d)", __func__, (char*)(edit_node->name), __FILE__, __LINE__);
+		xmlFreeNode(edit_node);
+		return (NULL);
+	}
+
+	return (edit_node);
+}
+
 /**
  * Common routine to create a node
  */
 static int edit_create_routine(xmlNodePtr parent, xmlNodePtr edit_node)
 {
+	xmlNodePtr created;
+
 	if (parent == NULL || edit_node == NULL) {
 		ERROR("%s: invalid input parameter.", __func__);
 		return (EXIT_FAILURE);
 	}
 
-	/* create a new element in the configuration data as a copy of the element from the edit-config */
+	/* create a new element in the configuration data by moving the element from the edit-config */
 	VERB("Creating the node %s (%s:%d)", (char*)edit_node->name, __FILE__, __LINE__);
+	if ((created = edit_graft(parent, edit_node)) == NULL) {
+		return (EXIT_FAILURE);
+	}
 	if (parent->type == XML_DOCUMENT_NODE) {
 		if (parent->children == NULL) {
-			xmlDocSetRootElement(parent->doc, xmlCopyNode(edit_node, 1));
+			xmlDocSetRootElement(parent->doc, created);
 		} else {
 			/* adding root's sibling! */
-			xmlAddChild(parent, xmlCopyNode(edit_node, 1));
+			xmlAddChild(parent, created);
 		}
 	} else {
-		if (xmlAddChild(parent, xmlCopyNode(edit_node, 1)) == NULL) {
+		if (xmlAddChild(parent, created) == NULL) {
 			ERROR("%s: Creating new node (%s) failed (%s:%d)", __func__, (char*)(edit_node->name), __FILE__, __LINE__);
 			return (EXIT_FAILURE);
 		}
 	}
+	equiv_link(created);
 
 	return (EXIT_SUCCESS);
 }
@@ -1517,7 +1935,7 @@ static int edit_create_lists(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr
 		*error = NULL;
 	}
 
-	if ((list_type = is_user_ordered_list(find_element_model(edit_node, model))) == 0) {
+	if ((list_type = is_user_ordered(edit_node, model)) == 0) {
 		return (EXIT_FAILURE);
 	}
 	/*
@@ -1529,17 +1947,17 @@ static int edit_create_lists(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr
 
 	/* switch according to the insert value */
 	if (insert == NULL || xmlStrcmp(insert, BAD_CAST "last") == 0) {
-		if ((created = xmlAddChild(parent, xmlCopyNode(edit_node, 1))) == NULL) {
+		if ((created = xmlAddChild(parent, edit_graft(parent, edit_node))) == NULL) {
 			goto error;
 		}
 	} else if (xmlStrcmp(insert, BAD_CAST "first") == 0) {
 		if (parent->children == NULL) {
-			if ((created = xmlAddChild(parent, xmlCopyNode(edit_node, 1))) == NULL) {
+			if ((created = xmlAddChild(parent, edit_graft(parent, edit_node))) == NULL) {
 				goto error;
 			}
 		} else {
 			/* check if the parent is list */
-			if (is_user_ordered_list(find_element_model(parent, model)) != 0) {
+			if (is_user_ordered(parent, model) != 0) {
 				/* we are in the list, so the first nodes must be the keys and
 				 * we have to place this new node only as the first instance of
 				 * it, not as the first child node of its parent
@@ -1553,18 +1971,18 @@ static int edit_create_lists(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr
 				}
 				if (node != NULL) {
 					/* put the new node before the currently first instance of the list */
-					if ((created = xmlAddPrevSibling(node, xmlCopyNode(edit_node, 1))) == NULL) {
+					if ((created = xmlAddPrevSibling(node, edit_graft(parent, edit_node))) == NULL) {
 						goto error;
 					}
 				} else {
 					/* put it as last node since there is currently no instance of the list */
-					if ((created = xmlAddChild(parent, xmlCopyNode(edit_node, 1))) == NULL) {
+					if ((created = xmlAddChild(parent, edit_graft(parent, edit_node))) == NULL) {
 						goto error;
 					}
 				}
 			} else {
 				/* it is not a list, so simply place it as the first child */
-				if ((created = xmlAddPrevSibling(parent->children, xmlCopyNode(edit_node, 1))) == NULL) {
+				if ((created = xmlAddPrevSibling(parent->children, edit_graft(parent, edit_node))) == NULL) {
 					goto error;
 				}
 			}
@@ -1598,13 +2016,13 @@ static int edit_create_lists(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr
 				if (before_flag == 1) {
 					/* place the node before its reference */
 					xmlRemoveProp(xmlHasNsProp(edit_node, BAD_CAST "key", BAD_CAST NC_NS_YANG));
-					if ((created = xmlAddPrevSibling(node, xmlCopyNode(edit_node, 1))) == NULL) {
+					if ((created = xmlAddPrevSibling(node, edit_graft(parent, edit_node))) == NULL) {
 						goto error;
 					}
 				} else if (before_flag == 0) {
 					/* place the node after its reference */
 					xmlRemoveProp(xmlHasNsProp(edit_node, BAD_CAST "key", BAD_CAST NC_NS_YANG));
-					if ((created = xmlAddNextSibling(node, xmlCopyNode(edit_node, 1))) == NULL) {
+					if ((created = xmlAddNextSibling(node, edit_graft(parent, edit_node))) == NULL) {
 						goto error;
 					}
 				} /* else nonsence */
@@ -1613,13 +2031,13 @@ static int edit_create_lists(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr
 	}
 
 	xmlFree(insert);
+	equiv_link(created);
 	nc_clear_namespaces(created);
 
 	return (EXIT_SUCCESS);
 
 error:
 	xmlFree(insert);
-	keyListFree(keys);
 	return (EXIT_FAILURE);
 }
 
@@ -1771,6 +2189,7 @@ static xmlNodePtr edit_create_recursively(xmlDocPtr orig_doc, xmlNodePtr edit_no
 				xmlSetNs(retval, ns_aux);
 			}
 			xmlDocSetRootElement(orig_doc, retval);
+			equiv_link(retval);
 			return (retval);
 		}
 
@@ -1786,6 +2205,7 @@ static xmlNodePtr edit_create_recursively(xmlDocPtr orig_doc, xmlNodePtr edit_no
 			ns_aux = xmlNewNs(retval, edit_node->ns->href, NULL);
 			xmlSetNs(retval, ns_aux);
 		}
+		equiv_link(retval);
 	}
 	return retval;
 }
@@ -1794,13 +2214,15 @@ static xmlNodePtr edit_create_recursively(xmlDocPtr orig_doc, xmlNodePtr edit_no
  * \brief Perform edit-config's "create" operation.
  *
  * \param[in] orig_doc Original configuration document to edit.
+ * \param[in] orig_parent Equivalent of the edit node's parent, NULL if not
+ * known - then it is searched and the missing ancestors are created.
  * \param[in] edit_node Node from the edit-config's \<config\> element with
  * specified "create" operation.
  * \param[in] keys  List of key elements from configuration data model.
  *
  * \return Zero on success, non-zero otherwise.
  */
-static int edit_create(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
+static int edit_create(xmlDocPtr orig_doc, xmlNodePtr orig_parent, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	xmlNodePtr parent = NULL, model_node;
 	int r;
@@ -1829,7 +2251,10 @@ static int edit_create(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_T
 		}
 	}
 
-	if (edit_node->parent->type != XML_DOCUMENT_NODE) {
+	if (orig_parent != NULL) {
+		/* the parent already exists */
+		parent = orig_parent;
+	} else if (edit_node->parent->type != XML_DOCUMENT_NODE) {
 		parent = edit_create_recursively(orig_doc, edit_node->parent, defop, model, keys, nacm, error);
 		if (parent == NULL) {
 			return EXIT_FAILURE;
@@ -1845,7 +2270,7 @@ static int edit_create(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_T
 
 	/* handle user-ordered lists */
 	model_node = find_element_model(edit_node, model);
-	if (is_user_ordered_list(model_node) != 0) {
+	if (is_user_ordered(edit_node, model) != 0) {
 		if (edit_create_lists(parent, edit_node, model, keys, error) == EXIT_FAILURE) {
 			return (EXIT_FAILURE);
 		}
@@ -1854,14 +2279,16 @@ static int edit_create(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_T
 			return (EXIT_FAILURE);
 		}
 	} else {
-		/* create a new element in the configuration data as a copy of the element from the edit-config */
+		/* create a new element in the configuration data from the element of the edit-config */
 		if (edit_create_routine(parent, edit_node) == EXIT_FAILURE) {
 			return (EXIT_FAILURE);
 		}
 	}
 
-	/* remove the node from the edit document */
-	edit_delete(edit_node);
+	/* remove the node from the edit document unless it was moved into the configuration data */
+	if (edit_node->doc != orig_doc) {
+		edit_delete(edit_node);
+	}
 
 	return EXIT_SUCCESS;
 }
@@ -1910,13 +2337,14 @@ int edit_replace_nacmcheck(xmlNodePtr orig_node, xmlDocPtr edit_doc, xmlDocPtr m
  * \brief Perform edit-config's "replace" operation on the selected node.
  *
  * \param[in] orig_doc Original configuration document to edit.
+ * \param[in] orig_parent Equivalent of the edit node's parent, NULL if not known.
  * \param[in] edit_node Node from the edit-config's \<config\> element with
  * the specified "replace" operation.
  * \param[in] keys  List of the key elements from the configuration data model.
  *
  * \return Zero on success, non-zero otherwise.
  */
-static int edit_replace(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
+static int edit_replace(xmlDocPtr orig_doc, xmlNodePtr orig_parent, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	xmlNodePtr old;
 	int r;
@@ -1945,10 +2373,10 @@ static int edit_replace(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_
 		return (EXIT_FAILURE);
 	}
 
-	old = find_element_equiv(orig_doc, edit_node, model, keys);
+	old = find_element_equiv_in(orig_doc, orig_parent, edit_node, model, keys);
 	if (old == NULL) {
 		/* node to be replaced doesn't exist, so create new configuration data */
-		return edit_create(orig_doc, edit_node, defop, model, keys, nacm, error);
+		return edit_create(orig_doc, orig_parent, edit_node, defop, model, keys, nacm, error);
 	} else {
 		/* NACM */
 		if ((r = edit_replace_nacmcheck(old, edit_node->doc, model, keys, nacm, error)) != NACM_PERMIT) {
@@ -1978,9 +2406,11 @@ static int edit_replace(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_
 		 * "moving" of the instance of the list/leaf-list using YANG's insert
 		 * attribute
 		 */
+		orig_parent = old->parent;
+		equiv_unlink(old);
 		xmlUnlinkNode(old);
 		xmlFreeNode(old);
-		return edit_create(orig_doc, edit_node, defop, model, keys, nacm, error);
+		return edit_create(orig_doc, orig_parent, edit_node, defop, model, keys, nacm, error);
 	}
 }
 
@@ -1998,7 +2428,7 @@ static int edit_merge_lists(xmlNodePtr merged_node, xmlNodePtr edit_node, xmlDoc
 	char* insert;
 
 	/* if this is a list/leaf-list, moving using insert attribute can be required */
-	if ((list_type = is_user_ordered_list(find_element_model(merged_node, model))) != 0) {
+	if ((list_type = is_user_ordered(merged_node, model)) != 0) {
 		/* get the insert attribute and remove it from the merged node if already placed in */
 		if ((insert = (char*)xmlGetNsProp(edit_node, BAD_CAST "insert", BAD_CAST NC_NS_YANG)) != NULL) {
 			xmlRemoveProp(xmlHasNsProp(merged_node, BAD_CAST "insert", BAD_CAST NC_NS_YANG));
@@ -2017,7 +2447,7 @@ static int edit_merge_lists(xmlNodePtr merged_node, xmlNodePtr edit_node, xmlDoc
 				/* move it to the beginning of the children list */
 				if (merged_node->prev != NULL) {
 					xmlUnlinkNode(merged_node);
-					if (is_user_ordered_list(find_element_model(parent, model)) != 0) {
+					if (is_user_ordered(parent, model) != 0) {
 						/* we are in the list, so the first nodes must be the keys and
 						 * we have to place this new node only as the first instance of
 						 * it, not as the first child node of its parent
@@ -2089,41 +2519,22 @@ static int edit_merge_lists(xmlNodePtr merged_node, xmlNodePtr edit_node, xmlDoc
 	return (0);
 }
 
-static xmlNodePtr is_list(xmlNodePtr node, xmlDocPtr model)
-{
-	xmlNodePtr model_node;
-
-	model_node = find_element_model(node, model);
-	if (model_node == NULL) {
-		WARN("unknown element %s!", (char* )(node->name));
-		return (0);
-	} else if (xmlStrcmp(model_node->name, BAD_CAST "list") == 0) {
-		return (model_node);
-	} else {
-		return (NULL);
-	}
-}
-
 static int is_leaf_list(xmlNodePtr node, xmlDocPtr model)
 {
-	xmlNodePtr model_node;
+	struct schema_node* snode;
 
-	model_node = find_element_model(node, model);
-	if (model_node == NULL) {
+	if ((snode = schema_find(schema_get(model), node)) == NULL) {
 		WARN("unknown element %s!", (char* )(node->name));
 		return (0);
-	} else if (xmlStrcmp(model_node->name, BAD_CAST "leaf-list") == 0) {
-		return (1);
-	} else {
-		return (0);
 	}
+	return (snode->type == SCHEMA_LEAFLIST);
 }
 
 static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	xmlNodePtr children, aux, next, nextchild, parent;
 	int r, access, duplicates;
-	int leaf_list;
+	int leaf_list, unique;
 	char *msg = NULL;
 
 	/* process leaf text nodes - even if we are merging, leaf text nodes are
@@ -2179,7 +2590,10 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 				duplicates = 0;
 
 				/* check previous existence of exactly the same element in original document */
-				if (orig_node->parent != NULL && orig_node->parent->parent != NULL) {
+				if (orig_node->parent != NULL && orig_node->parent->parent != NULL &&
+						equiv_lookup(orig_node->parent->parent, edit_node->parent, NULL, 1, &aux) == 0) {
+					duplicates = (aux != NULL && matching_elements(aux, edit_node->parent, NULL, 1) == 1);
+				} else if (orig_node->parent != NULL && orig_node->parent->parent != NULL) {
 					for (aux = orig_node->parent->parent->children; aux != NULL ; aux = aux->next) {
 						/* we don't need keys since this is a leaf-list */
 						if (matching_elements(aux, edit_node->parent, NULL, 1) == 1) { /* checks text content */
@@ -2194,6 +2608,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 						ERROR("Adding leaf-list node when merging failed (%s:%d)", __FILE__, __LINE__);
 						return EXIT_FAILURE;
 					}
+					equiv_link(aux);
 					nc_clear_namespaces(aux);
 				}
 			}
@@ -2223,10 +2638,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 
 			/* find matching element to children */
 			leaf_list = is_leaf_list(children, model);
-			aux = orig_node->children;
-			while (aux != NULL && matching_elements(children, aux, keys, leaf_list) == 0) {
-				aux = aux->next;
-			}
+			aux = equiv_child(orig_node, children, keys, leaf_list);
 		}
 
 		nextchild = children->next;
@@ -2236,7 +2648,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 			 * original configuration data, so create it as new
 			 */
 			VERB("Adding a missing node %s while merging (%s:%d)", (char*)children->name, __FILE__, __LINE__);
-			if (edit_create(orig_node->doc, children, defop, model, keys, nacm, error) != 0) {
+			if (edit_create(orig_node->doc, orig_node, children, defop, model, keys, nacm, error) != 0) {
 				ERROR("Adding missing nodes when merging failed (%s:%d)", __FILE__, __LINE__);
 				return EXIT_FAILURE;
 			}
@@ -2265,6 +2677,7 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 				 * don't care the content, because we want to change it.
 				 */
 				leaf_list = is_leaf_list(children, model);
+				unique = equiv_unique(parent);
 
 				while (aux != NULL) {
 					next = aux->next;
@@ -2295,6 +2708,10 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 						if (edit_choice_clean(parent, children, model, nacm, error) == EXIT_FAILURE) {
 							return (EXIT_FAILURE);
 						}
+						if (unique) {
+							/* the indexed children are unique, there is no other match */
+							next = NULL;
+						}
 					}
 					aux = next;
 				}
@@ -2307,10 +2724,20 @@ static int edit_merge_recursively(xmlNodePtr orig_node, xmlNodePtr edit_node, NC
 	return EXIT_SUCCESS;
 }
 
-int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
+/**
+ * \brief Perform edit-config's "merge" operation.
+ *
+ * \param[in] orig_doc Original configuration document to edit.
+ * \param[in] orig_parent Equivalent of the edit node's parent, NULL if not known.
+ * \param[in] edit_node Node from the edit-config's \<config\> element to merge.
+ * \param[in] keys  List of key elements from configuration data model.
+ *
+ * \return Zero on success, non-zero otherwise.
+ */
+static int edit_merge_in(xmlDocPtr orig_doc, xmlNodePtr orig_parent, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
 {
 	xmlNodePtr orig_node;
-	xmlNodePtr aux, children;
+	xmlNodePtr aux, children, nextchild;
 	int r;
 	char *msg = NULL;
 
@@ -2323,9 +2750,9 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 	}
 
 	VERB("Merging the node %s (%s:%d)", (char*)edit_node->name, __FILE__, __LINE__);
-	orig_node = find_element_equiv(orig_doc, edit_node, model, keys);
+	orig_node = find_element_equiv_in(orig_doc, orig_parent, edit_node, model, keys);
 	if (orig_node == NULL) {
-		return edit_create(orig_doc, edit_node, defop, model, keys, nacm, error);
+		return edit_create(orig_doc, orig_parent, edit_node, defop, model, keys, nacm, error);
 	}
 
 	children = edit_node->children;
@@ -2337,17 +2764,16 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 				continue;
 			}
 
-			aux = find_element_equiv(orig_doc, children, model, keys);
+			aux = equiv_child(orig_node, children, keys, is_leaf_list(children, model));
 		} else if (children->type == XML_TEXT_NODE) {
-			aux = find_element_equiv(orig_doc, children->parent, model, keys);
-			if (aux) {
-				aux = aux->children;
-			}
+			/* the equivalent of the children's parent is orig_node */
+			aux = orig_node->children;
 		} else {
 			children = children->next;
 			continue;
 		}
 
+		nextchild = children->next;
 		if (aux == NULL) {
 			/*
 			 * there is no equivalent element of the children in the
@@ -2374,10 +2800,11 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 				}
 			}
 
-			if ((aux = xmlAddChild(orig_node, xmlCopyNode(children, 1))) == NULL) {
+			if ((aux = xmlAddChild(orig_node, edit_graft(orig_node, children))) == NULL) {
 				ERROR("Adding missing nodes when merging failed (%s:%d)", __FILE__, __LINE__);
 				return EXIT_FAILURE;
 			}
+			equiv_link(aux);
 		} else {
 			/* go recursive */
 			VERB("Merging the node %s (%s:%d)", (char*)children->name, __FILE__, __LINE__);
@@ -2394,7 +2821,7 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 			return (EXIT_FAILURE);
 		}
 
-		children = children->next;
+		children = nextchild;
 	}
 	/* remove the node from the edit document */
 	edit_delete(edit_node);
@@ -2402,29 +2829,32 @@ int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defo
 	return EXIT_SUCCESS;
 }
 
+int edit_merge(xmlDocPtr orig_doc, xmlNodePtr edit_node, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err** error)
+{
+	return (edit_merge_in(orig_doc, NULL, edit_node, defop, model, keys, nacm, error));
+}
+
 /**
  * \brief Perform all the edit-config's operations specified in the edit_doc document.
  *
  * \param[in] orig_doc Original configuration document to edit.
  * \param[in] edit_doc XML document covering edit-config's \<config\> element
  *                     supposed to edit orig_doc configuration data.
+ * \param[in,out] ops List of the edit_doc's nodes with an operation.
  * \param[in] defop Default edit-config's operation for this edit-config call.
  * \param[in] model XML form (YIN) of the configuration data model appropriate
  * to the given configuration data.
+ * \param[in] keys List of the key elements from the configuration data model.
  * \param[out] err NETCONF error structure.
  *
  * \return On error, non-zero is returned and err structure is filled. Zero is
  *         returned on success.
  */
-static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, const struct nacm_rpc* nacm, struct nc_err **error)
+static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, struct edit_ops* ops, NC_EDIT_DEFOP_TYPE defop, xmlDocPtr model, keyList keys, const struct nacm_rpc* nacm, struct nc_err **error)
 {
-	xmlXPathObjectPtr nodes;
 	int i;
 	char *msg = NULL;
 	xmlNodePtr orig_node, edit_node;
-	keyList keys;
-
-	keys = get_keynode_list(model);
 
 	if (error != NULL) {
 		*error = NULL;
@@ -2434,7 +2864,7 @@ static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP
 	if (defop == NC_EDIT_DEFOP_REPLACE) {
 		/* replace whole document */
 		for (edit_node = edit_doc->children; edit_node != NULL; edit_node = edit_doc->children) {
-			edit_replace(orig_doc, edit_node, defop, model, keys, nacm, error);
+			edit_replace(orig_doc, NULL, edit_node, defop, model, keys, nacm, error);
 		}
 
 		/* according to RFC 6020 sec. 7.2, default-operation "replace"
@@ -2444,107 +2874,66 @@ static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP
 	}
 
 	/* delete operations */
-	nodes = get_operation_elements(NC_EDIT_OP_DELETE, edit_doc);
-	if (nodes != NULL) {
-		if (!xmlXPathNodeSetIsEmpty(nodes->nodesetval)) {
-			/* something to delete */
-			for (i = 0; i < nodes->nodesetval->nodeNr; i++) {
-				edit_node = nodes->nodesetval->nodeTab[i];
-				orig_node = find_element_equiv(orig_doc, edit_node, model, keys);
-				if (orig_node == NULL) {
-					xmlXPathFreeObject(nodes);
-					if (error != NULL) {
-						*error = nc_err_new(NC_ERR_DATA_MISSING);
-					}
-					goto error;
-				}
-				for (; orig_node != NULL; orig_node = find_element_equiv(orig_doc, edit_node, model, keys)) {
-					/* NACM */
-					if (nacm_check_data(orig_node, NACM_ACCESS_DELETE, nacm) == NACM_PERMIT) {
-						/* remove the edit node's equivalent from the original document */
-						edit_delete(orig_node);
-					} else {
-						if (error != NULL ) {
-							*error = nc_err_new(NC_ERR_ACCESS_DENIED);
-							if (asprintf(&msg, "deleting \"%s\" data node is not permitted.", (char*) (orig_node->name)) != -1) {
-								nc_err_set(*error, NC_ERR_PARAM_MSG, msg);
-								free(msg);
-							}
-						}
-						xmlXPathFreeObject(nodes);
-						goto error;
+	for (i = edit_op_next(ops, 0, NC_EDIT_OP_DELETE); i != -1; i = edit_op_next(ops, i + 1, NC_EDIT_OP_DELETE)) {
+		edit_node = ops->list[i].node;
+		orig_node = find_element_equiv_in(orig_doc, edit_op_parent(&ops->list[i]), edit_node, model, keys);
+		if (orig_node == NULL) {
+			if (error != NULL) {
+				*error = nc_err_new(NC_ERR_DATA_MISSING);
+			}
+			goto error;
+		}
+		for (; orig_node != NULL; orig_node = find_element_equiv_in(orig_doc, edit_op_parent(&ops->list[i]), edit_node, model, keys)) {
+			/* NACM */
+			if (nacm_check_data(orig_node, NACM_ACCESS_DELETE, nacm) == NACM_PERMIT) {
+				/* remove the edit node's equivalent from the original document */
+				edit_delete(orig_node);
+			} else {
+				if (error != NULL ) {
+					*error = nc_err_new(NC_ERR_ACCESS_DENIED);
+					if (asprintf(&msg, "deleting \"%s\" data node is not permitted.", (char*) (orig_node->name)) != -1) {
+						nc_err_set(*error, NC_ERR_PARAM_MSG, msg);
+						free(msg);
 					}
 				}
-				/* remove the node from the edit document */
-				edit_delete(edit_node);
-				nodes->nodesetval->nodeTab[i] = NULL;
+				goto error;
 			}
 		}
-		xmlXPathFreeObject(nodes);
+		/* remove the node from the edit document */
+		edit_delete(edit_node);
+		ops->list[i].done = 1;
 	}
 
 	/* remove operations */
-	nodes = get_operation_elements(NC_EDIT_OP_REMOVE, edit_doc);
-	if (nodes != NULL) {
-		if (!xmlXPathNodeSetIsEmpty(nodes->nodesetval)) {
-			/* something to remove */
-			for (i = 0; i < nodes->nodesetval->nodeNr; i++) {
-				if (edit_remove(orig_doc, nodes->nodesetval->nodeTab[i], model, keys, nacm, error) != EXIT_SUCCESS) {
-					xmlXPathFreeObject(nodes);
-					goto error;
-				}
-				nodes->nodesetval->nodeTab[i] = NULL;
-			}
+	for (i = edit_op_next(ops, 0, NC_EDIT_OP_REMOVE); i != -1; i = edit_op_next(ops, i + 1, NC_EDIT_OP_REMOVE)) {
+		if (edit_remove(orig_doc, edit_op_parent(&ops->list[i]), ops->list[i].node, model, keys, nacm, error) != EXIT_SUCCESS) {
+			goto error;
 		}
-		xmlXPathFreeObject(nodes);
+		ops->list[i].done = 1;
 	}
 
 	/* replace operations */
-	nodes = get_operation_elements(NC_EDIT_OP_REPLACE, edit_doc);
-	if (nodes != NULL) {
-		if (!xmlXPathNodeSetIsEmpty(nodes->nodesetval)) {
-			/* something to replace */
-			for (i = 0; i < nodes->nodesetval->nodeNr; i++) {
-				if (edit_replace(orig_doc, nodes->nodesetval->nodeTab[i], defop, model, keys, nacm, error) != EXIT_SUCCESS) {
-					xmlXPathFreeObject(nodes);
-					goto error;
-				}
-				nodes->nodesetval->nodeTab[i] = NULL;
-			}
+	for (i = edit_op_next(ops, 0, NC_EDIT_OP_REPLACE); i != -1; i = edit_op_next(ops, i + 1, NC_EDIT_OP_REPLACE)) {
+		if (edit_replace(orig_doc, edit_op_parent(&ops->list[i]), ops->list[i].node, defop, model, keys, nacm, error) != EXIT_SUCCESS) {
+			goto error;
 		}
-		xmlXPathFreeObject(nodes);
+		ops->list[i].done = 1;
 	}
 
 	/* create operations */
-	nodes = get_operation_elements(NC_EDIT_OP_CREATE, edit_doc);
-	if (nodes != NULL) {
-		if (!xmlXPathNodeSetIsEmpty(nodes->nodesetval)) {
-			/* something to create */
-			for (i = 0; i < nodes->nodesetval->nodeNr; i++) {
-				if (edit_create(orig_doc, nodes->nodesetval->nodeTab[i], defop, model, keys, nacm, error) != EXIT_SUCCESS) {
-					xmlXPathFreeObject(nodes);
-					goto error;
-				}
-				nodes->nodesetval->nodeTab[i] = NULL;
-			}
+	for (i = edit_op_next(ops, 0, NC_EDIT_OP_CREATE); i != -1; i = edit_op_next(ops, i + 1, NC_EDIT_OP_CREATE)) {
+		if (edit_create(orig_doc, edit_op_parent(&ops->list[i]), ops->list[i].node, defop, model, keys, nacm, error) != EXIT_SUCCESS) {
+			goto error;
 		}
-		xmlXPathFreeObject(nodes);
+		ops->list[i].done = 1;
 	}
 
 	/* merge operations */
-	nodes = get_operation_elements(NC_EDIT_OP_MERGE, edit_doc);
-	if (nodes != NULL) {
-		if (!xmlXPathNodeSetIsEmpty(nodes->nodesetval)) {
-			/* something to create */
-			for (i = 0; i < nodes->nodesetval->nodeNr; i++) {
-				if (edit_merge(orig_doc, nodes->nodesetval->nodeTab[i], defop, model, keys, nacm, error) != EXIT_SUCCESS) {
-					xmlXPathFreeObject(nodes);
-					goto error;
-				}
-				nodes->nodesetval->nodeTab[i] = NULL;
-			}
+	for (i = edit_op_next(ops, 0, NC_EDIT_OP_MERGE); i != -1; i = edit_op_next(ops, i + 1, NC_EDIT_OP_MERGE)) {
+		if (edit_merge_in(orig_doc, edit_op_parent(&ops->list[i]), ops->list[i].node, defop, model, keys, nacm, error) != EXIT_SUCCESS) {
+			goto error;
 		}
-		xmlXPathFreeObject(nodes);
+		ops->list[i].done = 1;
 	}
 
 	/* default merge */
@@ -2561,18 +2950,10 @@ static int edit_operations(xmlDocPtr orig_doc, xmlDocPtr edit_doc, NC_EDIT_DEFOP
 
 cleanup:
 
-	if (keys != NULL) {
-		keyListFree(keys);
-	}
-
 	return EXIT_SUCCESS;
 
 error:
 
-	if (keys != NULL ) {
-		keyListFree(keys);
-	}
-
 	if (error != NULL && *error == NULL) {
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 	}
@@ -2580,118 +2961,29 @@ error:
 	return EXIT_FAILURE;
 }
 
-static int compact_edit_operations_recursively(xmlNodePtr node, NC_EDIT_OP_TYPE supreme_op)
-{
-	NC_EDIT_OP_TYPE op;
-	xmlNodePtr children;
-	int ret;
-
-	assert(node);
-
-	op = get_operation(node, NC_EDIT_DEFOP_NOTSET, NULL);
-	switch ((int)op) {
-	case NC_EDIT_OP_ERROR:
-		return EXIT_FAILURE;
-		break;
-	case 0:
-		/* no operation defined -> go recursively, but use supreme
-		 * operation, it may be the default operation and in such a case
-		 * remove it */
-		op = supreme_op;
-		break;
-	default:
-		/* any operation specified */
-		if (op == supreme_op) {
-			/* operation duplicity -> remove subordinate duplicated operation */
-			/* remove operation attribute */
-			xmlRemoveProp(xmlHasNsProp(node, BAD_CAST NC_EDIT_ATTR_OP, BAD_CAST NC_NS_BASE));
-			nc_clear_namespaces(node);
-		}
-		break;
-	}
-
-	/* go recursive */
-	for (children = node->children; children != NULL; children = children->next) {
-		ret = compact_edit_operations_recursively(children, op);
-		if (ret == EXIT_FAILURE) {
-			return EXIT_FAILURE;
-		}
-	}
-	return EXIT_SUCCESS;
-}
-
-static int compact_edit_operations(xmlDocPtr edit_doc, NC_EDIT_DEFOP_TYPE defop)
-{
-	xmlNodePtr root;
-	NC_EDIT_OP_TYPE op;
-
-	if (edit_doc == NULL) {
-		return EXIT_FAILURE;
-	}
-
-	/* to start recursive check, use defop as root's supreme operation */
-	for (root = edit_doc->children; root != NULL; root = root->next) {
-		if (root->type != XML_ELEMENT_NODE) {
-			continue;
-		}
-
-		switch (defop) {
-		case NC_EDIT_DEFOP_NOTSET:
-		case NC_EDIT_DEFOP_MERGE:
-			op = NC_EDIT_OP_MERGE;
-			break;
-		case NC_EDIT_DEFOP_REPLACE:
-			op = NC_EDIT_OP_REPLACE;
-			break;
-		case NC_EDIT_DEFOP_NONE:
-			op = NC_EDIT_OP_NOTSET;
-			break;
-		default:
-			return EXIT_FAILURE;
-		}
-
-		if (compact_edit_operations_recursively(root, op) != EXIT_SUCCESS) {
-			return (EXIT_FAILURE);
-		}
-	}
-	return EXIT_SUCCESS;
-}
-
 static int check_list_keys(xmlDocPtr edit, xmlDocPtr model, struct nc_err **error)
 {
-	xmlNodePtr listdef;
 	xmlNodePtr *keys = NULL;
 	xmlNodePtr node, next;
-	keyList modelkeys;
+	struct schema* schema;
+	struct schema_node* snode;
 	int ret = EXIT_SUCCESS;
-	int i;
 
-	modelkeys = get_keynode_list(model);
-	if (!modelkeys) {
-		/* no keys in the model */
+	if ((schema = schema_get(model)) == NULL) {
+		/* no definitions of the lists */
 		return ret;
 	}
 
 	node = xmlDocGetRootElement(edit);
 	while (node) {
-		if ((listdef = is_list(node, model)) != NULL) {
-			for (i = 0; i < modelkeys->nodesetval->nodeNr; i++) {
-				if (modelkeys->nodesetval->nodeTab[i]->parent == listdef) {
-					break;
-				}
-			}
-
-			if (i < modelkeys->nodesetval->nodeNr) {
-				/* find out if all the keys are present in edit data */
-				if (find_key_elems(modelkeys->nodesetval->nodeTab[i], node, 1, &keys)) {
-					ret = EXIT_FAILURE;
-					goto cleanup;
-				}
-				free(keys);
-				keys = NULL;
-
-			} /* else list has no keys */
+		/* find out if all the keys are present in edit data */
+		if ((snode = schema_find(schema, node)) != NULL && snode->type == SCHEMA_LIST &&
+				schema_key_elems(snode, node, 1, &keys) != EXIT_SUCCESS) {
+			ret = EXIT_FAILURE;
+			goto cleanup;
 		}
+		free(keys);
+		keys = NULL;
 
 		/* go to the next element to process (depth-first processing) */
 		/* children first */
@@ -2729,9 +3021,6 @@ static int check_list_keys(xmlDocPtr edit, xmlDocPtr model, struct nc_err **erro
 	}
 
 cleanup:
-
-	keyListFree(modelkeys);
-
 	if (ret && error != NULL) {
 		*error = nc_err_new(NC_ERR_MISSING_ELEM);
 		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, (char*)node->name);
@@ -2757,6 +3046,10 @@ cleanup:
  */
 int edit_config(xmlDocPtr repo, xmlDocPtr edit, struct ncds_ds* ds, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE UNUSED(errop), const struct nacm_rpc* nacm, struct nc_err **error)
 {
+	struct edit_ops ops = {NULL, 0, 0};
+	keyList keys = NULL;
+	int indexed = 0;
+
 	if (repo == NULL || edit == NULL) {
 		return (EXIT_FAILURE);
 	}
@@ -2765,26 +3058,35 @@ int edit_config(xmlDocPtr repo, xmlDocPtr edit, struct ncds_ds* ds, NC_EDIT_DEFO
 	if (check_list_keys(edit, ds->ext_model, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
-	/* check operations */
-	if (check_edit_ops(NC_CHECK_EDIT_DELETE, defop, repo, edit, ds->ext_model, error) != EXIT_SUCCESS) {
+
+	/* index the edited nodes' children for searching the equivalents of the edit nodes */
+	indexed = equiv_index_new(repo, ds->ext_model);
+	keys = get_keynode_list(ds->ext_model);
+
+	/* collect the nodes with an operation, check their hierarchy and remove the duplicated operations */
+	if (edit_ops_collect(&ops, repo, edit, defop, ds->ext_model, keys, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
-	if (check_edit_ops(NC_CHECK_EDIT_CREATE, defop, repo, edit, ds->ext_model, error) != EXIT_SUCCESS) {
+
+	/* check operations */
+	if (check_edit_ops(NC_CHECK_EDIT_DELETE, repo, &ops, ds->ext_model, keys, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
-
-	if (compact_edit_operations(edit, defop) != EXIT_SUCCESS) {
-		ERROR("Compacting edit-config operations failed.");
-		if (error != NULL) {
-			*error = nc_err_new(NC_ERR_OP_FAILED);
-		}
+	if (check_edit_ops(NC_CHECK_EDIT_CREATE, repo, &ops, ds->ext_model, keys, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
 
 	/* perform operations */
-	if (edit_operations(repo, edit, defop, ds->ext_model, nacm, error) != EXIT_SUCCESS) {
+	if (edit_operations(repo, edit, &ops, defop, ds->ext_model, keys, nacm, error) != EXIT_SUCCESS) {
 		goto error_cleanup;
 	}
+	edit_ops_free(&ops);
+	if (keys != NULL) {
+		keyListFree(keys);
+	}
+	if (indexed) {
+		equiv_index_free(repo);
+	}
 
 	/* with defaults capability */
 	if (ncdflt_get_basic_mode() == NCWD_MODE_TRIM) {
@@ -2797,6 +3099,13 @@ int edit_config(xmlDocPtr repo, xmlDocPtr edit, struct ncds_ds* ds, NC_EDIT_DEFO
 	return EXIT_SUCCESS;
 
 error_cleanup:
+	edit_ops_free(&ops);
+	if (keys != NULL) {
+		keyListFree(keys);
+	}
+	if (indexed) {
+		equiv_index_free(repo);
+	}
 
 	return EXIT_FAILURE;
 }
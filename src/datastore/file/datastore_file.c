@@ -44,6 +44,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
@@ -51,6 +52,7 @@
 #include <dirent.h>
 #include <libgen.h>
 #include <time.h>
+#include <poll.h>
 
 #include <libxml/tree.h>
 
@@ -62,6 +64,7 @@
 #include "../datastore_internal.h"
 #include "datastore_file.h"
 #include "../edit_config.h"
+#include "../schema.h"
 
 static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 
@@ -72,28 +75,64 @@ static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
   <candidate modified=\"false\" lock=\"\"/>\
 </datastores>"
 
-static struct timespec tv_timeout;
-static sigset_t fullsigset;
-
-#define LOCK(file_ds, ret) {\
+/*
+ * Processes share the datastore file via the reader/writer lock, so readers
+ * (RDLOCK) from different processes do not block each other. Threads of a
+ * single process are serialized by the local mutex, because they share the
+ * in-memory copy of the file. The get-config readers take only the shared
+ * lock and read the published snapshots, see file_snapshot_get().
+ */
+#define LOCK_(file_ds, ret, lockfunc) {\
+	struct timespec tv_timeout;\
+	sigset_t fullsigset;\
+	pthread_mutex_lock(&(file_ds->ds_lock.local));\
 	sigfillset(&fullsigset);\
 	sigprocmask(SIG_SETMASK, &fullsigset, &(file_ds->ds_lock.sigset));\
 	clock_gettime(CLOCK_REALTIME, &tv_timeout);\
 	tv_timeout.tv_sec += NCDS_LOCK_TIMEOUT;\
-	if (sem_timedwait(file_ds->ds_lock.lock, &tv_timeout) == -1 && errno == ETIMEDOUT) {\
+	if (lockfunc(file_ds->ds_lock.rwlock, &tv_timeout) != 0) {\
 		ret = 1;\
 		sigprocmask(SIG_SETMASK, &(file_ds->ds_lock.sigset), NULL);\
+		pthread_mutex_unlock(&(file_ds->ds_lock.local));\
 	} else {\
 		ret = 0;\
 		file_ds->ds_lock.holding_lock = 1;\
 	}\
 }
+#define LOCK(file_ds, ret) LOCK_(file_ds, ret, pthread_rwlock_timedwrlock)
+#define RDLOCK(file_ds, ret) LOCK_(file_ds, ret, pthread_rwlock_timedrdlock)
 #define UNLOCK(file_ds) {\
-	sem_post(file_ds->ds_lock.lock);\
+	pthread_rwlock_unlock(file_ds->ds_lock.rwlock);\
 	file_ds->ds_lock.holding_lock = 0;\
 	sigprocmask(SIG_SETMASK, &(file_ds->ds_lock.sigset), NULL);\
+	pthread_mutex_unlock(&(file_ds->ds_lock.local));\
 }
 
+static int file_reload(struct ncds_ds_file* file_ds);
+static int file_sync_part(struct ncds_ds_file* file_ds, struct ds_part_s* part);
+static unsigned long file_generation(xmlDocPtr doc);
+static int file_journal_replay(struct ncds_ds_file* file_ds, struct ds_part_s* part);
+static xmlNodePtr file_journal_target(struct ncds_ds_file* file_ds, const xmlChar* name);
+static void file_history_push(struct ncds_ds_file* file_ds, xmlNodePtr target_ds, xmlNodePtr old, xmlNodePtr new);
+static void file_history_trim(struct ncds_ds_file* file_ds);
+static void file_history_clear(struct ncds_ds_file* file_ds);
+static struct ds_snapshot_s* file_snapshot_get(struct ncds_ds_file* file_ds, int i, struct nc_err** error);
+static void file_snapshot_put(struct ds_snapshot_s* snapshot);
+static void file_snapshot_publish(struct ncds_ds_file* file_ds, int i, struct ds_snapshot_s* snapshot);
+static void file_history_add(struct ncds_ds_file* file_ds, struct ds_history_s* record);
+static void file_history_free(struct ds_history_s* record);
+static size_t file_history_size(xmlNodePtr node);
+static int file_history_undo(struct ds_history_s* record);
+static void file_delta_reset(struct ncds_ds_file* file_ds, int valid);
+static void file_private_free(void* payload, const xmlChar* UNUSED(name));
+static int file_private_used(struct ncds_ds_file* file_ds, const struct nc_session* session);
+static void file_private_drop(struct ncds_ds_file* file_ds, const struct nc_session* session);
+static xmlDocPtr file_private_view(struct ncds_ds_file* file_ds, const struct nc_session* session);
+static struct file_private_swap* file_private_show(struct ncds_ds_file* file_ds, const struct nc_session* session);
+static void file_private_restore(struct file_private_swap* swaps);
+static int file_private_copy(struct ncds_ds_file* file_ds, const struct nc_session* session, xmlNodePtr source, struct nc_err** error);
+static int file_private_commit(struct ncds_ds_file* file_ds, const struct nc_session* session, const nc_rpc* rpc, xmlDocPtr* old, xmlDocPtr* new, struct nc_err** error);
+
 /**
  * @brief Determine if the datastore is accessible (is not NETCONF locked) for the
  * specified session. This function MUST be called between LOCK and UNLOCK
@@ -190,6 +229,127 @@ API int ncds_file_set_path(struct ncds_ds* datastore, const char* path)
 	return 0;
 }
 
+API int ncds_file_set_sync(struct ncds_ds* datastore, NCDS_FILE_SYNC mode, unsigned int window)
+{
+	struct ncds_ds_file * file_ds = (struct ncds_ds_file*)datastore;
+
+	if (datastore == NULL || datastore->type != NCDS_TYPE_FILE) {
+		ERROR("%s: invalid datastore.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	switch (mode) {
+	case NCDS_FILE_SYNC_NONE:
+	case NCDS_FILE_SYNC_COMMIT:
+	case NCDS_FILE_SYNC_GROUP:
+		break;
+	default:
+		ERROR("%s: invalid durability mode.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	file_ds->sync.mode = mode;
+	file_ds->sync.window = window;
+
+	return (EXIT_SUCCESS);
+}
+
+API int ncds_file_set_layout(struct ncds_ds* datastore, NCDS_FILE_LAYOUT layout)
+{
+	struct ncds_ds_file * file_ds = (struct ncds_ds_file*)datastore;
+
+	if (datastore == NULL || datastore->type != NCDS_TYPE_FILE) {
+		ERROR("%s: invalid datastore.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	if (file_ds->parts_count > 0) {
+		ERROR("%s: the datastore is already initiated.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	switch (layout) {
+	case NCDS_FILE_LAYOUT_SINGLE:
+	case NCDS_FILE_LAYOUT_SPLIT:
+		break;
+	default:
+		ERROR("%s: invalid datastore layout.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	file_ds->layout = layout;
+
+	return (EXIT_SUCCESS);
+}
+
+API int ncds_file_get_stats(struct ncds_ds* datastore, struct ncds_file_stats* stats)
+{
+	struct ncds_ds_file * file_ds = (struct ncds_ds_file*)datastore;
+
+	if (datastore == NULL || datastore->type != NCDS_TYPE_FILE || stats == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	if (file_ds->ds_lock.rwlock == NULL) {
+		/* not initiated yet */
+		memcpy(stats, &(file_ds->sync.stats), sizeof(struct ncds_file_stats));
+		return (EXIT_SUCCESS);
+	}
+
+	pthread_mutex_lock(&(file_ds->sync.lock));
+	memcpy(stats, &(file_ds->sync.stats), sizeof(struct ncds_file_stats));
+	pthread_mutex_unlock(&(file_ds->sync.lock));
+
+	return (EXIT_SUCCESS);
+}
+
+API int ncds_file_set_rollback(struct ncds_ds* datastore, unsigned int levels, size_t max_size)
+{
+	struct ncds_ds_file * file_ds = (struct ncds_ds_file*)datastore;
+
+	if (datastore == NULL || datastore->type != NCDS_TYPE_FILE) {
+		ERROR("%s: invalid datastore.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	if (file_ds->ds_lock.rwlock != NULL) {
+		pthread_mutex_lock(&(file_ds->ds_lock.local));
+	}
+	file_ds->rollback.levels = levels;
+	file_ds->rollback.max_size = max_size;
+	file_history_trim(file_ds);
+	if (file_ds->ds_lock.rwlock != NULL) {
+		pthread_mutex_unlock(&(file_ds->ds_lock.local));
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+API int ncds_file_set_private_candidate(struct ncds_ds* datastore, int enable)
+{
+	struct ncds_ds_file * file_ds = (struct ncds_ds_file*)datastore;
+
+	if (datastore == NULL || datastore->type != NCDS_TYPE_FILE) {
+		ERROR("%s: invalid datastore.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	if (file_ds->ds_lock.rwlock != NULL) {
+		pthread_mutex_lock(&(file_ds->ds_lock.local));
+	}
+	file_ds->private_candidate = enable;
+	if (!enable && file_ds->privates != NULL) {
+		xmlHashFree(file_ds->privates, file_private_free);
+		file_ds->privates = NULL;
+	}
+	if (file_ds->ds_lock.rwlock != NULL) {
+		pthread_mutex_unlock(&(file_ds->ds_lock.local));
+	}
+
+	return (EXIT_SUCCESS);
+}
+
 /**
  * @brief Checks if the structure of an XML matches the expected one
  * @param[in] doc Document to check.
@@ -308,702 +468,4846 @@ invalid_ds:
 	return (EXIT_FAILURE);
 }
 
-int ncds_file_changed(struct ncds_ds* ds)
+/**
+ * @brief Start watching the directory with the part files for changes made by
+ * other programs (text editors etc.). On failure, the modification times of the
+ * files are checked instead.
+ *
+ * @param file_ds File datastore structure.
+ */
+static void file_watch_init(struct ncds_ds_file* file_ds)
 {
-	time_t t;
-	struct stat statbuf;
+	char* dir_path;
 
-	/* get current time */
-	if ((t = time(NULL)) == ((time_t)(-1))) {
-		ERROR("time() failed (%s)", strerror(errno));
-		/* we do not know, so answer that file was changed */
-		return (1);
+	if ((dir_path = strdup(file_ds->path)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return;
 	}
-
-	/* check when the file was modified */
-	if (stat(((struct ncds_ds_file*)ds)->path, &statbuf) == 0) {
-		if (statbuf.st_mtime < ds->last_access) {
-			/* file was not modified */
-			return (0);
-		}
+	if ((file_ds->watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+		WARN("Unable to watch the datastore %s (%s), checking its modification time instead.", file_ds->path, strerror(errno));
+	} else if (inotify_add_watch(file_ds->watch, dirname(dir_path), NCDS_WATCH_EVENTS) == -1) {
+		WARN("Unable to watch the datastore %s (%s), checking its modification time instead.", file_ds->path, strerror(errno));
+		close(file_ds->watch);
+		file_ds->watch = -1;
 	}
-	return (1);
+	free(dir_path);
 }
 
 /**
- * @ingroup store
- * @brief Initialization of the file datastore
+ * @brief Test if the part file is still the one this process read or wrote
+ * last time, compared by the inode, size and modification time.
  *
- * @file_ds File datastore structure
+ * @param part Part to check.
  *
- * @return 0 on success, non-zero else
+ * @return 1 if the file is not the known one, 0 otherwise.
  */
-int ncds_file_init(struct ncds_ds* ds)
+static int file_part_replaced(struct ds_part_s* part)
 {
-	struct stat st;
-	char* new_path = NULL, *sempath, *dir_name, *file_name, *dup_path;
-	struct dirent * file_info;
-	DIR * dir;
-	int fd;
-	mode_t mask;
-	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-
-	file_ds->xml = xmlReadFile(file_ds->path, NULL, NC_XMLREAD_OPTIONS);
-	while (file_ds->xml == NULL || file_structure_check(file_ds->xml) == 0) { /* while is used for break */
-		WARN("Failed to parse the datastore (%s).", file_ds->path);
-		/*
-		 * Try to use a backup datastore that we can use instead the main one
-		 */
-		if (stat(file_ds->path, &st) == -1) {
-			ERROR("Unable to work with datastore file (%s), trying to use a backup datastore.", strerror(errno));
-		} else if (st.st_size > 0) {
-			/* there are some data in the datastore file */
-			WARN("Datastore file contains some data, trying to use a backup datastore...");
-		} else { /* st.st_size == 0 */
-			/* nothing needed, just use the datastore file and create an empty datastore inside it */
-			break;
-		}
+	struct stat statbuf;
 
-		/* create a temporary file where an empty datastore will be created */
-		dup_path = strdup(file_ds->path);
-		file_name = basename(dup_path);
-		dir_name = dirname(dup_path);
+	if (stat(part->path, &statbuf) == -1) {
+		return (1);
+	}
 
-		/* cleanup so far structures because new will be created */
-		fclose(file_ds->file);
-		xmlFreeDoc(file_ds->xml);
-		file_ds->file = NULL;
-		file_ds->xml = NULL;
+	return (statbuf.st_dev != part->file_stat.st_dev || statbuf.st_ino != part->file_stat.st_ino ||
+			statbuf.st_size != part->file_stat.st_size ||
+			statbuf.st_mtim.tv_sec != part->file_stat.st_mtim.tv_sec ||
+			statbuf.st_mtim.tv_nsec != part->file_stat.st_mtim.tv_nsec);
+}
 
-		/* checking if there are any valid backup datastores */
-		if ((dir = opendir(dir_name)) == NULL) {
-			ERROR("Unable to open datastore directory %s (%s).", dir_name, strerror(errno));
-			free(dup_path);
-			return (EXIT_FAILURE);
-		}
+/**
+ * @brief Process the pending events of the datastore directory watch and mark
+ * the changed parts as externally modified. Events of a part whose file still
+ * matches the file this process read or wrote last time, e.g. the events of
+ * our own rename, are ignored.
+ *
+ * @param file_ds File datastore structure.
+ */
+/**
+ * @brief Stop watching the datastore files. The readers of the snapshots
+ * check the watch without the local lock, so it is replaced atomically.
+ */
+static void file_watch_close(struct ncds_ds_file* file_ds)
+{
+	int watch = file_ds->watch;
 
-		for (errno = 0; (file_info = readdir(dir)) != NULL;) {
-			if (errno) {
-				ERROR("Unable to read datastore directory %s (%s).", dir_name, strerror(errno));
-				free(dup_path);
-				return (EXIT_FAILURE);
-			}
+	__atomic_store_n(&(file_ds->watch), -1, __ATOMIC_RELEASE);
+	close(watch);
+}
 
-			/* check if readed file contains original file name */
-			if (strncmp(file_info->d_name, file_name, strlen(file_name)) != 0) {
-				continue;
-			}
+/**
+ * @brief Forget the published snapshots if a part file was changed by another
+ * program, the readers of the snapshots see only the libnetconf changes.
+ */
+static void file_watch_forget(struct ncds_ds_file* file_ds)
+{
+	int i;
 
-			/* we have some file that could be a backup datastore from some previous run */
-			if (asprintf(&new_path, "%s/%s", dir_name, file_info->d_name) == -1) {
-				ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
-				free(dup_path);
-				return (EXIT_FAILURE);
-			}
-			nc_clip_occurences_with(new_path, '/', '/');
+	for (i = 0; i < file_ds->parts_count && !file_ds->parts[i].external; i++);
+	if (i < file_ds->parts_count) {
+		for (i = 0; i < 3; i++) {
+			file_snapshot_publish(file_ds, i, NULL);
+		}
+	}
+}
 
-			file_ds->xml = xmlReadFile(new_path, NULL, NC_XMLREAD_OPTIONS);
-			if (file_ds->xml == NULL || file_structure_check(file_ds->xml) == 0) {
-				/* bad backup datastore, try another one */
-				free(new_path);
-				new_path = NULL;
-				continue;
-			} else {
-				/* we found a correct backup datastore, use it */
-				WARN("Using %s as a backup datastore.", new_path);
-				file_ds->file = fopen(new_path, "r+");
-				if (file_ds->file == NULL) {
-					/* ok, that is not so correct as we thought, wtf?!? */
-					ERROR("Unable to open backup datastore (%s)", strerror(errno));
-					xmlFreeDoc(file_ds->xml);
-					file_ds->xml = NULL;
-					free(new_path);
-					new_path = NULL;
+static void file_watch_read(struct ncds_ds_file* file_ds)
+{
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event* event;
+	const char* name;
+	ssize_t len;
+	char* ptr;
+	int i;
+
+	if (file_ds->parts_count == 0 || file_ds->watch == -1) {
+		return;
+	}
 
-					/* try another file in backup datastore directory */
+	while ((len = read(file_ds->watch, buf, sizeof(buf))) > 0) {
+		for (ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event*) ptr;
+			for (i = 0; i < file_ds->parts_count; i++) {
+				if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED)) {
+					/* some events were lost or the watch was removed */
+					file_ds->parts[i].external = 1;
 					continue;
 				}
-
-				/* now it is surely correct, not like a few lines above :) */
-				free(file_ds->path);
-				file_ds->path = new_path;
-				break;
+				name = strrchr(file_ds->parts[i].path, '/');
+				name = (name == NULL) ? file_ds->parts[i].path : name + 1;
+				if (event->len > 0 && strcmp(event->name, name) == 0 && !file_ds->parts[i].external &&
+						file_part_replaced(&(file_ds->parts[i]))) {
+					file_ds->parts[i].external = 1;
+				}
 			}
+			if (event->mask & IN_IGNORED) {
+				WARN("Watching the datastore %s stopped, checking its modification time instead.", file_ds->path);
+				file_watch_close(file_ds);
+				file_watch_forget(file_ds);
+				return;
+			}
+		}
+	}
+	if (len == -1 && errno != EAGAIN && errno != EINTR) {
+		WARN("Reading the datastore %s watch failed (%s), checking its modification time instead.", file_ds->path, strerror(errno));
+		file_watch_close(file_ds);
+		for (i = 0; i < file_ds->parts_count; i++) {
+			file_ds->parts[i].external = 1;
 		}
+	}
+	file_watch_forget(file_ds);
+}
 
-		free(dup_path);
-		closedir(dir);
+/**
+ * @brief Test if the part file or its journal was changed since the last reload.
+ * This function MUST be called with the local lock held.
+ */
+static int file_part_changed(struct ncds_ds_file* file_ds, struct ds_part_s* part)
+{
+	struct stat statbuf;
+	int i = part - file_ds->parts;
 
-		if (file_ds->file == NULL) {
-			/* no previous backup datastore found, create a new one */
+	if (part->last_access == 0 || part->external ||
+			file_ds->ds_lock.shared->parts[i].rewrites != part->rewrites ||
+			file_ds->ds_lock.shared->parts[i].changes != part->changes) {
+		return (1);
+	}
 
-			/* Create file based on original name */
-			if (asprintf(&new_path, "%s.XXXXXX", file_ds->path) == -1) {
-				ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
-				return (EXIT_FAILURE);
-			}
-			nc_clip_occurences_with(new_path, '/', '/');
-			WARN("Using %s as a backup datastore.", new_path);
-			if ((fd = mkstemp(new_path)) == -1) {
-				ERROR("Unable to create backup datastore (%s).", strerror(errno));
-				free(new_path);
-				return (EXIT_FAILURE);
-			}
-			if ((file_ds->file = fdopen(fd, "r+")) == NULL) {
-				ERROR("Unable to open backup datastore (%s)", strerror(errno));
-				free(new_path);
-				close(fd);
-				return (EXIT_FAILURE);
-			}
-			free(file_ds->path);
-			file_ds->path = new_path;
-		}
+	/* without the watch, check when the file was modified */
+	if (file_ds->watch == -1 && (stat(part->path, &statbuf) != 0 || statbuf.st_mtime >= part->last_access)) {
+		return (1);
+	}
+	return (0);
+}
 
-		/* end the while loop */
-		break;
+int ncds_file_changed(struct ncds_ds* ds)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	int i, ret;
+
+	pthread_mutex_lock(&(file_ds->ds_lock.local));
+	file_watch_read(file_ds);
+	for (ret = file_ds->modified, i = 0; !ret && i < file_ds->parts_count; i++) {
+		ret = file_part_changed(file_ds, &(file_ds->parts[i]));
 	}
+	pthread_mutex_unlock(&(file_ds->ds_lock.local));
 
-	/* if necessary, create an empty datastore */
-	if (file_ds->xml == NULL) {
+	return (ret);
+}
 
-		file_ds->xml = file_create_xmlframe();
-		if (file_ds->xml == NULL) {
-			return (EXIT_FAILURE);
+/**
+ * @brief Find the part storing the specified datastore.
+ *
+ * @param file_ds File datastore structure.
+ * @param target_ds Node of the datastore.
+ *
+ * @return Part of the datastore.
+ */
+static struct ds_part_s* file_part(struct ncds_ds_file* file_ds, xmlNodePtr target_ds)
+{
+	int i;
+
+	for (i = 1; i < file_ds->parts_count; i++) {
+		if (xmlStrcmp(target_ds->name, BAD_CAST file_ds->parts[i].name) == 0) {
+			return (&(file_ds->parts[i]));
 		}
-		xmlDocFormatDump(file_ds->file, file_ds->xml, 1);
-		WARN("File %s was empty. Basic structure created.", file_ds->path);
 	}
 
-	/* init value */
-	file_ds->xml_rollback = NULL;
+	return (&(file_ds->parts[0]));
+}
 
-	/* get pointers to running, startup and candidate nodes in xml */
-	if (file_fill_dsnodes(file_ds) != EXIT_SUCCESS) {
-		return (EXIT_FAILURE);
-	}
+/**
+ * @brief Get the datastore node with the specified name from a datastore file
+ * content.
+ */
+static xmlNodePtr file_part_node(xmlDocPtr doc, const char* name)
+{
+	xmlNodePtr node;
 
-	/* unlock forgotten locks if any */
-	xmlSetProp (file_ds->running, BAD_CAST "lock", BAD_CAST "");
-	xmlSetProp (file_ds->startup, BAD_CAST "lock", BAD_CAST "");
-	xmlSetProp (file_ds->candidate, BAD_CAST "lock", BAD_CAST "");
-
-	/*
-	 * open and eventually create a lock
-	 */
-	/* first - prepare the path, there must be a separate lock for each
-	 * datastore(set), so name it according to the filepath with a special prefix.
-	 * Slashes in the path are replaced with underscores.
-	 * Sequences of slashes are treated as a single slash character.
-	 */
-	if (asprintf(&sempath, "%s/%s", NCDS_LOCK, file_ds->path) == -1) {
-		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
-		return (EXIT_FAILURE);
+	if (doc == NULL || xmlDocGetRootElement(doc) == NULL) {
+		return (NULL);
 	}
-	nc_clip_occurences_with(sempath, '/', '_');
-	/* recreate initial backslash in the semaphore name */
-	sempath[0] = '/';
-	/* and then create the lock (actually it is a semaphore) */
-	mask = umask(0000);
-	if ((file_ds->ds_lock.lock = sem_open (sempath, O_CREAT, FILE_PERM, 1)) == SEM_FAILED) {
-		umask(mask);
-		return (EXIT_FAILURE);
+	for (node = xmlDocGetRootElement(doc)->children; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, BAD_CAST name) == 0) {
+			return (node);
+		}
 	}
-	umask(mask);
-	free (sempath);
 
-	return (EXIT_SUCCESS);
+	return (NULL);
 }
 
-void ncds_file_free(struct ncds_ds* ds)
+/**
+ * @brief Copy the datastore node into another document.
+ *
+ * @param doc Target document.
+ * @param ns Namespace of the file datastore structure in the target document.
+ * @param node Datastore node to copy.
+ *
+ * @return Copy of the datastore node.
+ */
+static xmlNodePtr file_part_copy(xmlDocPtr doc, xmlNsPtr ns, xmlNodePtr node)
 {
-	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-
-	if (file_ds != NULL) {
-		/* ncds_ds_file specific part */
-		if (file_ds->file != NULL) {
-			fclose(file_ds->file);
-		}
-		free(file_ds->path);
-		xmlFreeDoc(file_ds->xml);
-		xmlFreeDoc(file_ds->xml_rollback);
-		if (file_ds->ds_lock.lock != NULL) {
-			if (file_ds->ds_lock.holding_lock) {
-				sem_post (file_ds->ds_lock.lock);
-			}
-			sem_close(file_ds->ds_lock.lock);
-		}
+	xmlNodePtr copy;
+	xmlAttrPtr attr;
+	xmlChar* value;
+
+	copy = xmlNewDocNode(doc, ns, node->name, NULL);
+	for (attr = node->properties; attr != NULL; attr = attr->next) {
+		value = xmlNodeGetContent((xmlNodePtr) attr);
+		xmlSetProp(copy, attr->name, value);
+		xmlFree(value);
+	}
+	if (node->children != NULL) {
+		xmlAddChildList(copy, xmlDocCopyNodeList(doc, node->children));
 	}
+
+	return (copy);
 }
 
 /**
- * @brief Reloads xml configuration from the datastorage file. This function MUST be
- * called ONLY between file_ds_lock() and file_ds_unlock().
- *
- * Tries to read from the datastore and find the datastore root elements.
- * If succussfully, the old xml is freed and replaced with a new one.
- * If it fails, the structure is preserved as it was.
+ * @brief Replace the datastore of the part by its content read from the part
+ * file.
  *
- * @param file_ds Pointer to the datastorage structure
+ * @param file_ds File datastore structure.
+ * @param part Part of the datastore.
+ * @param doc Content of the part file.
  *
  * @return EXIT_SUCCESS or EXIT_FAILURE
  */
-static int file_reload(struct ncds_ds_file* file_ds)
+static int file_part_load(struct ncds_ds_file* file_ds, struct ds_part_s* part, xmlDocPtr doc)
 {
-	xmlDocPtr new_xml;
-	struct stat statbuf;
-	time_t t;
-
-	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
-		ERROR("%s: invalid parameter.", __func__);
-		return EXIT_FAILURE;
-	}
-
-	/* get current time */
-	if ((t = time(NULL)) == ((time_t)(-1))) {
-		t = 0;
-		WARN("Setting datastore access time failed (%s)", strerror(errno));
-	}
-
-	/* check when the file was modified */
-	if (stat(file_ds->path, &statbuf) == 0) {
-		if (statbuf.st_mtime < file_ds->ds.last_access) {
-			/* file was not modified */
-			return (EXIT_SUCCESS);
-		}
-	}
-
-	/* file was modified, it may be necessary to reopen it */
-	fclose(file_ds->file);
-	file_ds->file = fopen(file_ds->path, "r+");
-	if (file_ds->file == NULL) {
-		ERROR("%s: reopenening the file %s failed (%s)", __func__, file_ds->path, strerror(errno));
-		return EXIT_FAILURE;
-	}
-
-	new_xml = xmlReadFile (file_ds->path, NULL, NC_XMLREAD_OPTIONS);
-	if (new_xml == NULL) {
-		return EXIT_FAILURE;
-	}
-
-	xmlFreeDoc (file_ds->xml);
-	file_ds->xml = new_xml;
+	xmlNodePtr old, new;
 
-	if (file_fill_dsnodes (file_ds)) {
-		xmlFreeDoc (new_xml);
-		return EXIT_FAILURE;
+	if ((new = file_part_node(doc, part->name)) == NULL ||
+			(old = file_part_node(file_ds->xml, part->name)) == NULL) {
+		ERROR("%s: the datastore %s not found in %s.", __func__, part->name, part->path);
+		return (EXIT_FAILURE);
 	}
 
-	/* update access time */
-	file_ds->ds.last_access = t;
-
-	return EXIT_SUCCESS;
+	xmlReplaceNode(old, file_part_copy(file_ds->xml, old->ns, new));
+	xmlFreeNode(old);
 
+	return (file_fill_dsnodes(file_ds));
 }
 
 /**
- * @brief Write the current version of the configuration to a file. This function MUST be
- * called ONLY between file_ds_lock() and file_ds_unlock().
+ * @brief Write the content of the part into the file.
  *
- * @param file_ds Datastore to sync.
+ * @param file_ds File datastore structure.
+ * @param part Part to write.
+ * @param file Opened file to write into.
  *
- * @return EXIT_SUCCESS or EXIT_FAILURE
+ * @return Number of written bytes, -1 on error.
  */
-static int file_sync(struct ncds_ds_file* file_ds)
+static long file_part_write(struct ncds_ds_file* file_ds, struct ds_part_s* part, FILE* file)
 {
-	time_t t;
+	xmlDocPtr doc;
+	xmlNodePtr root, node;
+	char gen[24];
+	long size;
+	int i;
 
-	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
-		ERROR("%s: invalid parameter.", __func__);
-		return EXIT_FAILURE;
-	}
+	snprintf(gen, sizeof(gen), "%lu", part->generation);
 
-	/* erase actual config */
-	if (ftruncate (fileno(file_ds->file), 0) == -1) {
-		ERROR ("%s: truncate() of file %s failed (%s)", __func__, file_ds->path, strerror(errno));
-		return EXIT_FAILURE;
+	if (part->name == NULL) {
+		/* the single file with all the datastores */
+		xmlSetProp(xmlDocGetRootElement(file_ds->xml), BAD_CAST "generation", BAD_CAST gen);
+		return (xmlDocFormatDump(file, file_ds->xml, 1));
 	}
-	rewind (file_ds->file);
 
-	if(xmlDocFormatDump(file_ds->file, file_ds->xml, 1) == -1) {
-		ERROR("%s: storing repository into the file %s failed.", __func__, file_ds->path);
-		return (EXIT_FAILURE);
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	doc->encoding = xmlStrdup(BAD_CAST "UTF-8");
+	root = xmlDocCopyNode(xmlDocGetRootElement(file_ds->xml), doc, 2);
+	xmlDocSetRootElement(doc, root);
+	xmlSetProp(root, BAD_CAST "generation", BAD_CAST gen);
+	for (node = xmlDocGetRootElement(file_ds->xml)->children; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (xmlStrcmp(node->name, BAD_CAST part->name) == 0) {
+			xmlAddChild(root, file_part_copy(doc, root->ns, node));
+		} else if (part == &(file_ds->parts[0])) {
+			/*
+			 * the datastore file keeps the complete structure, but the
+			 * content of the datastores in other parts is not stored here
+			 */
+			for (i = 1; i < file_ds->parts_count; i++) {
+				if (xmlStrcmp(node->name, BAD_CAST file_ds->parts[i].name) == 0) {
+					break;
+				}
+			}
+			if (i < file_ds->parts_count) {
+				xmlNewChild(root, root->ns, node->name, NULL);
+			} else {
+				xmlAddChild(root, file_part_copy(doc, root->ns, node));
+			}
+		}
 	}
 
-	/* update last access time */
-	if ((t = time(NULL)) == ((time_t)(-1))) {
-		WARN("Setting datastore access time failed (%s)", strerror(errno));
-	} else {
-		file_ds->ds.last_access = t;
-	}
+	size = xmlDocFormatDump(file, doc, 1);
+	xmlFreeDoc(doc);
 
-	return EXIT_SUCCESS;
+	return (size);
 }
 
-static int file_rollback_store(struct ncds_ds_file* file_ds)
+/**
+ * @brief Prepare the datastore parts and their journals. This function is
+ * called at the end of ncds_file_init().
+ *
+ * @param file_ds File datastore structure.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_parts_init(struct ncds_ds_file* file_ds)
 {
-	if (file_ds == NULL) {
-		ERROR("%s: invalid parameter.", __func__);
-		return (EXIT_FAILURE);
-	}
-
-	xmlFreeDoc(file_ds->xml_rollback);
-	file_ds->xml_rollback = xmlCopyDoc(file_ds->xml, 1);
+	const char* names[] = {"running", "startup", "candidate"};
+	struct ds_part_s* part;
+	struct stat st;
+	xmlDocPtr doc;
+	mode_t mask;
+	int i, created;
+
+	file_ds->watch = -1;
+	file_ds->parts_count = (file_ds->layout == NCDS_FILE_LAYOUT_SPLIT) ? NCDS_FILE_PARTS : 1;
+	for (i = 0; i < file_ds->parts_count; i++) {
+		part = &(file_ds->parts[i]);
+		part->name = (file_ds->layout == NCDS_FILE_LAYOUT_SPLIT) ? names[i] : NULL;
+
+		created = 0;
+		if (i == 0) {
+			/* the datastore file opened by ncds_file_set_path() */
+			part->path = strdup(file_ds->path);
+			part->file = file_ds->file;
+			file_ds->file = NULL;
+			part->generation = file_generation(file_ds->xml);
+		} else {
+			if (asprintf(&part->path, "%s.%s", file_ds->path, part->name) == -1) {
+				ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+				part->path = NULL;
+				return (EXIT_FAILURE);
+			}
+			mask = umask(MASK_PERM);
+			part->file = fopen(part->path, "a+");
+			umask(mask);
+			if (part->file == NULL || (part->file = freopen(NULL, "r+", part->file)) == NULL) {
+				ERROR("Datastore file %s cannot be opened (%s).", part->path, strerror(errno));
+				return (EXIT_FAILURE);
+			}
 
-	return (EXIT_SUCCESS);
-}
+			doc = NULL;
+			if (fstat(fileno(part->file), &st) == 0 && st.st_size > 0) {
+				doc = xmlReadFile(part->path, NULL, NC_XMLREAD_OPTIONS);
+			}
+			if (doc != NULL && file_part_load(file_ds, part, doc) == EXIT_SUCCESS) {
+				part->generation = file_generation(doc);
+			} else {
+				/* move the datastore from the single datastore file */
+				if (doc != NULL) {
+					WARN("Failed to parse the datastore %s, using the content of %s.", part->path, file_ds->path);
+				}
+				part->generation = 0;
+				if (ftruncate(fileno(part->file), 0) == -1 || file_part_write(file_ds, part, part->file) == -1) {
+					ERROR("Unable to write the datastore file %s.", part->path);
+					xmlFreeDoc(doc);
+					return (EXIT_FAILURE);
+				}
+				fflush(part->file);
+				created = 1;
+			}
+			xmlFreeDoc(doc);
+		}
 
-static int file_rollback_restore(struct ncds_ds_file* file_ds)
-{
-	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
-		ERROR("%s: invalid parameter.", __func__);
-		return (EXIT_FAILURE);
-	}
+		if (stat(part->path, &st) == 0) {
+			part->file_size = st.st_size;
+		}
 
-	if (file_ds->xml_rollback == NULL) {
-		ERROR("No backup repository for rollback operation (datastore %d).", file_ds->ds.id);
-		return (EXIT_FAILURE);
+		/*
+		 * open the journal, its records are applied by file_reload() since they
+		 * can be processed only with the final (consolidated) data model
+		 */
+		if (asprintf(&part->journal_path, "%s%s", part->path, NCDS_JOURNAL_SUFFIX) == -1) {
+			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+			part->journal_path = NULL;
+			return (EXIT_FAILURE);
+		}
+		mask = umask(MASK_PERM);
+		part->journal = fopen(part->journal_path, "a+");
+		umask(mask);
+		if (part->journal == NULL) {
+			WARN("Unable to open the datastore journal %s (%s), changes will be written directly into the datastore file.", part->journal_path, strerror(errno));
+		} else if (created && ftruncate(fileno(part->journal), 0) == -1) {
+			/* records of a previous part file must not be applied */
+			ERROR("%s: truncate() of file %s failed (%s)", __func__, part->journal_path, strerror(errno));
+			return (EXIT_FAILURE);
+		}
+		part->journal_offset = 0;
+		part->journal_end = -1;
 	}
 
-	xmlFreeDoc(file_ds->xml);
-	file_ds->xml = file_ds->xml_rollback;
-	file_ds->xml_rollback = NULL;
-	file_ds->ds.last_access = 0;
+	/* changes of the part files made so far are read by the first reload */
+	file_watch_init(file_ds);
 
-	file_fill_dsnodes(file_ds);
-
-	return (file_sync(file_ds));
+	return (EXIT_SUCCESS);
 }
 
-int ncds_file_rollback(struct ncds_ds* ds)
+/**
+ * @brief Open and eventually create the lock of the datastore file - the
+ * semaphore and the shared data with the reader/writer lock. All the processes
+ * accessing the datastore file use the same objects.
+ *
+ * @param[in] path Path to the datastore file.
+ * @param[out] lock Semaphore guarding the initialization of the shared data,
+ * NULL if it cannot be opened.
+ *
+ * @return Mapped shared data, NULL on error.
+ */
+struct ds_shared_s* ncds_file_shared_open(const char* path, sem_t** lock)
 {
-	int ret;
+	struct ds_shared_s* shared;
+	pthread_rwlockattr_t rwlockattr;
+	struct stat st;
+	char* sempath;
+	mode_t mask;
+	int fd;
 
-	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	*lock = NULL;
 
-	if (file_ds == NULL || file_ds->ds.type != NCDS_TYPE_FILE) {
-		return (EXIT_FAILURE);
+	/* first - prepare the path, there must be a separate lock for each
+	 * datastore(set), so name it according to the filepath with a special prefix.
+	 * Slashes in the path are replaced with underscores.
+	 * Sequences of slashes are treated as a single slash character.
+	 */
+	if (asprintf(&sempath, "%s/%s", NCDS_LOCK, path) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
 	}
-
-	LOCK(file_ds, ret);
-	if (ret) {
-		return (EXIT_FAILURE);
+	nc_clip_occurences_with(sempath, '/', '_');
+	/* recreate initial backslash in the semaphore name */
+	sempath[0] = '/';
+	/* and then create the lock (actually it is a semaphore) */
+	mask = umask(0000);
+	if ((*lock = sem_open (sempath, O_CREAT, FILE_PERM, 1)) == SEM_FAILED) {
+		*lock = NULL;
+		umask(mask);
+		free(sempath);
+		return (NULL);
 	}
-	ret = file_rollback_restore(file_ds);
-	UNLOCK(file_ds);
-
-	return (ret);
-}
-
-static struct ncds_lockinfo lockinfo_running = {NC_DATASTORE_RUNNING, NULL, NULL};
-static struct ncds_lockinfo lockinfo_startup = {NC_DATASTORE_STARTUP, NULL, NULL};
-static struct ncds_lockinfo lockinfo_candidate = {NC_DATASTORE_CANDIDATE, NULL, NULL};
-const struct ncds_lockinfo *ncds_file_lockinfo(struct ncds_ds* ds, NC_DATASTORE target)
-{
-	int ret;
-	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-	xmlNodePtr target_ds;
-	struct ncds_lockinfo *info;
+	free (sempath);
 
-	LOCK(file_ds, ret);
-	if (ret) {
+	/* the same for the reader/writer lock in the shared memory */
+	if (asprintf(&sempath, "%s/%s", NCDS_RWLOCK, path) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		umask(mask);
 		return (NULL);
 	}
-
-	if (file_reload (file_ds)) {
-		UNLOCK(file_ds);
+	nc_clip_occurences_with(sempath, '/', '_');
+	sempath[0] = '/';
+	/* the semaphore guards the initialization of the shared lock */
+	sem_wait(*lock);
+	fd = shm_open(sempath, O_RDWR | O_CREAT, FILE_PERM);
+	umask(mask);
+	free(sempath);
+	if (fd == -1 || fstat(fd, &st) == -1 ||
+			(st.st_size < (off_t) sizeof(struct ds_shared_s) && ftruncate(fd, sizeof(struct ds_shared_s)) == -1)) {
+		ERROR("Unable to prepare the datastore lock (%s).", strerror(errno));
+		if (fd != -1) {
+			close(fd);
+		}
+		sem_post(*lock);
 		return (NULL);
 	}
-
-	/* check validity of function parameters */
-	switch(target) {
-	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
-		info = &lockinfo_running;
-		break;
-	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
-		info = &lockinfo_startup;
-		break;
-	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
-		info = &lockinfo_candidate;
-		break;
-	default:
-		UNLOCK(file_ds);
+	shared = mmap(NULL, sizeof(struct ds_shared_s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shared == MAP_FAILED) {
+		ERROR("Mapping the datastore lock failed (%s).", strerror(errno));
+		sem_post(*lock);
 		return (NULL);
-		break;
 	}
-	free((*info).sid);
-	free((*info).time);
-	(*info).sid = (char*) xmlGetProp (target_ds, BAD_CAST "lock");
-	(*info).time = (char*) xmlGetProp (target_ds, BAD_CAST "locktime");
-	if ((*info).sid == NULL) {
-		WARN("%s: missing the \"lock\" attribute in the %s datastore.", __func__, file_ds->ds.data_model->name);
-	} else if (strisempty((*info).sid)) {
-		free((*info).sid);
-		free((*info).time);
-		(*info).sid = NULL;
-		(*info).time = NULL;
+	if (st.st_size == 0) {
+		/* we have created the shared memory, so initiate the lock */
+		pthread_rwlockattr_init(&rwlockattr);
+		pthread_rwlockattr_setpshared(&rwlockattr, PTHREAD_PROCESS_SHARED);
+		pthread_rwlock_init(&(shared->rwlock), &rwlockattr);
+		pthread_rwlockattr_destroy(&rwlockattr);
 	}
+	sem_post(*lock);
 
-	UNLOCK(file_ds);
-
-	return (info);
+	return (shared);
 }
 
-int ncds_file_lock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
+/**
+ * @ingroup store
+ * @brief Initialization of the file datastore
+ *
+ * @file_ds File datastore structure
+ *
+ * @return 0 on success, non-zero else
+ */
+int ncds_file_init(struct ncds_ds* ds)
 {
-	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-	xmlChar* lock, *modified = NULL;
+	struct stat st;
+	char* new_path = NULL, *dir_name, *file_name, *dup_path;
+	struct dirent * file_info;
+	DIR * dir;
+	int fd;
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+
+	file_ds->xml = xmlReadFile(file_ds->path, NULL, NC_XMLREAD_OPTIONS);
+	while (file_ds->xml == NULL || file_structure_check(file_ds->xml) == 0) { /* while is used for break */
+		WARN("Failed to parse the datastore (%s).", file_ds->path);
+		/*
+		 * Try to use a backup datastore that we can use instead the main one
+		 */
+		if (stat(file_ds->path, &st) == -1) {
+			ERROR("Unable to work with datastore file (%s), trying to use a backup datastore.", strerror(errno));
+		} else if (st.st_size > 0) {
+			/* there are some data in the datastore file */
+			WARN("Datastore file contains some data, trying to use a backup datastore...");
+		} else { /* st.st_size == 0 */
+			/* nothing needed, just use the datastore file and create an empty datastore inside it */
+			break;
+		}
+
+		/* create a temporary file where an empty datastore will be created */
+		dup_path = strdup(file_ds->path);
+		file_name = basename(dup_path);
+		dir_name = dirname(dup_path);
+
+		/* cleanup so far structures because new will be created */
+		fclose(file_ds->file);
+		xmlFreeDoc(file_ds->xml);
+		file_ds->file = NULL;
+		file_ds->xml = NULL;
+
+		/* checking if there are any valid backup datastores */
+		if ((dir = opendir(dir_name)) == NULL) {
+			ERROR("Unable to open datastore directory %s (%s).", dir_name, strerror(errno));
+			free(dup_path);
+			return (EXIT_FAILURE);
+		}
+
+		for (errno = 0; (file_info = readdir(dir)) != NULL;) {
+			if (errno) {
+				ERROR("Unable to read datastore directory %s (%s).", dir_name, strerror(errno));
+				free(dup_path);
+				return (EXIT_FAILURE);
+			}
+
+			/* check if readed file contains original file name */
+			if (strncmp(file_info->d_name, file_name, strlen(file_name)) != 0) {
+				continue;
+			}
+
+			/* we have some file that could be a backup datastore from some previous run */
+			if (asprintf(&new_path, "%s/%s", dir_name, file_info->d_name) == -1) {
+				ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+				free(dup_path);
+				return (EXIT_FAILURE);
+			}
+			nc_clip_occurences_with(new_path, '/', '/');
+
+			file_ds->xml = xmlReadFile(new_path, NULL, NC_XMLREAD_OPTIONS);
+			if (file_ds->xml == NULL || file_structure_check(file_ds->xml) == 0) {
+				/* bad backup datastore, try another one */
+				free(new_path);
+				new_path = NULL;
+				continue;
+			} else {
+				/* we found a correct backup datastore, use it */
+				WARN("Using %s as a backup datastore.", new_path);
+				file_ds->file = fopen(new_path, "r+");
+				if (file_ds->file == NULL) {
+					/* ok, that is not so correct as we thought, wtf?!? */
+					ERROR("Unable to open backup datastore (%s)", strerror(errno));
+					xmlFreeDoc(file_ds->xml);
+					file_ds->xml = NULL;
+					free(new_path);
+					new_path = NULL;
+
+					/* try another file in backup datastore directory */
+					continue;
+				}
+
+				/* now it is surely correct, not like a few lines above :) */
+				free(file_ds->path);
+				file_ds->path = new_path;
+				break;
+			}
+		}
+
+		free(dup_path);
+		closedir(dir);
+
+		if (file_ds->file == NULL) {
+			/* no previous backup datastore found, create a new one */
+
+			/* Create file based on original name */
+			if (asprintf(&new_path, "%s.XXXXXX", file_ds->path) == -1) {
+				ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+				return (EXIT_FAILURE);
+			}
+			nc_clip_occurences_with(new_path, '/', '/');
+			WARN("Using %s as a backup datastore.", new_path);
+			if ((fd = mkstemp(new_path)) == -1) {
+				ERROR("Unable to create backup datastore (%s).", strerror(errno));
+				free(new_path);
+				return (EXIT_FAILURE);
+			}
+			if ((file_ds->file = fdopen(fd, "r+")) == NULL) {
+				ERROR("Unable to open backup datastore (%s)", strerror(errno));
+				free(new_path);
+				close(fd);
+				return (EXIT_FAILURE);
+			}
+			free(file_ds->path);
+			file_ds->path = new_path;
+		}
+
+		/* end the while loop */
+		break;
+	}
+
+	/* if necessary, create an empty datastore */
+	if (file_ds->xml == NULL) {
+
+		file_ds->xml = file_create_xmlframe();
+		if (file_ds->xml == NULL) {
+			return (EXIT_FAILURE);
+		}
+		xmlDocFormatDump(file_ds->file, file_ds->xml, 1);
+		WARN("File %s was empty. Basic structure created.", file_ds->path);
+	}
+
+	/* get pointers to running, startup and candidate nodes in xml */
+	if (file_fill_dsnodes(file_ds) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
+	/* unlock forgotten locks if any */
+	xmlSetProp (file_ds->running, BAD_CAST "lock", BAD_CAST "");
+	xmlSetProp (file_ds->startup, BAD_CAST "lock", BAD_CAST "");
+	xmlSetProp (file_ds->candidate, BAD_CAST "lock", BAD_CAST "");
+	xmlSetProp (file_ds->running, BAD_CAST "partial-locks", BAD_CAST "");
+
+	/* open and eventually create a lock */
+	if ((file_ds->ds_lock.shared = ncds_file_shared_open(file_ds->path, &(file_ds->ds_lock.lock))) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	file_ds->ds_lock.rwlock = &(file_ds->ds_lock.shared->rwlock);
+
+	pthread_mutex_init(&(file_ds->ds_lock.local), NULL);
+	pthread_rwlock_init(&(file_ds->snapshots.lock), NULL);
+	pthread_mutex_init(&(file_ds->sync.lock), NULL);
+	pthread_cond_init(&(file_ds->sync.flushed), NULL);
+
+	return (file_parts_init(file_ds));
+}
+
+void ncds_file_free(struct ncds_ds* ds)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	int ret, i;
+
+	if (file_ds != NULL) {
+		/* ncds_ds_file specific part */
+		ncds_file_flush(ds);
+		/* write the journals into the datastore files on the clean exit */
+		if (file_ds->parts_count > 0 && file_ds->ds_lock.rwlock != NULL && !file_ds->ds_lock.holding_lock) {
+			LOCK(file_ds, ret);
+			if (ret == 0) {
+				if (file_reload(file_ds) == EXIT_SUCCESS) {
+					for (i = 0; i < file_ds->parts_count; i++) {
+						if (file_ds->parts[i].journal_offset > 0) {
+							file_sync_part(file_ds, &(file_ds->parts[i]));
+						}
+					}
+				}
+				UNLOCK(file_ds);
+			}
+		}
+		for (i = 0; i < NCDS_FILE_PARTS; i++) {
+			if (file_ds->parts[i].journal != NULL) {
+				fclose(file_ds->parts[i].journal);
+			}
+			free(file_ds->parts[i].journal_path);
+			if (file_ds->parts[i].file != NULL) {
+				fclose(file_ds->parts[i].file);
+			}
+			free(file_ds->parts[i].path);
+		}
+		if (file_ds->parts_count > 0 && file_ds->watch != -1) {
+			close(file_ds->watch);
+		}
+		if (file_ds->sync.stats.commits > 0) {
+			VERB("Datastore %s: %lu changes (average latency %llu us, maximum %lu us), %lu checkpoints, %lu fsyncs (maximum batch %lu).",
+					file_ds->path, file_ds->sync.stats.commits,
+					file_ds->sync.stats.latency_total / file_ds->sync.stats.commits, file_ds->sync.stats.latency_max,
+					file_ds->sync.stats.checkpoints, file_ds->sync.stats.fsyncs, file_ds->sync.stats.batch_max);
+		}
+		if (file_ds->file != NULL) {
+			fclose(file_ds->file);
+		}
+		free(file_ds->path);
+		file_history_clear(file_ds);
+		file_delta_reset(file_ds, 0);
+		if (file_ds->privates != NULL) {
+			xmlHashFree(file_ds->privates, file_private_free);
+		}
+		xmlFreeDoc(file_ds->xml);
+		if (file_ds->ds_lock.rwlock != NULL) {
+			if (file_ds->ds_lock.holding_lock) {
+				pthread_rwlock_unlock(file_ds->ds_lock.rwlock);
+			}
+			munmap(file_ds->ds_lock.shared, sizeof(struct ds_shared_s));
+			pthread_mutex_destroy(&(file_ds->ds_lock.local));
+			for (i = 0; i < 3; i++) {
+				file_snapshot_put(file_ds->snapshots.ds[i]);
+			}
+			pthread_rwlock_destroy(&(file_ds->snapshots.lock));
+			pthread_mutex_destroy(&(file_ds->sync.lock));
+			pthread_cond_destroy(&(file_ds->sync.flushed));
+		}
+		if (file_ds->ds_lock.lock != NULL) {
+			sem_close(file_ds->ds_lock.lock);
+		}
+	}
+}
+
+/**
+ * @brief Reloads xml configuration of a datastore part from its file.
+ *
+ * @param file_ds Pointer to the datastorage structure
+ * @param part Part to reload.
+ * @param t Current time.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_reload_part(struct ncds_ds_file* file_ds, struct ds_part_s* part, time_t t)
+{
+	xmlDocPtr new_xml;
+	struct stat statbuf;
+	unsigned long rewrites, changes;
+	int i = part - file_ds->parts;
+
+	rewrites = file_ds->ds_lock.shared->parts[i].rewrites;
+	changes = file_ds->ds_lock.shared->parts[i].changes;
+
+	if (part->last_access != 0 && !part->external && rewrites == part->rewrites) {
+		/* without the watch, check when the file was modified */
+		if (file_ds->watch != -1 || (stat(part->path, &statbuf) == 0 && statbuf.st_mtime < part->last_access)) {
+			/* file was not modified, but the journal could be */
+			if (changes == part->changes) {
+				return (EXIT_SUCCESS);
+			}
+			part->changes = changes;
+			return (file_journal_replay(file_ds, part));
+		}
+	}
+	if (stat(part->path, &statbuf) == -1) {
+		ERROR("%s: stat() of file %s failed (%s)", __func__, part->path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	/* the history and the delta refer to the content being replaced */
+	file_history_clear(file_ds);
+	if (part->name == NULL || strcmp(part->name, "startup") != 0) {
+		file_delta_reset(file_ds, 0);
+	}
+
+	/* file was modified, it may be necessary to reopen it */
+	fclose(part->file);
+	part->file = fopen(part->path, "r+");
+	if (part->file == NULL) {
+		ERROR("%s: reopenening the file %s failed (%s)", __func__, part->path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if (fstat(fileno(part->file), &(part->file_stat)) == -1) {
+		memset(&(part->file_stat), 0, sizeof(part->file_stat));
+	}
+
+	new_xml = xmlReadFile (part->path, NULL, NC_XMLREAD_OPTIONS);
+	if (new_xml == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	part->generation = file_generation(new_xml);
+	if (part->name == NULL) {
+		xmlFreeDoc (file_ds->xml);
+		file_ds->xml = new_xml;
+
+		if (file_fill_dsnodes (file_ds)) {
+			return EXIT_FAILURE;
+		}
+	} else {
+		/* only the datastore of the part is replaced */
+		if (file_part_load(file_ds, part, new_xml) != EXIT_SUCCESS) {
+			xmlFreeDoc(new_xml);
+			return EXIT_FAILURE;
+		}
+		xmlFreeDoc(new_xml);
+	}
+
+	/* update access time */
+	part->last_access = t;
+	part->external = 0;
+	part->rewrites = rewrites;
+	part->changes = changes;
+
+	/* apply the whole journal of the read file generation */
+	part->file_size = statbuf.st_size;
+	part->journal_offset = 0;
+	return (file_journal_replay(file_ds, part));
+}
+
+/**
+ * @brief Reloads xml configuration from the datastorage file. This function MUST be
+ * called ONLY between file_ds_lock() and file_ds_unlock().
+ *
+ * Tries to read from the datastore and find the datastore root elements.
+ * If succussfully, the old xml is freed and replaced with a new one.
+ * If it fails, the structure is preserved as it was. In the split layout,
+ * only the changed datastores are read.
+ *
+ * @param file_ds Pointer to the datastorage structure
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_reload(struct ncds_ds_file* file_ds)
+{
+	time_t t;
+	int i;
+
+	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
+		ERROR("%s: invalid parameter.", __func__);
+		return EXIT_FAILURE;
+	}
+
+	/* get current time */
+	if ((t = time(NULL)) == ((time_t)(-1))) {
+		t = 0;
+		WARN("Setting datastore access time failed (%s)", strerror(errno));
+	}
+
+	file_watch_read(file_ds);
+	for (i = 0; i < file_ds->parts_count; i++) {
+		if (file_reload_part(file_ds, &(file_ds->parts[i]), t) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+	}
+	file_ds->modified = 0;
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Flush a file to the disk and count it in the statistics.
+ *
+ * @param file_ds Datastore the file belongs to.
+ * @param fd File descriptor to flush.
+ * @param path Path of the file for the error messages.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_fsync(struct ncds_ds_file* file_ds, int fd, const char* path)
+{
+	int ret;
+
+	ret = fsync(fd);
+
+	pthread_mutex_lock(&(file_ds->sync.lock));
+	file_ds->sync.stats.fsyncs++;
+	pthread_mutex_unlock(&(file_ds->sync.lock));
+
+	if (ret == -1) {
+		ERROR("%s: fsync() of file %s failed (%s)", __func__, path, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Flush the directory entries of the datastore files to the disk.
+ *
+ * @param file_ds Datastore whose directory is flushed.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_fsync_dir(struct ncds_ds_file* file_ds)
+{
+	char* dup_path;
+	int fd, ret;
+
+	dup_path = strdup(file_ds->path);
+	if ((fd = open(dirname(dup_path), O_RDONLY)) == -1) {
+		ERROR("%s: opening the datastore directory %s failed (%s)", __func__, dup_path, strerror(errno));
+		free(dup_path);
+		return (EXIT_FAILURE);
+	}
+	ret = file_fsync(file_ds, fd, dup_path);
+	close(fd);
+	free(dup_path);
+
+	return (ret);
+}
+
+/**
+ * @brief Write the part into a temporary file, flush it and rename it to the
+ * part file, so the part file is always complete.
+ *
+ * @param file_ds Datastore to write.
+ * @param part Part to write.
+ *
+ * @return Size of the written file, -1 on error. On error, the part file is
+ * left untouched.
+ */
+static long file_write_rename(struct ncds_ds_file* file_ds, struct ds_part_s* part)
+{
+	struct stat st;
+	char* tmp_path;
+	FILE* tmp_file;
+	long size;
+	int fd;
+
+	if (asprintf(&tmp_path, "%s%s", part->path, NCDS_TMP_SUFFIX) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (-1);
+	}
+
+	/* keep permissions of the datastore file */
+	if (fstat(fileno(part->file), &st) == -1 ||
+			(fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, st.st_mode & 07777)) == -1) {
+		WARN("%s: unable to create the file %s (%s).", __func__, tmp_path, strerror(errno));
+		free(tmp_path);
+		return (-1);
+	}
+	if (fchmod(fd, st.st_mode & 07777) == -1 || (tmp_file = fdopen(fd, "r+")) == NULL) {
+		WARN("%s: unable to prepare the file %s (%s).", __func__, tmp_path, strerror(errno));
+		close(fd);
+		unlink(tmp_path);
+		free(tmp_path);
+		return (-1);
+	}
+
+	if ((size = file_part_write(file_ds, part, tmp_file)) == -1 || fflush(tmp_file) != 0 ||
+			file_fsync(file_ds, fd, tmp_path) != EXIT_SUCCESS) {
+		WARN("%s: storing repository into the file %s failed.", __func__, tmp_path);
+		fclose(tmp_file);
+		unlink(tmp_path);
+		free(tmp_path);
+		return (-1);
+	}
+
+	if (rename(tmp_path, part->path) == -1) {
+		WARN("%s: renaming %s to %s failed (%s).", __func__, tmp_path, part->path, strerror(errno));
+		fclose(tmp_file);
+		unlink(tmp_path);
+		free(tmp_path);
+		return (-1);
+	}
+	free(tmp_path);
+
+	/* the temporary file is the part file now */
+	fclose(part->file);
+	part->file = tmp_file;
+
+	/* the part file is complete now, only the directory entry may not be on the disk yet */
+	if (file_fsync_dir(file_ds) != EXIT_SUCCESS) {
+		WARN("%s: the directory of %s not synchronized, the rename may not be durable.", __func__, part->path);
+	} else {
+		file_ds->sync.dir_synced = 1;
+	}
+
+	return (size);
+}
+
+/**
+ * @brief Check that the journal contains no record this process has not applied
+ * yet, so it can be truncated. An incomplete record left by a crash is allowed.
+ *
+ * @param part Part with the journal.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_journal_consumed(struct ds_part_s* part)
+{
+	struct stat st;
+
+	if (part->journal == NULL) {
+		return (EXIT_SUCCESS);
+	}
+
+	fflush(part->journal);
+	if (fstat(fileno(part->journal), &st) == -1 ||
+			(st.st_size != part->journal_offset && st.st_size != part->journal_end)) {
+		ERROR("%s: the journal %s contains records not applied to the datastore.", __func__, part->journal_path);
+		/* read everything again by the next reload */
+		part->last_access = 0;
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Write the current version of the part configuration to its file. This
+ * function MUST be called ONLY between file_ds_lock() and file_ds_unlock().
+ *
+ * @param file_ds Datastore to sync.
+ * @param part Part to write.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_sync_part(struct ncds_ds_file* file_ds, struct ds_part_s* part)
+{
+	time_t t;
+	char gen[24];
+	long size;
+	int i;
+
+	if (file_journal_consumed(part) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
+	/* start a new generation, so the current journal records become invalid */
+	part->generation++;
+
+	if (file_ds->sync.mode != NCDS_FILE_SYNC_NONE) {
+		/* never rewrite the file in place, the journal still holds the changes */
+		if ((size = file_write_rename(file_ds, part)) == -1) {
+			ERROR("%s: checkpoint of the file %s failed, keeping the journal.", __func__, part->path);
+			part->generation--;
+			if (part->name == NULL) {
+				snprintf(gen, sizeof(gen), "%lu", part->generation);
+				xmlSetProp(xmlDocGetRootElement(file_ds->xml), BAD_CAST "generation", BAD_CAST gen);
+			}
+			return (EXIT_FAILURE);
+		}
+	} else {
+		/* erase actual config */
+		if (ftruncate (fileno(part->file), 0) == -1) {
+			ERROR ("%s: truncate() of file %s failed (%s)", __func__, part->path, strerror(errno));
+			return EXIT_FAILURE;
+		}
+		rewind (part->file);
+
+		if((size = file_part_write(file_ds, part, part->file)) == -1) {
+			ERROR("%s: storing repository into the file %s failed.", __func__, part->path);
+			return (EXIT_FAILURE);
+		}
+	}
+	part->file_size = size;
+
+	/* the journal is applied in the file now */
+	if (part->journal != NULL && part->journal_offset > 0) {
+		if (ftruncate(fileno(part->journal), 0) == -1) {
+			WARN("%s: truncate() of file %s failed (%s)", __func__, part->journal_path, strerror(errno));
+		}
+	}
+	part->journal_offset = 0;
+	part->journal_end = 0;
+
+	/* let the other processes know, but ignore the watch events of our own write */
+	part->rewrites = ++file_ds->ds_lock.shared->parts[part - file_ds->parts].rewrites;
+	if (fflush(part->file) != 0 || fstat(fileno(part->file), &(part->file_stat)) == -1) {
+		memset(&(part->file_stat), 0, sizeof(part->file_stat));
+	}
+	file_watch_read(file_ds);
+	file_ds->modified = 1;
+
+	pthread_mutex_lock(&(file_ds->sync.lock));
+	file_ds->sync.stats.checkpoints++;
+	if (file_ds->sync.mode != NCDS_FILE_SYNC_NONE) {
+		part->dirty = 0;
+		for (i = 0; i < file_ds->parts_count && !file_ds->parts[i].dirty; i++);
+		if (i == file_ds->parts_count) {
+			/* all the written changes are on the disk */
+			file_ds->sync.synced = file_ds->sync.written;
+		}
+	}
+	pthread_mutex_unlock(&(file_ds->sync.lock));
+
+	/* update last access time */
+	if ((t = time(NULL)) == ((time_t)(-1))) {
+		WARN("Setting datastore access time failed (%s)", strerror(errno));
+	} else {
+		part->last_access = t;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Count the change latency into the statistics. This function MUST be
+ * called with the sync lock held.
+ *
+ * @param file_ds Changed datastore.
+ * @param start Time when writing of the change started.
+ */
+static void file_commit_stats(struct ncds_ds_file* file_ds, const struct timespec* start)
+{
+	struct timespec now;
+	unsigned long latency;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	latency = (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000;
+
+	file_ds->sync.stats.latency_total += latency;
+	if (latency > file_ds->sync.stats.latency_max) {
+		file_ds->sync.stats.latency_max = latency;
+	}
+}
+
+/**
+ * @brief Flush the journals with all the changes written so far. This function
+ * MUST be called with the sync lock held, the lock is released during the flush.
+ *
+ * @param file_ds Datastore to flush.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_flush(struct ncds_ds_file* file_ds)
+{
+	unsigned long written;
+	int dirty[NCDS_FILE_PARTS];
+	int i, count = 0, ret = 0;
+
+	file_ds->sync.flushing = 1;
+	written = file_ds->sync.written;
+	for (i = 0; i < file_ds->parts_count; i++) {
+		dirty[i] = file_ds->parts[i].dirty;
+		file_ds->parts[i].dirty = 0;
+	}
+	pthread_mutex_unlock(&(file_ds->sync.lock));
+
+	for (i = 0; i < file_ds->parts_count; i++) {
+		if (!dirty[i]) {
+			continue;
+		}
+		count++;
+		if (fsync(fileno(file_ds->parts[i].journal)) == -1) {
+			ERROR("%s: fsync() of file %s failed (%s)", __func__, file_ds->parts[i].journal_path, strerror(errno));
+			ret = -1;
+		} else {
+			dirty[i] = 0;
+		}
+	}
+	if (ret == 0 && !file_ds->sync.dir_synced) {
+		/* the journal could have been just created */
+		if (file_fsync_dir(file_ds) == EXIT_SUCCESS) {
+			file_ds->sync.dir_synced = 1;
+		}
+	}
+
+	pthread_mutex_lock(&(file_ds->sync.lock));
+	file_ds->sync.flushing = 0;
+	file_ds->sync.stats.fsyncs += count;
+	if (ret == -1) {
+		for (i = 0; i < file_ds->parts_count; i++) {
+			file_ds->parts[i].dirty |= dirty[i];
+		}
+	} else if (written > file_ds->sync.synced) {
+		if (written - file_ds->sync.synced > file_ds->sync.stats.batch_max) {
+			file_ds->sync.stats.batch_max = written - file_ds->sync.synced;
+		}
+		file_ds->sync.synced = written;
+	}
+	pthread_cond_broadcast(&(file_ds->sync.flushed));
+
+	return ((ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/**
+ * @brief Change written by the thread and waiting for the group flush.
+ */
+struct file_pending {
+	struct ncds_ds_file* ds;
+	unsigned long commit;
+	struct timespec start;
+};
+
+static pthread_key_t file_pending_key;
+static pthread_once_t file_pending_once = PTHREAD_ONCE_INIT;
+
+static void file_pending_key_create(void)
+{
+	pthread_key_create(&file_pending_key, free);
+}
+
+/**
+ * @brief Get the pending change of the calling thread.
+ *
+ * @return Pending change structure, NULL on memory allocation error.
+ */
+static struct file_pending* file_commit_pending(void)
+{
+	struct file_pending* pending;
+
+	pthread_once(&file_pending_once, file_pending_key_create);
+	if ((pending = pthread_getspecific(file_pending_key)) == NULL) {
+		if ((pending = calloc(1, sizeof(struct file_pending))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (NULL);
+		}
+		pthread_setspecific(file_pending_key, pending);
+	}
+
+	return (pending);
+}
+
+/**
+ * @brief Finish writing of a change according to the durability mode. This
+ * function MUST be called ONLY between file_ds_lock() and file_ds_unlock().
+ *
+ * @param file_ds Changed datastore.
+ * @param part Part with the journal where the change was written, NULL if
+ * the change was written by rewriting the part file.
+ * @param start Time when writing of the change started.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_commit(struct ncds_ds_file* file_ds, struct ds_part_s* part, const struct timespec* start)
+{
+	struct file_pending* pending;
+	int ret = EXIT_SUCCESS;
+
+	pthread_mutex_lock(&(file_ds->sync.lock));
+	file_ds->sync.written++;
+	file_ds->sync.stats.commits++;
+	if (part != NULL) {
+		part->dirty = 1;
+	}
+	if (file_ds->sync.mode == NCDS_FILE_SYNC_NONE || part == NULL) {
+		/* nothing to flush or the part file was just rewritten */
+		file_commit_stats(file_ds, start);
+	} else if (file_ds->sync.defer) {
+		/* flushed by ncds_file_flush() at the end of the transaction */
+		if (file_ds->sync.deferred == 0) {
+			file_ds->sync.deferred_start = *start;
+		}
+		file_ds->sync.deferred = file_ds->sync.written;
+	} else if (file_ds->sync.mode == NCDS_FILE_SYNC_COMMIT) {
+		while (file_ds->sync.flushing) {
+			pthread_cond_wait(&(file_ds->sync.flushed), &(file_ds->sync.lock));
+		}
+		ret = file_flush(file_ds);
+		file_commit_stats(file_ds, start);
+	} else {
+		/* NCDS_FILE_SYNC_GROUP, flushed by ncds_file_flush() after unlocking the datastore */
+		pending = file_commit_pending();
+		if (pending != NULL && (pending->ds == NULL || pending->ds == file_ds)) {
+			if (pending->ds == NULL) {
+				pending->ds = file_ds;
+				pending->start = *start;
+			}
+			pending->commit = file_ds->sync.written;
+		} else {
+			/* the thread waits for another datastore, do not postpone the flush */
+			while (file_ds->sync.flushing) {
+				pthread_cond_wait(&(file_ds->sync.flushed), &(file_ds->sync.lock));
+			}
+			ret = file_flush(file_ds);
+			file_commit_stats(file_ds, start);
+		}
+	}
+	pthread_mutex_unlock(&(file_ds->sync.lock));
+
+	return (ret);
+}
+
+/**
+ * @brief Wait until the change is flushed to the disk. If no other thread of
+ * the process is flushing the journal, the caller waits for the group commit
+ * window and then flushes all the changes written in the meantime. This function
+ * MUST NOT be called between file_ds_lock() and file_ds_unlock().
+ *
+ * @param file_ds Changed datastore.
+ * @param commit Number of the change from file_commit().
+ * @param start Time when writing of the change started.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_commit_wait(struct ncds_ds_file* file_ds, unsigned long commit, const struct timespec* start)
+{
+	struct timespec window;
+	int ret = EXIT_SUCCESS;
+
+	pthread_mutex_lock(&(file_ds->sync.lock));
+	while (file_ds->sync.synced < commit) {
+		if (file_ds->sync.flushing) {
+			pthread_cond_wait(&(file_ds->sync.flushed), &(file_ds->sync.lock));
+			continue;
+		}
+
+		if (file_ds->sync.mode == NCDS_FILE_SYNC_GROUP && file_ds->sync.window > 0) {
+			/* let other changes join the flush */
+			file_ds->sync.flushing = 1;
+			pthread_mutex_unlock(&(file_ds->sync.lock));
+			window.tv_sec = file_ds->sync.window / 1000000;
+			window.tv_nsec = (file_ds->sync.window % 1000000) * 1000;
+			nanosleep(&window, NULL);
+			pthread_mutex_lock(&(file_ds->sync.lock));
+		}
+		if ((ret = file_flush(file_ds)) != EXIT_SUCCESS) {
+			break;
+		}
+	}
+	file_commit_stats(file_ds, start);
+	pthread_mutex_unlock(&(file_ds->sync.lock));
+
+	return (ret);
+}
+
+int ncds_file_flush(struct ncds_ds* ds)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	struct file_pending* pending;
+	struct timespec start;
+	unsigned long commit;
+	int ret;
+
+	commit = 0;
+	pthread_mutex_lock(&(file_ds->sync.lock));
+	if (file_ds->sync.defer && pthread_equal(file_ds->sync.defer_thread, pthread_self())) {
+		/* end of the transaction */
+		commit = file_ds->sync.deferred;
+		start = file_ds->sync.deferred_start;
+		file_ds->sync.defer = 0;
+		file_ds->sync.deferred = 0;
+	}
+	pthread_mutex_unlock(&(file_ds->sync.lock));
+	if (commit != 0 && (ret = file_commit_wait(file_ds, commit, &start)) != EXIT_SUCCESS) {
+		return (ret);
+	}
+
+	if (file_ds->sync.mode != NCDS_FILE_SYNC_GROUP) {
+		return (EXIT_SUCCESS);
+	}
+
+	pthread_once(&file_pending_once, file_pending_key_create);
+	pending = pthread_getspecific(file_pending_key);
+	if (pending == NULL || pending->ds != file_ds) {
+		/* nothing written by this thread */
+		return (EXIT_SUCCESS);
+	}
+
+	ret = file_commit_wait(file_ds, pending->commit, &(pending->start));
+	pending->ds = NULL;
+
+	return (ret);
+}
+
+int ncds_file_defer(struct ncds_ds* ds)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+
+	pthread_mutex_lock(&(file_ds->sync.lock));
+	file_ds->sync.defer = 1;
+	file_ds->sync.defer_thread = pthread_self();
+	pthread_mutex_unlock(&(file_ds->sync.lock));
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Get the generation of the datastore file content.
+ *
+ * @param doc Content of the datastore file.
+ *
+ * @return Generation number, 0 if not set.
+ */
+static unsigned long file_generation(xmlDocPtr doc)
+{
+	xmlChar* gen;
+	unsigned long ret = 0;
+
+	if ((gen = xmlGetProp(xmlDocGetRootElement(doc), BAD_CAST "generation")) != NULL) {
+		ret = strtoul((char*) gen, NULL, 10);
+		xmlFree(gen);
+	}
+
+	return (ret);
+}
+
+/**
+ * @brief Get the datastore node according to its name used in the journal records.
+ */
+static xmlNodePtr file_journal_target(struct ncds_ds_file* file_ds, const xmlChar* name)
+{
+	if (name == NULL) {
+		return (NULL);
+	} else if (xmlStrcmp(name, BAD_CAST "running") == 0) {
+		return (file_ds->running);
+	} else if (xmlStrcmp(name, BAD_CAST "startup") == 0) {
+		return (file_ds->startup);
+	} else if (xmlStrcmp(name, BAD_CAST "candidate") == 0) {
+		return (file_ds->candidate);
+	}
+
+	return (NULL);
+}
+
+/**
+ * @brief Get the datastore node of the copy-config source datastore.
+ */
+static xmlNodePtr file_journal_source(struct ncds_ds_file* file_ds, NC_DATASTORE source)
+{
+	switch (source) {
+	case NC_DATASTORE_RUNNING:
+		return (file_ds->running);
+	case NC_DATASTORE_STARTUP:
+		return (file_ds->startup);
+	default:
+		return (file_ds->candidate);
+	}
+}
+
+/**
+ * @brief Create a new journal record.
+ *
+ * @param op Name of the change operation (edit, copy, delete or set).
+ * @param target_ds Node of the changed datastore.
+ *
+ * @return Record to be filled and passed to file_journal().
+ */
+static xmlNodePtr file_journal_new(const char* op, xmlNodePtr target_ds)
+{
+	xmlDocPtr doc;
+	xmlNodePtr record;
+
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	record = xmlNewDocNode(doc, NULL, BAD_CAST op, NULL);
+	xmlDocSetRootElement(doc, record);
+	xmlNewProp(record, BAD_CAST "target", target_ds->name);
+
+	return (record);
+}
+
+/**
+ * @brief Append the record of the change into the journal. The record is
+ * completed by the current attributes (lock, modified) of the changed datastore
+ * and freed. If the journal cannot be used or it is too big, the whole part
+ * file is rewritten instead. This function MUST be called ONLY between
+ * file_ds_lock() and file_ds_unlock().
+ *
+ * @param file_ds Changed datastore.
+ * @param record Record of the change created by file_journal_new().
+ * @param target_ds Node of the changed datastore.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_journal(struct ncds_ds_file* file_ds, xmlNodePtr record, xmlNodePtr target_ds)
+{
+	struct ds_part_s* part;
+	xmlBufferPtr buf;
+	xmlAttrPtr attr;
+	xmlChar* value;
+	struct timespec start;
+	char gen[24];
+	int len;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	part = file_part(file_ds, target_ds);
+
+	if (part->journal == NULL) {
+		xmlFreeDoc(record->doc);
+		if (file_sync_part(file_ds, part) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+		return (file_commit(file_ds, NULL, &start));
+	}
+
+	if ((value = xmlGetProp(record, BAD_CAST "source")) != NULL) {
+		if (file_part(file_ds, file_journal_target(file_ds, value)) != part) {
+			/* the source is journaled separately, so store the copied content */
+			xmlUnsetProp(record, BAD_CAST "source");
+			if (target_ds->children != NULL) {
+				xmlAddChildList(record, xmlDocCopyNodeList(record->doc, target_ds->children));
+			}
+		}
+		xmlFree(value);
+	}
+	for (attr = target_ds->properties; attr != NULL; attr = attr->next) {
+		value = xmlNodeGetContent((xmlNodePtr) attr);
+		xmlSetProp(record, attr->name, value);
+		xmlFree(value);
+	}
+	snprintf(gen, sizeof(gen), "%lu", part->generation);
+	xmlSetProp(record, BAD_CAST "generation", BAD_CAST gen);
+
+	buf = xmlBufferCreate();
+	xmlNodeDump(buf, record->doc, record, 0, 0);
+	xmlFreeDoc(record->doc);
+
+	/* drop a possibly incomplete record left by a crash, but never the records not applied yet */
+	if (file_journal_consumed(part) != EXIT_SUCCESS) {
+		xmlBufferFree(buf);
+		return (EXIT_FAILURE);
+	}
+	if (ftruncate(fileno(part->journal), part->journal_offset) == -1 ||
+			fseek(part->journal, 0, SEEK_END) == -1 ||
+			(len = fprintf(part->journal, "%d\n%s\n", xmlBufferLength(buf), (char*) xmlBufferContent(buf))) < 0 ||
+			fflush(part->journal) != 0) {
+		WARN("%s: writing into the journal %s failed (%s).", __func__, part->journal_path, strerror(errno));
+		xmlBufferFree(buf);
+		if (file_sync_part(file_ds, part) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+		return (file_commit(file_ds, NULL, &start));
+	}
+	xmlBufferFree(buf);
+	part->journal_offset += len;
+	part->journal_end = part->journal_offset;
+	part->changes = ++file_ds->ds_lock.shared->parts[part - file_ds->parts].changes;
+	file_ds->modified = 1;
+
+	if (part->journal_offset > NCDS_JOURNAL_MIN_SIZE && part->journal_offset > part->file_size) {
+		/* checkpoint - apply the journal into the part file, the record is kept in the journal on failure */
+		if (file_sync_part(file_ds, part) == EXIT_SUCCESS) {
+			return (file_commit(file_ds, NULL, &start));
+		}
+	}
+
+	return (file_commit(file_ds, part, &start));
+}
+
+/*
+ * Marker of the roots of the changed subtrees in the delta skeleton and in the
+ * partial documents provided by ncds_file_commit().
+ */
+static char file_delta_dirty;
+#define DELTA_DIRTY(node) ((node)->_private != NULL)
+
+/**
+ * @brief Forget the changed subtrees of the candidate and running datastores.
+ *
+ * @param file_ds Datastore.
+ * @param valid Non-zero if the candidate and running have the same content,
+ * zero if their differences are not known.
+ */
+static void file_delta_reset(struct ncds_ds_file* file_ds, int valid)
+{
+	xmlFreeDoc(file_ds->delta.paths);
+	file_ds->delta.paths = NULL;
+	file_ds->delta.valid = valid;
+}
+
+/**
+ * @brief Update the delta after the whole content of the datastore was replaced.
+ *
+ * @param file_ds Datastore.
+ * @param target_ds Node of the changed datastore.
+ * @param source_ds Node of the datastore the content was copied from, NULL if
+ * the content does not come from a datastore.
+ */
+static void file_delta_copied(struct ncds_ds_file* file_ds, xmlNodePtr target_ds, xmlNodePtr source_ds)
+{
+	if (target_ds != file_ds->running && target_ds != file_ds->candidate) {
+		return;
+	}
+
+	/* commit and discard-changes make the datastores the same */
+	file_delta_reset(file_ds, source_ds != NULL && source_ds != target_ds &&
+			(source_ds == file_ds->running || source_ds == file_ds->candidate));
+}
+
+/**
+ * @brief Get the schema node of the data node from the schema node of its parent.
+ */
+static const struct schema_node* file_delta_schema(const struct schema* schema, const struct schema_node* parent, xmlNodePtr node)
+{
+	if (parent == NULL) {
+		return (xmlHashLookup(schema->roots, node->name));
+	}
+	return ((parent->children == NULL) ? NULL : xmlHashLookup(parent->children, node->name));
+}
+
+/**
+ * @brief Check whether the node is a key of the list instance.
+ */
+static int file_delta_is_key(const struct schema_node* parent, xmlNodePtr node)
+{
+	int i;
+
+	if (parent == NULL || parent->type != SCHEMA_LIST) {
+		return (0);
+	}
+	for (i = 0; i < parent->keys_count; i++) {
+		if (xmlStrEqual(node->name, parent->keys[i])) {
+			return (1);
+		}
+	}
+	return (0);
+}
+
+/**
+ * @brief Check whether the node is defined in a case of a choice.
+ */
+static int file_delta_is_case(const struct schema_node* snode)
+{
+	xmlNodePtr yin = snode->yin->parent;
+
+	return (yin != NULL && (xmlStrEqual(yin->name, BAD_CAST "choice") || xmlStrEqual(yin->name, BAD_CAST "case")));
+}
+
+/**
+ * @brief Check whether the node has no element children (leaf, leaf-list
+ * instance or an empty container).
+ */
+static int file_delta_is_leaf(xmlNodePtr node)
+{
+	for (node = node->children; node != NULL && node->type != XML_ELEMENT_NODE; node = node->next);
+	return (node == NULL);
+}
+
+/**
+ * @brief Get the value of the key of the list instance.
+ */
+static xmlChar* file_delta_key(xmlNodePtr node, const xmlChar* name)
+{
+	for (node = node->children; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE && xmlStrEqual(node->name, name)) {
+			return (xmlNodeGetContent(node));
+		}
+	}
+	return (NULL);
+}
+
+/**
+ * @brief Check that the data nodes are the same instance of the schema node.
+ *
+ * @return non-zero if the nodes match, zero if not.
+ */
+static int file_delta_match(const struct schema_node* snode, xmlNodePtr a, xmlNodePtr b)
+{
+	xmlChar *x, *y;
+	int i, match = 1;
+
+	if (b->type != XML_ELEMENT_NODE || !xmlStrEqual(a->name, b->name) ||
+			(a->ns == NULL) != (b->ns == NULL) || (a->ns != NULL && !xmlStrEqual(a->ns->href, b->ns->href))) {
+		return (0);
+	}
+
+	if (snode->type == SCHEMA_LIST) {
+		for (i = 0; match && i < snode->keys_count; i++) {
+			x = file_delta_key(a, snode->keys[i]);
+			y = file_delta_key(b, snode->keys[i]);
+			match = xmlStrEqual(x, y);
+			xmlFree(x);
+			xmlFree(y);
+		}
+	} else if (snode->type == SCHEMA_LEAFLIST) {
+		x = xmlNodeGetContent(a);
+		y = xmlNodeGetContent(b);
+		match = xmlStrEqual(x, y);
+		xmlFree(x);
+		xmlFree(y);
+	}
+
+	return (match);
+}
+
+/**
+ * @brief Find the instance matching the node among the siblings.
+ */
+static xmlNodePtr file_delta_find(const struct schema_node* snode, xmlNodePtr first, xmlNodePtr node)
+{
+	for (; first != NULL && !file_delta_match(snode, node, first); first = first->next);
+	return (first);
+}
+
+/**
+ * @brief Add the node as the last child of the parent or of the document if
+ * the parent is NULL.
+ */
+static void file_delta_add(xmlDocPtr doc, xmlNodePtr parent, xmlNodePtr node)
+{
+	xmlAddChild((parent == NULL) ? (xmlNodePtr) doc : parent, node);
+}
+
+/**
+ * @brief Create the skeleton node identifying the data node.
+ */
+static xmlNodePtr file_delta_new(const struct schema_node* snode, xmlDocPtr doc, xmlNodePtr parent, xmlNodePtr node)
+{
+	xmlNodePtr new;
+	xmlChar* value;
+	int i;
+
+	new = xmlNewDocNode(doc, NULL, node->name, NULL);
+	file_delta_add(doc, parent, new);
+	if (node->ns != NULL) {
+		xmlSetNs(new, xmlNewNs(new, node->ns->href, NULL));
+	}
+
+	if (snode->type == SCHEMA_LIST) {
+		for (i = 0; i < snode->keys_count; i++) {
+			value = file_delta_key(node, snode->keys[i]);
+			xmlNewTextChild(new, new->ns, snode->keys[i], value);
+			xmlFree(value);
+		}
+	} else if (snode->type == SCHEMA_LEAFLIST) {
+		value = xmlNodeGetContent(node);
+		xmlNodeAddContent(new, value);
+		xmlFree(value);
+	}
+
+	return (new);
+}
+
+/**
+ * @brief Mark the skeleton node as the root of a changed subtree, its
+ * descendants except the keys are not needed anymore.
+ */
+static void file_delta_set_dirty(const struct schema_node* snode, xmlNodePtr skel)
+{
+	xmlNodePtr child, next;
+
+	skel->_private = &file_delta_dirty;
+	for (child = skel->children; child != NULL; child = next) {
+		next = child->next;
+		if (child->type == XML_ELEMENT_NODE && !file_delta_is_key(snode, child)) {
+			xmlUnlinkNode(child);
+			xmlFreeNode(child);
+		}
+	}
+}
+
+/**
+ * @brief Add the nodes changed by the edit-config into the delta skeleton.
+ * The changed subtrees are the nodes with an operation, the leaves and the
+ * nodes without any content (they can be created by merge). The instances of
+ * ordered-by-user lists can move and creating a case of a choice removes the
+ * other cases, so their parent is changed as a whole.
+ *
+ * @param schema Compiled schema of the datastore.
+ * @param doc Delta skeleton.
+ * @param skel Skeleton node of the edit parent, NULL on the top level.
+ * @param psnode Schema node of the edit parent, NULL on the top level.
+ * @param edit First node of the edit-config on the level.
+ * @param replace The default operation is replace.
+ *
+ * @return 0 when the skeleton was updated, 1 when the parent was marked as
+ * the changed subtree, -1 when the changes cannot be described.
+ */
+static int file_delta_mark_recursive(const struct schema* schema, xmlDocPtr doc, xmlNodePtr skel, const struct schema_node* psnode, xmlNodePtr edit, int replace)
+{
+	const struct schema_node* snode;
+	xmlNodePtr node, child;
+	int dirty;
+
+	for (; edit != NULL; edit = edit->next) {
+		if (edit->type != XML_ELEMENT_NODE || file_delta_is_key(psnode, edit)) {
+			continue;
+		}
+		if ((snode = file_delta_schema(schema, psnode, edit)) == NULL) {
+			return (-1);
+		}
+		if ((snode->flags & SCHEMA_ORDERED_USER) || file_delta_is_case(snode)) {
+			return ((skel == NULL) ? -1 : 1);
+		}
+
+		node = file_delta_find(snode, (skel == NULL) ? doc->children : skel->children, edit);
+		if (node != NULL && DELTA_DIRTY(node)) {
+			continue;
+		} else if (node == NULL) {
+			node = file_delta_new(snode, doc, skel, edit);
+		}
+
+		dirty = replace || (snode->type != SCHEMA_CONTAINER && snode->type != SCHEMA_LIST) ||
+				xmlHasNsProp(edit, BAD_CAST "operation", BAD_CAST NC_NS_BASE10) != NULL;
+		if (!dirty) {
+			for (child = edit->children; child != NULL && (child->type != XML_ELEMENT_NODE || file_delta_is_key(snode, child)); child = child->next);
+			dirty = (child == NULL);
+		}
+		if (!dirty && (dirty = file_delta_mark_recursive(schema, doc, node, snode, edit->children, 0)) == -1) {
+			return (-1);
+		}
+		if (dirty) {
+			file_delta_set_dirty(snode, node);
+		}
+	}
+
+	return (0);
+}
+
+/**
+ * @brief Record the subtrees of the candidate or running datastore changed by
+ * the edit-config. It must be called before edit_config() consumes the edit.
+ *
+ * @param file_ds Datastore.
+ * @param target_ds Node of the edited datastore.
+ * @param config_doc Edit configuration.
+ * @param defop Default edit operation.
+ */
+static void file_delta_mark(struct ncds_ds_file* file_ds, xmlNodePtr target_ds, xmlDocPtr config_doc, NC_EDIT_DEFOP_TYPE defop)
+{
+	const struct schema* schema;
+
+	if (!file_ds->delta.valid || (target_ds != file_ds->running && target_ds != file_ds->candidate)) {
+		return;
+	}
+
+	/* in the trim mode, default values are removed from the whole datastore */
+	if (ncdflt_get_basic_mode() == NCWD_MODE_TRIM || (schema = schema_get(file_ds->ds.ext_model)) == NULL) {
+		file_delta_reset(file_ds, 0);
+		return;
+	}
+
+	if (file_ds->delta.paths == NULL) {
+		file_ds->delta.paths = xmlNewDoc(BAD_CAST "1.0");
+	}
+	if (file_delta_mark_recursive(schema, file_ds->delta.paths, NULL, NULL, config_doc->children, defop == NC_EDIT_DEFOP_REPLACE) != 0) {
+		file_delta_reset(file_ds, 0);
+	}
+}
+
+/**
+ * @brief Create the reverse delta replacing the children of the node, without
+ * the original nodes.
+ *
+ * @param target_ds Node of the changed datastore.
+ * @param parent Node whose children are replaced, the path to it is taken from
+ * its current position.
+ * @param index Position of the first replaced child.
+ * @param count Number of the replaced children.
+ *
+ * @return Reverse delta, NULL on error.
+ */
+static struct ds_undo_s* file_undo_new(xmlNodePtr target_ds, xmlNodePtr parent, int index, int count)
+{
+	struct ds_undo_s* undo;
+	xmlNodePtr node, sibling;
+	int depth, i;
+
+	for (depth = 0, node = parent; node != target_ds; node = node->parent, depth++);
+	if ((undo = calloc(1, sizeof(struct ds_undo_s))) == NULL ||
+			(depth > 0 && (undo->path = malloc(depth * sizeof(int))) == NULL)) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(undo);
+		return (NULL);
+	}
+	for (i = depth, node = parent; i > 0; node = node->parent) {
+		undo->path[--i] = 0;
+		for (sibling = node->prev; sibling != NULL; sibling = sibling->prev, undo->path[i]++);
+	}
+	undo->depth = depth;
+	undo->index = index;
+	undo->count = count;
+	undo->nodes = xmlNewDocNode(parent->doc, NULL, BAD_CAST "undo", NULL);
+
+	return (undo);
+}
+
+/**
+ * @brief Original children of a node whose content is changed by the
+ * edit-config.
+ */
+struct file_edit_level {
+	/**
+	 * node whose children are changed, it is not changed itself
+	 */
+	xmlNodePtr parent;
+	/**
+	 * original children of the node
+	 */
+	xmlNodePtr* children;
+	/**
+	 * copies of the children changed by the edit-config, NULL for the
+	 * children kept untouched
+	 */
+	xmlNodePtr* copies;
+	int count;
+	struct file_edit_level* next;
+};
+
+static void file_edit_free(struct file_edit_level* levels)
+{
+	struct file_edit_level* level;
+	int i;
+
+	while ((level = levels) != NULL) {
+		levels = level->next;
+		for (i = 0; i < level->count; i++) {
+			xmlFreeNode(level->copies[i]);
+		}
+		free(level->children);
+		free(level->copies);
+		free(level);
+	}
+}
+
+/**
+ * @brief Check whether the node is defined under a choice, anywhere between the
+ * node and its parent data node (the cases can be augmented).
+ */
+static int file_edit_in_choice(const struct schema_node* snode)
+{
+	xmlNodePtr yin;
+
+	for (yin = snode->yin->parent; yin != NULL && yin->type == XML_ELEMENT_NODE &&
+			(snode->parent == NULL || yin != snode->parent->yin); yin = yin->parent) {
+		if (xmlStrEqual(yin->name, BAD_CAST "choice")) {
+			return (1);
+		}
+	}
+	return (0);
+}
+
+/**
+ * @brief Save the children of the data node changed according to the delta
+ * skeleton of the edit-config. The roots of the changed subtrees are copied,
+ * the other children are only remembered and the skeleton is followed into
+ * them. The levels are stored with the parents before their descendants.
+ * If the skeleton touches a choice, all the choice nodes on the level are
+ * copied, since the edit removes the other cases.
+ *
+ * @param schema Compiled schema of the datastore.
+ * @param doc Document the copies are created in.
+ * @param tail Where the levels are appended.
+ * @param parent Data node whose children are saved.
+ * @param psnode Schema node of the parent, NULL on the top level.
+ * @param skel First skeleton node on the level.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_edit_save_recursive(const struct schema* schema, xmlDocPtr doc, struct file_edit_level*** tail,
+		xmlNodePtr parent, const struct schema_node* psnode, xmlNodePtr skel)
+{
+	const struct schema_node* snode, *csnode;
+	struct file_edit_level* level;
+	xmlNodePtr node;
+	int i, choice = 0;
+
+	if ((level = calloc(1, sizeof(struct file_edit_level))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	**tail = level;
+	*tail = &(level->next);
+	level->parent = parent;
+
+	for (node = parent->children; node != NULL; node = node->next, level->count++);
+	if (level->count > 0 && ((level->children = malloc(level->count * sizeof(xmlNodePtr))) == NULL ||
+			(level->copies = calloc(level->count, sizeof(xmlNodePtr))) == NULL)) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		level->count = 0;
+		return (EXIT_FAILURE);
+	}
+	for (i = 0, node = parent->children; node != NULL; node = node->next, i++) {
+		level->children[i] = node;
+	}
+
+	for (; skel != NULL; skel = skel->next) {
+		if (skel->type != XML_ELEMENT_NODE || file_delta_is_key(psnode, skel) ||
+				(snode = file_delta_schema(schema, psnode, skel)) == NULL) {
+			continue;
+		}
+		if (!choice && file_edit_in_choice(snode)) {
+			/*
+			 * the edit removes the nodes of the other cases (edit_choice_clean()),
+			 * they are not in the skeleton, so save all the choice nodes
+			 */
+			choice = 1;
+			for (i = 0; i < level->count; i++) {
+				if (level->children[i]->type == XML_ELEMENT_NODE &&
+						(csnode = file_delta_schema(schema, psnode, level->children[i])) != NULL && file_edit_in_choice(csnode) &&
+						(level->copies[i] = xmlDocCopyNode(level->children[i], doc, 1)) == NULL) {
+					ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+					return (EXIT_FAILURE);
+				}
+			}
+		}
+		for (i = 0; i < level->count && !file_delta_match(snode, skel, level->children[i]); i++);
+		if (i == level->count) {
+			/* the node is going to be created */
+			continue;
+		}
+
+		if (DELTA_DIRTY(skel)) {
+			if (level->copies[i] == NULL && (level->copies[i] = xmlDocCopyNode(level->children[i], doc, 1)) == NULL) {
+				ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+				return (EXIT_FAILURE);
+			}
+		} else if (level->copies[i] == NULL &&
+				file_edit_save_recursive(schema, doc, tail, level->children[i], snode, skel->children) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Save the original state of the nodes the edit-config is going to
+ * change. Only the changed subtrees are copied, so the cost is proportional to
+ * the change, not to the size of the datastore.
+ *
+ * @param file_ds Datastore.
+ * @param target_ds Node of the edited datastore.
+ * @param config_doc Edit configuration, it must not be consumed yet.
+ * @param defop Default edit operation.
+ * @param levels Saved children of the changed nodes, to be freed by
+ * file_edit_free().
+ *
+ * @return EXIT_SUCCESS, EXIT_FAILURE if the changed nodes cannot be determined.
+ */
+static int file_edit_save(struct ncds_ds_file* file_ds, xmlNodePtr target_ds, xmlDocPtr config_doc, NC_EDIT_DEFOP_TYPE defop, struct file_edit_level** levels)
+{
+	const struct schema* schema;
+	struct file_edit_level** tail = levels;
+	xmlDocPtr skel;
+	int ret = EXIT_FAILURE;
+
+	*levels = NULL;
+
+	/* in the trim mode, default values are removed from the whole datastore */
+	if (ncdflt_get_basic_mode() == NCWD_MODE_TRIM || (schema = schema_get(file_ds->ds.ext_model)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	/* the delta skeleton of this edit-config only */
+	skel = xmlNewDoc(BAD_CAST "1.0");
+	if (file_delta_mark_recursive(schema, skel, NULL, NULL, config_doc->children, defop == NC_EDIT_DEFOP_REPLACE) == 0) {
+		ret = file_edit_save_recursive(schema, file_ds->xml, &tail, target_ds, NULL, skel->children);
+	}
+	xmlFreeDoc(skel);
+
+	if (ret != EXIT_SUCCESS) {
+		file_edit_free(*levels);
+		*levels = NULL;
+	}
+	return (ret);
+}
+
+/**
+ * @brief Create the reverse delta of the edit-config from the saved original
+ * nodes. On each level, the untouched children are still in their original
+ * order and they split the children into the replaced ranges. The deltas are
+ * prepended, so the deeper levels and the later ranges are undone first and
+ * the positions are valid at the time they are applied.
+ *
+ * @param target_ds Node of the edited datastore.
+ * @param modified Original value of the "modified" attribute of the datastore
+ * node, it is consumed.
+ * @param levels Saved children of the changed nodes, the copies are moved into
+ * the record.
+ *
+ * @return History record, NULL on error.
+ */
+static struct ds_history_s* file_edit_undo(xmlNodePtr target_ds, xmlChar* modified, struct file_edit_level* levels)
+{
+	struct ds_history_s* record;
+	struct ds_undo_s* undo;
+	xmlNodePtr node, expected;
+	int i, index, start, count;
+
+	if ((record = calloc(1, sizeof(struct ds_history_s))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		xmlFree(modified);
+		return (NULL);
+	}
+	record->target_ds = target_ds;
+	record->modified = modified;
+	record->size = sizeof(struct ds_history_s);
+
+	for (; levels != NULL; levels = levels->next) {
+		for (i = 0, index = 0, node = levels->parent->children; ; i++, index++, node = node->next) {
+			/* the original nodes replaced by the nodes up to the next untouched one */
+			for (start = i; i < levels->count && levels->copies[i] != NULL; i++);
+			expected = (i < levels->count) ? levels->children[i] : NULL;
+			for (count = 0; node != NULL && node != expected; node = node->next, count++);
+
+			if (count > 0 || i > start) {
+				if ((undo = file_undo_new(target_ds, levels->parent, index, count)) == NULL) {
+					file_history_free(record);
+					return (NULL);
+				}
+				for (; start < i; start++) {
+					xmlAddChild(undo->nodes, levels->copies[start]);
+					levels->copies[start] = NULL;
+				}
+				undo->next = record->undo;
+				record->undo = undo;
+				record->size += sizeof(struct ds_undo_s) + undo->depth * sizeof(int) + file_history_size(undo->nodes);
+			}
+			index += count;
+
+			if (expected == NULL) {
+				break;
+			} else if (node == NULL) {
+				ERROR("%s: the node \"%s\" was changed outside of the edited subtrees.", __func__, (char*)expected->name);
+				file_history_free(record);
+				return (NULL);
+			}
+		}
+	}
+
+	return (record);
+}
+
+/*
+ * Original children of the datastore document while it stands for a single
+ * datastore, see file_edit_scope().
+ */
+struct file_edit_scope {
+	xmlNodePtr children;
+	xmlNodePtr last;
+};
+
+/**
+ * @brief Let the datastore document stand for the edited datastore, its
+ * children are the datastore content until file_edit_unscope(). Only the top
+ * level nodes are relinked, the content stays in the same document.
+ *
+ * @param file_ds Datastore.
+ * @param target_ds Node of the edited datastore.
+ * @param scope Storage for the original children of the document.
+ */
+static void file_edit_scope(struct ncds_ds_file* file_ds, xmlNodePtr target_ds, struct file_edit_scope* scope)
+{
+	xmlNodePtr child;
+
+	scope->children = file_ds->xml->children;
+	scope->last = file_ds->xml->last;
+
+	file_ds->xml->children = target_ds->children;
+	file_ds->xml->last = target_ds->last;
+	target_ds->children = target_ds->last = NULL;
+	for (child = file_ds->xml->children; child != NULL; child = child->next) {
+		child->parent = (xmlNodePtr)file_ds->xml;
+	}
+}
+
+/**
+ * @brief Put the current children of the datastore document back into the
+ * datastore node and restore the original document children.
+ */
+static void file_edit_unscope(struct ncds_ds_file* file_ds, xmlNodePtr target_ds, struct file_edit_scope* scope)
+{
+	xmlNodePtr child;
+
+	target_ds->children = file_ds->xml->children;
+	target_ds->last = file_ds->xml->last;
+	for (child = target_ds->children; child != NULL; child = child->next) {
+		child->parent = target_ds;
+	}
+
+	file_ds->xml->children = scope->children;
+	file_ds->xml->last = scope->last;
+}
+
+/**
+ * @brief Apply the edit-config changes to the datastore.
+ *
+ * The datastore content is edited in place, edit_config() processes the
+ * datastore document scoped to the edited datastore by file_edit_scope().
+ * The nodes the edit changes are saved before by file_edit_save(), so
+ * protecting the edit costs as much as the change. Their reverse delta undoes a failed edit and it is also the
+ * record of the rollback history. Only if the changed nodes cannot be
+ * determined (no compiled schema, the trim with-defaults mode), the whole
+ * content is copied for the history, or, without the history, the content
+ * broken by a failed edit is read again from the file.
+ *
+ * @param file_ds Datastore to edit.
+ * @param target_ds Node of the edited datastore.
+ * @param config_doc Edit configuration (consumed by edit_config()).
+ * @param defop Default edit operation.
+ * @param errop Error option.
+ * @param nacm NACM structure of the request, NULL to skip access control.
+ * @param error NETCONF error structure.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_edit(struct ncds_ds_file* file_ds, xmlNodePtr target_ds, xmlDocPtr config_doc, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, const struct nacm_rpc* nacm, struct nc_err** error)
+{
+	struct file_edit_level* levels = NULL;
+	struct file_edit_scope scope;
+	struct ds_history_s* record;
+	xmlNodePtr aux_node, old = NULL;
+	int retval = EXIT_SUCCESS, backup = 0;
+
+	if (file_edit_save(file_ds, target_ds, config_doc, defop, &levels) == EXIT_SUCCESS) {
+		backup = 1;
+	} else if (file_ds->rollback.levels > 0) {
+		if (target_ds->children != NULL && (old = xmlDocCopyNodeList(file_ds->xml, target_ds->children)) == NULL) {
+			/* the older changes cannot be rolled back without this one */
+			file_history_clear(file_ds);
+		} else {
+			backup = 1;
+		}
+	}
+
+	/* remember the changed subtrees for the commit */
+	file_delta_mark(file_ds, target_ds, config_doc, defop);
+
+	/* preform edit config */
+	file_edit_scope(file_ds, target_ds, &scope);
+	if (edit_config(file_ds->xml, config_doc, (struct ncds_ds*)file_ds, defop, errop, nacm, error)) {
+		retval = EXIT_FAILURE;
+		if (levels != NULL) {
+			/* undo the partial changes */
+			file_edit_unscope(file_ds, target_ds, &scope);
+			if ((record = file_edit_undo(target_ds, xmlGetProp(target_ds, BAD_CAST "modified"), levels)) == NULL ||
+					file_history_undo(record) != EXIT_SUCCESS) {
+				file_part(file_ds, target_ds)->last_access = 0;
+			}
+			if (record != NULL) {
+				file_history_free(record);
+			}
+		} else if (backup) {
+			/* put back the original content */
+			while ((aux_node = file_ds->xml->children) != NULL) {
+				xmlUnlinkNode(aux_node);
+				xmlFreeNode(aux_node);
+			}
+			file_edit_unscope(file_ds, target_ds, &scope);
+			if (old != NULL) {
+				xmlAddChildList(target_ds, old);
+			}
+		} else {
+			/* the content can be partially changed, read it again from the file */
+			file_edit_unscope(file_ds, target_ds, &scope);
+			file_part(file_ds, target_ds)->last_access = 0;
+		}
+	} else {
+		file_edit_unscope(file_ds, target_ds, &scope);
+		if (levels != NULL) {
+			if (file_ds->rollback.levels == 0) {
+				/* no history is kept */
+			} else if ((record = file_edit_undo(target_ds, xmlGetProp(target_ds, BAD_CAST "modified"), levels)) == NULL) {
+				/* the older changes cannot be rolled back without this one */
+				file_history_clear(file_ds);
+			} else {
+				file_history_add(file_ds, record);
+			}
+		} else if (backup) {
+			file_history_push(file_ds, target_ds, old, target_ds->children);
+			xmlFreeNodeList(old);
+		}
+
+		/*
+		 * if we are changing candidate, mark it as modified, since we need
+		 * this information for locking - according to RFC, candidate cannot
+		 * be locked since it has been modified and not committed.
+		 */
+		if (target_ds == file_ds->candidate) {
+			xmlSetProp(target_ds, BAD_CAST "modified", BAD_CAST "true");
+		}
+	}
+	file_edit_free(levels);
+
+	return (retval);
+}
+
+/**
+ * @brief Apply a journal record to the datastore.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_journal_apply(struct ncds_ds_file* file_ds, xmlNodePtr record)
+{
+	xmlNodePtr target_ds, source, node;
+	xmlDocPtr config_doc;
+	xmlChar* value;
+	struct nc_err* e = NULL;
+	NC_EDIT_DEFOP_TYPE defop;
+	NC_EDIT_ERROPT_TYPE errop;
+	const char* attrs[] = {"lock", "locktime", "modified", "partial-locks", NULL};
+	int i;
+
+	value = xmlGetProp(record, BAD_CAST "target");
+	target_ds = file_journal_target(file_ds, value);
+	xmlFree(value);
+	if (target_ds == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	if (xmlStrcmp(record->name, BAD_CAST "edit") == 0) {
+		value = xmlGetProp(record, BAD_CAST "defop");
+		defop = (value == NULL) ? NC_EDIT_DEFOP_NOTSET : atoi((char*) value);
+		xmlFree(value);
+		value = xmlGetProp(record, BAD_CAST "errop");
+		errop = (value == NULL) ? NC_EDIT_ERROPT_NOTSET : atoi((char*) value);
+		xmlFree(value);
+
+		config_doc = xmlNewDoc(BAD_CAST "1.0");
+		for (node = record->children; node != NULL; node = node->next) {
+			if (config_doc->children == NULL) {
+				xmlDocSetRootElement(config_doc, xmlDocCopyNode(node, config_doc, 1));
+			} else {
+				xmlAddNextSibling(config_doc->last, xmlDocCopyNode(node, config_doc, 1));
+			}
+		}
+		i = file_edit(file_ds, target_ds, config_doc, defop, errop, NULL, &e);
+		xmlFreeDoc(config_doc);
+		if (i != EXIT_SUCCESS) {
+			nc_err_free(e);
+			return (EXIT_FAILURE);
+		}
+	} else if (xmlStrcmp(record->name, BAD_CAST "copy") == 0 || xmlStrcmp(record->name, BAD_CAST "delete") == 0) {
+		value = xmlGetProp(record, BAD_CAST "source");
+		source = file_journal_target(file_ds, value);
+		xmlFree(value);
+
+		while ((node = target_ds->children) != NULL) {
+			xmlUnlinkNode(node);
+			xmlFreeNode(node);
+		}
+		if (source != NULL) {
+			xmlAddChildList(target_ds, xmlCopyNodeList(source->children));
+		} else if (record->children != NULL) {
+			xmlAddChildList(target_ds, xmlDocCopyNodeList(file_ds->xml, record->children));
+		}
+		file_delta_copied(file_ds, target_ds, source);
+	} /* else set - only the attributes are changed */
+
+	for (i = 0; attrs[i] != NULL; i++) {
+		if ((value = xmlGetProp(record, BAD_CAST attrs[i])) != NULL) {
+			xmlSetProp(target_ds, BAD_CAST attrs[i], value);
+			xmlFree(value);
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Apply the journal records not yet applied to the datastore. This
+ * function MUST be called ONLY between file_ds_lock() and file_ds_unlock().
+ *
+ * @param file_ds Datastore to update.
+ * @param part Part whose journal is applied.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_journal_replay(struct ncds_ds_file* file_ds, struct ds_part_s* part)
+{
+	xmlDocPtr doc;
+	char* data;
+	int len, c, ret;
+
+	if (part->journal == NULL) {
+		return (EXIT_SUCCESS);
+	}
+
+	fflush(part->journal);
+	if (fseek(part->journal, part->journal_offset, SEEK_SET) == -1) {
+		ERROR("%s: reading the journal %s failed (%s).", __func__, part->journal_path, strerror(errno));
+		goto failed;
+	}
+
+	/* an incomplete record at the end is ignored, any other damage is an error */
+	while ((ret = fscanf(part->journal, "%d", &len)) != EOF) {
+		if (ret != 1) {
+			ERROR("%s: invalid record in the journal %s.", __func__, part->journal_path);
+			goto failed;
+		} else if ((c = fgetc(part->journal)) == EOF) {
+			break;
+		} else if (c != '\n' || len <= 0) {
+			ERROR("%s: invalid record in the journal %s.", __func__, part->journal_path);
+			goto failed;
+		}
+		if ((data = malloc(len + 1)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			goto failed;
+		}
+		if (fread(data, 1, len, part->journal) != (size_t) len || (c = fgetc(part->journal)) == EOF) {
+			free(data);
+			break;
+		} else if (c != '\n') {
+			free(data);
+			ERROR("%s: invalid record in the journal %s.", __func__, part->journal_path);
+			goto failed;
+		}
+
+		if ((doc = xmlReadMemory(data, len, NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
+			ERROR("%s: invalid record in the journal %s.", __func__, part->journal_path);
+			free(data);
+			goto failed;
+		}
+		free(data);
+
+		if (file_generation(doc) == part->generation) {
+			if (file_journal_apply(file_ds, xmlDocGetRootElement(doc)) != EXIT_SUCCESS) {
+				ERROR("%s: applying a record from the journal %s failed.", __func__, part->journal_path);
+				xmlFreeDoc(doc);
+				goto failed;
+			}
+			/* the change of another process cannot be rolled back by us */
+			file_history_clear(file_ds);
+		}
+		xmlFreeDoc(doc);
+
+		part->journal_offset = ftell(part->journal);
+	}
+	if (ferror(part->journal)) {
+		ERROR("%s: reading the journal %s failed (%s).", __func__, part->journal_path, strerror(errno));
+		goto failed;
+	}
+
+	/* only an incomplete record written by a crashed process can remain */
+	if (fseek(part->journal, 0, SEEK_END) == -1 || (part->journal_end = ftell(part->journal)) == -1) {
+		ERROR("%s: reading the journal %s failed (%s).", __func__, part->journal_path, strerror(errno));
+		goto failed;
+	}
+
+	return (EXIT_SUCCESS);
+
+failed:
+	/*
+	 * the content differs from the file and the journal now, read it again
+	 * from scratch by the next reload and do not touch the journal until then
+	 */
+	clearerr(part->journal);
+	part->last_access = 0;
+	part->journal_end = -1;
+	return (EXIT_FAILURE);
+}
+
+/**
+ * @brief Parameters of the reverse delta generation.
+ */
+struct file_diff {
+	xmlDocPtr doc;
+	struct ds_undo_s** tail;
+	size_t size;
+	int* path;
+	int path_size;
+};
+
+/**
+ * @brief Estimate the memory used by the node list.
+ */
+static size_t file_history_size(xmlNodePtr node)
+{
+	xmlAttrPtr attr;
+	size_t size = 0;
+
+	for (; node != NULL; node = node->next) {
+		size += sizeof(xmlNode);
+		if (node->content != NULL) {
+			size += xmlStrlen(node->content) + 1;
+		}
+		if (node->type == XML_ELEMENT_NODE) {
+			for (attr = node->properties; attr != NULL; attr = attr->next) {
+				size += sizeof(xmlAttr) + file_history_size(attr->children);
+			}
+			size += file_history_size(node->children);
+		}
+	}
+
+	return (size);
+}
+
+/**
+ * @brief Compare the nodes without their children.
+ *
+ * @return non-zero if the nodes match, zero if not.
+ */
+static int file_node_equal(xmlNodePtr a, xmlNodePtr b)
+{
+	xmlAttrPtr attr, battr;
+	xmlNodePtr x, y;
+	int count = 0;
+
+	if (a->type != b->type || !xmlStrEqual(a->name, b->name)) {
+		return (0);
+	}
+
+	switch (a->type) {
+	case XML_ELEMENT_NODE:
+		if ((a->ns == NULL) != (b->ns == NULL) || (a->ns != NULL && !xmlStrEqual(a->ns->href, b->ns->href))) {
+			return (0);
+		}
+		for (attr = a->properties; attr != NULL; attr = attr->next, count++) {
+			if ((battr = xmlHasNsProp(b, attr->name, (attr->ns != NULL) ? attr->ns->href : NULL)) == NULL) {
+				return (0);
+			}
+			for (x = attr->children, y = battr->children; x != NULL && y != NULL && xmlStrEqual(x->content, y->content); x = x->next, y = y->next);
+			if (x != NULL || y != NULL) {
+				return (0);
+			}
+		}
+		for (battr = b->properties; battr != NULL; battr = battr->next, count--);
+		return (count == 0);
+	case XML_TEXT_NODE:
+	case XML_CDATA_SECTION_NODE:
+	case XML_COMMENT_NODE:
+	case XML_PI_NODE:
+		return (xmlStrEqual(a->content, b->content));
+	default:
+		return (0);
+	}
+}
+
+/**
+ * @brief Generate the reverse delta changing the new node list back to the old
+ * one. The lists are compared from both ends and the nodes in between are
+ * remembered, the matching nodes are compared recursively. The deltas are
+ * generated from the deepest ones, so applying them does not move the nodes
+ * addressed by the following deltas.
+ *
+ * @param diff Parameters of the generation.
+ * @param old First node of the original list.
+ * @param new First node of the changed list.
+ * @param depth Depth of the lists under the datastore node.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_history_diff(struct file_diff* diff, xmlNodePtr old, xmlNodePtr new, int depth)
+{
+	xmlNodePtr old_last = NULL, new_last = NULL, o, n;
+	int old_count, new_count, prefix, suffix, i;
+	struct ds_undo_s* undo;
+	int* path;
+
+	for (old_count = 0, o = old; o != NULL; old_last = o, o = o->next, old_count++);
+	for (new_count = 0, n = new; n != NULL; new_last = n, n = n->next, new_count++);
+
+	/* the same beginning and end of the lists */
+	for (prefix = 0, o = old, n = new; prefix < old_count && prefix < new_count && file_node_equal(o, n);
+			prefix++, o = o->next, n = n->next);
+	for (suffix = 0, o = old_last, n = new_last; prefix + suffix < old_count && prefix + suffix < new_count && file_node_equal(o, n);
+			suffix++, o = o->prev, n = n->prev);
+
+	/* the matching nodes can differ in their children */
+	if (depth == diff->path_size) {
+		if ((path = realloc(diff->path, (diff->path_size + 16) * sizeof(int))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (EXIT_FAILURE);
+		}
+		diff->path = path;
+		diff->path_size += 16;
+	}
+	for (i = 0, o = old, n = new; i < prefix; i++, o = o->next, n = n->next) {
+		if (o->type == XML_ELEMENT_NODE && (o->children != NULL || n->children != NULL)) {
+			diff->path[depth] = i;
+			if (file_history_diff(diff, o->children, n->children, depth + 1) != EXIT_SUCCESS) {
+				return (EXIT_FAILURE);
+			}
+		}
+	}
+	for (i = 0, o = old_last, n = new_last; i < suffix; i++, o = o->prev, n = n->prev) {
+		if (o->type == XML_ELEMENT_NODE && (o->children != NULL || n->children != NULL)) {
+			diff->path[depth] = new_count - 1 - i;
+			if (file_history_diff(diff, o->children, n->children, depth + 1) != EXIT_SUCCESS) {
+				return (EXIT_FAILURE);
+			}
+		}
+	}
+
+	if (prefix + suffix == old_count && prefix + suffix == new_count) {
+		return (EXIT_SUCCESS);
+	}
+
+	/* remember copies of the original nodes replaced by the change */
+	if ((undo = calloc(1, sizeof(struct ds_undo_s))) == NULL ||
+			(depth > 0 && (undo->path = malloc(depth * sizeof(int))) == NULL)) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(undo);
+		return (EXIT_FAILURE);
+	}
+	*(diff->tail) = undo;
+	diff->tail = &(undo->next);
+	if (depth > 0) {
+		memcpy(undo->path, diff->path, depth * sizeof(int));
+	}
+	undo->depth = depth;
+	undo->index = prefix;
+	undo->count = new_count - prefix - suffix;
+	undo->nodes = xmlNewDocNode(diff->doc, NULL, BAD_CAST "undo", NULL);
+	for (i = 0, o = old; i < prefix; i++, o = o->next);
+	for (; i < old_count - suffix; i++, o = o->next) {
+		xmlAddChild(undo->nodes, xmlDocCopyNode(o, diff->doc, 1));
+	}
+	diff->size += sizeof(struct ds_undo_s) + depth * sizeof(int) + file_history_size(undo->nodes);
+
+	return (EXIT_SUCCESS);
+}
+
+static void file_history_free(struct ds_history_s* record)
+{
+	struct ds_undo_s* undo;
+
+	while ((undo = record->undo) != NULL) {
+		record->undo = undo->next;
+		xmlFreeNode(undo->nodes);
+		free(undo->path);
+		free(undo);
+	}
+	xmlFree(record->modified);
+	free(record);
+}
+
+/**
+ * @brief Forget the oldest changes over the rollback history limits, the most
+ * recent change is kept if the levels are not 0.
+ */
+static void file_history_trim(struct ncds_ds_file* file_ds)
+{
+	struct ds_history_s* record, **last;
+
+	while (file_ds->rollback.count > file_ds->rollback.levels ||
+			(file_ds->rollback.count > 1 && file_ds->rollback.size > file_ds->rollback.max_size)) {
+		for (last = &(file_ds->rollback.history); (*last)->next != NULL; last = &((*last)->next));
+		record = *last;
+		*last = NULL;
+		file_ds->rollback.count--;
+		file_ds->rollback.size -= record->size;
+		file_history_free(record);
+	}
+}
+
+/**
+ * @brief Forget the whole rollback history, e.g. since the datastore was
+ * changed by another process. It MUST be called before the datastore document
+ * is freed.
+ */
+static void file_history_clear(struct ncds_ds_file* file_ds)
+{
+	struct ds_history_s* record;
+
+	while ((record = file_ds->rollback.history) != NULL) {
+		file_ds->rollback.history = record->next;
+		file_history_free(record);
+	}
+	file_ds->rollback.count = 0;
+	file_ds->rollback.size = 0;
+}
+
+/**
+ * @brief Add the record of the most recent change into the history.
+ */
+static void file_history_add(struct ncds_ds_file* file_ds, struct ds_history_s* record)
+{
+	record->next = file_ds->rollback.history;
+	file_ds->rollback.history = record;
+	file_ds->rollback.count++;
+	file_ds->rollback.size += record->size;
+	file_history_trim(file_ds);
+}
+
+/**
+ * @brief Remember the reverse delta of the datastore change.
+ *
+ * @param file_ds Datastore to change.
+ * @param target_ds Node of the changed datastore.
+ * @param old First node of the original content of the datastore.
+ * @param new First node of the new content of the datastore.
+ */
+static void file_history_push(struct ncds_ds_file* file_ds, xmlNodePtr target_ds, xmlNodePtr old, xmlNodePtr new)
+{
+	struct ds_history_s* record;
+	struct file_diff diff;
+
+	if (file_ds->rollback.levels == 0) {
+		return;
+	}
+
+	if ((record = calloc(1, sizeof(struct ds_history_s))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		file_history_clear(file_ds);
+		return;
+	}
+	record->target_ds = target_ds;
+	record->modified = xmlGetProp(target_ds, BAD_CAST "modified");
+
+	diff.doc = file_ds->xml;
+	diff.tail = &(record->undo);
+	diff.size = sizeof(struct ds_history_s);
+	diff.path = NULL;
+	diff.path_size = 0;
+	if (file_history_diff(&diff, old, new, 0) != EXIT_SUCCESS) {
+		/* the older changes cannot be rolled back without this one */
+		free(diff.path);
+		file_history_free(record);
+		file_history_clear(file_ds);
+		return;
+	}
+	free(diff.path);
+	record->size = diff.size;
+
+	file_history_add(file_ds, record);
+}
+
+/**
+ * @brief Get the child node on the specified position.
+ */
+static xmlNodePtr file_child(xmlNodePtr parent, int index)
+{
+	xmlNodePtr node;
+
+	for (node = parent->children; node != NULL && index > 0; node = node->next, index--);
+	return (node);
+}
+
+/**
+ * @brief Apply the reverse deltas of the change.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_history_undo(struct ds_history_s* record)
+{
+	struct ds_undo_s* undo;
+	xmlNodePtr parent, node, next;
+	int i;
+
+	for (undo = record->undo; undo != NULL; undo = undo->next) {
+		for (parent = record->target_ds, i = 0; parent != NULL && i < undo->depth; i++) {
+			parent = file_child(parent, undo->path[i]);
+		}
+		if (parent == NULL) {
+			return (EXIT_FAILURE);
+		}
+
+		/* drop the nodes added by the change */
+		for (node = file_child(parent, undo->index), i = 0; node != NULL && i < undo->count; node = next, i++) {
+			next = node->next;
+			xmlUnlinkNode(node);
+			xmlFreeNode(node);
+		}
+		if (i < undo->count) {
+			return (EXIT_FAILURE);
+		}
+
+		/* and put back the original ones */
+		while ((next = undo->nodes->children) != NULL) {
+			xmlUnlinkNode(next);
+			if (node != NULL) {
+				xmlAddPrevSibling(node, next);
+			} else {
+				xmlAddChild(parent, next);
+			}
+		}
+	}
+
+	if (record->modified != NULL) {
+		xmlSetProp(record->target_ds, BAD_CAST "modified", record->modified);
+	} else {
+		xmlUnsetProp(record->target_ds, BAD_CAST "modified");
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+int ncds_file_rollback(struct ncds_ds* ds)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	struct ds_history_s* record;
+	xmlNodePtr journal_record;
+	int ret;
+
+	if (file_ds == NULL || file_ds->ds.type != NCDS_TYPE_FILE) {
+		return (EXIT_FAILURE);
+	}
+
+	LOCK(file_ds, ret);
+	if (ret) {
+		return (EXIT_FAILURE);
+	}
+	if (file_reload(file_ds) != EXIT_SUCCESS) {
+		UNLOCK(file_ds);
+		return (EXIT_FAILURE);
+	}
+
+	if ((record = file_ds->rollback.history) == NULL) {
+		UNLOCK(file_ds);
+		ERROR("No backup repository for rollback operation (datastore %d).", file_ds->ds.id);
+		return (EXIT_FAILURE);
+	}
+	file_ds->rollback.history = record->next;
+	file_ds->rollback.count--;
+	file_ds->rollback.size -= record->size;
+
+	if (file_history_undo(record) != EXIT_SUCCESS) {
+		ERROR("Rollback of the datastore %d failed.", file_ds->ds.id);
+		/* the datastore content is broken, read it again from the file */
+		file_part(file_ds, record->target_ds)->last_access = 0;
+		file_history_clear(file_ds);
+		ret = EXIT_FAILURE;
+	} else {
+		file_delta_copied(file_ds, record->target_ds, NULL);
+
+		/* store the original content */
+		journal_record = file_journal_new("copy", record->target_ds);
+		if (record->target_ds->children != NULL) {
+			xmlAddChildList(journal_record, xmlDocCopyNodeList(journal_record->doc, record->target_ds->children));
+		}
+		ret = file_journal(file_ds, journal_record, record->target_ds);
+	}
+	file_history_free(record);
+	UNLOCK(file_ds);
+
+	if (ret == EXIT_SUCCESS) {
+		ret = ncds_file_flush(ds);
+	}
+
+	return (ret);
+}
+
+static struct ncds_lockinfo lockinfo_running = {NC_DATASTORE_RUNNING, NULL, NULL};
+static struct ncds_lockinfo lockinfo_startup = {NC_DATASTORE_STARTUP, NULL, NULL};
+static struct ncds_lockinfo lockinfo_candidate = {NC_DATASTORE_CANDIDATE, NULL, NULL};
+const struct ncds_lockinfo *ncds_file_lockinfo(struct ncds_ds* ds, NC_DATASTORE target)
+{
+	int ret;
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	xmlNodePtr target_ds;
+	struct ncds_lockinfo *info;
+
+	RDLOCK(file_ds, ret);
+	if (ret) {
+		return (NULL);
+	}
+
+	if (file_reload (file_ds)) {
+		UNLOCK(file_ds);
+		return (NULL);
+	}
+
+	/* check validity of function parameters */
+	switch(target) {
+	case NC_DATASTORE_RUNNING:
+		target_ds = file_ds->running;
+		info = &lockinfo_running;
+		break;
+	case NC_DATASTORE_STARTUP:
+		target_ds = file_ds->startup;
+		info = &lockinfo_startup;
+		break;
+	case NC_DATASTORE_CANDIDATE:
+		target_ds = file_ds->candidate;
+		info = &lockinfo_candidate;
+		break;
+	default:
+		UNLOCK(file_ds);
+		return (NULL);
+		break;
+	}
+	free((*info).sid);
+	free((*info).time);
+	(*info).sid = (char*) xmlGetProp (target_ds, BAD_CAST "lock");
+	(*info).time = (char*) xmlGetProp (target_ds, BAD_CAST "locktime");
+	if ((*info).sid == NULL) {
+		WARN("%s: missing the \"lock\" attribute in the %s datastore.", __func__, file_ds->ds.data_model->name);
+	} else if (strisempty((*info).sid)) {
+		free((*info).sid);
+		free((*info).time);
+		(*info).sid = NULL;
+		(*info).time = NULL;
+	}
+
+	UNLOCK(file_ds);
+
+	return (info);
+}
+
+int ncds_file_get_plocks(struct ncds_ds* ds, char** locks)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	struct ds_snapshot_s* snapshot;
+
+	*locks = NULL;
+
+	if ((snapshot = file_snapshot_get(file_ds, 0, NULL)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	if (snapshot->plocks != NULL && !strisempty(snapshot->plocks)) {
+		*locks = strdup(snapshot->plocks);
+	}
+	file_snapshot_put(snapshot);
+
+	return (EXIT_SUCCESS);
+}
+
+int ncds_file_update_plocks(struct ncds_ds* ds, char* (*update)(const char* locks, void* arg), void* arg)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	xmlChar* locks;
+	char* new_locks;
+	int ret;
+
+	LOCK(file_ds, ret);
+	if (ret) {
+		return (EXIT_FAILURE);
+	}
+
+	if (file_reload(file_ds)) {
+		UNLOCK(file_ds);
+		return (EXIT_FAILURE);
+	}
+
+	locks = xmlGetProp(file_ds->running, BAD_CAST "partial-locks");
+	new_locks = update((locks != NULL && !strisempty((char*) locks)) ? (char*) locks : NULL, arg);
+	xmlFree(locks);
+	if (new_locks == NULL) {
+		/* nothing changed */
+		UNLOCK(file_ds);
+		return (EXIT_SUCCESS);
+	}
+
+	xmlSetProp(file_ds->running, BAD_CAST "partial-locks", BAD_CAST new_locks);
+	free(new_locks);
+	ret = file_journal(file_ds, file_journal_new("set", file_ds->running), file_ds->running);
+	UNLOCK(file_ds);
+
+	if (ret == EXIT_SUCCESS) {
+		ret = ncds_file_flush(ds);
+	}
+
+	return (ret);
+}
+
+int ncds_file_lock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	xmlChar* lock, *modified = NULL;
 	xmlNodePtr target_ds;
 	struct nc_session* no_session;
 	int retval = EXIT_SUCCESS, ret;
 	char* t;
 
-	assert(error);
+	assert(error);
+
+	LOCK(file_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		return EXIT_FAILURE;
+	}
+
+	if (file_reload (file_ds)) {
+		UNLOCK(file_ds);
+		return EXIT_FAILURE;
+	}
+
+	/* check validity of function parameters */
+	switch(target) {
+	case NC_DATASTORE_RUNNING:
+		target_ds = file_ds->running;
+		break;
+	case NC_DATASTORE_STARTUP:
+		target_ds = file_ds->startup;
+		break;
+	case NC_DATASTORE_CANDIDATE:
+		target_ds = file_ds->candidate;
+		break;
+	default:
+		UNLOCK(file_ds);
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+		break;
+	}
+
+	/* check if repository is locked by anyone including me */
+	no_session = nc_session_dummy(INTERNAL_DUMMY_ID, session->username, session->hostname, session->capabilities);
+	if (file_ds_access (file_ds, target, no_session) != 0) {
+		/* someone is already holding the lock */
+		lock = xmlGetProp (target_ds, BAD_CAST "lock");
+		*error = nc_err_new(NC_ERR_LOCK_DENIED);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_SID, (char*)lock);
+		xmlFree(lock);
+		retval = EXIT_FAILURE;
+	} else {
+		if (target == NC_DATASTORE_CANDIDATE &&
+				(modified = xmlGetProp(target_ds, BAD_CAST "modified")) != NULL &&
+				xmlStrcmp(modified, BAD_CAST "true") == 0) {
+			*error = nc_err_new(NC_ERR_LOCK_DENIED);
+			nc_err_set(*error, NC_ERR_PARAM_MSG, "Candidate datastore not locked but already modified.");
+			retval = EXIT_FAILURE;
+		} else {
+			xmlSetProp (target_ds, BAD_CAST "lock", BAD_CAST session->session_id);
+			xmlSetProp (target_ds, BAD_CAST "locktime", BAD_CAST (t = nc_time2datetime(time(NULL), NULL)));
+			free(t);
+			if (file_journal(file_ds, file_journal_new("set", target_ds), target_ds)) {
+				*error = nc_err_new(NC_ERR_OP_FAILED);
+				nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+				retval = EXIT_FAILURE;
+			}
+		}
+		xmlFree(modified);
+	}
+	UNLOCK(file_ds);
+
+	/* cleanup */
+	nc_session_free(no_session);
+
+	return (retval);
+}
+
+int ncds_file_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	xmlNodePtr target_ds, del, record;
+	struct nc_session* no_session;
+	int retval = EXIT_SUCCESS, ret;
+
+	assert(error);
+
+	LOCK(file_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		return EXIT_FAILURE;
+	}
+
+	if (file_reload (file_ds)) {
+		UNLOCK(file_ds);
+		return EXIT_FAILURE;
+	}
+
+	/* check validity of function parameters */
+	switch(target) {
+	case NC_DATASTORE_RUNNING:
+		target_ds = file_ds->running;
+		break;
+	case NC_DATASTORE_STARTUP:
+		target_ds = file_ds->startup;
+		break;
+	case NC_DATASTORE_CANDIDATE:
+		target_ds = file_ds->candidate;
+		break;
+	default:
+		UNLOCK(file_ds);
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+		break;
+	}
+
+	/* check if repository is locked */
+	no_session = nc_session_dummy(INTERNAL_DUMMY_ID, session->username, session->hostname, session->capabilities);
+	if (file_ds_access (file_ds, target, no_session) == 0) {
+		/* not locked */
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Target datastore is not locked.");
+		retval = EXIT_FAILURE;
+	} else if (file_ds_access (file_ds, target, session) != 0) {
+		/* the datastore is locked by somebody else */
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Target datastore is locked by another session.");
+		retval = EXIT_FAILURE;
+	} else {
+		/* the datastore is locked by request originating session */
+		record = file_journal_new("set", target_ds);
+
+		if (target == NC_DATASTORE_CANDIDATE) {
+			/* drop current candidate configuration */
+			while ((del = file_ds->candidate->children) != NULL) {
+				xmlUnlinkNode (file_ds->candidate->children);
+				xmlFreeNode (del);
+			}
+
+			/* copy running into candidate configuration */
+			xmlAddChildList(file_ds->candidate, xmlCopyNodeList(file_ds->running->children));
+			xmlNodeSetName(record, BAD_CAST "copy");
+			xmlNewProp(record, BAD_CAST "source", BAD_CAST "running");
+			file_delta_copied(file_ds, file_ds->candidate, file_ds->running);
+			if (file_private_used(file_ds, session)) {
+				file_private_drop(file_ds, session);
+			}
+
+			/* mark candidate as not modified */
+			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "false");
+		}
+
+		/* unlock datastore */
+		xmlSetProp (target_ds, BAD_CAST "lock", BAD_CAST "");
+		xmlSetProp (target_ds, BAD_CAST "locktime", BAD_CAST "");
+		if (file_journal(file_ds, record, target_ds)) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+			retval = EXIT_FAILURE;
+		}
+	}
+
+	UNLOCK(file_ds);
+
+	/* cleanup */
+	if (no_session != NULL) {
+		nc_session_free(no_session);
+	}
+
+	return (retval);
+}
+
+/**
+ * @brief Get the index of the datastore in the snapshots, -1 if it is invalid.
+ */
+static int file_snapshot_index(NC_DATASTORE source)
+{
+	switch (source) {
+	case NC_DATASTORE_RUNNING:
+		return (0);
+	case NC_DATASTORE_STARTUP:
+		return (1);
+	case NC_DATASTORE_CANDIDATE:
+		return (2);
+	default:
+		return (-1);
+	}
+}
+
+/**
+ * @brief Release the reference to the snapshot.
+ */
+static void file_snapshot_put(struct ds_snapshot_s* snapshot)
+{
+	if (snapshot != NULL && __atomic_sub_fetch(&(snapshot->refs), 1, __ATOMIC_ACQ_REL) == 0) {
+		free(snapshot->data);
+		free(snapshot->plocks);
+		free(snapshot);
+	}
+}
+
+/**
+ * @brief Get a reference to the published snapshot of the datastore.
+ */
+static struct ds_snapshot_s* file_snapshot_ref(struct ncds_ds_file* file_ds, int i)
+{
+	struct ds_snapshot_s* snapshot;
+
+	pthread_rwlock_rdlock(&(file_ds->snapshots.lock));
+	if ((snapshot = file_ds->snapshots.ds[i]) != NULL) {
+		__atomic_add_fetch(&(snapshot->refs), 1, __ATOMIC_ACQ_REL);
+	}
+	pthread_rwlock_unlock(&(file_ds->snapshots.lock));
+
+	return (snapshot);
+}
+
+/**
+ * @brief Replace the published snapshot of the datastore.
+ *
+ * @param file_ds Datastore.
+ * @param i Index of the datastore.
+ * @param snapshot New snapshot, its reference is passed, NULL to forget the
+ * current one.
+ */
+static void file_snapshot_publish(struct ncds_ds_file* file_ds, int i, struct ds_snapshot_s* snapshot)
+{
+	struct ds_snapshot_s* old;
+
+	pthread_rwlock_wrlock(&(file_ds->snapshots.lock));
+	old = file_ds->snapshots.ds[i];
+	file_ds->snapshots.ds[i] = snapshot;
+	pthread_rwlock_unlock(&(file_ds->snapshots.lock));
+
+	file_snapshot_put(old);
+}
+
+/**
+ * @brief Test if the snapshot still matches the part file and its journal.
+ * Only the shared reader/writer lock is needed, the pending watch events are
+ * just detected here, they are processed by file_reload() with the local lock
+ * held.
+ */
+static int file_snapshot_valid(struct ncds_ds_file* file_ds, const struct ds_snapshot_s* snapshot)
+{
+	struct ds_part_s* part = &(file_ds->parts[snapshot->part]);
+	struct pollfd pfd;
+	struct stat statbuf;
+
+	if (file_ds->ds_lock.shared->parts[snapshot->part].rewrites != snapshot->rewrites ||
+			file_ds->ds_lock.shared->parts[snapshot->part].changes != snapshot->changes) {
+		return (0);
+	}
+
+	/* the external changes make file_watch_read() forget the snapshots */
+	if ((pfd.fd = __atomic_load_n(&(file_ds->watch), __ATOMIC_ACQUIRE)) != -1) {
+		pfd.events = POLLIN;
+		return (poll(&pfd, 1, 0) == 0);
+	}
+	/* without the watch, check when the file was modified */
+	return (stat(part->path, &statbuf) == 0 && statbuf.st_mtime < snapshot->last_access);
+}
+
+/**
+ * @brief Take and publish the snapshot of the current content of the
+ * datastore, unless the published one is still current. The local lock MUST
+ * be held and the datastore reloaded.
+ *
+ * @return Reference to the snapshot, NULL on error.
+ */
+static struct ds_snapshot_s* file_snapshot_take(struct ncds_ds_file* file_ds, int i)
+{
+	struct ds_snapshot_s* snapshot;
+	struct ds_part_s* part;
+	xmlNodePtr target_ds, aux_node;
+	xmlBufferPtr resultbuffer;
+
+	target_ds = (i == 0) ? file_ds->running : ((i == 1) ? file_ds->startup : file_ds->candidate);
+	part = file_part(file_ds, target_ds);
+
+	/* another thread could publish it in the meantime */
+	if ((snapshot = file_snapshot_ref(file_ds, i)) != NULL) {
+		if (snapshot->rewrites == part->rewrites && snapshot->changes == part->changes && snapshot->last_access == part->last_access) {
+			return (snapshot);
+		}
+		file_snapshot_put(snapshot);
+	}
+
+	if ((snapshot = calloc(1, sizeof(struct ds_snapshot_s))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	if ((resultbuffer = xmlBufferCreate()) == NULL) {
+		ERROR("%s: xmlBufferCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		free(snapshot);
+		return (NULL);
+	}
+	for (aux_node = target_ds->children; aux_node != NULL; aux_node = aux_node->next) {
+		xmlNodeDump(resultbuffer, file_ds->xml, aux_node, 2, 1);
+	}
+	snapshot->data = nc_clrwspace((char *) xmlBufferContent(resultbuffer));
+	xmlBufferFree(resultbuffer);
+	if (i == 0) {
+		snapshot->plocks = (char*) xmlGetProp(target_ds, BAD_CAST "partial-locks");
+	}
+
+	snapshot->part = part - file_ds->parts;
+	snapshot->rewrites = part->rewrites;
+	snapshot->changes = part->changes;
+	snapshot->last_access = part->last_access;
+	/* one reference is kept by the datastore, one is returned */
+	snapshot->refs = 2;
+	file_snapshot_publish(file_ds, i, snapshot);
+
+	return (snapshot);
+}
+
+/**
+ * @brief Get the snapshot of the datastore content. Only the shared
+ * reader/writer lock is held, so the readers do not block each other. When
+ * the current snapshot is outdated, the shared lock is released and taken
+ * again by RDLOCK together with the local lock (in the order used by the
+ * writers) to reload the datastore and to publish a new snapshot.
+ *
+ * @param file_ds Datastore.
+ * @param i Index of the datastore.
+ * @param error NETCONF error structure, NULL if not required.
+ *
+ * @return Reference to the snapshot to be released by file_snapshot_put(),
+ * NULL on error.
+ */
+static struct ds_snapshot_s* file_snapshot_get(struct ncds_ds_file* file_ds, int i, struct nc_err** error)
+{
+	struct ds_snapshot_s* snapshot;
+	struct timespec tv_timeout;
+	sigset_t fullsigset, sigset;
+	int ret;
+
+	sigfillset(&fullsigset);
+	sigprocmask(SIG_SETMASK, &fullsigset, &sigset);
+	clock_gettime(CLOCK_REALTIME, &tv_timeout);
+	tv_timeout.tv_sec += NCDS_LOCK_TIMEOUT;
+	if (pthread_rwlock_timedrdlock(file_ds->ds_lock.rwlock, &tv_timeout) != 0) {
+		sigprocmask(SIG_SETMASK, &sigset, NULL);
+		if (error != NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		}
+		return (NULL);
+	}
+
+	if ((snapshot = file_snapshot_ref(file_ds, i)) != NULL && !file_snapshot_valid(file_ds, snapshot)) {
+		file_snapshot_put(snapshot);
+		snapshot = NULL;
+	}
+	pthread_rwlock_unlock(file_ds->ds_lock.rwlock);
+
+	if (snapshot == NULL) {
+		/*
+		 * the local mutex MUST be taken before the shared lock (as in
+		 * LOCK), so start again with RDLOCK, file_snapshot_take() reuses
+		 * the snapshot published meanwhile by another thread
+		 */
+		RDLOCK(file_ds, ret);
+		if (ret) {
+			sigprocmask(SIG_SETMASK, &sigset, NULL);
+			if (error != NULL) {
+				*error = nc_err_new(NC_ERR_OP_FAILED);
+				nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+			}
+			return (NULL);
+		}
+		if (file_reload(file_ds) == EXIT_SUCCESS) {
+			snapshot = file_snapshot_take(file_ds, i);
+		}
+		UNLOCK(file_ds);
+	}
+	sigprocmask(SIG_SETMASK, &sigset, NULL);
+
+	return (snapshot);
+}
+
+char* ncds_file_getconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	struct ds_snapshot_s* snapshot;
+	struct file_private_swap* swaps;
+	xmlNodePtr aux_node;
+	xmlBufferPtr resultbuffer;
+	char* data = NULL;
+	int ret;
+
+	assert(error);
+
+	/* check validity of function parameters */
+	if (file_snapshot_index(source) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "source");
+		return (NULL);
+	}
+
+	/* the shared datastores are read from their snapshots */
+	if (source != NC_DATASTORE_CANDIDATE || !file_private_used(file_ds, session)) {
+		if ((snapshot = file_snapshot_get(file_ds, file_snapshot_index(source), error)) == NULL) {
+			return (NULL);
+		}
+		if (snapshot->data != NULL) {
+			data = strdup(snapshot->data);
+		}
+		file_snapshot_put(snapshot);
+		return (data);
+	}
+
+	/* the private candidate of the session */
+	RDLOCK(file_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		return NULL;
+	}
+
+	if (file_reload (file_ds)) {
+		UNLOCK(file_ds);
+		return NULL;
+	}
+
+	resultbuffer = xmlBufferCreate();
+	if (resultbuffer == NULL) {
+		UNLOCK(file_ds);
+		ERROR("%s: xmlBufferCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		return (NULL);
+	}
+	/* the running datastore shows the private candidate only while it is dumped */
+	swaps = file_private_show(file_ds, session);
+	for (aux_node = file_ds->running->children; aux_node != NULL; aux_node = aux_node->next) {
+		xmlNodeDump(resultbuffer, file_ds->xml, aux_node, 2, 1);
+	}
+	file_private_restore(swaps);
+	data = nc_clrwspace((char *) xmlBufferContent(resultbuffer));
+	xmlBufferFree(resultbuffer);
+
+	UNLOCK(file_ds);
+	return (data);
+}
+
+/**
+ * @brief Copy the content of the datastore or externally send
+ * the configuration to another datastore
+ *
+ * @param ds Pointer to a datastore structure
+ * @param session Session which the request is a part of
+ * @param rpc RPC message with the request
+ * @param target Target datastore.
+ * @param source Source datastore, if the value is NC_DATASTORE_NONE
+ * then the next parameter holds the configration to copy
+ * @param config Configuration to be used as the source in the form of a serialized XML.
+ * @param error	 Netconf error structure.
+ *
+ * @return EXIT_SUCCESS when done without problems
+ * 	   EXIT_FAILURE when error occured
+ * 	   EXIT_RPC_NOT_APPLICABLE when rpc is not applicable
+ */
+int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, const nc_rpc* rpc, NC_DATASTORE target, NC_DATASTORE source, char * config, struct nc_err **error)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	xmlDocPtr config_doc = NULL, aux_doc;
+	xmlNodePtr target_ds, source_ds, aux_node, root, record;
+	keyList keys;
+	char *aux = NULL, *configp;
+	int r, ret = 0, private_source = 0;
+
+	assert(error);
+
+	LOCK(file_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		return EXIT_FAILURE;
+	}
+
+	if (file_reload (file_ds)) {
+		UNLOCK(file_ds);
+		return EXIT_FAILURE;
+	}
+
+	switch(target) {
+	case NC_DATASTORE_RUNNING:
+		target_ds = file_ds->running;
+		break;
+	case NC_DATASTORE_STARTUP:
+		target_ds = file_ds->startup;
+		break;
+	case NC_DATASTORE_CANDIDATE:
+		target_ds = file_ds->candidate;
+		break;
+	default:
+		UNLOCK(file_ds);
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return EXIT_FAILURE;
+		break;
+	}
+
+	/* isn't target locked? */
+	if (file_ds_access (file_ds, target, session) != 0) {
+		UNLOCK(file_ds);
+		*error = nc_err_new (NC_ERR_IN_USE);
+		return EXIT_FAILURE;
+	}
+	if (source == NC_DATASTORE_CANDIDATE && target == NC_DATASTORE_RUNNING) {
+		/* commit - check also the lock on source (i.e. candidate) datastore */
+		if (file_ds_access (file_ds, source, session) != 0) {
+			UNLOCK(file_ds);
+			*error = nc_err_new (NC_ERR_IN_USE);
+			return EXIT_FAILURE;
+		}
+
+		if (file_private_used(file_ds, session)) {
+			ret = file_private_commit(file_ds, session, rpc, NULL, NULL, error);
+			UNLOCK(file_ds);
+			return ret;
+		}
+	}
+
+	switch(source) {
+	case NC_DATASTORE_RUNNING:
+		source_ds = file_ds->running->children;
+		break;
+	case NC_DATASTORE_STARTUP:
+		source_ds = file_ds->startup->children;
+		break;
+	case NC_DATASTORE_CANDIDATE:
+		if (file_private_used(file_ds, session)) {
+			/* the private candidate is copied as a configuration */
+			config_doc = file_private_view(file_ds, session);
+			source_ds = config_doc->children;
+			private_source = 1;
+		} else {
+			source_ds = file_ds->candidate->children;
+		}
+		break;
+	case NC_DATASTORE_CONFIG:
+		if (config == NULL) {
+			UNLOCK(file_ds);
+			ERROR("%s: invalid source config.", __func__);
+			*error = nc_err_new(NC_ERR_BAD_ELEM);
+			nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
+			return EXIT_FAILURE;
+		}
+		if (strncmp(config, "<?xml", 5) == 0) {
+			if ((configp = strchr(config, '>')) == NULL) {
+				UNLOCK(file_ds);
+				ERROR("%s: invalid source config.", __func__);
+				*error = nc_err_new(NC_ERR_BAD_ELEM);
+				nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
+				return EXIT_FAILURE;
+			}
+			++configp;
+			while (*configp == ' ' || *configp == '\n' || *configp == '\t') {
+				++configp;
+			}
+		} else {
+			configp = config;
+		}
+		if (asprintf(&aux, "<config>%s</config>", configp) == -1) {
+			UNLOCK(file_ds);
+			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			return EXIT_FAILURE;
+		}
+		if ((config_doc = xmlReadMemory (aux, strlen(aux), NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
+			free(aux);
+			UNLOCK(file_ds);
+			ERROR("%s: reading source config failed.", __func__);
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			return EXIT_FAILURE;
+		}
+		free(aux);
+		source_ds = config_doc->children->children;
+		break;
+	default:
+		UNLOCK(file_ds);
+		ERROR("%s: invalid source.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return EXIT_FAILURE;
+		break;
+	}
+
+	if (target == NC_DATASTORE_CANDIDATE && file_private_used(file_ds, session)) {
+		if (source == NC_DATASTORE_RUNNING) {
+			/* discard-changes */
+			file_private_drop(file_ds, session);
+		} else {
+			ret = file_private_copy(file_ds, session, source_ds, error);
+		}
+		UNLOCK(file_ds);
+		xmlFreeDoc(config_doc);
+		return ret;
+	}
+
+	/* we could still do something with candidate datastore,
+	 * so we have to change the "modified" attribute
+	 */
+	if (source_ds == NULL && target_ds->children == NULL) {
+		file_history_push(file_ds, target_ds, NULL, NULL);
+		ret = EXIT_RPC_NOT_APPLICABLE;
+		goto finish;
+	}
+
+	aux_doc = xmlNewDoc (BAD_CAST "1.0");
+	if (source_ds) {
+		xmlDocSetRootElement(aux_doc, xmlCopyNode(source_ds, 1));
+		for (root = source_ds->next; root != NULL; root = aux_node) {
+			aux_node = root->next;
+			xmlAddNextSibling(aux_doc->last, xmlCopyNode(root, 1));
+		}
+	}
+
+	if (rpc != NULL && rpc->nacm != NULL ) {
+		/* NACM */
+		/* RFC 6536, sec. 3.2.4., paragraph 2
+		 * If the source of the <copy-config> protocol operation is the running
+		 * configuration datastore and the target is the startup configuration
+		 * datastore, the client is only required to have permission to execute
+		 * the <copy-config> protocol operation.
+		 */
+		if (!(source == NC_DATASTORE_RUNNING && target == NC_DATASTORE_STARTUP)) {
+			keys = get_keynode_list(file_ds->ds.ext_model);
+			if (source == NC_DATASTORE_RUNNING || source == NC_DATASTORE_STARTUP || source == NC_DATASTORE_CANDIDATE) {
+				/* RFC 6536, sec 3.2.4., paragraph 3
+				 * If the source of the <copy-config> operation is a datastore,
+				 * then data nodes to which the client does not have read access
+				 * are silently omitted
+				 */
+				nacm_check_data_read(aux_doc, rpc->nacm);
+			}
+
+			/* RFC 6536, sec. 3.2.4., paragraph 4
+			 * If the target of the <copy-config> operation is a datastore,
+			 * the client needs access to the modified nodes according to
+			 * the effective access operation of the each modified node.
+			 */
+			if (target_ds->children == NULL) {
+				/* creating a completely new configuration data */
+				r = nacm_check_data(aux_doc->children, NACM_ACCESS_CREATE, rpc->nacm);
+			} else {
+				/* replacing an old configuration data */
+				r = edit_replace_nacmcheck(target_ds->children, aux_doc, file_ds->ds.ext_model, keys, rpc->nacm, error);
+			}
+
+			if (r != NACM_PERMIT) {
+				if (r == NACM_DENY) {
+					if (error != NULL ) {
+						*error = nc_err_new(NC_ERR_ACCESS_DENIED);
+					}
+				} else {
+					if (error != NULL ) {
+						*error = nc_err_new(NC_ERR_OP_FAILED);
+					}
+				}
+				UNLOCK(file_ds);
+				xmlFreeDoc(aux_doc);
+				keyListFree(keys);
+				xmlFreeDoc (config_doc);
+				return (EXIT_FAILURE);
+			}
+			keyListFree(keys);
+		}
+	}
+
+	/* drop current target configuration */
+	file_history_push(file_ds, target_ds, target_ds->children, aux_doc->children);
+	while ((aux_node = target_ds->children) != NULL) {
+		xmlUnlinkNode (target_ds->children);
+		xmlFreeNode (aux_node);
+	}
+
+	/* copy new target configuration */
+	xmlAddChildList(target_ds, xmlCopyNodeList(aux_doc->children));
+	xmlFreeDoc(aux_doc);
+
+finish:
+	/*
+	 * if we are changing candidate, mark it as modified, since we need
+	 * this information for locking - according to RFC, candidate cannot
+	 * be locked since it has been modified and not committed.
+	 */
+	if (target == NC_DATASTORE_CANDIDATE) {
+		if (source == NC_DATASTORE_RUNNING) {
+			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "false");
+		} else {
+			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "true");
+		}
+	}
+
+	file_delta_copied(file_ds, target_ds, (source == NC_DATASTORE_CONFIG || private_source) ? NULL : file_journal_source(file_ds, source));
+
+	/* journal the source datastore or the new content */
+	record = file_journal_new("copy", target_ds);
+	if (source == NC_DATASTORE_CONFIG || private_source) {
+		if (target_ds->children != NULL) {
+			xmlAddChildList(record, xmlDocCopyNodeList(record->doc, target_ds->children));
+		}
+	} else {
+		xmlNewProp(record, BAD_CAST "source", file_journal_source(file_ds, source)->name);
+	}
+	if (file_journal(file_ds, record, target_ds)) {
+		UNLOCK(file_ds);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+		return EXIT_FAILURE;
+	}
+	UNLOCK(file_ds);
+
+	xmlFreeDoc (config_doc);
+	return ret;
+}
+
+/**
+ * @brief Parameters of the commit of the changed subtrees.
+ */
+struct file_delta_commit {
+	const struct schema* schema;
+	/**
+	 * history record of the commit, NULL if not kept
+	 */
+	struct ds_history_s* record;
+	/**
+	 * the history record could not be completed
+	 */
+	int failed;
+	/**
+	 * partial documents with the running configuration before and after
+	 * the commit, NULL if not required
+	 */
+	xmlDocPtr old, new;
+};
+
+/**
+ * @brief Remember the reverse delta of a single change of the running
+ * datastore. The deltas are prepended, so they are undone in the reverse
+ * order and the positions are valid at the time they are applied.
+ *
+ * @param commit Parameters of the commit.
+ * @param parent Parent of the changed node.
+ * @param index Position of the change among the parent's children.
+ * @param count Number of the added nodes (0 or 1).
+ * @param orig Original node replaced or removed by the change, it is moved
+ * into the history or freed. NULL if the node was only added.
+ */
+static void file_delta_undo(struct file_delta_commit* commit, xmlNodePtr parent, int index, int count, xmlNodePtr orig)
+{
+	struct ds_undo_s* undo;
+
+	if (orig != NULL) {
+		xmlUnlinkNode(orig);
+	}
+	if (commit->record == NULL) {
+		xmlFreeNode(orig);
+		return;
+	}
+
+	if ((undo = file_undo_new(commit->record->target_ds, parent, index, count)) == NULL) {
+		xmlFreeNode(orig);
+		/* the older changes cannot be rolled back without this one */
+		file_history_free(commit->record);
+		commit->record = NULL;
+		commit->failed = 1;
+		return;
+	}
+	if (orig != NULL) {
+		xmlAddChild(undo->nodes, orig);
+	}
+
+	undo->next = commit->record->undo;
+	commit->record->undo = undo;
+	commit->record->size += sizeof(struct ds_undo_s) + undo->depth * sizeof(int) + file_history_size(undo->nodes);
+}
+
+/**
+ * @brief Get the position of the node among its siblings.
+ */
+static int file_delta_index(xmlNodePtr node)
+{
+	int index;
+
+	for (index = 0; node->prev != NULL; node = node->prev, index++);
+	return (index);
+}
+
+/**
+ * @brief Add a copy of the node with its leaves, but without its other
+ * descendants, into the partial document.
+ */
+static xmlNodePtr file_delta_copy_path(xmlDocPtr doc, xmlNodePtr parent, xmlNodePtr node)
+{
+	xmlNodePtr copy;
+
+	copy = xmlDocCopyNode(node, doc, 2);
+	file_delta_add(doc, parent, copy);
+	for (node = node->children; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE && file_delta_is_leaf(node)) {
+			xmlAddChild(copy, xmlDocCopyNode(node, doc, 1));
+		}
+	}
+
+	return (copy);
+}
+
+/**
+ * @brief Add a copy of the changed subtree into the partial document. The
+ * leaves of the ancestors are already there.
+ */
+static void file_delta_copy_subtree(xmlDocPtr doc, xmlNodePtr parent, xmlNodePtr node)
+{
+	xmlNodePtr copy;
+
+	if (doc == NULL || (parent != NULL && file_delta_is_leaf(node))) {
+		return;
+	}
+
+	copy = xmlDocCopyNode(node, doc, 1);
+	copy->_private = &file_delta_dirty;
+	file_delta_add(doc, parent, copy);
+}
+
+/**
+ * @brief Apply the changed subtrees of the candidate to the running datastore.
+ *
+ * @param commit Parameters of the commit.
+ * @param skel First skeleton node on the level.
+ * @param psnode Schema node of the parent, NULL on the top level.
+ * @param running Parent node in the running datastore.
+ * @param candidate Parent node in the candidate datastore.
+ * @param old Parent node in the old partial document, NULL on the top level.
+ * @param new Parent node in the new partial document, NULL on the top level.
+ */
+static void file_delta_apply(struct file_delta_commit* commit, xmlNodePtr skel, const struct schema_node* psnode,
+		xmlNodePtr running, xmlNodePtr candidate, xmlNodePtr old, xmlNodePtr new)
+{
+	const struct schema_node* snode, *prev_snode;
+	xmlNodePtr r, c, copy, prev, o = NULL, n = NULL;
+
+	for (; skel != NULL; skel = skel->next) {
+		if (skel->type != XML_ELEMENT_NODE || file_delta_is_key(psnode, skel) ||
+				(snode = file_delta_schema(commit->schema, psnode, skel)) == NULL) {
+			continue;
+		}
+		r = file_delta_find(snode, running->children, skel);
+		c = file_delta_find(snode, candidate->children, skel);
+
+		if (r != NULL && c != NULL && !DELTA_DIRTY(skel)) {
+			/* only some of the descendants were changed */
+			if (commit->old != NULL) {
+				o = file_delta_copy_path(commit->old, old, r);
+			}
+			if (commit->new != NULL) {
+				n = xmlDocCopyNode(r, commit->new, 2);
+				file_delta_add(commit->new, new, n);
+			}
+			file_delta_apply(commit, skel->children, snode, r, c, o, n);
+			if (n != NULL) {
+				for (r = r->children; r != NULL; r = r->next) {
+					if (r->type == XML_ELEMENT_NODE && file_delta_is_leaf(r)) {
+						xmlAddChild(n, xmlDocCopyNode(r, commit->new, 1));
+					}
+				}
+			}
+			continue;
+		}
+
+		/* the whole subtree is replaced */
+		if (r != NULL) {
+			file_delta_copy_subtree(commit->old, old, r);
+		}
+		if (c == NULL) {
+			file_delta_undo(commit, running, file_delta_index(r), 0, r);
+			continue;
+		}
+
+		copy = xmlDocCopyNode(c, running->doc, 1);
+		if (r != NULL) {
+			xmlReplaceNode(r, copy);
+		} else {
+			/* keep the order of the candidate */
+			for (prev = c->prev; prev != NULL && prev->type != XML_ELEMENT_NODE; prev = prev->prev);
+			if (prev == NULL && running->children != NULL) {
+				xmlAddPrevSibling(running->children, copy);
+			} else if (prev != NULL && (prev_snode = file_delta_schema(commit->schema, psnode, prev)) != NULL &&
+					(prev = file_delta_find(prev_snode, running->children, prev)) != NULL) {
+				xmlAddNextSibling(prev, copy);
+			} else {
+				xmlAddChild(running, copy);
+			}
+		}
+		file_delta_undo(commit, running, file_delta_index(copy), 1, r);
+		file_delta_copy_subtree(commit->new, new, c);
+	}
+}
+
+/**
+ * @brief Create a document with a copy of the datastore content, all the top
+ * level nodes are marked as changed.
+ */
+static xmlDocPtr file_delta_snapshot(xmlNodePtr target_ds)
+{
+	xmlDocPtr doc;
+	xmlNodePtr node;
+
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	for (node = target_ds->children; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE) {
+			file_delta_copy_subtree(doc, NULL, node);
+		}
+	}
+
+	return (doc);
+}
+
+/**
+ * @brief Copy the subtrees described by the delta skeleton into the partial
+ * document.
+ *
+ * @param schema Compiled schema of the datastore.
+ * @param skel First skeleton node on the level.
+ * @param psnode Schema node of the parent, NULL on the top level.
+ * @param data Parent node in the datastore.
+ * @param doc Partial document.
+ * @param parent Parent node in the partial document, NULL on the top level.
+ */
+static void file_delta_extract(const struct schema* schema, xmlNodePtr skel, const struct schema_node* psnode, xmlNodePtr data, xmlDocPtr doc, xmlNodePtr parent)
+{
+	const struct schema_node* snode;
+	xmlNodePtr node;
+
+	for (; skel != NULL; skel = skel->next) {
+		if (skel->type != XML_ELEMENT_NODE || file_delta_is_key(psnode, skel) ||
+				(snode = file_delta_schema(schema, psnode, skel)) == NULL ||
+				(node = file_delta_find(snode, data->children, skel)) == NULL) {
+			continue;
+		}
+
+		if (DELTA_DIRTY(skel)) {
+			file_delta_copy_subtree(doc, parent, node);
+		} else {
+			file_delta_extract(schema, skel->children, snode, node, doc, file_delta_copy_path(doc, parent, node));
+		}
+	}
+}
+
+static void file_private_free(void* payload, const xmlChar* UNUSED(name))
+{
+	struct ds_private_s* priv = (struct ds_private_s*)payload;
+
+	xmlFreeDoc(priv->doc);
+	xmlFreeDoc(priv->base);
+	xmlFreeDoc(priv->paths);
+	free(priv);
+}
+
+/**
+ * @brief Check whether the session works with its private candidate.
+ */
+static int file_private_used(struct ncds_ds_file* file_ds, const struct nc_session* session)
+{
+	return (file_ds->private_candidate && session != NULL);
+}
+
+/**
+ * @brief Get the private candidate of the session.
+ *
+ * @param file_ds Datastore.
+ * @param session Session.
+ * @param create Create the private candidate if the session does not have it.
+ *
+ * @return Private candidate, NULL if the session did not change its candidate
+ * (and create is zero) or on error.
+ */
+static struct ds_private_s* file_private_get(struct ncds_ds_file* file_ds, const struct nc_session* session, int create)
+{
+	struct ds_private_s* priv = NULL;
+
+	if (file_ds->privates != NULL) {
+		priv = xmlHashLookup(file_ds->privates, BAD_CAST session->session_id);
+	}
+	if (priv != NULL || !create) {
+		return (priv);
+	}
+
+	if (file_ds->privates == NULL && (file_ds->privates = xmlHashCreate(8)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	if ((priv = calloc(1, sizeof(struct ds_private_s))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	priv->doc = xmlNewDoc(BAD_CAST "1.0");
+	priv->base = xmlNewDoc(BAD_CAST "1.0");
+	priv->paths = xmlNewDoc(BAD_CAST "1.0");
+	if (xmlHashAddEntry(file_ds->privates, BAD_CAST session->session_id, priv) != 0) {
+		file_private_free(priv, NULL);
+		return (NULL);
+	}
+
+	return (priv);
+}
+
+/**
+ * @brief Drop the changes of the session's private candidate.
+ */
+static void file_private_drop(struct ncds_ds_file* file_ds, const struct nc_session* session)
+{
+	if (file_ds->privates != NULL) {
+		xmlHashRemoveEntry(file_ds->privates, BAD_CAST session->session_id, file_private_free);
+	}
+}
+
+void ncds_file_private_free(struct ncds_ds* ds, const struct nc_session* session)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+
+	if (file_ds->ds_lock.rwlock == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&(file_ds->ds_lock.local));
+	file_private_drop(file_ds, session);
+	pthread_mutex_unlock(&(file_ds->ds_lock.local));
+}
+
+/**
+ * @brief Copy the node identified by its keys, the path to its changed
+ * descendants.
+ */
+static xmlNodePtr file_private_shallow(const struct schema_node* snode, xmlNodePtr node, xmlDocPtr doc)
+{
+	xmlNodePtr copy, key;
+
+	copy = xmlDocCopyNode(node, doc, 2);
+	for (key = node->children; key != NULL; key = key->next) {
+		if (key->type == XML_ELEMENT_NODE && file_delta_is_key(snode, key)) {
+			xmlAddChild(copy, xmlDocCopyNode(key, doc, 1));
+		}
+	}
+
+	return (copy);
+}
+
+/**
+ * @brief Move the node into the document of the parent.
+ */
+static void file_private_adopt(xmlNodePtr node, xmlNodePtr parent)
+{
+	xmlDOMWrapAdoptNode(NULL, node->doc, node, parent->doc, (parent->type == XML_DOCUMENT_NODE) ? NULL : parent, 0);
+}
+
+/**
+ * @brief Running node exchanged with the private candidate node by
+ * file_private_overlay(). The records are prepended, so they are restored in
+ * the reverse order.
+ */
+struct file_private_swap {
+	/**
+	 * parent of the running node and its previous sibling, NULL if it is
+	 * the first child
+	 */
+	xmlNodePtr parent, prev;
+	/**
+	 * the running node, NULL if the node exists only in the private candidate
+	 */
+	xmlNodePtr running;
+	/**
+	 * the private candidate node and its parent, NULL if the node was
+	 * removed in the private candidate
+	 */
+	xmlNodePtr priv, priv_parent;
+	struct file_private_swap* next;
+};
+
+/**
+ * @brief Temporarily move the changed subtrees of the private candidate into
+ * the running datastore in place of the running ones, so the running datastore
+ * shows the content of the private candidate without copying it. The changes
+ * must be reverted by file_private_restore() before the running datastore is
+ * used again.
+ *
+ * @param schema Compiled schema of the datastore.
+ * @param skel First skeleton node on the level.
+ * @param psnode Schema node of the parent, NULL on the top level.
+ * @param running Parent node in the running datastore.
+ * @param priv Parent node in the private candidate.
+ * @param swaps List of the exchanged nodes to prepend to.
+ */
+static void file_private_overlay(const struct schema* schema, xmlNodePtr skel, const struct schema_node* psnode, xmlNodePtr running, xmlNodePtr priv, struct file_private_swap** swaps)
+{
+	const struct schema_node* snode;
+	struct file_private_swap* swap;
+	xmlNodePtr r, p;
+
+	for (; skel != NULL; skel = skel->next) {
+		if (skel->type != XML_ELEMENT_NODE || file_delta_is_key(psnode, skel) ||
+				(snode = file_delta_schema(schema, psnode, skel)) == NULL) {
+			continue;
+		}
+		r = file_delta_find(snode, running->children, skel);
+		p = file_delta_find(snode, priv->children, skel);
+
+		if (!DELTA_DIRTY(skel) && r != NULL) {
+			/* only the descendants were changed */
+			if (p != NULL) {
+				file_private_overlay(schema, skel->children, snode, r, p, swaps);
+			}
+			continue;
+		} else if (r == NULL && p == NULL) {
+			continue;
+		}
+
+		if ((swap = malloc(sizeof(struct file_private_swap))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return;
+		}
+		swap->parent = running;
+		swap->prev = (r == NULL) ? NULL : r->prev;
+		swap->running = r;
+		swap->priv = p;
+		swap->priv_parent = priv;
+		swap->next = *swaps;
+		*swaps = swap;
+
+		if (p == NULL) {
+			xmlUnlinkNode(r);
+			continue;
+		}
+		xmlUnlinkNode(p);
+		file_private_adopt(p, running);
+		if (r != NULL) {
+			xmlReplaceNode(r, p);
+		} else {
+			xmlAddChild(running, p);
+		}
+	}
+}
+
+/**
+ * @brief Revert the changes made by file_private_overlay().
+ */
+static void file_private_restore(struct file_private_swap* swaps)
+{
+	struct file_private_swap* swap;
+
+	while ((swap = swaps) != NULL) {
+		swaps = swap->next;
+
+		if (swap->priv != NULL) {
+			if (swap->running != NULL) {
+				xmlReplaceNode(swap->priv, swap->running);
+			} else {
+				xmlUnlinkNode(swap->priv);
+			}
+			file_private_adopt(swap->priv, swap->priv_parent);
+			xmlAddChild(swap->priv_parent, swap->priv);
+		} else if (swap->prev != NULL) {
+			xmlAddNextSibling(swap->prev, swap->running);
+		} else if (swap->parent->children != NULL) {
+			xmlAddPrevSibling(swap->parent->children, swap->running);
+		} else {
+			xmlAddChild(swap->parent, swap->running);
+		}
+		free(swap);
+	}
+}
+
+/**
+ * @brief Show the session's private candidate in the running datastore until
+ * file_private_restore() is called on the result.
+ *
+ * @return List of the exchanged nodes, NULL if there is nothing to show.
+ */
+static struct file_private_swap* file_private_show(struct ncds_ds_file* file_ds, const struct nc_session* session)
+{
+	const struct schema* schema;
+	struct ds_private_s* priv;
+	struct file_private_swap* swaps = NULL;
+
+	if ((priv = file_private_get(file_ds, session, 0)) != NULL && (schema = schema_get(file_ds->ds.ext_model)) != NULL) {
+		file_private_overlay(schema, priv->paths->children, NULL, file_ds->running, (xmlNodePtr)priv->doc, &swaps);
+	}
+
+	return (swaps);
+}
+
+/**
+ * @brief Copy the running node with its descendants changed in the private
+ * candidate (or in its base) into the document.
+ *
+ * @param schema Compiled schema of the datastore.
+ * @param skel Skeleton node of the running node.
+ * @param snode Schema node of the running node.
+ * @param running Running node.
+ * @param priv The matching node of the private candidate or of its base.
+ * @param doc Document of the copy.
+ */
+static xmlNodePtr file_private_merged(const struct schema* schema, xmlNodePtr skel, const struct schema_node* snode, xmlNodePtr running, xmlNodePtr priv, xmlDocPtr doc)
+{
+	struct file_private_swap* swaps = NULL;
+	xmlNodePtr copy;
+
+	file_private_overlay(schema, skel->children, snode, running, priv, &swaps);
+	copy = xmlDocCopyNode(running, doc, 1);
+	file_private_restore(swaps);
+
+	return (copy);
+}
+
+/**
+ * @brief Content of the private candidate replaced by an edit, it is put back
+ * if the edit fails. The records are prepended, so the deepest changes are
+ * removed first.
+ */
+struct file_private_undo {
+	/**
+	 * parent of the replaced node in the private candidate
+	 */
+	xmlNodePtr parent;
+	/**
+	 * schema node and skeleton node identifying the replaced node
+	 */
+	const struct schema_node* snode;
+	xmlNodePtr node;
+	/**
+	 * the original node, NULL if it did not exist, and its position among
+	 * the children of the parent
+	 */
+	xmlNodePtr saved;
+	int index;
+	struct file_private_undo* next;
+};
+
+/**
+ * @brief Parameters of file_private_touch().
+ */
+struct file_private_touch {
+	const struct schema* schema;
+	struct ds_private_s* priv;
+	/**
+	 * the content of the private candidate is kept by the edit, so it is
+	 * prepared and saved, otherwise only the base is prepared
+	 */
+	int content;
+	struct file_private_undo* undo;
+};
+
+/**
+ * @brief Add the undo record of the node, the caller fills the saved copy of
+ * the original node.
+ *
+ * @param touch Parameters.
+ * @param parent Parent node in the private candidate.
+ * @param snode Schema node of the node.
+ * @param node Skeleton node identifying the node.
+ * @param orig The original node, NULL if it does not exist.
+ *
+ * @return The record, NULL on error.
+ */
+static struct file_private_undo* file_private_save(struct file_private_touch* touch, xmlNodePtr parent, const struct schema_node* snode, xmlNodePtr node, xmlNodePtr orig)
+{
+	struct file_private_undo* undo;
+
+	if ((undo = malloc(sizeof(struct file_private_undo))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	undo->parent = parent;
+	undo->snode = snode;
+	undo->node = node;
+	undo->saved = NULL;
+	for (undo->index = 0; orig != NULL && orig->prev != NULL; orig = orig->prev, undo->index++);
+	undo->next = touch->undo;
+	touch->undo = undo;
+
+	return (undo);
+}
+
+/**
+ * @brief Put the saved content back into the private candidate if the edit
+ * failed, and free the undo records.
+ */
+static void file_private_undo(struct file_private_undo* undo, int restore)
+{
+	struct file_private_undo* record, **prev, **first;
+	xmlNodePtr node;
+	int i;
+
+	if (!restore) {
+		while ((record = undo) != NULL) {
+			undo = record->next;
+			xmlFreeNode(record->saved);
+			free(record);
+		}
+		return;
+	}
+
+	/* remove the content of the edit, the siblings not touched by it remain */
+	for (record = undo; record != NULL; record = record->next) {
+		if ((node = file_delta_find(record->snode, record->parent->children, record->node)) != NULL) {
+			xmlUnlinkNode(node);
+			xmlFreeNode(node);
+		}
+	}
+
+	/* put the saved nodes back to their positions, the lower positions first */
+	while (undo != NULL) {
+		for (first = prev = &undo; *prev != NULL; prev = &((*prev)->next)) {
+			if ((*prev)->index < (*first)->index) {
+				first = prev;
+			}
+		}
+		record = *first;
+		*first = record->next;
+
+		if (record->saved != NULL) {
+			for (i = 0, node = record->parent->children; node != NULL && i < record->index; node = node->next, i++);
+			if (node != NULL) {
+				xmlAddPrevSibling(node, record->saved);
+			} else {
+				xmlAddChild(record->parent, record->saved);
+			}
+		}
+		free(record);
+	}
+}
+
+/**
+ * @brief Save the nodes of the private candidate changed by the edit inside a
+ * subtree already changed by the session, only the touched nodes are copied.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_private_keep(struct file_private_touch* touch, xmlNodePtr touched, const struct schema_node* snode, xmlNodePtr parent, xmlNodePtr node)
+{
+	const struct schema_node* csnode;
+	struct file_private_undo* undo;
+	xmlNodePtr t;
+
+	if (DELTA_DIRTY(touched) || node == NULL) {
+		if ((undo = file_private_save(touch, parent, snode, touched, node)) == NULL) {
+			return (EXIT_FAILURE);
+		}
+		undo->saved = (node == NULL) ? NULL : xmlDocCopyNode(node, touch->priv->doc, 1);
+		return (EXIT_SUCCESS);
+	}
+
+	for (t = touched->children; t != NULL; t = t->next) {
+		if (t->type != XML_ELEMENT_NODE || file_delta_is_key(snode, t) ||
+				(csnode = file_delta_schema(touch->schema, snode, t)) == NULL) {
+			continue;
+		}
+		if (file_private_keep(touch, t, csnode, node, file_delta_find(csnode, node->children, t))) {
+			return (EXIT_FAILURE);
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Prepare the private candidate for the edit touching the nodes of the
+ * skeleton. The nodes changed for the first time get their base from the
+ * running datastore, the running subtrees changed by the edit are copied into
+ * the private candidate and only the path to them otherwise. The replaced
+ * content is saved in the undo records.
+ *
+ * @param touch Parameters.
+ * @param touched First node of the skeleton of the edit on the level.
+ * @param psnode Schema node of the parent, NULL on the top level.
+ * @param skel Parent node in the skeleton of the private candidate, NULL if
+ * it does not exist.
+ * @param doc Parent node in the private candidate, NULL if it does not exist.
+ * @param base Parent node in the base, NULL if it does not exist.
+ * @param running Parent node in the running datastore, NULL if it does not exist.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_private_touch(struct file_private_touch* touch, xmlNodePtr touched, const struct schema_node* psnode, xmlNodePtr skel, xmlNodePtr doc, xmlNodePtr base, xmlNodePtr running)
+{
+	const struct schema_node* snode;
+	struct file_private_undo* undo;
+	xmlNodePtr s, d, b, r, new;
+
+	for (; touched != NULL; touched = touched->next) {
+		if (touched->type != XML_ELEMENT_NODE || file_delta_is_key(psnode, touched) ||
+				(snode = file_delta_schema(touch->schema, psnode, touched)) == NULL) {
+			continue;
+		}
+		s = (skel == NULL) ? NULL : file_delta_find(snode, skel->children, touched);
+		d = (doc == NULL) ? NULL : file_delta_find(snode, doc->children, touched);
+		b = (base == NULL) ? NULL : file_delta_find(snode, base->children, touched);
+		r = (running == NULL) ? NULL : file_delta_find(snode, running->children, touched);
+
+		if (s != NULL && DELTA_DIRTY(s)) {
+			/* already changed as a whole, the base is kept */
+			if (doc != NULL && file_private_keep(touch, touched, snode, doc, d)) {
+				return (EXIT_FAILURE);
+			}
+			continue;
+		}
+
+		/* the base when the node is changed for the first time */
+		if (s == NULL && base != NULL) {
+			if (b != NULL) {
+				xmlUnlinkNode(b);
+				xmlFreeNode(b);
+				b = NULL;
+			}
+			if (r != NULL) {
+				b = DELTA_DIRTY(touched) ? xmlDocCopyNode(r, touch->priv->base, 1) : file_private_shallow(snode, r, touch->priv->base);
+				xmlAddChild(base, b);
+			}
+		} else if (s != NULL && DELTA_DIRTY(touched) && b != NULL && r != NULL) {
+			/* the whole subtree with the base of the changed descendants */
+			new = file_private_merged(touch->schema, s, snode, r, b, touch->priv->base);
+			xmlReplaceNode(b, new);
+			xmlFreeNode(b);
+			b = new;
+		}
+
+		if (doc == NULL) {
+			/* nothing to prepare in the private candidate */
+			d = NULL;
+		} else if (DELTA_DIRTY(touched)) {
+			if (s != NULL && d != NULL && r == NULL) {
+				/* created in the private candidate, it is complete */
+				if (file_private_keep(touch, touched, snode, doc, d)) {
+					return (EXIT_FAILURE);
+				}
+				continue;
+			}
+			if ((undo = file_private_save(touch, doc, snode, touched, d)) == NULL) {
+				return (EXIT_FAILURE);
+			}
+			if (r == NULL) {
+				new = NULL;
+			} else if (s != NULL && d != NULL) {
+				new = file_private_merged(touch->schema, s, snode, r, d, touch->priv->doc);
+			} else {
+				new = xmlDocCopyNode(r, touch->priv->doc, 1);
+			}
+			/* the original node is kept for the undo, the copy takes its position */
+			if (d != NULL && new != NULL) {
+				xmlReplaceNode(d, new);
+			} else if (d != NULL) {
+				xmlUnlinkNode(d);
+			} else if (new != NULL) {
+				xmlAddChild(doc, new);
+			}
+			undo->saved = d;
+			continue;
+		} else if (d == NULL) {
+			/* the path to the changed descendants, removed if the edit fails */
+			if (file_private_save(touch, doc, snode, touched, NULL) == NULL) {
+				return (EXIT_FAILURE);
+			}
+			if (r != NULL) {
+				d = file_private_shallow(snode, r, touch->priv->doc);
+				xmlAddChild(doc, d);
+			}
+		}
+
+		if (!DELTA_DIRTY(touched) && (r != NULL || d != NULL) &&
+				file_private_touch(touch, touched->children, snode, s, d, b, r)) {
+			return (EXIT_FAILURE);
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
 
-	LOCK(file_ds, ret);
-	if (ret) {
+/**
+ * @brief Create the private candidate of the session if needed and prepare it
+ * for the changes, see file_private_touch().
+ *
+ * @param file_ds Datastore.
+ * @param session Session.
+ * @param touched Skeleton of the changes.
+ * @param content Prepare the content of the private candidate, not only the base.
+ * @param undo Undo records of the replaced content, they must be passed to
+ * file_private_undo().
+ * @param error NETCONF error structure.
+ *
+ * @return Private candidate, NULL on error.
+ */
+static struct ds_private_s* file_private_prepare(struct ncds_ds_file* file_ds, const struct nc_session* session, xmlDocPtr touched, int content, struct file_private_undo** undo, struct nc_err** error)
+{
+	struct file_private_touch touch;
+
+	touch.schema = schema_get(file_ds->ds.ext_model);
+	touch.content = content;
+	touch.undo = NULL;
+	if ((touch.priv = file_private_get(file_ds, session, 1)) == NULL ||
+			file_private_touch(&touch, touched->children, NULL, (xmlNodePtr)touch.priv->paths,
+			content ? (xmlNodePtr)touch.priv->doc : NULL, (xmlNodePtr)touch.priv->base, file_ds->running)) {
+		file_private_undo(touch.undo, 1);
 		*error = nc_err_new(NC_ERR_OP_FAILED);
-		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
-		return EXIT_FAILURE;
+		return (NULL);
 	}
 
-	if (file_reload (file_ds)) {
-		UNLOCK(file_ds);
-		return EXIT_FAILURE;
-	}
+	*undo = touch.undo;
+	return (touch.priv);
+}
 
-	/* check validity of function parameters */
-	switch(target) {
-	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
-		break;
-	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
-		break;
-	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
-		break;
-	default:
-		UNLOCK(file_ds);
-		ERROR("%s: invalid target.", __func__);
-		*error = nc_err_new(NC_ERR_BAD_ELEM);
-		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
-		return (EXIT_FAILURE);
-		break;
-	}
+/**
+ * @brief Mark the top level nodes as changed as a whole in the skeleton.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE on an unknown element.
+ */
+static int file_private_dirty(const struct schema* schema, xmlDocPtr touched, xmlNodePtr node, struct nc_err** error)
+{
+	const struct schema_node* snode;
+	xmlNodePtr skel;
 
-	/* check if repository is locked by anyone including me */
-	no_session = nc_session_dummy(INTERNAL_DUMMY_ID, session->username, session->hostname, session->capabilities);
-	if (file_ds_access (file_ds, target, no_session) != 0) {
-		/* someone is already holding the lock */
-		lock = xmlGetProp (target_ds, BAD_CAST "lock");
-		*error = nc_err_new(NC_ERR_LOCK_DENIED);
-		nc_err_set(*error, NC_ERR_PARAM_INFO_SID, (char*)lock);
-		xmlFree(lock);
-		retval = EXIT_FAILURE;
-	} else {
-		if (target == NC_DATASTORE_CANDIDATE &&
-				(modified = xmlGetProp(target_ds, BAD_CAST "modified")) != NULL &&
-				xmlStrcmp(modified, BAD_CAST "true") == 0) {
-			*error = nc_err_new(NC_ERR_LOCK_DENIED);
-			nc_err_set(*error, NC_ERR_PARAM_MSG, "Candidate datastore not locked but already modified.");
-			retval = EXIT_FAILURE;
-		} else {
-			xmlSetProp (target_ds, BAD_CAST "lock", BAD_CAST session->session_id);
-			xmlSetProp (target_ds, BAD_CAST "locktime", BAD_CAST (t = nc_time2datetime(time(NULL), NULL)));
-			free(t);
-			if (file_sync(file_ds)) {
-				*error = nc_err_new(NC_ERR_OP_FAILED);
-				nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
-				retval = EXIT_FAILURE;
-			}
+	for (; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
 		}
-		xmlFree(modified);
+		if ((snode = file_delta_schema(schema, NULL, node)) == NULL) {
+			*error = nc_err_new(NC_ERR_UNKNOWN_ELEM);
+			nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, (char*)node->name);
+			return (EXIT_FAILURE);
+		}
+		if ((skel = file_delta_find(snode, touched->children, node)) == NULL) {
+			skel = file_delta_new(snode, touched, NULL, node);
+		}
+		file_delta_set_dirty(snode, skel);
 	}
-	UNLOCK(file_ds);
 
-	/* cleanup */
-	nc_session_free(no_session);
-
-	return (retval);
+	return (EXIT_SUCCESS);
 }
 
-int ncds_file_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
+/**
+ * @brief Merge the skeleton of the changes into the skeleton of the private
+ * candidate.
+ *
+ * @param schema Compiled schema of the datastore.
+ * @param paths Skeleton of the private candidate.
+ * @param skel Parent node in the skeleton of the private candidate, NULL on
+ * the top level.
+ * @param psnode Schema node of the parent, NULL on the top level.
+ * @param touched First node of the skeleton of the changes on the level.
+ */
+static void file_private_mark(const struct schema* schema, xmlDocPtr paths, xmlNodePtr skel, const struct schema_node* psnode, xmlNodePtr touched)
 {
-	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-	xmlNodePtr target_ds, del;
-	struct nc_session* no_session;
-	int retval = EXIT_SUCCESS, ret;
+	const struct schema_node* snode;
+	xmlNodePtr s;
 
-	assert(error);
+	for (; touched != NULL; touched = touched->next) {
+		if (touched->type != XML_ELEMENT_NODE || file_delta_is_key(psnode, touched) ||
+				(snode = file_delta_schema(schema, psnode, touched)) == NULL) {
+			continue;
+		}
 
-	LOCK(file_ds, ret);
-	if (ret) {
+		if ((s = file_delta_find(snode, (skel == NULL) ? paths->children : skel->children, touched)) == NULL) {
+			s = file_delta_new(snode, paths, skel, touched);
+		} else if (DELTA_DIRTY(s)) {
+			continue;
+		}
+		if (DELTA_DIRTY(touched)) {
+			file_delta_set_dirty(snode, s);
+		} else {
+			file_private_mark(schema, paths, s, snode, touched->children);
+		}
+	}
+}
+
+/**
+ * @brief Apply the edit-config to the private candidate of the session.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_private_edit(struct ncds_ds_file* file_ds, const struct nc_session* session, xmlDocPtr config_doc,
+		NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, const struct nacm_rpc* nacm, struct nc_err** error)
+{
+	const struct schema* schema;
+	struct ds_private_s* priv;
+	struct file_private_undo* undo;
+	xmlDocPtr touched;
+	xmlNodePtr node;
+	int ret;
+
+	if ((schema = schema_get(file_ds->ds.ext_model)) == NULL) {
 		*error = nc_err_new(NC_ERR_OP_FAILED);
-		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
-		return EXIT_FAILURE;
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Private candidate requires the compiled data model.");
+		return (EXIT_FAILURE);
 	}
 
-	if (file_reload (file_ds)) {
-		UNLOCK(file_ds);
-		return EXIT_FAILURE;
+	/*
+	 * the nodes changed by the edit, the changes which cannot be described
+	 * (and removing the default values in the trim mode) change the whole
+	 * top level subtrees
+	 */
+	touched = xmlNewDoc(BAD_CAST "1.0");
+	if (ncdflt_get_basic_mode() == NCWD_MODE_TRIM ||
+			file_delta_mark_recursive(schema, touched, NULL, NULL, config_doc->children, defop == NC_EDIT_DEFOP_REPLACE) != 0) {
+		while ((node = touched->children) != NULL) {
+			xmlUnlinkNode(node);
+			xmlFreeNode(node);
+		}
+		if (file_private_dirty(schema, touched, config_doc->children, error)) {
+			xmlFreeDoc(touched);
+			return (EXIT_FAILURE);
+		}
 	}
 
-	/* check validity of function parameters */
-	switch(target) {
-	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
-		break;
-	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
-		break;
-	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
-		break;
-	default:
-		UNLOCK(file_ds);
-		ERROR("%s: invalid target.", __func__);
-		*error = nc_err_new(NC_ERR_BAD_ELEM);
-		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+	if ((priv = file_private_prepare(file_ds, session, touched, 1, &undo, error)) == NULL) {
+		xmlFreeDoc(touched);
 		return (EXIT_FAILURE);
-		break;
 	}
 
-	/* check if repository is locked */
-	no_session = nc_session_dummy(INTERNAL_DUMMY_ID, session->username, session->hostname, session->capabilities);
-	if (file_ds_access (file_ds, target, no_session) == 0) {
-		/* not locked */
-		*error = nc_err_new(NC_ERR_OP_FAILED);
-		nc_err_set(*error, NC_ERR_PARAM_MSG, "Target datastore is not locked.");
-		retval = EXIT_FAILURE;
-	} else if (file_ds_access (file_ds, target, session) != 0) {
-		/* the datastore is locked by somebody else */
-		*error = nc_err_new(NC_ERR_OP_FAILED);
-		nc_err_set(*error, NC_ERR_PARAM_MSG, "Target datastore is locked by another session.");
-		retval = EXIT_FAILURE;
-	} else {
-		/* the datastore is locked by request originating session */
+	/* the private candidate is edited in place, the undo records revert a failed edit */
+	ret = edit_config(priv->doc, config_doc, (struct ncds_ds*)file_ds, defop, errop, nacm, error);
+	file_private_undo(undo, ret != EXIT_SUCCESS);
+	if (ret == EXIT_SUCCESS) {
+		file_private_mark(schema, priv->paths, NULL, NULL, touched->children);
+	}
+	xmlFreeDoc(touched);
 
-		if (target == NC_DATASTORE_CANDIDATE) {
-			/* drop current candidate configuration */
-			while ((del = file_ds->candidate->children) != NULL) {
-				xmlUnlinkNode (file_ds->candidate->children);
-				xmlFreeNode (del);
-			}
+	return ((ret == EXIT_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
 
-			/* copy running into candidate configuration */
-			xmlAddChildList(file_ds->candidate, xmlCopyNodeList(file_ds->running->children));
+/**
+ * @brief Replace the whole content of the session's private candidate.
+ *
+ * @param file_ds Datastore.
+ * @param session Session.
+ * @param source First node of the new content.
+ * @param error NETCONF error structure.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_private_copy(struct ncds_ds_file* file_ds, const struct nc_session* session, xmlNodePtr source, struct nc_err** error)
+{
+	const struct schema* schema;
+	struct ds_private_s* priv;
+	struct file_private_undo* undo;
+	xmlDocPtr touched;
+	xmlNodePtr node;
 
-			/* mark candidate as not modified */
-			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "false");
-		}
+	if ((schema = schema_get(file_ds->ds.ext_model)) == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Private candidate requires the compiled data model.");
+		return (EXIT_FAILURE);
+	}
 
-		/* unlock datastore */
-		xmlSetProp (target_ds, BAD_CAST "lock", BAD_CAST "");
-		xmlSetProp (target_ds, BAD_CAST "locktime", BAD_CAST "");
-		if (file_sync(file_ds)) {
-			*error = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
-			retval = EXIT_FAILURE;
+	/* all the top level subtrees are changed, only their base is needed */
+	touched = xmlNewDoc(BAD_CAST "1.0");
+	if (file_private_dirty(schema, touched, file_ds->running->children, error) ||
+			file_private_dirty(schema, touched, source, error) ||
+			(priv = file_private_prepare(file_ds, session, touched, 0, &undo, error)) == NULL) {
+		xmlFreeDoc(touched);
+		return (EXIT_FAILURE);
+	}
+	file_private_undo(undo, 0);
+
+	while ((node = priv->doc->children) != NULL) {
+		xmlUnlinkNode(node);
+		xmlFreeNode(node);
+	}
+	for (node = source; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE) {
+			file_delta_add(priv->doc, NULL, xmlDocCopyNode(node, priv->doc, 1));
 		}
 	}
+	file_private_mark(schema, priv->paths, NULL, NULL, touched->children);
+	xmlFreeDoc(touched);
 
-	UNLOCK(file_ds);
+	return (EXIT_SUCCESS);
+}
 
-	/* cleanup */
-	if (no_session != NULL) {
-		nc_session_free(no_session);
+/**
+ * @brief Create a document with the content of the session's private candidate.
+ */
+static xmlDocPtr file_private_view(struct ncds_ds_file* file_ds, const struct nc_session* session)
+{
+	struct file_private_swap* swaps;
+	xmlDocPtr doc;
+	xmlNodePtr node;
+
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	swaps = file_private_show(file_ds, session);
+	for (node = file_ds->running->children; node != NULL; node = node->next) {
+		file_delta_add(doc, NULL, xmlDocCopyNode(node, doc, 1));
 	}
+	file_private_restore(swaps);
 
-	return (retval);
+	return (doc);
 }
 
-char* ncds_file_getconfig(struct ncds_ds* ds, const struct nc_session* UNUSED(session), NC_DATASTORE source, struct nc_err** error)
+/**
+ * @brief Compare the subtrees including their descendants, NULL subtrees are
+ * equal.
+ */
+static int file_tree_equal(xmlNodePtr a, xmlNodePtr b)
 {
-	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-	xmlNodePtr target_ds, aux_node;
-	xmlBufferPtr resultbuffer;
-	char* data = NULL;
-	int ret;
+	if (a == NULL || b == NULL) {
+		return (a == b);
+	}
+	if (!file_node_equal(a, b)) {
+		return (0);
+	}
 
-	assert(error);
+	for (a = a->children, b = b->children; a != NULL && b != NULL; a = a->next, b = b->next) {
+		if (!file_tree_equal(a, b)) {
+			return (0);
+		}
+	}
+	return (a == NULL && b == NULL);
+}
 
-	LOCK(file_ds, ret);
-	if (ret) {
-		*error = nc_err_new(NC_ERR_OP_FAILED);
-		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
-		return NULL;
+/**
+ * @brief Check whether the running datastore was changed in the subtrees
+ * changed by the session since the session changed them for the first time.
+ *
+ * @param schema Compiled schema of the datastore.
+ * @param skel First skeleton node on the level.
+ * @param psnode Schema node of the parent, NULL on the top level.
+ * @param base Parent node in the base of the private candidate.
+ * @param running Parent node in the running datastore.
+ *
+ * @return non-zero on conflict, zero if not.
+ */
+static int file_private_conflict(const struct schema* schema, xmlNodePtr skel, const struct schema_node* psnode, xmlNodePtr base, xmlNodePtr running)
+{
+	const struct schema_node* snode;
+	xmlNodePtr b, r;
+
+	for (; skel != NULL; skel = skel->next) {
+		if (skel->type != XML_ELEMENT_NODE || file_delta_is_key(psnode, skel) ||
+				(snode = file_delta_schema(schema, psnode, skel)) == NULL) {
+			continue;
+		}
+		b = file_delta_find(snode, base->children, skel);
+		r = file_delta_find(snode, running->children, skel);
+
+		if (DELTA_DIRTY(skel)) {
+			if (!file_tree_equal(b, r)) {
+				return (1);
+			}
+		} else if ((b == NULL) != (r == NULL)) {
+			return (1);
+		} else if (b != NULL && file_private_conflict(schema, skel->children, snode, b, r)) {
+			return (1);
+		}
 	}
 
-	if (file_reload (file_ds)) {
-		UNLOCK(file_ds);
-		return NULL;
+	return (0);
+}
+
+/**
+ * @brief Create the edit-config applying the changes of the private candidate
+ * to the running datastore. The changed subtrees replace the running ones or
+ * they are removed, their ancestors are merged.
+ *
+ * @param schema Compiled schema of the datastore.
+ * @param skel First skeleton node on the level.
+ * @param psnode Schema node of the parent, NULL on the top level.
+ * @param candidate Parent node in the private candidate.
+ * @param doc Edit-config document.
+ * @param parent Parent node in the edit-config, NULL on the top level.
+ */
+static void file_private_changes(const struct schema* schema, xmlNodePtr skel, const struct schema_node* psnode, xmlNodePtr candidate, xmlDocPtr doc, xmlNodePtr parent)
+{
+	const struct schema_node* snode;
+	xmlNodePtr c, node, key;
+	xmlNsPtr ns;
+
+	for (; skel != NULL; skel = skel->next) {
+		if (skel->type != XML_ELEMENT_NODE || file_delta_is_key(psnode, skel) ||
+				(snode = file_delta_schema(schema, psnode, skel)) == NULL) {
+			continue;
+		}
+		c = file_delta_find(snode, candidate->children, skel);
+
+		if (!DELTA_DIRTY(skel)) {
+			if (c != NULL) {
+				/* ancestor of the changed subtrees identified by its keys */
+				node = xmlDocCopyNode(c, doc, 2);
+				file_delta_add(doc, parent, node);
+				for (key = c->children; key != NULL; key = key->next) {
+					if (key->type == XML_ELEMENT_NODE && file_delta_is_key(snode, key)) {
+						xmlAddChild(node, xmlDocCopyNode(key, doc, 1));
+					}
+				}
+				file_private_changes(schema, skel->children, snode, c, doc, node);
+			}
+			continue;
+		}
+
+		if (c != NULL) {
+			node = xmlDocCopyNode(c, doc, 1);
+			file_delta_add(doc, parent, node);
+		} else {
+			node = file_delta_new(snode, doc, parent, skel);
+		}
+		if ((ns = xmlSearchNsByHref(doc, node, BAD_CAST NC_NS_BASE10)) != NULL ||
+				(ns = xmlNewNs(node, BAD_CAST NC_NS_BASE10, BAD_CAST NC_NS_BASE10_ID)) != NULL) {
+			xmlSetNsProp(node, ns, BAD_CAST "operation", BAD_CAST ((c == NULL) ? "remove" : "replace"));
+		}
 	}
+}
 
-	/* check validity of function parameters */
-	switch(source) {
-	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
-		break;
-	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
-		break;
-	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
-		break;
-	default:
-		UNLOCK(file_ds);
-		ERROR("%s: invalid target.", __func__);
-		*error = nc_err_new(NC_ERR_BAD_ELEM);
-		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "source");
-		return (NULL);
-		break;
+/**
+ * @brief Commit the session's private candidate. Only the subtrees changed by
+ * the session are applied to the current running datastore, so the changes
+ * made by other sessions in the meantime are kept. The commit fails if the
+ * running datastore was changed in the same subtrees.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_private_commit(struct ncds_ds_file* file_ds, const struct nc_session* session, const nc_rpc* rpc, xmlDocPtr* old, xmlDocPtr* new, struct nc_err** error)
+{
+	const struct schema* schema;
+	struct ds_private_s* priv;
+	xmlDocPtr edit;
+	xmlNodePtr record;
+	char num[12];
+
+	if (file_ds_access(file_ds, NC_DATASTORE_RUNNING, session) != 0) {
+		*error = nc_err_new(NC_ERR_IN_USE);
+		return (EXIT_FAILURE);
 	}
 
-	resultbuffer = xmlBufferCreate();
-	if (resultbuffer == NULL) {
-		UNLOCK(file_ds);
-		ERROR("%s: xmlBufferCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+	if (old != NULL) {
+		*old = xmlNewDoc(BAD_CAST "1.0");
+	}
+	if (new != NULL) {
+		*new = xmlNewDoc(BAD_CAST "1.0");
+	}
+	if ((priv = file_private_get(file_ds, session, 0)) == NULL || priv->paths->children == NULL) {
+		/* nothing changed */
+		return (EXIT_SUCCESS);
+	}
+
+	schema = schema_get(file_ds->ds.ext_model);
+	if (file_private_conflict(schema, priv->paths->children, NULL, (xmlNodePtr)priv->base, file_ds->running)) {
 		*error = nc_err_new(NC_ERR_OP_FAILED);
-		return (NULL);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "The running datastore was changed by another session in the parts changed in the private candidate.");
+		goto error;
 	}
-	for (aux_node = target_ds->children; aux_node != NULL; aux_node = aux_node->next) {
-		xmlNodeDump(resultbuffer, file_ds->xml, aux_node, 2, 1);
+
+	if (old != NULL) {
+		file_delta_extract(schema, priv->paths->children, NULL, file_ds->running, *old, NULL);
 	}
-	data = nc_clrwspace((char *) xmlBufferContent(resultbuffer));
-	xmlBufferFree(resultbuffer);
 
-	UNLOCK(file_ds);
-	return (data);
+	edit = xmlNewDoc(BAD_CAST "1.0");
+	file_private_changes(schema, priv->paths->children, NULL, (xmlNodePtr)priv->doc, edit, NULL);
+
+	/* journal the changes before edit_config() consumes them */
+	record = file_journal_new("edit", file_ds->running);
+	xmlAddChildList(record, xmlDocCopyNodeList(record->doc, edit->children));
+	snprintf(num, sizeof(num), "%d", NC_EDIT_DEFOP_MERGE);
+	xmlNewProp(record, BAD_CAST "defop", BAD_CAST num);
+	snprintf(num, sizeof(num), "%d", NC_EDIT_ERROPT_NOTSET);
+	xmlNewProp(record, BAD_CAST "errop", BAD_CAST num);
+
+	if (file_edit(file_ds, file_ds->running, edit, NC_EDIT_DEFOP_MERGE, NC_EDIT_ERROPT_NOTSET, (rpc != NULL) ? rpc->nacm : NULL, error)) {
+		xmlFreeDoc(edit);
+		xmlFreeDoc(record->doc);
+		goto error;
+	}
+	xmlFreeDoc(edit);
+
+	if (new != NULL) {
+		file_delta_extract(schema, priv->paths->children, NULL, file_ds->running, *new, NULL);
+	}
+	file_private_drop(file_ds, session);
+
+	if (file_journal(file_ds, record, file_ds->running)) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+		goto error;
+	}
+
+	return (EXIT_SUCCESS);
+
+error:
+	if (old != NULL) {
+		xmlFreeDoc(*old);
+		*old = NULL;
+	}
+	if (new != NULL) {
+		xmlFreeDoc(*new);
+		*new = NULL;
+	}
+	return (EXIT_FAILURE);
 }
 
-/**
- * @brief Copy the content of the datastore or externally send
- * the configuration to another datastore
- *
- * @param ds Pointer to a datastore structure
- * @param session Session which the request is a part of
- * @param rpc RPC message with the request
- * @param target Target datastore.
- * @param source Source datastore, if the value is NC_DATASTORE_NONE
- * then the next parameter holds the configration to copy
- * @param config Configuration to be used as the source in the form of a serialized XML.
- * @param error	 Netconf error structure.
- *
- * @return EXIT_SUCCESS when done without problems
- * 	   EXIT_FAILURE when error occured
- * 	   EXIT_RPC_NOT_APPLICABLE when rpc is not applicable
- */
-int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, const nc_rpc* rpc, NC_DATASTORE target, NC_DATASTORE source, char * config, struct nc_err **error)
+int ncds_file_commit(struct ncds_ds* ds, const struct nc_session* session, const nc_rpc* rpc, xmlDocPtr* old, xmlDocPtr* new, struct nc_err** error)
 {
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-	xmlDocPtr config_doc = NULL, aux_doc;
-	xmlNodePtr target_ds, source_ds, aux_node, root;
-	keyList keys;
-	char *aux = NULL, *configp;
-	int r, ret = 0;
+	struct file_delta_commit commit;
+	xmlNodePtr record;
+	int ret;
 
 	assert(error);
 
@@ -1014,207 +5318,105 @@ int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, c
 		return EXIT_FAILURE;
 	}
 
-	if (file_reload (file_ds)) {
+	if (file_reload(file_ds)) {
 		UNLOCK(file_ds);
 		return EXIT_FAILURE;
 	}
-	file_rollback_store(file_ds);
 
-	switch(target) {
-	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
-		break;
-	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
-		break;
-	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
-		break;
-	default:
+	if (file_private_used(file_ds, session)) {
+		ret = file_private_commit(file_ds, session, rpc, old, new, error);
 		UNLOCK(file_ds);
-		ERROR("%s: invalid target.", __func__);
-		*error = nc_err_new(NC_ERR_BAD_ELEM);
-		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
-		return EXIT_FAILURE;
-		break;
+		return (ret);
 	}
 
-	/* isn't target locked? */
-	if (file_ds_access (file_ds, target, session) != 0) {
-		UNLOCK(file_ds);
-		*error = nc_err_new (NC_ERR_IN_USE);
-		return EXIT_FAILURE;
-	}
-	if (source == NC_DATASTORE_CANDIDATE && target == NC_DATASTORE_RUNNING) {
-		/* commit - check also the lock on source (i.e. candidate) datastore */
-		if (file_ds_access (file_ds, source, session) != 0) {
-			UNLOCK(file_ds);
-			*error = nc_err_new (NC_ERR_IN_USE);
-			return EXIT_FAILURE;
+	/*
+	 * without the known changes or with the access control (NACM omits
+	 * the unreadable nodes of the candidate), copy the whole candidate
+	 */
+	commit.schema = schema_get(file_ds->ds.ext_model);
+	if (!file_ds->delta.valid || commit.schema == NULL || (rpc != NULL && rpc->nacm != NULL)) {
+		if (old != NULL) {
+			*old = file_delta_snapshot(file_ds->running);
 		}
-	}
+		UNLOCK(file_ds);
 
-	switch(source) {
-	case NC_DATASTORE_RUNNING:
-		source_ds = file_ds->running->children;
-		break;
-	case NC_DATASTORE_STARTUP:
-		source_ds = file_ds->startup->children;
-		break;
-	case NC_DATASTORE_CANDIDATE:
-		source_ds = file_ds->candidate->children;
-		break;
-	case NC_DATASTORE_CONFIG:
-		if (config == NULL) {
-			UNLOCK(file_ds);
-			ERROR("%s: invalid source config.", __func__);
-			*error = nc_err_new(NC_ERR_BAD_ELEM);
-			nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
-			return EXIT_FAILURE;
+		ret = ncds_file_copyconfig(ds, session, rpc, NC_DATASTORE_RUNNING, NC_DATASTORE_CANDIDATE, NULL, error);
+		if (ret == EXIT_FAILURE) {
+			if (old != NULL) {
+				xmlFreeDoc(*old);
+				*old = NULL;
+			}
+			return (EXIT_FAILURE);
 		}
-		if (strncmp(config, "<?xml", 5) == 0) {
-			if ((configp = strchr(config, '>')) == NULL) {
+
+		if (new != NULL) {
+			*new = NULL;
+			RDLOCK(file_ds, ret);
+			if (ret == 0) {
+				if (file_reload(file_ds) == EXIT_SUCCESS) {
+					*new = file_delta_snapshot(file_ds->running);
+				}
 				UNLOCK(file_ds);
-				ERROR("%s: invalid source config.", __func__);
-				*error = nc_err_new(NC_ERR_BAD_ELEM);
-				nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
-				return EXIT_FAILURE;
 			}
-			++configp;
-			while (*configp == ' ' || *configp == '\n' || *configp == '\t') {
-				++configp;
+			if (*new == NULL) {
+				*new = xmlNewDoc(BAD_CAST "1.0");
 			}
-		} else {
-			configp = config;
-		}
-		if (asprintf(&aux, "<config>%s</config>", configp) == -1) {
-			UNLOCK(file_ds);
-			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
-			*error = nc_err_new(NC_ERR_OP_FAILED);
-			return EXIT_FAILURE;
 		}
-		if ((config_doc = xmlReadMemory (aux, strlen(aux), NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
-			free(aux);
-			UNLOCK(file_ds);
-			ERROR("%s: reading source config failed.", __func__);
-			*error = nc_err_new(NC_ERR_OP_FAILED);
-			return EXIT_FAILURE;
-		}
-		free(aux);
-		source_ds = config_doc->children->children;
-		break;
-	default:
-		UNLOCK(file_ds);
-		ERROR("%s: invalid source.", __func__);
-		*error = nc_err_new(NC_ERR_BAD_ELEM);
-		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
-		return EXIT_FAILURE;
-		break;
-	}
-
-	/* we could still do something with candidate datastore,
-	 * so we have to change the "modified" attribute
-	 */
-	if (source_ds == NULL && target_ds->children == NULL) {
-		ret = EXIT_RPC_NOT_APPLICABLE;
-		goto finish;
+		return (EXIT_SUCCESS);
 	}
 
-	aux_doc = xmlNewDoc (BAD_CAST "1.0");
-	if (source_ds) {
-		xmlDocSetRootElement(aux_doc, xmlCopyNode(source_ds, 1));
-		for (root = source_ds->next; root != NULL; root = aux_node) {
-			aux_node = root->next;
-			xmlAddNextSibling(aux_doc->last, xmlCopyNode(root, 1));
-		}
+	/* check also the lock on the candidate */
+	if (file_ds_access(file_ds, NC_DATASTORE_RUNNING, session) != 0 || file_ds_access(file_ds, NC_DATASTORE_CANDIDATE, session) != 0) {
+		UNLOCK(file_ds);
+		*error = nc_err_new(NC_ERR_IN_USE);
+		return EXIT_FAILURE;
 	}
 
-	if (rpc != NULL && rpc->nacm != NULL ) {
-		/* NACM */
-		/* RFC 6536, sec. 3.2.4., paragraph 2
-		 * If the source of the <copy-config> protocol operation is the running
-		 * configuration datastore and the target is the startup configuration
-		 * datastore, the client is only required to have permission to execute
-		 * the <copy-config> protocol operation.
-		 */
-		if (!(source == NC_DATASTORE_RUNNING && target == NC_DATASTORE_STARTUP)) {
-			keys = get_keynode_list(file_ds->ds.ext_model);
-			if (source == NC_DATASTORE_RUNNING || source == NC_DATASTORE_STARTUP || source == NC_DATASTORE_CANDIDATE) {
-				/* RFC 6536, sec 3.2.4., paragraph 3
-				 * If the source of the <copy-config> operation is a datastore,
-				 * then data nodes to which the client does not have read access
-				 * are silently omitted
-				 */
-				nacm_check_data_read(aux_doc, rpc->nacm);
-			}
-
-			/* RFC 6536, sec. 3.2.4., paragraph 4
-			 * If the target of the <copy-config> operation is a datastore,
-			 * the client needs access to the modified nodes according to
-			 * the effective access operation of the each modified node.
-			 */
-			if (target_ds->children == NULL) {
-				/* creating a completely new configuration data */
-				r = nacm_check_data(aux_doc->children, NACM_ACCESS_CREATE, rpc->nacm);
-			} else {
-				/* replacing an old configuration data */
-				r = edit_replace_nacmcheck(target_ds->children, aux_doc, file_ds->ds.ext_model, keys, rpc->nacm, error);
-			}
-
-			if (r != NACM_PERMIT) {
-				if (r == NACM_DENY) {
-					if (error != NULL ) {
-						*error = nc_err_new(NC_ERR_ACCESS_DENIED);
-					}
-				} else {
-					if (error != NULL ) {
-						*error = nc_err_new(NC_ERR_OP_FAILED);
-					}
-				}
-				UNLOCK(file_ds);
-				xmlFreeDoc(aux_doc);
-				keyListFree(keys);
-				xmlFreeDoc (config_doc);
-				return (EXIT_FAILURE);
-			}
-			keyListFree(keys);
+	commit.failed = 0;
+	commit.record = NULL;
+	if (file_ds->rollback.levels > 0) {
+		if ((commit.record = calloc(1, sizeof(struct ds_history_s))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			commit.failed = 1;
+		} else {
+			commit.record->target_ds = file_ds->running;
+			commit.record->modified = xmlGetProp(file_ds->running, BAD_CAST "modified");
+			commit.record->size = sizeof(struct ds_history_s);
 		}
 	}
+	commit.old = (old != NULL) ? xmlNewDoc(BAD_CAST "1.0") : NULL;
+	commit.new = (new != NULL) ? xmlNewDoc(BAD_CAST "1.0") : NULL;
 
-	/* drop current target configuration */
-	while ((aux_node = target_ds->children) != NULL) {
-		xmlUnlinkNode (target_ds->children);
-		xmlFreeNode (aux_node);
+	if (file_ds->delta.paths != NULL) {
+		file_delta_apply(&commit, file_ds->delta.paths->children, NULL, file_ds->running, file_ds->candidate, NULL, NULL);
 	}
 
-	/* copy new target configuration */
-	xmlAddChildList(target_ds, xmlCopyNodeList(aux_doc->children));
-	xmlFreeDoc(aux_doc);
-
-finish:
-	/*
-	 * if we are changing candidate, mark it as modified, since we need
-	 * this information for locking - according to RFC, candidate cannot
-	 * be locked since it has been modified and not committed.
-	 */
-	if (target == NC_DATASTORE_CANDIDATE) {
-		if (source == NC_DATASTORE_RUNNING) {
-			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "false");
-		} else {
-			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "true");
-		}
+	if (commit.record != NULL) {
+		file_history_add(file_ds, commit.record);
+	} else if (commit.failed) {
+		file_history_clear(file_ds);
 	}
+	file_delta_reset(file_ds, 1);
 
-	if (file_sync (file_ds)) {
+	record = file_journal_new("copy", file_ds->running);
+	xmlNewProp(record, BAD_CAST "source", file_ds->candidate->name);
+	if (file_journal(file_ds, record, file_ds->running)) {
 		UNLOCK(file_ds);
+		xmlFreeDoc(commit.old);
+		xmlFreeDoc(commit.new);
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 		nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
 		return EXIT_FAILURE;
 	}
 	UNLOCK(file_ds);
 
-	xmlFreeDoc (config_doc);
-	return ret;
+	if (old != NULL) {
+		*old = commit.old;
+	}
+	if (new != NULL) {
+		*new = commit.new;
+	}
+	return EXIT_SUCCESS;
 }
 
 /**
@@ -1246,7 +5448,6 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
 		UNLOCK(file_ds);
 		return EXIT_FAILURE;
 	}
-	file_rollback_store(file_ds);
 
 	switch(target) {
 	case NC_DATASTORE_RUNNING:
@@ -1276,6 +5477,13 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
 		return EXIT_FAILURE;
 	}
 
+	if (target == NC_DATASTORE_CANDIDATE && file_private_used(file_ds, session)) {
+		ret = file_private_copy(file_ds, session, NULL, error);
+		UNLOCK(file_ds);
+		return ret;
+	}
+
+	file_history_push(file_ds, target_ds, target_ds->children, NULL);
 	while ((del = target_ds->children) != NULL) {
 		xmlUnlinkNode (target_ds->children);
 		xmlFreeNode (del);
@@ -1290,7 +5498,9 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
 		xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "true");
 	}
 
-	if (file_sync (file_ds)) {
+	file_delta_copied(file_ds, target_ds, NULL);
+
+	if (file_journal(file_ds, file_journal_new("delete", target_ds), target_ds)) {
 		UNLOCK(file_ds);
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 		nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
@@ -1317,10 +5527,10 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
 int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error)
 {
 	struct ncds_ds_file * file_ds = (struct ncds_ds_file *)ds;
-	xmlDocPtr config_doc, datastore_doc;
-	xmlNodePtr target_ds, aux_node, root;
+	xmlDocPtr config_doc;
+	xmlNodePtr target_ds, aux_node, root, record;
 	int retval = EXIT_SUCCESS, ret;
-	char* aux = NULL;
+	char* aux = NULL, num[12];
 	const char* configp;
 
 	assert(error);
@@ -1338,7 +5548,6 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 		UNLOCK(file_ds);
 		return EXIT_FAILURE;
 	}
-	file_rollback_store(file_ds);
 
 	switch(target) {
 	case NC_DATASTORE_RUNNING:
@@ -1405,38 +5614,28 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 	xmlUnlinkNode(root);
 	xmlFreeNode(root);
 
-	/* create an XML doc with a copy of the datastore configuration */
-	datastore_doc = xmlNewDoc (BAD_CAST "1.0");
-	xmlDocSetRootElement(datastore_doc, xmlCopyNode(target_ds->children, 1));
-	if (target_ds->children) {
-		for (root = target_ds->children->next; root != NULL; root = aux_node) {
-			aux_node = root->next;
-			xmlAddNextSibling(datastore_doc->last, xmlCopyNode(root, 1));
-		}
+	if (target == NC_DATASTORE_CANDIDATE && file_private_used(file_ds, session)) {
+		retval = file_private_edit(file_ds, session, config_doc, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error);
+		UNLOCK(file_ds);
+		xmlFreeDoc(config_doc);
+		return retval;
 	}
 
+	/* journal the request before edit_config() consumes it */
+	record = file_journal_new("edit", target_ds);
+	xmlAddChildList(record, xmlDocCopyNodeList(record->doc, config_doc->children));
+	snprintf(num, sizeof(num), "%d", defop);
+	xmlNewProp(record, BAD_CAST "defop", BAD_CAST num);
+	snprintf(num, sizeof(num), "%d", errop);
+	xmlNewProp(record, BAD_CAST "errop", BAD_CAST num);
+
 	/* preform edit config */
-	if (edit_config(datastore_doc, config_doc, (struct ncds_ds*)file_ds, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error)) {
+	if (file_edit(file_ds, target_ds, config_doc, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error)) {
 		retval = EXIT_FAILURE;
+		xmlFreeDoc(record->doc);
 	} else {
-		/* replace datastore by edited configuration */
-		while ((aux_node = target_ds->children) != NULL) {
-			xmlUnlinkNode(aux_node);
-			xmlFreeNode(aux_node);
-		}
-		xmlAddChildList(target_ds, xmlCopyNodeList(datastore_doc->children));
-
-		/*
-		 * if we are changing candidate, mark it as modified, since we need
-		 * this information for locking - according to RFC, candidate cannot
-		 * be locked since it has been modified and not committed.
-		 */
-		if (target == NC_DATASTORE_CANDIDATE) {
-			xmlSetProp(target_ds, BAD_CAST "modified", BAD_CAST "true");
-		}
-
 		/* sync xml tree with file on the hdd */
-		if (file_sync(file_ds)) {
+		if (file_journal(file_ds, record, target_ds)) {
 			*error = nc_err_new(NC_ERR_OP_FAILED);
 			nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
 			retval = EXIT_FAILURE;
@@ -1444,7 +5643,6 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 	}
 	UNLOCK(file_ds);
 
-	xmlFreeDoc(datastore_doc);
 	xmlFreeDoc(config_doc);
 
 	return retval;
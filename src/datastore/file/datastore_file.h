@@ -43,15 +43,172 @@
 #include "../../netconf_internal.h"
 #include "../datastore_internal.h"
 #include <semaphore.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <libxml/hash.h>
 
 /* Unique name prefix of every semaphore created */
 #define NCDS_LOCK "/NCDS_FLOCK"
 
-/* Number of seconds waiting for a semaphore increment before
+/* Unique name prefix of every shared memory object with the datastore lock */
+#define NCDS_RWLOCK "/NCDS_FRWLOCK"
+
+/* Events on the datastore files watched to detect their external changes */
+#define NCDS_WATCH_EVENTS (IN_MODIFY | IN_MOVED_TO | IN_CREATE)
+
+/* Number of seconds waiting for the datastore lock before
  * giving up and cancelling the locking
  */
 #define NCDS_LOCK_TIMEOUT 5
 
+/* Suffix of the journal file placed next to the datastore file */
+#define NCDS_JOURNAL_SUFFIX ".journal"
+
+/* Suffix of the temporary file used to rewrite the datastore file */
+#define NCDS_TMP_SUFFIX ".tmp"
+
+/* Maximal number of files storing the datastores */
+#define NCDS_FILE_PARTS 3
+
+/* Minimal size of the journal (in bytes) to write it into the datastore
+ * file, bigger datastore files are rewritten when the journal exceeds
+ * their size
+ */
+#define NCDS_JOURNAL_MIN_SIZE 65536
+
+/* Default number of the changes which can be rolled back */
+#define NCDS_ROLLBACK_LEVELS 10
+
+/* Default limit of the memory (in bytes) used by the rollback history */
+#define NCDS_ROLLBACK_MAX_SIZE (1024 * 1024)
+
+/**
+ * @brief Reverse delta of a change of a datastore - the children of the node
+ * at the given position are replaced by the original nodes.
+ */
+struct ds_undo_s {
+	/**
+	 * Indexes of the nodes on the way from the datastore node to the parent
+	 * of the replaced nodes
+	 */
+	int* path;
+	/**
+	 * Number of the items in the path
+	 */
+	int depth;
+	/**
+	 * Index of the first replaced child
+	 */
+	int index;
+	/**
+	 * Number of the replaced children in the changed datastore
+	 */
+	int count;
+	/**
+	 * Node holding copies of the original children as its children
+	 */
+	xmlNodePtr nodes;
+	struct ds_undo_s* next;
+};
+
+/**
+ * @brief Record of the rollback history.
+ */
+struct ds_history_s {
+	/**
+	 * Node of the changed datastore
+	 */
+	xmlNodePtr target_ds;
+	/**
+	 * Original value of the "modified" attribute of the datastore node
+	 */
+	xmlChar* modified;
+	/**
+	 * Reverse deltas in the order they are applied in
+	 */
+	struct ds_undo_s* undo;
+	/**
+	 * Estimated memory used by the record
+	 */
+	size_t size;
+	struct ds_history_s* next;
+};
+
+/**
+ * @brief Data shared by all the processes accessing the datastore files
+ * (placed in the POSIX shared memory). The counters are changed only with the
+ * reader/writer lock held for writing.
+ */
+struct ds_shared_s {
+	/**
+	 * reader/writer lock of the datastore files
+	 */
+	pthread_rwlock_t rwlock;
+	struct {
+		/**
+		 * number of the part file rewrites
+		 */
+		unsigned long rewrites;
+		/**
+		 * number of the records appended into the part journal
+		 */
+		unsigned long changes;
+	} parts[NCDS_FILE_PARTS];
+};
+
+/**
+ * @brief Private candidate datastore of a session. Its content is the running
+ * datastore with the subtrees changed by the session replaced.
+ */
+struct ds_private_s {
+	/**
+	 * the changed subtrees of the candidate and the paths to them identified
+	 * by the keys, the rest of the candidate is not copied
+	 */
+	xmlDocPtr doc;
+	/**
+	 * the same subtrees and paths of the running datastore when they were
+	 * changed for the first time, the base for detecting conflicts on commit
+	 */
+	xmlDocPtr base;
+	/**
+	 * skeleton of the subtrees changed by the session, as in struct
+	 * ds_delta_s
+	 */
+	xmlDocPtr paths;
+};
+
+/**
+ * @brief Content of a datastore published for the readers. The snapshot is
+ * never changed, a newer content is published as a new snapshot and the old
+ * one is freed by its last user.
+ */
+struct ds_snapshot_s {
+	/**
+	 * number of the references
+	 */
+	int refs;
+	/**
+	 * index of the part storing the datastore
+	 */
+	int part;
+	/**
+	 * values of the shared counters (struct ds_shared_s) and the access time
+	 * of the part when the snapshot was taken
+	 */
+	unsigned long rewrites, changes;
+	time_t last_access;
+	/**
+	 * serialized content of the datastore as returned by get-config
+	 */
+	char* data;
+	/**
+	 * partial locks of the running datastore, NULL if there are none
+	 */
+	char* plocks;
+};
+
 /**
  * @brief File datastore implementation-specific ncds_ds structure.
  */
@@ -66,29 +223,248 @@ struct ncds_ds_file {
 	 */
 	char* path;
 	/**
-	 * @brief File descriptor of an opened file containing the configuration data
+	 * @brief File descriptor of an opened file containing the configuration data,
+	 * it is passed to the first of the datastore parts by ncds_file_init()
 	 */
 	FILE* file;
+	/**
+	 * Layout of the datastore files
+	 */
+	NCDS_FILE_LAYOUT layout;
+	/**
+	 * Files storing the datastores - a single part with all the datastores or
+	 * a part per datastore (running, startup, candidate) in the split layout
+	 */
+	struct ds_part_s {
+		/**
+		 * Name of the datastore stored in the part, NULL for all of them
+		 */
+		const char* name;
+		/**
+		 * Path to the part file
+		 */
+		char* path;
+		/**
+		 * File descriptor of the opened part file
+		 */
+		FILE* file;
+		/**
+		 * Journal of the changes made after the last write of the part
+		 * file, records are appended as the datastore is being changed
+		 */
+		FILE* journal;
+		/**
+		 * Path to the journal file
+		 */
+		char* journal_path;
+		/**
+		 * Size of the journal part already applied to the xml document
+		 */
+		long journal_offset;
+		/**
+		 * Size of the journal when it was read or written last time, the
+		 * data after journal_offset up to this size are an incomplete
+		 * record left by a crash
+		 */
+		long journal_end;
+		/**
+		 * Size of the part file when it was (re)written or read last time
+		 */
+		long file_size;
+		/**
+		 * Status of the part file when it was (re)written or read last
+		 * time, watch events are ignored while the file still matches it
+		 */
+		struct stat file_stat;
+		/**
+		 * Generation of the part file, incremented by each rewrite of the
+		 * file. Journal records of other generations are ignored.
+		 */
+		unsigned long generation;
+		/**
+		 * Time of the last read or write of the part file
+		 */
+		time_t last_access;
+		/**
+		 * The journal was written since the last flush to the disk
+		 */
+		int dirty;
+		/**
+		 * Values of the shared counters (struct ds_shared_s) corresponding
+		 * to the loaded content of the part
+		 */
+		unsigned long rewrites, changes;
+		/**
+		 * The part file was changed by another program than libnetconf
+		 */
+		int external;
+	} parts[NCDS_FILE_PARTS];
+	/**
+	 * Number of the used parts
+	 */
+	int parts_count;
+	/**
+	 * inotify instance watching the directory with the part files, -1 if not
+	 * available (modification times of the files are checked instead)
+	 */
+	int watch;
+	/**
+	 * The datastore was changed by this process since the last reload
+	 */
+	int modified;
+	/**
+	 * durability of the datastore changes
+	 */
+	struct ds_sync_s {
+		/**
+		 * durability mode
+		 */
+		NCDS_FILE_SYNC mode;
+		/**
+		 * group commit window in microseconds
+		 */
+		unsigned int window;
+		/**
+		 * guards the following items and statistics
+		 */
+		pthread_mutex_t lock;
+		/**
+		 * signalled when a group flush is finished
+		 */
+		pthread_cond_t flushed;
+		/**
+		 * number of the changes written into the journal
+		 */
+		unsigned long written;
+		/**
+		 * number of the changes flushed to the disk
+		 */
+		unsigned long synced;
+		/**
+		 * a thread is flushing the journal
+		 */
+		int flushing;
+		/**
+		 * the directory with the datastore files was flushed
+		 */
+		int dir_synced;
+		/**
+		 * flushing of the changes is postponed by a transaction
+		 */
+		int defer;
+		/**
+		 * thread of the transaction postponing the flush
+		 */
+		pthread_t defer_thread;
+		/**
+		 * number of the last postponed change, 0 if there is none
+		 */
+		unsigned long deferred;
+		/**
+		 * time when writing of the first postponed change started
+		 */
+		struct timespec deferred_start;
+		/**
+		 * statistics
+		 */
+		struct ncds_file_stats stats;
+	} sync;
 	/**
 	 * libxml2's document structure of the datastore
 	 */
 	xmlDocPtr xml;
 	/**
-	 * backup libxml2's document structure of the datastore for rollback
+	 * history of the changes made by this process for rollback
 	 */
-	xmlDocPtr xml_rollback;
+	struct ds_rollback_s {
+		/**
+		 * maximal number of the records
+		 */
+		unsigned int levels;
+		/**
+		 * limit of the memory used by the records, except the last one
+		 */
+		size_t max_size;
+		/**
+		 * records from the most recent change
+		 */
+		struct ds_history_s* history;
+		/**
+		 * current number of the records
+		 */
+		unsigned int count;
+		/**
+		 * current memory used by the records
+		 */
+		size_t size;
+	} rollback;
+	/**
+	 * subtrees of the candidate and running datastores changed since their
+	 * content was the same (the last commit or discard-changes)
+	 */
+	struct ds_delta_s {
+		/**
+		 * the changed subtrees are known, otherwise the whole candidate
+		 * is committed
+		 */
+		int valid;
+		/**
+		 * skeleton of the changed subtrees - their ancestors with the key
+		 * leaves of the list instances, the roots of the changed subtrees
+		 * are marked by a non-NULL _private pointer, NULL if nothing changed
+		 */
+		xmlDocPtr paths;
+	} delta;
+	/**
+	 * each session uses its private candidate
+	 */
+	int private_candidate;
+	/**
+	 * private candidates (struct ds_private_s) of the sessions which changed
+	 * them, hashed by the session ID
+	 */
+	xmlHashTablePtr privates;
 	/**
 	 * libxml2 Node pointers providing access to individual datastores
 	 */
 	xmlNodePtr candidate, running, startup;
+	/**
+	 * snapshots of the running, startup and candidate datastores read
+	 * without the local lock
+	 */
+	struct ds_snapshots_s {
+		/**
+		 * guards the pointers, it is held for writing only to replace
+		 * a snapshot
+		 */
+		pthread_rwlock_t lock;
+		/**
+		 * the published snapshots, NULL if not taken yet
+		 */
+		struct ds_snapshot_s* ds[3];
+	} snapshots;
 	/**
 	 * locking structure
 	 */
 	struct ds_lock_s {
 		/**
-		 * semaphore pointer
+		 * semaphore pointer, it guards the initialization of the shared
+		 * reader/writer lock
 		 */
 		sem_t * lock;
+		/**
+		 * data shared by all the processes accessing the datastore file
+		 */
+		struct ds_shared_s * shared;
+		/**
+		 * reader/writer lock in the shared data
+		 */
+		pthread_rwlock_t * rwlock;
+		/**
+		 * serialize threads of this process working with the in-memory
+		 * copy of the datastore file
+		 */
+		pthread_mutex_t local;
 		/**
 		 * signal set before locked
 	 	 */
@@ -109,8 +485,17 @@ struct ncds_ds_file {
 int ncds_file_init(struct ncds_ds* ds);
 
 /**
- * @brief Test if configuration datastore was changed by another process since
- * last access of the caller.
+ * @brief Open and eventually create the lock shared by all the processes
+ * accessing the datastore file.
+ * @param[in] path Path to the datastore file.
+ * @param[out] lock Semaphore guarding the initialization of the shared data.
+ * @return Mapped shared data, NULL on error.
+ */
+struct ds_shared_s* ncds_file_shared_open(const char* path, sem_t** lock);
+
+/**
+ * @brief Test if configuration datastore was changed since the last access of
+ * the caller (reload of the datastore).
  * @param[in] ds File datastore structure which will be tested.
  * @return 0 as false if the datastore was not updated, 1 if the datastore was
  * changed.
@@ -118,7 +503,25 @@ int ncds_file_init(struct ncds_ds* ds);
 int ncds_file_changed(struct ncds_ds* ds);
 
 /**
- * @brief If possible, rollback the last change of the datastore.
+ * @brief Wait until the changes made by the calling thread are flushed to the
+ * disk (NCDS_FILE_SYNC_GROUP mode or the changes postponed by ncds_file_defer()).
+ * @param[in] ds File datastore structure.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_file_flush(struct ncds_ds* ds);
+
+/**
+ * @brief Postpone flushing of the following changes to the disk until
+ * ncds_file_flush() is called (NCDS_FILE_SYNC_COMMIT and NCDS_FILE_SYNC_GROUP
+ * modes).
+ * @param[in] ds File datastore structure.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_file_defer(struct ncds_ds* ds);
+
+/**
+ * @brief If possible, rollback the last change of the datastore. Repeated
+ * calls rollback the older changes stored in the rollback history.
  * @param[in] ds File datastore which will be rolled back.
  * @return 0 on success, non-zero if the operation can not be performed.
  */
@@ -187,6 +590,57 @@ void ncds_file_free(struct ncds_ds* ds);
  */
 int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, const nc_rpc* rpc, NC_DATASTORE target, NC_DATASTORE source, char *config, struct nc_err **error);
 
+/**
+ * @brief Commit the candidate datastore into the running datastore. Only the
+ * subtrees changed since the content of the datastores was the same are
+ * copied, the whole candidate is copied if they are not known.
+ *
+ * @param[in] ds File datastore to commit
+ * @param[in] session Session requesting the commit
+ * @param[in] rpc RPC message with the request. RPC message is used only for access control. If rpc is NULL access control is skipped.
+ * @param[out] old Running configuration before the commit restricted to the
+ * changed subtrees, NULL if not required.
+ * @param[out] new Running configuration after the commit restricted to the
+ * changed subtrees, NULL if not required.
+ * @param[out] error NETCONF error structure
+ *
+ * @return 0 on success, non-zero on error and error structure is filled.
+ */
+int ncds_file_commit(struct ncds_ds* ds, const struct nc_session* session, const nc_rpc* rpc, xmlDocPtr* old, xmlDocPtr* new, struct nc_err** error);
+
+/**
+ * @brief Get the partial locks of the running datastore. They are stored
+ * in the "partial-locks" attribute of the running datastore next to its
+ * global lock, so they are shared by all the processes using the files.
+ *
+ * @param[in] ds File datastore.
+ * @param[out] locks Serialized partial locks, NULL if there are none.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_file_get_plocks(struct ncds_ds* ds, char** locks);
+
+/**
+ * @brief Change the partial locks of the running datastore with the
+ * datastore locked for writing.
+ *
+ * @param[in] ds File datastore.
+ * @param[in] update Callback returning the new partial locks, NULL to keep
+ * the current ones.
+ * @param[in] arg Argument of the update callback.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_file_update_plocks(struct ncds_ds* ds, char* (*update)(const char* locks, void* arg), void* arg);
+
+/**
+ * @brief Free the private candidate of the session.
+ *
+ * @param[in] ds File datastore.
+ * @param[in] session Closed session.
+ */
+void ncds_file_private_free(struct ncds_ds* ds, const struct nc_session* session);
+
 /**
  * @brief Delete the target datastore
  *
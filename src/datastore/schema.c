@@ -0,0 +1,366 @@
+/**
+ * \file schema.c
+ * \brief Compiled schema tree of the YIN data models used for mapping
+ * the configuration data nodes to their definitions.
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libxml/tree.h>
+#include <libxml/dict.h>
+#include <libxml/hash.h>
+
+#include "schema.h"
+#include "../netconf_internal.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+/* serializes compiling of the models on their first use, see schema_get() */
+static pthread_mutex_t schema_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void schema_node_free(void* payload, const xmlChar* UNUSED(name))
+{
+	struct schema_node* snode = (struct schema_node*)payload;
+
+	if (snode == NULL) {
+		return;
+	}
+
+	if (snode->children != NULL) {
+		xmlHashFree(snode->children, schema_node_free);
+	}
+	free(snode->keys);
+	free(snode);
+}
+
+static int schema_node_keys(struct schema* schema, struct schema_node* snode, const xmlChar* value)
+{
+	const xmlChar *start, *end;
+	int count;
+
+	/* key statement argument is a whitespace separated list of the key leafs */
+	for (count = 0, start = value; *start != '\0';) {
+		while (*start == ' ' || *start == '\t' || *start == '\n' || *start == '\r') {
+			start++;
+		}
+		if (*start == '\0') {
+			break;
+		}
+		for (end = start; *end != '\0' && *end != ' ' && *end != '\t' && *end != '\n' && *end != '\r'; end++);
+
+		if ((count % 8) == 0) {
+			const xmlChar** aux = realloc(snode->keys, (count + 9) * sizeof(xmlChar*));
+			if (aux == NULL) {
+				ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+				return (EXIT_FAILURE);
+			}
+			snode->keys = aux;
+		}
+		snode->keys[count++] = xmlDictLookup(schema->dict, start, end - start);
+		snode->keys[count] = NULL;
+		start = end;
+	}
+	snode->keys_count = count;
+
+	return (EXIT_SUCCESS);
+}
+
+/* read the properties of the data node from its substatements */
+static int schema_node_props(struct schema* schema, struct schema_node* snode)
+{
+	xmlNodePtr stmt;
+	xmlChar* value;
+	int ret = EXIT_SUCCESS;
+
+	for (stmt = snode->yin->children; stmt != NULL && ret == EXIT_SUCCESS; stmt = stmt->next) {
+		if (stmt->type != XML_ELEMENT_NODE || stmt->ns == NULL) {
+			continue;
+		}
+
+		if (xmlStrcmp(stmt->ns->href, BAD_CAST NC_NS_NACM) == 0) {
+			if (xmlStrcmp(stmt->name, BAD_CAST "default-deny-all") == 0) {
+				snode->flags |= SCHEMA_NACM_DENY_ALL;
+			} else if (xmlStrcmp(stmt->name, BAD_CAST "default-deny-write") == 0) {
+				snode->flags |= SCHEMA_NACM_DENY_WRITE;
+			}
+			continue;
+		} else if (xmlStrcmp(stmt->ns->href, BAD_CAST NC_NS_YIN) != 0) {
+			continue;
+		}
+
+		if (xmlStrcmp(stmt->name, BAD_CAST "presence") == 0) {
+			snode->flags |= SCHEMA_PRESENCE;
+			continue;
+		} else if (xmlStrcmp(stmt->name, BAD_CAST "key") != 0 &&
+				xmlStrcmp(stmt->name, BAD_CAST "default") != 0 &&
+				xmlStrcmp(stmt->name, BAD_CAST "ordered-by") != 0 &&
+				xmlStrcmp(stmt->name, BAD_CAST "config") != 0) {
+			continue;
+		}
+
+		if ((value = xmlGetProp(stmt, BAD_CAST "value")) == NULL) {
+			continue;
+		}
+		if (xmlStrcmp(stmt->name, BAD_CAST "key") == 0) {
+			if (snode->type == SCHEMA_LIST && snode->keys == NULL) {
+				ret = schema_node_keys(schema, snode, value);
+			}
+		} else if (xmlStrcmp(stmt->name, BAD_CAST "default") == 0) {
+			if (snode->dflt == NULL) {
+				snode->dflt = xmlDictLookup(schema->dict, value, -1);
+			}
+		} else if (xmlStrcmp(stmt->name, BAD_CAST "ordered-by") == 0) {
+			if (xmlStrcmp(value, BAD_CAST "user") == 0 &&
+					(snode->type == SCHEMA_LIST || snode->type == SCHEMA_LEAFLIST)) {
+				snode->flags |= SCHEMA_ORDERED_USER;
+			}
+		} else { /* config */
+			if (xmlStrcmp(value, BAD_CAST "false") == 0) {
+				snode->flags |= SCHEMA_CONFIG_FALSE;
+			}
+		}
+		xmlFree(value);
+	}
+
+	return (ret);
+}
+
+/*
+ * Compile data definitions from the children of the yin_parent into the table.
+ * Choice, case and augment statements are transparent, the first definition
+ * of a name wins as in find_element_model().
+ */
+static int schema_compile_children(struct schema* schema, struct schema_node* parent, xmlHashTablePtr table, xmlNodePtr yin_parent)
+{
+	xmlNodePtr stmt;
+	xmlChar* name;
+	struct schema_node* snode;
+	SCHEMA_NODE_TYPE type;
+
+	for (stmt = yin_parent->children; stmt != NULL; stmt = stmt->next) {
+		if (stmt->type != XML_ELEMENT_NODE || stmt->ns == NULL ||
+				xmlStrcmp(stmt->ns->href, BAD_CAST NC_NS_YIN) != 0) {
+			continue;
+		}
+
+		if (xmlStrcmp(stmt->name, BAD_CAST "choice") == 0 ||
+				xmlStrcmp(stmt->name, BAD_CAST "case") == 0 ||
+				xmlStrcmp(stmt->name, BAD_CAST "augment") == 0) {
+			if (schema_compile_children(schema, parent, table, stmt) != EXIT_SUCCESS) {
+				return (EXIT_FAILURE);
+			}
+			continue;
+		} else if (xmlStrcmp(stmt->name, BAD_CAST "container") == 0) {
+			type = SCHEMA_CONTAINER;
+		} else if (xmlStrcmp(stmt->name, BAD_CAST "leaf") == 0) {
+			type = SCHEMA_LEAF;
+		} else if (xmlStrcmp(stmt->name, BAD_CAST "leaf-list") == 0) {
+			type = SCHEMA_LEAFLIST;
+		} else if (xmlStrcmp(stmt->name, BAD_CAST "list") == 0) {
+			type = SCHEMA_LIST;
+		} else if (xmlStrcmp(stmt->name, BAD_CAST "anyxml") == 0) {
+			type = SCHEMA_ANYXML;
+		} else {
+			continue;
+		}
+
+		if ((name = xmlGetProp(stmt, BAD_CAST "name")) == NULL) {
+			continue;
+		}
+
+		if ((snode = calloc(1, sizeof(struct schema_node))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+			xmlFree(name);
+			return (EXIT_FAILURE);
+		}
+		snode->type = type;
+		snode->name = xmlDictLookup(schema->dict, name, -1);
+		xmlFree(name);
+		snode->yin = stmt;
+		snode->parent = parent;
+
+		if (xmlHashAddEntry(table, snode->name, snode) != 0) {
+			/* already defined, keep the first definition */
+			free(snode);
+			continue;
+		}
+
+		if (schema_node_props(schema, snode) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+
+		if (type == SCHEMA_CONTAINER || type == SCHEMA_LIST) {
+			if ((snode->children = xmlHashCreateDict(8, schema->dict)) == NULL) {
+				ERROR("%s: Creating hash table failed.", __func__);
+				return (EXIT_FAILURE);
+			}
+			if (schema_compile_children(schema, snode, snode->children, stmt) != EXIT_SUCCESS) {
+				return (EXIT_FAILURE);
+			}
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static void schema_free(struct schema* schema)
+{
+	if (schema == NULL) {
+		return;
+	}
+
+	if (schema->roots != NULL) {
+		xmlHashFree(schema->roots, schema_node_free);
+	}
+	xmlDictFree(schema->dict);
+	free(schema);
+}
+
+static struct schema* schema_compile(xmlDocPtr model)
+{
+	struct schema* schema;
+	xmlNodePtr root;
+
+	if ((root = xmlDocGetRootElement(model)) == NULL) {
+		return (NULL);
+	}
+
+	if ((schema = calloc(1, sizeof(struct schema))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+		return (NULL);
+	}
+	if ((schema->dict = xmlDictCreate()) == NULL ||
+			(schema->roots = xmlHashCreateDict(16, schema->dict)) == NULL) {
+		ERROR("%s: Creating hash table failed.", __func__);
+		schema_free(schema);
+		return (NULL);
+	}
+
+	if (schema_compile_children(schema, NULL, schema->roots, root) != EXIT_SUCCESS) {
+		schema_free(schema);
+		return (NULL);
+	}
+
+	return (schema);
+}
+
+int schema_attach(xmlDocPtr model)
+{
+	struct schema* schema;
+
+	if (model == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	schema_detach(model);
+	if ((schema = schema_compile(model)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	__atomic_store_n(&(model->_private), schema, __ATOMIC_RELEASE);
+	return (EXIT_SUCCESS);
+}
+
+void schema_detach(xmlDocPtr model)
+{
+	if (model == NULL) {
+		return;
+	}
+
+	schema_free(model->_private);
+	model->_private = NULL;
+}
+
+struct schema* schema_get(xmlDocPtr model)
+{
+	struct schema* schema;
+
+	if (model == NULL) {
+		return (NULL);
+	}
+
+	if ((schema = __atomic_load_n(&(model->_private), __ATOMIC_ACQUIRE)) != NULL) {
+		return (schema);
+	}
+
+	/* not consolidated yet, compile it now */
+	pthread_mutex_lock(&schema_lock);
+	if ((schema = model->_private) == NULL && (schema = schema_compile(model)) != NULL) {
+		__atomic_store_n(&(model->_private), schema, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&schema_lock);
+
+	return (schema);
+}
+
+struct schema_node* schema_find(const struct schema* schema, const xmlNodePtr node)
+{
+	struct schema_node* parent;
+
+	if (schema == NULL || node == NULL || node->parent == NULL || node->type != XML_ELEMENT_NODE) {
+		return (NULL);
+	}
+
+	if (node->parent->type == XML_DOCUMENT_NODE) {
+		return (xmlHashLookup(schema->roots, node->name));
+	}
+
+	if ((parent = schema_find(schema, node->parent)) == NULL || parent->children == NULL) {
+		return (NULL);
+	}
+	return (xmlHashLookup(parent->children, node->name));
+}
+
+int schema_is_key(const struct schema* schema, const xmlNodePtr parent, const xmlNodePtr child)
+{
+	struct schema_node* snode;
+	int i;
+
+	if (child == NULL || (snode = schema_find(schema, parent)) == NULL) {
+		return (0);
+	}
+
+	for (i = 0; i < snode->keys_count; i++) {
+		if (xmlStrEqual(snode->keys[i], child->name)) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
@@ -0,0 +1,159 @@
+/**
+ * \file schema.h
+ * \brief Compiled schema tree of the YIN data models.
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef NC_SCHEMA_H_
+#define NC_SCHEMA_H_
+
+#include <libxml/tree.h>
+#include <libxml/dict.h>
+#include <libxml/hash.h>
+
+/**
+ * @brief Kind of the data definition statement of the compiled schema node.
+ */
+typedef enum {
+	SCHEMA_CONTAINER, /**< container */
+	SCHEMA_LEAF, /**< leaf */
+	SCHEMA_LEAFLIST, /**< leaf-list */
+	SCHEMA_LIST, /**< list */
+	SCHEMA_ANYXML /**< anyxml */
+} SCHEMA_NODE_TYPE;
+
+#define SCHEMA_CONFIG_FALSE   0x01 /**< config false */
+#define SCHEMA_ORDERED_USER   0x02 /**< ordered-by user list or leaf-list */
+#define SCHEMA_PRESENCE       0x04 /**< presence container */
+#define SCHEMA_NACM_DENY_ALL  0x08 /**< nacm:default-deny-all */
+#define SCHEMA_NACM_DENY_WRITE 0x10 /**< nacm:default-deny-write */
+
+/**
+ * @brief Compiled data definition node.
+ *
+ * The choice, case and augment statements are not represented, their
+ * children are hooked directly to the closest data node.
+ */
+struct schema_node {
+	SCHEMA_NODE_TYPE type;
+	/**
+	 * @brief Node name, interned in the schema dictionary.
+	 */
+	const xmlChar* name;
+	/**
+	 * @brief Definition of the node in the YIN data model.
+	 */
+	xmlNodePtr yin;
+	struct schema_node* parent;
+	/**
+	 * @brief Names of the list's keys (interned), NULL terminated.
+	 */
+	const xmlChar** keys;
+	int keys_count;
+	/**
+	 * @brief Default value of the leaf (interned), NULL if not defined.
+	 */
+	const xmlChar* dflt;
+	/**
+	 * @brief Combination of SCHEMA_* flags.
+	 */
+	int flags;
+	/**
+	 * @brief Children of the node hashed by their names.
+	 */
+	xmlHashTablePtr children;
+};
+
+/**
+ * @brief Compiled schema of a single YIN data model.
+ */
+struct schema {
+	xmlDictPtr dict;
+	/**
+	 * @brief Top level data nodes hashed by their names.
+	 */
+	xmlHashTablePtr roots;
+};
+
+/**
+ * @brief Compile the YIN data model into the schema tree and attach it to
+ * the model document. Previously attached schema is replaced.
+ *
+ * @param[in] model YIN data model document.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int schema_attach(xmlDocPtr model);
+
+/**
+ * @brief Free the schema attached to the model document.
+ *
+ * Must be called before the model document is changed or freed.
+ *
+ * @param[in] model YIN data model document.
+ */
+void schema_detach(xmlDocPtr model);
+
+/**
+ * @brief Get the schema compiled from the given model document.
+ *
+ * The models are compiled by ncds_consolidate(), a model not compiled yet
+ * (e.g. used before the consolidation) is compiled and attached here.
+ *
+ * @param[in] model YIN data model document.
+ * @return Attached schema, NULL if the model cannot be compiled.
+ */
+struct schema* schema_get(xmlDocPtr model);
+
+/**
+ * @brief Find the schema node defining the given data node.
+ *
+ * Only node names are compared, the same way as find_element_model() does.
+ *
+ * @param[in] schema Compiled schema.
+ * @param[in] node Configuration data element.
+ * @return Schema node, NULL if the node is not defined in the schema.
+ */
+struct schema_node* schema_find(const struct schema* schema, const xmlNodePtr node);
+
+/**
+ * @brief Decide if the child element is a key of the parent list instance.
+ * @param[in] schema Compiled schema.
+ * @param[in] parent List instance element.
+ * @param[in] child Child element of the parent.
+ * @return 1 if the child is a key of the parent, 0 otherwise.
+ */
+int schema_is_key(const struct schema* schema, const xmlNodePtr parent, const xmlNodePtr child);
+
+#endif /* NC_SCHEMA_H_ */
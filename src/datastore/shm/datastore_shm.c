@@ -0,0 +1,1213 @@
+/**
+ * \file datastore_shm.c
+ * \brief Implementation of the NETCONF datastore kept in the POSIX shared memory.
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+#include <libxml/tree.h>
+
+#include "../../netconf_internal.h"
+#include "../../error.h"
+#include "../../session.h"
+#include "../../nacm.h"
+#include "../datastore_internal.h"
+#include "datastore_shm.h"
+#include "../edit_config.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+/*
+ * Writers of all the processes are serialized by the robust mutex in the
+ * shared header, threads of a single process additionally by the local mutex,
+ * because they share the rollback backup. Readers take none of them, they only
+ * reference the immutable mapping of the current object (see shm_map_get()).
+ */
+#define LOCK(shm_ds, ret) {\
+	struct timespec tv_timeout;\
+	sigset_t fullsigset;\
+	pthread_mutex_lock(&(shm_ds->local));\
+	sigfillset(&fullsigset);\
+	sigprocmask(SIG_SETMASK, &fullsigset, &(shm_ds->sigset));\
+	clock_gettime(CLOCK_REALTIME, &tv_timeout);\
+	tv_timeout.tv_sec += NCDS_SHM_LOCK_TIMEOUT;\
+	ret = pthread_mutex_timedlock(&(shm_ds->header->lock), &tv_timeout);\
+	if (ret == EOWNERDEAD) {\
+		/* the content is always consistent, the generations are published atomically */\
+		pthread_mutex_consistent(&(shm_ds->header->lock));\
+		ret = 0;\
+	}\
+	if (ret != 0) {\
+		ret = 1;\
+		sigprocmask(SIG_SETMASK, &(shm_ds->sigset), NULL);\
+		pthread_mutex_unlock(&(shm_ds->local));\
+	}\
+}
+#define UNLOCK(shm_ds) {\
+	pthread_mutex_unlock(&(shm_ds->header->lock));\
+	sigprocmask(SIG_SETMASK, &(shm_ds->sigset), NULL);\
+	pthread_mutex_unlock(&(shm_ds->local));\
+}
+
+/* Number of attempts to map the current object of a datastore changed concurrently */
+#define SHM_MAP_RETRIES 100
+
+/* Suffixes of the files storing the datastores, indexed by shm_part() */
+static const char* shm_part_names[NCDS_SHM_PARTS] = {"running", "startup", "candidate"};
+
+API int ncds_shm_set_name(struct ncds_ds* datastore, const char* name)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)datastore;
+
+	if (datastore == NULL || datastore->type != NCDS_TYPE_SHM) {
+		ERROR("%s: invalid datastore.", __func__);
+		return (EXIT_FAILURE);
+	}
+	if (name == NULL || strlen(name) == 0 || strchr(name, '/') != NULL) {
+		ERROR("%s: invalid name.", __func__);
+		return (EXIT_FAILURE);
+	}
+	if (shm_ds->header != NULL) {
+		ERROR("%s: the datastore is already initiated.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	free(shm_ds->name);
+	shm_ds->name = strdup(name);
+
+	return (EXIT_SUCCESS);
+}
+
+API int ncds_shm_set_path(struct ncds_ds* datastore, const char* path)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)datastore;
+
+	if (datastore == NULL || datastore->type != NCDS_TYPE_SHM) {
+		ERROR("%s: invalid datastore.", __func__);
+		return (EXIT_FAILURE);
+	}
+	if (path != NULL && strlen(path) == 0) {
+		ERROR("%s: invalid path.", __func__);
+		return (EXIT_FAILURE);
+	}
+	if (shm_ds->header != NULL) {
+		ERROR("%s: the datastore is already initiated.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	free(shm_ds->path);
+	shm_ds->path = (path == NULL) ? NULL : strdup(path);
+	shm_ds->path_set = 1;
+
+	return (EXIT_SUCCESS);
+}
+
+static int shm_part(NC_DATASTORE target)
+{
+	switch (target) {
+	case NC_DATASTORE_RUNNING:
+		return (0);
+	case NC_DATASTORE_STARTUP:
+		return (1);
+	case NC_DATASTORE_CANDIDATE:
+		return (2);
+	default:
+		return (-1);
+	}
+}
+
+/**
+ * @brief Get the name of the shared memory object with the datastore content.
+ */
+static char* shm_object_name(struct ncds_ds_shm* shm_ds, int part, uint64_t generation)
+{
+	char* name;
+
+	if (asprintf(&name, "%s%s_%d_%llu", NCDS_SHM_PREFIX, shm_ds->name, part, (unsigned long long)generation) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	return (name);
+}
+
+/**
+ * @brief Release the reference of the mapping, the object is unmapped when
+ * the last reference is released.
+ */
+static void shm_map_put(struct ds_shm_map_s* map)
+{
+	if (map == NULL || __atomic_sub_fetch(&(map->refs), 1, __ATOMIC_ACQ_REL) != 0) {
+		return;
+	}
+
+	if (map->data != NULL) {
+		munmap(map->data, map->size);
+	}
+	free(map);
+}
+
+/**
+ * @brief Map the object of the specified generation of the datastore.
+ *
+ * @param[out] replaced Set to 1 if the object was already replaced by a newer
+ * generation and removed.
+ *
+ * @return Mapping with a single reference, NULL on error.
+ */
+static struct ds_shm_map_s* shm_map_open(struct ncds_ds_shm* shm_ds, int part, uint64_t generation, int* replaced)
+{
+	struct ds_shm_map_s* map;
+	struct stat st;
+	char* name;
+	int fd;
+
+	*replaced = 0;
+	if ((map = calloc(1, sizeof(struct ds_shm_map_s))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	map->refs = 1;
+	if (generation == 0) {
+		/* the datastore is empty */
+		return (map);
+	}
+
+	if ((name = shm_object_name(shm_ds, part, generation)) == NULL) {
+		free(map);
+		return (NULL);
+	}
+	fd = shm_open(name, O_RDONLY, 0);
+	free(name);
+	if (fd == -1) {
+		if (errno == ENOENT) {
+			*replaced = 1;
+		} else {
+			ERROR("Opening the datastore %s failed (%s).", shm_ds->name, strerror(errno));
+		}
+		free(map);
+		return (NULL);
+	}
+	if (fstat(fd, &st) == -1 || st.st_size == 0 ||
+			(map->data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		ERROR("Mapping the datastore %s failed (%s).", shm_ds->name, strerror(errno));
+		close(fd);
+		free(map);
+		return (NULL);
+	}
+	close(fd);
+	map->generation = generation;
+	map->size = st.st_size;
+
+	return (map);
+}
+
+/**
+ * @brief Get the mapping of the current object of the datastore. The local
+ * mutex is not required, the mapping is never changed and it stays valid
+ * until its reference is released by shm_map_put().
+ *
+ * @return Referenced mapping of the object, NULL on error.
+ */
+static struct ds_shm_map_s* shm_map_get(struct ncds_ds_shm* shm_ds, int part)
+{
+	struct ds_shm_map_s* map, *old;
+	uint64_t generation;
+	int i, replaced;
+
+	for (i = 0; i < SHM_MAP_RETRIES; i++) {
+		generation = __atomic_load_n(&(shm_ds->header->parts[part].generation), __ATOMIC_ACQUIRE);
+
+		pthread_rwlock_rdlock(&(shm_ds->maps_lock));
+		if ((map = shm_ds->maps[part]) != NULL && map->generation == generation) {
+			__atomic_add_fetch(&(map->refs), 1, __ATOMIC_RELAXED);
+			pthread_rwlock_unlock(&(shm_ds->maps_lock));
+			return (map);
+		}
+		pthread_rwlock_unlock(&(shm_ds->maps_lock));
+
+		if ((map = shm_map_open(shm_ds, part, generation, &replaced)) == NULL) {
+			if (replaced) {
+				continue;
+			}
+			return (NULL);
+		}
+
+		/* keep the mapping for the next readers */
+		map->refs = 2;
+		pthread_rwlock_wrlock(&(shm_ds->maps_lock));
+		old = shm_ds->maps[part];
+		shm_ds->maps[part] = map;
+		pthread_rwlock_unlock(&(shm_ds->maps_lock));
+		shm_map_put(old);
+
+		return (map);
+	}
+
+	ERROR("Mapping the datastore %s failed (changed too frequently).", shm_ds->name);
+	return (NULL);
+}
+
+/**
+ * @brief Create the shared memory object of the specified generation of the
+ * datastore. It MUST be called between LOCK and UNLOCK.
+ */
+static int shm_object_create(struct ncds_ds_shm* shm_ds, int part, uint64_t generation, const char* data, size_t size)
+{
+	char* name, *dst;
+	mode_t mask;
+	int fd;
+
+	if ((name = shm_object_name(shm_ds, part, generation)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	mask = umask(0000);
+	if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, FILE_PERM)) == -1 && errno == EEXIST) {
+		/* left by a process which failed to publish it */
+		shm_unlink(name);
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, FILE_PERM);
+	}
+	umask(mask);
+	if (fd == -1 || ftruncate(fd, size) == -1 ||
+			(dst = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		ERROR("Writing the datastore %s failed (%s).", shm_ds->name, strerror(errno));
+		if (fd != -1) {
+			close(fd);
+			shm_unlink(name);
+		}
+		free(name);
+		return (EXIT_FAILURE);
+	}
+	close(fd);
+	memcpy(dst, data, size);
+	munmap(dst, size);
+	free(name);
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Remove the shared memory object of the specified generation of the
+ * datastore, processes which have it mapped can still read it.
+ */
+static void shm_object_remove(struct ncds_ds_shm* shm_ds, int part, uint64_t generation)
+{
+	char* name;
+
+	if ((name = shm_object_name(shm_ds, part, generation)) != NULL) {
+		shm_unlink(name);
+		free(name);
+	}
+}
+
+/**
+ * @brief Get the name of the file storing the datastore content.
+ */
+static char* shm_file_name(struct ncds_ds_shm* shm_ds, int part)
+{
+	char* name;
+
+	if (asprintf(&name, "%s.%s", shm_ds->path, shm_part_names[part]) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	return (name);
+}
+
+/**
+ * @brief Store the new content of the datastore into its file. The content is
+ * written into a temporary file renamed over the datastore file, so the file
+ * always contains a complete content. It MUST be called between LOCK and
+ * UNLOCK.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int shm_persist(struct ncds_ds_shm* shm_ds, int part, const char* data, size_t size)
+{
+	char* name, *tmp = NULL, *dir;
+	mode_t mask;
+	ssize_t r;
+	size_t done;
+	int fd;
+
+	if (shm_ds->path == NULL) {
+		/* not stored on the disk */
+		return (EXIT_SUCCESS);
+	}
+
+	if ((name = shm_file_name(shm_ds, part)) == NULL || asprintf(&tmp, "%s.tmp", name) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		free(name);
+		return (EXIT_FAILURE);
+	}
+
+	mask = umask(MASK_PERM);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, FILE_PERM);
+	umask(mask);
+	if (fd == -1) {
+		goto error;
+	}
+	for (done = 0; done < size; done += r) {
+		if ((r = write(fd, data + done, size - done)) == -1) {
+			if (errno == EINTR) {
+				r = 0;
+				continue;
+			}
+			close(fd);
+			goto error;
+		}
+	}
+	if (fsync(fd) == -1) {
+		close(fd);
+		goto error;
+	}
+	close(fd);
+	if (rename(tmp, name) == -1) {
+		goto error;
+	}
+
+	/* make the rename durable */
+	if ((dir = strrchr(name, '/')) != NULL) {
+		*(dir == name ? dir + 1 : dir) = '\0';
+		if ((fd = open(name, O_RDONLY)) != -1) {
+			fsync(fd);
+			close(fd);
+		}
+	}
+	free(name);
+	free(tmp);
+
+	return (EXIT_SUCCESS);
+
+error:
+	ERROR("Storing the datastore %s into %s failed (%s).", shm_ds->name, name, strerror(errno));
+	unlink(tmp);
+	free(name);
+	free(tmp);
+	return (EXIT_FAILURE);
+}
+
+/**
+ * @brief Publish the new content of the datastore. It MUST be called between
+ * LOCK and UNLOCK. The replaced object stays mapped for the rollback.
+ *
+ * @param shm_ds Datastore to change.
+ * @param part Index of the changed datastore.
+ * @param data Serialized new content, it is not required to be NULL terminated.
+ * @param size Size of the new content, 0 to make the datastore empty.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int shm_publish(struct ncds_ds_shm* shm_ds, int part, const char* data, size_t size)
+{
+	struct ds_shm_map_s* map;
+	uint64_t generation = 0;
+
+	/* the replaced content */
+	if ((map = shm_map_get(shm_ds, part)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	if (size > 0) {
+		generation = shm_ds->header->counter + 1;
+		if (shm_object_create(shm_ds, part, generation, data, size) != EXIT_SUCCESS) {
+			shm_map_put(map);
+			return (EXIT_FAILURE);
+		}
+	}
+	if (shm_persist(shm_ds, part, data, size) != EXIT_SUCCESS) {
+		if (generation != 0) {
+			shm_object_remove(shm_ds, part, generation);
+		}
+		shm_map_put(map);
+		return (EXIT_FAILURE);
+	}
+	if (generation != 0) {
+		shm_ds->header->counter = generation;
+	}
+
+	/* readers see the complete object since now */
+	__atomic_store_n(&(shm_ds->header->parts[part].generation), generation, __ATOMIC_RELEASE);
+
+	if (map->generation != 0) {
+		shm_object_remove(shm_ds, part, map->generation);
+	}
+
+	/* keep the replaced content for the rollback */
+	shm_map_put(shm_ds->backup.map);
+	shm_ds->backup.part = part;
+	shm_ds->backup.generation = generation;
+	shm_ds->backup.map = map;
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Load the datastores from their files into the just created shared
+ * header. It MUST be called with the init_lock held.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int shm_load(struct ncds_ds_shm* shm_ds)
+{
+	struct stat st;
+	char* name, *data[NCDS_SHM_PARTS] = {NULL, NULL, NULL};
+	size_t size[NCDS_SHM_PARTS] = {0, 0, 0};
+	int fd, i, ret = EXIT_SUCCESS;
+	ssize_t r;
+
+	for (i = 0; i < NCDS_SHM_PARTS && ret == EXIT_SUCCESS; i++) {
+		if ((name = shm_file_name(shm_ds, i)) == NULL) {
+			ret = EXIT_FAILURE;
+			break;
+		}
+		if ((fd = open(name, O_RDONLY)) == -1) {
+			if (errno != ENOENT) {
+				ERROR("Opening the datastore file %s failed (%s).", name, strerror(errno));
+				ret = EXIT_FAILURE;
+			}
+			/* else the datastore was never stored, it is empty */
+			free(name);
+			continue;
+		}
+		if (fstat(fd, &st) == -1) {
+			ERROR("Reading the datastore file %s failed (%s).", name, strerror(errno));
+			ret = EXIT_FAILURE;
+		} else if (st.st_size > 0) {
+			if ((data[i] = malloc(st.st_size)) == NULL) {
+				ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+				ret = EXIT_FAILURE;
+			}
+			while (ret == EXIT_SUCCESS && size[i] < (size_t)st.st_size) {
+				if ((r = read(fd, data[i] + size[i], st.st_size - size[i])) == -1 && errno == EINTR) {
+					continue;
+				} else if (r <= 0) {
+					ERROR("Reading the datastore file %s failed (%s).", name, (r == 0) ? "unexpected end of file" : strerror(errno));
+					ret = EXIT_FAILURE;
+				} else {
+					size[i] += r;
+				}
+			}
+		}
+		close(fd);
+		free(name);
+	}
+
+	for (i = 0; i < NCDS_SHM_PARTS && ret == EXIT_SUCCESS; i++) {
+		if (size[i] == 0) {
+			continue;
+		}
+		if (shm_object_create(shm_ds, i, shm_ds->header->counter + 1, data[i], size[i]) != EXIT_SUCCESS) {
+			ret = EXIT_FAILURE;
+			break;
+		}
+		shm_ds->header->counter++;
+		shm_ds->header->parts[i].generation = shm_ds->header->counter;
+	}
+	if (ret == EXIT_SUCCESS) {
+		/* the stored candidate was not committed if it differs from running */
+		shm_ds->header->parts[2].modified = (size[2] != size[0] || (size[2] != 0 && memcmp(data[2], data[0], size[2]) != 0));
+	}
+
+	for (i = 0; i < NCDS_SHM_PARTS; i++) {
+		if (ret != EXIT_SUCCESS && shm_ds->header->parts[i].generation != 0) {
+			shm_object_remove(shm_ds, i, shm_ds->header->parts[i].generation);
+			shm_ds->header->parts[i].generation = 0;
+		}
+		free(data[i]);
+	}
+
+	return (ret);
+}
+
+/**
+ * @brief Parse the serialized datastore content or configuration data.
+ *
+ * @param data Content, it is not required to be NULL terminated.
+ * @param size Size of the content.
+ *
+ * @return Document with the top level nodes of the content, NULL on error.
+ */
+static xmlDocPtr shm_read(const char* data, size_t size)
+{
+	xmlDocPtr doc;
+	xmlNodePtr root, node;
+	const char* datap;
+	char* config;
+
+	if (size >= 5 && strncmp(data, "<?xml", 5) == 0) {
+		if ((datap = memchr(data, '>', size)) == NULL) {
+			return (NULL);
+		}
+		++datap;
+		size -= datap - data;
+		data = datap;
+	}
+	if (asprintf(&config, "<config>%.*s</config>", (int)size, data) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	doc = xmlReadMemory(config, strlen(config), NULL, NULL, NC_XMLREAD_OPTIONS);
+	free(config);
+	if (doc == NULL) {
+		return (NULL);
+	}
+
+	/* get off the root config element */
+	root = xmlDocGetRootElement(doc);
+	while ((node = root->children) != NULL) {
+		xmlUnlinkNode(node);
+		xmlAddNextSibling(doc->last, node);
+	}
+	xmlUnlinkNode(root);
+	xmlFreeNode(root);
+
+	return (doc);
+}
+
+/**
+ * @brief Serialize the document and publish it as the new datastore content.
+ */
+static int shm_publish_doc(struct ncds_ds_shm* shm_ds, int part, xmlDocPtr doc)
+{
+	xmlBufferPtr buf;
+	xmlNodePtr node;
+	int ret;
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	for (node = doc->children; node != NULL; node = node->next) {
+		xmlNodeDump(buf, doc, node, 0, 0);
+	}
+	ret = shm_publish(shm_ds, part, (char*)xmlBufferContent(buf), xmlBufferLength(buf));
+	xmlBufferFree(buf);
+
+	return (ret);
+}
+
+/**
+ * @brief Determine if the datastore is accessible (is not NETCONF locked) for
+ * the specified session. It MUST be called between LOCK and UNLOCK.
+ *
+ * @return 0 when the session can work with the datastore, non-zero else.
+ */
+static int shm_access(struct ncds_ds_shm* shm_ds, int part, const struct nc_session* session)
+{
+	const char* lock = shm_ds->header->parts[part].lock;
+
+	if (lock[0] == '\0' || (session != NULL && strcmp(lock, session->session_id) == 0)) {
+		return (EXIT_SUCCESS);
+	}
+
+	return (EXIT_FAILURE);
+}
+
+int ncds_shm_init(struct ncds_ds* ds)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)ds;
+	pthread_mutexattr_t attr;
+	struct stat st;
+	char* path;
+	mode_t mask;
+	int fd, i;
+
+	if (shm_ds->name == NULL) {
+		/* name the datastore according to its data model */
+		if (shm_ds->ds.data_model == NULL || shm_ds->ds.data_model->name == NULL) {
+			ERROR("%s: missing the datastore name.", __func__);
+			return (EXIT_FAILURE);
+		}
+		shm_ds->name = strdup(shm_ds->ds.data_model->name);
+	}
+	if (!shm_ds->path_set && asprintf(&(shm_ds->path), "%s/datastore-shm-%s", NC_WORKINGDIR_PATH, shm_ds->name) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		shm_ds->path = NULL;
+		return (EXIT_FAILURE);
+	}
+
+	/* the semaphore guards the initialization of the shared header */
+	if (asprintf(&path, "%s%s", NCDS_SHM_LOCK, shm_ds->name) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	mask = umask(0000);
+	if ((shm_ds->init_lock = sem_open(path, O_CREAT, FILE_PERM, 1)) == SEM_FAILED) {
+		umask(mask);
+		ERROR("Unable to prepare the datastore lock (%s).", strerror(errno));
+		shm_ds->init_lock = NULL;
+		free(path);
+		return (EXIT_FAILURE);
+	}
+	free(path);
+
+	if (asprintf(&path, "%s%s", NCDS_SHM_PREFIX, shm_ds->name) == -1) {
+		umask(mask);
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	sem_wait(shm_ds->init_lock);
+	fd = shm_open(path, O_RDWR | O_CREAT, FILE_PERM);
+	umask(mask);
+	free(path);
+	if (fd == -1 || fstat(fd, &st) == -1 ||
+			(st.st_size < (off_t) sizeof(struct ds_shm_header_s) && ftruncate(fd, sizeof(struct ds_shm_header_s)) == -1)) {
+		ERROR("Unable to prepare the datastore %s (%s).", shm_ds->name, strerror(errno));
+		if (fd != -1) {
+			close(fd);
+		}
+		sem_post(shm_ds->init_lock);
+		return (EXIT_FAILURE);
+	}
+	shm_ds->header = mmap(NULL, sizeof(struct ds_shm_header_s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm_ds->header == MAP_FAILED) {
+		ERROR("Mapping the datastore %s failed (%s).", shm_ds->name, strerror(errno));
+		shm_ds->header = NULL;
+		sem_post(shm_ds->init_lock);
+		return (EXIT_FAILURE);
+	}
+	if (st.st_size == 0) {
+		/* we have created the shared memory, so initiate the lock */
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+		pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+		pthread_mutex_init(&(shm_ds->header->lock), &attr);
+		pthread_mutexattr_destroy(&attr);
+
+		/* the shared memory was lost (e.g. by the system restart), restore it */
+		if (shm_ds->path != NULL && shm_load(shm_ds) != EXIT_SUCCESS) {
+			ERROR("Loading the datastore %s from %s failed.", shm_ds->name, shm_ds->path);
+			munmap(shm_ds->header, sizeof(struct ds_shm_header_s));
+			shm_ds->header = NULL;
+			if (asprintf(&path, "%s%s", NCDS_SHM_PREFIX, shm_ds->name) != -1) {
+				/* let the next process try it again */
+				shm_unlink(path);
+				free(path);
+			}
+			sem_post(shm_ds->init_lock);
+			return (EXIT_FAILURE);
+		}
+	}
+	sem_post(shm_ds->init_lock);
+
+	pthread_mutex_init(&(shm_ds->local), NULL);
+	pthread_rwlock_init(&(shm_ds->maps_lock), NULL);
+	shm_ds->backup.part = -1;
+	for (i = 0; i < NCDS_SHM_PARTS; i++) {
+		shm_ds->lockinfo[i].datastore = (i == 0) ? NC_DATASTORE_RUNNING : (i == 1) ? NC_DATASTORE_STARTUP : NC_DATASTORE_CANDIDATE;
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+void ncds_shm_free(struct ncds_ds* ds)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)ds;
+	int i;
+
+	if (shm_ds == NULL) {
+		return;
+	}
+
+	for (i = 0; i < NCDS_SHM_PARTS; i++) {
+		shm_map_put(shm_ds->maps[i]);
+		free(shm_ds->lockinfo[i].sid);
+		free(shm_ds->lockinfo[i].time);
+	}
+	shm_map_put(shm_ds->backup.map);
+	if (shm_ds->header != NULL) {
+		munmap(shm_ds->header, sizeof(struct ds_shm_header_s));
+		pthread_mutex_destroy(&(shm_ds->local));
+		pthread_rwlock_destroy(&(shm_ds->maps_lock));
+	}
+	if (shm_ds->init_lock != NULL) {
+		sem_close(shm_ds->init_lock);
+	}
+	free(shm_ds->name);
+	free(shm_ds->path);
+}
+
+int ncds_shm_changed(struct ncds_ds* ds)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)ds;
+	uint64_t generation;
+	int i, ret = 0;
+
+	pthread_mutex_lock(&(shm_ds->local));
+	for (i = 0; i < NCDS_SHM_PARTS; i++) {
+		generation = __atomic_load_n(&(shm_ds->header->parts[i].generation), __ATOMIC_ACQUIRE);
+		if (generation != shm_ds->seen[i]) {
+			shm_ds->seen[i] = generation;
+			ret = 1;
+		}
+	}
+	pthread_mutex_unlock(&(shm_ds->local));
+
+	return (ret);
+}
+
+int ncds_shm_rollback(struct ncds_ds* ds)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)ds;
+	struct ds_shm_map_s* backup;
+	int part, ret;
+
+	LOCK(shm_ds, ret);
+	if (ret) {
+		return (EXIT_FAILURE);
+	}
+
+	if ((part = shm_ds->backup.part) == -1 ||
+			__atomic_load_n(&(shm_ds->header->parts[part].generation), __ATOMIC_ACQUIRE) != shm_ds->backup.generation) {
+		UNLOCK(shm_ds);
+		ERROR("No backup repository for rollback operation (datastore %d).", shm_ds->ds.id);
+		return (EXIT_FAILURE);
+	}
+
+	/* shm_publish() replaces the backup, so take it out first */
+	backup = shm_ds->backup.map;
+	shm_ds->backup.map = NULL;
+	ret = shm_publish(shm_ds, part, backup->data, backup->size);
+	shm_map_put(backup);
+	shm_map_put(shm_ds->backup.map);
+	shm_ds->backup.map = NULL;
+	shm_ds->backup.part = -1;
+	UNLOCK(shm_ds);
+
+	return (ret);
+}
+
+const struct ncds_lockinfo *ncds_shm_lockinfo(struct ncds_ds* ds, NC_DATASTORE target)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)ds;
+	struct ncds_lockinfo* info;
+	int part, ret;
+
+	if ((part = shm_part(target)) == -1) {
+		return (NULL);
+	}
+
+	LOCK(shm_ds, ret);
+	if (ret) {
+		return (NULL);
+	}
+
+	info = &(shm_ds->lockinfo[part]);
+	free(info->sid);
+	free(info->time);
+	info->sid = NULL;
+	info->time = NULL;
+	if (shm_ds->header->parts[part].lock[0] != '\0') {
+		info->sid = strdup(shm_ds->header->parts[part].lock);
+		info->time = strdup(shm_ds->header->parts[part].locktime);
+	}
+	UNLOCK(shm_ds);
+
+	return (info);
+}
+
+int ncds_shm_lock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)ds;
+	int part, ret;
+	char* t;
+
+	assert(error);
+
+	if ((part = shm_part(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+	if (strlen(session->session_id) >= NCDS_SHM_LOCK_LEN) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Session ID is too long.");
+		return (EXIT_FAILURE);
+	}
+
+	LOCK(shm_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore timeouted.");
+		return (EXIT_FAILURE);
+	}
+
+	if (shm_access(shm_ds, part, NULL) != 0) {
+		/* someone is already holding the lock */
+		*error = nc_err_new(NC_ERR_LOCK_DENIED);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_SID, shm_ds->header->parts[part].lock);
+		ret = EXIT_FAILURE;
+	} else if (target == NC_DATASTORE_CANDIDATE && shm_ds->header->parts[part].modified) {
+		*error = nc_err_new(NC_ERR_LOCK_DENIED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Candidate datastore not locked but already modified.");
+		ret = EXIT_FAILURE;
+	} else {
+		strcpy(shm_ds->header->parts[part].lock, session->session_id);
+		t = nc_time2datetime(time(NULL), NULL);
+		snprintf(shm_ds->header->parts[part].locktime, NCDS_SHM_LOCK_LEN, "%s", (t != NULL) ? t : "");
+		free(t);
+		ret = EXIT_SUCCESS;
+	}
+	UNLOCK(shm_ds);
+
+	return (ret);
+}
+
+int ncds_shm_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)ds;
+	struct ds_shm_map_s* map;
+	int part, ret;
+
+	assert(error);
+
+	if ((part = shm_part(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+
+	LOCK(shm_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore timeouted.");
+		return (EXIT_FAILURE);
+	}
+
+	ret = EXIT_SUCCESS;
+	if (shm_access(shm_ds, part, NULL) == 0) {
+		/* not locked */
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Target datastore is not locked.");
+		ret = EXIT_FAILURE;
+	} else if (shm_access(shm_ds, part, session) != 0) {
+		/* the datastore is locked by somebody else */
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Target datastore is locked by another session.");
+		ret = EXIT_FAILURE;
+	} else {
+		if (target == NC_DATASTORE_CANDIDATE) {
+			/* drop current candidate configuration, copy running into it */
+			if ((map = shm_map_get(shm_ds, shm_part(NC_DATASTORE_RUNNING))) == NULL ||
+					shm_publish(shm_ds, part, map->data, map->size) != EXIT_SUCCESS) {
+				*error = nc_err_new(NC_ERR_OP_FAILED);
+				ret = EXIT_FAILURE;
+			}
+			shm_map_put(map);
+			shm_ds->header->parts[part].modified = 0;
+		}
+
+		/* unlock datastore */
+		shm_ds->header->parts[part].lock[0] = '\0';
+		shm_ds->header->parts[part].locktime[0] = '\0';
+	}
+	UNLOCK(shm_ds);
+
+	return (ret);
+}
+
+char* ncds_shm_getconfig(struct ncds_ds* ds, const struct nc_session* UNUSED(session), NC_DATASTORE source, struct nc_err** error)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)ds;
+	struct ds_shm_map_s* map;
+	char* data = NULL;
+	int part;
+
+	if ((part = shm_part(source)) == -1) {
+		ERROR("%s: invalid source.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "source");
+		return (NULL);
+	}
+
+	/*
+	 * no lock, the referenced mapping is never changed; the content is
+	 * copied only because the caller gets its own string
+	 */
+	if ((map = shm_map_get(shm_ds, part)) != NULL) {
+		if ((data = malloc(map->size + 1)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		} else {
+			memcpy(data, map->data, map->size);
+			data[map->size] = '\0';
+		}
+		shm_map_put(map);
+	}
+
+	return (data);
+}
+
+int ncds_shm_copyconfig(struct ncds_ds *ds, const struct nc_session *session, const nc_rpc* rpc, NC_DATASTORE target, NC_DATASTORE source, char* config, struct nc_err **error)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)ds;
+	struct ds_shm_map_s* map;
+	xmlDocPtr aux_doc = NULL, target_doc = NULL;
+	keyList keys;
+	int part, ret, r;
+
+	assert(error);
+
+	if ((part = shm_part(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+	if (source != NC_DATASTORE_CONFIG && shm_part(source) == -1) {
+		ERROR("%s: invalid source.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "source");
+		return (EXIT_FAILURE);
+	} else if (source == NC_DATASTORE_CONFIG && config == NULL) {
+		ERROR("%s: invalid source config.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
+		return (EXIT_FAILURE);
+	}
+
+	LOCK(shm_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore timeouted.");
+		return (EXIT_FAILURE);
+	}
+
+	/* isn't target locked? */
+	if (shm_access(shm_ds, part, session) != 0 ||
+			/* commit - check also the lock on source (i.e. candidate) datastore */
+			(source == NC_DATASTORE_CANDIDATE && target == NC_DATASTORE_RUNNING && shm_access(shm_ds, shm_part(source), session) != 0)) {
+		UNLOCK(shm_ds);
+		*error = nc_err_new(NC_ERR_IN_USE);
+		return (EXIT_FAILURE);
+	}
+
+	if (source != NC_DATASTORE_CONFIG && (rpc == NULL || rpc->nacm == NULL ||
+			(source == NC_DATASTORE_RUNNING && target == NC_DATASTORE_STARTUP))) {
+		/* no access control, the content is copied as it is */
+		if ((map = shm_map_get(shm_ds, shm_part(source))) == NULL) {
+			ret = EXIT_FAILURE;
+		} else if (map->size == 0 && __atomic_load_n(&(shm_ds->header->parts[part].generation), __ATOMIC_ACQUIRE) == 0) {
+			ret = EXIT_RPC_NOT_APPLICABLE;
+		} else {
+			ret = shm_publish(shm_ds, part, map->data, map->size);
+		}
+		shm_map_put(map);
+		goto finish;
+	}
+
+	if (source == NC_DATASTORE_CONFIG) {
+		aux_doc = shm_read(config, strlen(config));
+	} else if ((map = shm_map_get(shm_ds, shm_part(source))) != NULL) {
+		aux_doc = shm_read(map->data, map->size);
+		shm_map_put(map);
+	}
+	if (aux_doc != NULL && (map = shm_map_get(shm_ds, part)) != NULL) {
+		target_doc = shm_read(map->data, map->size);
+		shm_map_put(map);
+	}
+	if (aux_doc == NULL || target_doc == NULL) {
+		ERROR("%s: reading source config failed.", __func__);
+		ret = EXIT_FAILURE;
+		goto finish;
+	}
+
+	if (aux_doc->children == NULL && target_doc->children == NULL) {
+		ret = EXIT_RPC_NOT_APPLICABLE;
+		goto finish;
+	}
+
+	if (rpc != NULL && rpc->nacm != NULL) {
+		/* NACM, the same as in the file datastore (RFC 6536, sec. 3.2.4.) */
+		keys = get_keynode_list(shm_ds->ds.ext_model);
+		if (source != NC_DATASTORE_CONFIG) {
+			nacm_check_data_read(aux_doc, rpc->nacm);
+		}
+		if (target_doc->children == NULL) {
+			r = nacm_check_data(aux_doc->children, NACM_ACCESS_CREATE, rpc->nacm);
+		} else {
+			r = edit_replace_nacmcheck(target_doc->children, aux_doc, shm_ds->ds.ext_model, keys, rpc->nacm, error);
+		}
+		keyListFree(keys);
+		if (r != NACM_PERMIT) {
+			if (*error == NULL) {
+				*error = nc_err_new((r == NACM_DENY) ? NC_ERR_ACCESS_DENIED : NC_ERR_OP_FAILED);
+			}
+			UNLOCK(shm_ds);
+			xmlFreeDoc(aux_doc);
+			xmlFreeDoc(target_doc);
+			return (EXIT_FAILURE);
+		}
+	}
+
+	ret = shm_publish_doc(shm_ds, part, aux_doc);
+
+finish:
+	if (ret == EXIT_FAILURE) {
+		if (*error == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+		}
+	} else if (target == NC_DATASTORE_CANDIDATE) {
+		/* according to RFC, candidate cannot be locked since it has been modified and not committed */
+		shm_ds->header->parts[part].modified = (source != NC_DATASTORE_RUNNING);
+	}
+	UNLOCK(shm_ds);
+	xmlFreeDoc(aux_doc);
+	xmlFreeDoc(target_doc);
+
+	return (ret);
+}
+
+int ncds_shm_deleteconfig(struct ncds_ds * ds, const struct nc_session * session, NC_DATASTORE target, struct nc_err **error)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)ds;
+	int part, ret;
+
+	assert(error);
+
+	if (target == NC_DATASTORE_RUNNING) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Cannot delete a running datastore.");
+		return (EXIT_FAILURE);
+	} else if ((part = shm_part(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+
+	LOCK(shm_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore timeouted.");
+		return (EXIT_FAILURE);
+	}
+
+	if (shm_access(shm_ds, part, session) != 0) {
+		UNLOCK(shm_ds);
+		*error = nc_err_new(NC_ERR_IN_USE);
+		return (EXIT_FAILURE);
+	}
+
+	if ((ret = shm_publish(shm_ds, part, NULL, 0)) != EXIT_SUCCESS) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+	} else if (target == NC_DATASTORE_CANDIDATE) {
+		shm_ds->header->parts[part].modified = 1;
+	}
+	UNLOCK(shm_ds);
+
+	return (ret);
+}
+
+int ncds_shm_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error)
+{
+	struct ncds_ds_shm* shm_ds = (struct ncds_ds_shm*)ds;
+	struct ds_shm_map_s* map;
+	xmlDocPtr config_doc, datastore_doc = NULL;
+	int part, ret;
+
+	assert(error);
+
+	if ((part = shm_part(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+
+	/* read config to XML doc */
+	if ((config_doc = shm_read(config, strlen(config))) == NULL) {
+		ERROR("%s: Reading xml data failed!", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
+		return (EXIT_FAILURE);
+	}
+
+	LOCK(shm_ds, ret);
+	if (ret) {
+		xmlFreeDoc(config_doc);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore timeouted.");
+		return (EXIT_FAILURE);
+	}
+
+	if (shm_access(shm_ds, part, session) != 0) {
+		UNLOCK(shm_ds);
+		xmlFreeDoc(config_doc);
+		*error = nc_err_new(NC_ERR_IN_USE);
+		return (EXIT_FAILURE);
+	}
+
+	if ((map = shm_map_get(shm_ds, part)) != NULL) {
+		datastore_doc = shm_read(map->data, map->size);
+		shm_map_put(map);
+	}
+	if (datastore_doc == NULL) {
+		ERROR("Reading the datastore %s failed.", shm_ds->name);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		ret = EXIT_FAILURE;
+	} else if ((ret = edit_config(datastore_doc, config_doc, ds, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error)) == EXIT_SUCCESS) {
+		if ((ret = shm_publish_doc(shm_ds, part, datastore_doc)) != EXIT_SUCCESS) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+		} else if (target == NC_DATASTORE_CANDIDATE) {
+			shm_ds->header->parts[part].modified = 1;
+		}
+	} else {
+		ret = EXIT_FAILURE;
+	}
+	UNLOCK(shm_ds);
+
+	xmlFreeDoc(datastore_doc);
+	xmlFreeDoc(config_doc);
+
+	return (ret);
+}
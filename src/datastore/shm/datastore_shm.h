@@ -0,0 +1,257 @@
+/**
+ * \file datastore_shm.h
+ * \brief NETCONF datastore handling function prototypes and structures for shared memory datastore implementation.
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef NC_DATASTORE_SHM_H_
+#define NC_DATASTORE_SHM_H_
+
+#include "../../netconf_internal.h"
+#include "../datastore_internal.h"
+#include <stdint.h>
+#include <signal.h>
+#include <semaphore.h>
+#include <pthread.h>
+
+/* Unique name prefix of every semaphore created */
+#define NCDS_SHM_LOCK "/NCDS_SLOCK_"
+
+/* Unique name prefix of every shared memory object of the datastores */
+#define NCDS_SHM_PREFIX "/NCDS_SHM_"
+
+/* Number of seconds waiting for the datastore lock before
+ * giving up and cancelling the locking
+ */
+#define NCDS_SHM_LOCK_TIMEOUT 5
+
+/* Number of the datastores (running, startup, candidate) */
+#define NCDS_SHM_PARTS 3
+
+/* Maximal length of the session ID and time of the NETCONF lock */
+#define NCDS_SHM_LOCK_LEN 64
+
+/**
+ * @brief Header of the datastores placed in the POSIX shared memory and
+ * shared by all the processes. The content of each datastore is stored
+ * serialized in its own shared memory object, which is never changed once it
+ * is published - a change creates a new object and publishes its generation
+ * in the header. Readers do not lock, they map the object of the generation
+ * they read. If it was already removed by a writer, they read the generation
+ * again. The replaced objects are unlinked by the writers and their memory
+ * is released when the last reader unmaps them. Each published content is
+ * also stored in the datastore file, so the header created again after the
+ * system restart loads the datastores from their files.
+ */
+struct ds_shm_header_s {
+	/**
+	 * lock of the writers, the members below are changed only with it held
+	 */
+	pthread_mutex_t lock;
+	/**
+	 * the last generation used for the datastore objects
+	 */
+	uint64_t counter;
+	struct {
+		/**
+		 * generation of the object with the datastore content, 0 if the
+		 * datastore is empty, read and written atomically
+		 */
+		uint64_t generation;
+		/**
+		 * ID of the session holding the NETCONF lock, empty if not locked
+		 */
+		char lock[NCDS_SHM_LOCK_LEN];
+		/**
+		 * time when the NETCONF lock was acquired
+		 */
+		char locktime[NCDS_SHM_LOCK_LEN];
+		/**
+		 * the (candidate) datastore was modified
+		 */
+		int modified;
+	} parts[NCDS_SHM_PARTS];
+};
+
+/**
+ * @brief Mapping of the datastore object in the process. It is never changed,
+ * the object is unmapped when the last reference is released.
+ */
+struct ds_shm_map_s {
+	/**
+	 * number of the references
+	 */
+	int refs;
+	/**
+	 * generation of the mapped object, 0 for the empty datastore
+	 */
+	uint64_t generation;
+	/**
+	 * content of the object (not NULL terminated)
+	 */
+	char* data;
+	/**
+	 * size of the content
+	 */
+	size_t size;
+};
+
+/**
+ * @brief Shared memory datastore implementation-specific ncds_ds structure.
+ */
+struct ncds_ds_shm {
+	/* common part from datastore_internal.h */
+	struct ncds_ds ds;
+
+	/* specific part */
+	/**
+	 * @brief Name of the shared memory objects of the datastores.
+	 */
+	char* name;
+	/**
+	 * @brief Path prefix of the files storing the datastores, NULL if the
+	 * datastores are not stored on the disk.
+	 */
+	char* path;
+	/**
+	 * @brief The path was set by ncds_shm_set_path(), the default is not used.
+	 */
+	int path_set;
+	/**
+	 * @brief Semaphore guarding the initialization of the shared header.
+	 */
+	sem_t* init_lock;
+	/**
+	 * @brief Mapped shared header.
+	 */
+	struct ds_shm_header_s* header;
+	/**
+	 * @brief Mutex of the threads for accessing the process local members
+	 * (the rollback backup, the lock info), reading the content does not
+	 * take it.
+	 */
+	pthread_mutex_t local;
+	/**
+	 * @brief Signal mask of the thread holding the writers lock.
+	 */
+	sigset_t sigset;
+	/**
+	 * @brief Objects of the datastores mapped the last time they were read,
+	 * NULL if not mapped yet.
+	 */
+	struct ds_shm_map_s* maps[NCDS_SHM_PARTS];
+	/**
+	 * @brief Guards the pointers to the mappings, it is held for writing
+	 * only to replace a mapping.
+	 */
+	pthread_rwlock_t maps_lock;
+	/**
+	 * @brief Generations of the datastores seen by ncds_shm_changed().
+	 */
+	uint64_t seen[NCDS_SHM_PARTS];
+	/**
+	 * @brief The last change made by the process for ncds_shm_rollback().
+	 */
+	struct {
+		/**
+		 * changed datastore, -1 if there is nothing to roll back
+		 */
+		int part;
+		/**
+		 * generation published by the change
+		 */
+		uint64_t generation;
+		/**
+		 * mapping of the replaced object (it stays readable after
+		 * the object is unlinked), NULL if there is nothing to roll back
+		 */
+		struct ds_shm_map_s* map;
+	} backup;
+	/**
+	 * @brief Information about the NETCONF locks returned by ncds_shm_lockinfo().
+	 */
+	struct ncds_lockinfo lockinfo[NCDS_SHM_PARTS];
+};
+
+/**
+ * @brief Initialization of the shared memory datastore
+ *
+ * @param ds Datastore to initialize
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_shm_init(struct ncds_ds* ds);
+
+/**
+ * @brief Closes the datastore, its content stays in the shared memory
+ *
+ * @param ds Datastore to close
+ */
+void ncds_shm_free(struct ncds_ds* ds);
+
+/**
+ * @brief Checks if any of the datastores was changed since the last call
+ *
+ * @param ds Datastore to check
+ *
+ * @return 0 if not changed, non-zero otherwise
+ */
+int ncds_shm_changed(struct ncds_ds* ds);
+
+/**
+ * @brief Undo the last change made by the calling process, if no other change
+ * was made since it.
+ *
+ * @param ds Datastore to roll back
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_shm_rollback(struct ncds_ds* ds);
+
+const struct ncds_lockinfo *ncds_shm_lockinfo(struct ncds_ds* ds, NC_DATASTORE target);
+
+int ncds_shm_lock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
+
+int ncds_shm_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
+
+char* ncds_shm_getconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
+
+int ncds_shm_copyconfig(struct ncds_ds* ds, const struct nc_session* session, const nc_rpc* rpc, NC_DATASTORE target, NC_DATASTORE source, char* config, struct nc_err** error);
+
+int ncds_shm_deleteconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
+
+int ncds_shm_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error);
+
+#endif /* NC_DATASTORE_SHM_H_ */
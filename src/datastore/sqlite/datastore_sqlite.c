@@ -0,0 +1,2072 @@
+/**
+ * \file datastore_sqlite.c
+ * \brief Implementation of the NETCONF datastore storing the configuration records in SQLite database.
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <ctype.h>
+#include <float.h>
+#include <time.h>
+
+#include <sqlite3.h>
+#include <libxml/tree.h>
+#include <libxml/hash.h>
+
+#include "../../netconf_internal.h"
+#include "../../error.h"
+#include "../../session.h"
+#include "../../nacm.h"
+#include "../datastore_internal.h"
+#include "datastore_sqlite.h"
+#include "../edit_config.h"
+#include "../schema.h"
+
+static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
+
+/*
+ * Path of a record is the path of its parent record followed by '/' and the
+ * node name with the values of the list keys, the top level leaves are kept
+ * in the record with the empty path. The subtree of the record P is then the
+ * record itself and the records with the path between "P/" and "P0" ('0'
+ * follows '/' in ASCII).
+ */
+static const char* sqlite_tables =
+	"CREATE TABLE IF NOT EXISTS records (ds INTEGER NOT NULL, path TEXT NOT NULL, parent TEXT, name TEXT NOT NULL,"
+	" pos REAL NOT NULL, data TEXT NOT NULL, PRIMARY KEY (ds, path)) WITHOUT ROWID;"
+	"CREATE INDEX IF NOT EXISTS records_children ON records (ds, parent, pos);"
+	"CREATE INDEX IF NOT EXISTS records_names ON records (ds, parent, name);"
+	"CREATE TABLE IF NOT EXISTS undo (ds INTEGER NOT NULL, path TEXT NOT NULL, parent TEXT, name TEXT,"
+	" pos REAL, data TEXT, PRIMARY KEY (ds, path)) WITHOUT ROWID;"
+	"CREATE TABLE IF NOT EXISTS datastores (ds INTEGER PRIMARY KEY, lock TEXT, locktime TEXT,"
+	" modified INTEGER NOT NULL DEFAULT 0, generation INTEGER NOT NULL DEFAULT 0);"
+	"INSERT OR IGNORE INTO datastores (ds) VALUES (0), (1), (2);";
+
+#define SQLITE_RECORD "SELECT path, parent, pos, data FROM records WHERE ds = ?1"
+#define SQLITE_SUBTREE "(path = ?2 OR (path > ?2 || '/' AND path < ?2 || '0'))"
+
+/* indexed by DS_SQL_STMT */
+static const char* sqlite_statements[DS_SQL_COUNT] = {
+	"BEGIN",
+	"BEGIN IMMEDIATE",
+	"COMMIT",
+	"ROLLBACK",
+	SQLITE_RECORD " ORDER BY parent, pos",
+	SQLITE_RECORD " AND path = ?2",
+	SQLITE_RECORD " AND " SQLITE_SUBTREE " ORDER BY parent, pos",
+	SQLITE_RECORD " AND parent = ?2 AND name = ?3 ORDER BY pos",
+	SQLITE_RECORD " AND path >= ?2 AND path < ?3 ORDER BY parent, pos",
+	"SELECT 1 FROM records WHERE ds = ?1 LIMIT 1",
+	"INSERT OR REPLACE INTO records (ds, path, parent, name, pos, data) VALUES (?1, ?2, ?3, ?4, ?5, ?6)",
+	"UPDATE records SET data = ?3 WHERE ds = ?1 AND path = ?2",
+	"UPDATE records SET pos = ?3 WHERE ds = ?1 AND path = ?2",
+	"DELETE FROM records WHERE ds = ?1 AND path = ?2",
+	"DELETE FROM records WHERE ds = ?1 AND " SQLITE_SUBTREE,
+	"DELETE FROM records WHERE ds = ?1",
+	"INSERT INTO records (ds, path, parent, name, pos, data) SELECT ?1, path, parent, name, pos, data FROM records WHERE ds = ?2",
+	"SELECT MAX(pos) FROM records WHERE ds = ?1 AND parent = ?2 AND pos < ?3",
+	"SELECT path FROM records WHERE ds = ?1 AND parent = ?2 ORDER BY pos",
+	"DELETE FROM undo",
+	"INSERT OR IGNORE INTO undo SELECT ds, path, parent, name, pos, data FROM records WHERE ds = ?1 AND path = ?2",
+	"INSERT OR IGNORE INTO undo SELECT ds, path, parent, name, pos, data FROM records WHERE ds = ?1 AND " SQLITE_SUBTREE,
+	"INSERT OR IGNORE INTO undo SELECT ds, path, parent, name, pos, data FROM records WHERE ds = ?1",
+	"INSERT OR IGNORE INTO undo (ds, path) VALUES (?1, ?2)",
+	"INSERT OR IGNORE INTO undo (ds, path) SELECT ds, path FROM records WHERE ds = ?1",
+	"DELETE FROM records WHERE EXISTS (SELECT 1 FROM undo WHERE undo.ds = records.ds AND undo.path = records.path)",
+	"INSERT INTO records SELECT ds, path, parent, name, pos, data FROM undo WHERE data IS NOT NULL",
+	"SELECT lock, locktime, modified, generation FROM datastores WHERE ds = ?1",
+	"UPDATE datastores SET lock = ?2, locktime = ?3 WHERE ds = ?1",
+	"UPDATE datastores SET modified = ?2 WHERE ds = ?1",
+	"UPDATE datastores SET generation = generation + 1",
+	"PRAGMA data_version"
+};
+
+/**
+ * @brief Record loaded from the database.
+ */
+struct sqlite_rec {
+	/**
+	 * position of the record among its siblings
+	 */
+	double pos;
+	/**
+	 * content of the record as stored, NULL for the records created by the change
+	 */
+	char* data;
+	/**
+	 * the record was found in the changed document
+	 */
+	int seen;
+};
+
+/**
+ * @brief Part of the datastore loaded into the document.
+ */
+struct sqlite_load {
+	struct ncds_ds_sqlite* sqlite_ds;
+	const struct schema* schema;
+	int part;
+	/**
+	 * loaded records, the top level nodes are the document's children
+	 */
+	xmlDocPtr doc;
+	/**
+	 * loaded records (struct sqlite_rec) hashed by their paths
+	 */
+	xmlHashTablePtr recs;
+	/**
+	 * nodes of the loaded records hashed by their paths, valid only until
+	 * the document is changed
+	 */
+	xmlHashTablePtr nodes;
+	/**
+	 * paths of the records with all their choice members loaded
+	 */
+	xmlHashTablePtr choices;
+	/**
+	 * the changes are recorded for the rollback record by record
+	 */
+	int undo;
+};
+
+/**
+ * @brief Child record of the stored node.
+ */
+struct sqlite_child {
+	xmlNodePtr node;
+	const struct schema_node* snode;
+	char* path;
+	char* name;
+	struct sqlite_rec* rec;
+};
+
+API int ncds_sqlite_set_path(struct ncds_ds* datastore, const char* path)
+{
+	struct ncds_ds_sqlite* sqlite_ds = (struct ncds_ds_sqlite*)datastore;
+
+	if (datastore == NULL || datastore->type != NCDS_TYPE_SQLITE) {
+		ERROR("%s: invalid datastore.", __func__);
+		return (EXIT_FAILURE);
+	}
+	if (path == NULL || strlen(path) == 0) {
+		ERROR("%s: invalid path.", __func__);
+		return (EXIT_FAILURE);
+	}
+	if (sqlite_ds->db != NULL) {
+		ERROR("%s: the datastore is already initiated.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	free(sqlite_ds->path);
+	sqlite_ds->path = strdup(path);
+
+	return (EXIT_SUCCESS);
+}
+
+static int sqlite_part(NC_DATASTORE target)
+{
+	switch (target) {
+	case NC_DATASTORE_RUNNING:
+		return (0);
+	case NC_DATASTORE_STARTUP:
+		return (1);
+	case NC_DATASTORE_CANDIDATE:
+		return (2);
+	default:
+		return (-1);
+	}
+}
+
+/**
+ * @brief Prepare the statement for the execution.
+ *
+ * @param sqlite_ds Datastore.
+ * @param id Statement.
+ * @param part Index of the datastore bound as the first parameter, -1 for none.
+ * @param path Record path bound as the second parameter, NULL for none. It
+ * MUST be valid until the statement is executed.
+ *
+ * @return The statement.
+ */
+static sqlite3_stmt* sqlite_stmt(struct ncds_ds_sqlite* sqlite_ds, DS_SQL_STMT id, int part, const char* path)
+{
+	sqlite3_stmt* stmt = sqlite_ds->stmt[id];
+
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	if (part != -1) {
+		sqlite3_bind_int(stmt, 1, part);
+	}
+	if (path != NULL) {
+		sqlite3_bind_text(stmt, 2, path, -1, SQLITE_STATIC);
+	}
+
+	return (stmt);
+}
+
+/**
+ * @brief Execute the statement (ignoring its result rows).
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int sqlite_exec(struct ncds_ds_sqlite* sqlite_ds, sqlite3_stmt* stmt)
+{
+	int ret;
+
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW);
+	sqlite3_reset(stmt);
+	if (ret != SQLITE_DONE) {
+		ERROR("SQLite datastore %s: %s.", sqlite_ds->path, sqlite3_errmsg(sqlite_ds->db));
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static int sqlite_begin(struct ncds_ds_sqlite* sqlite_ds, int write)
+{
+	sqlite_ds->change.part = -1;
+	return (sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, write ? DS_SQL_BEGIN_WRITE : DS_SQL_BEGIN_READ, -1, NULL)));
+}
+
+/**
+ * @brief Finish the transaction, it is rolled back if the commit fails.
+ *
+ * @return EXIT_SUCCESS if committed, EXIT_FAILURE else.
+ */
+static int sqlite_end(struct ncds_ds_sqlite* sqlite_ds, int commit)
+{
+	if (commit && sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_COMMIT, -1, NULL)) == EXIT_SUCCESS) {
+		if (sqlite_ds->change.part != -1) {
+			/* the committed change can be rolled back */
+			sqlite_ds->backup.part = sqlite_ds->change.part;
+			sqlite_ds->backup.generation = sqlite_ds->change.generation;
+			sqlite_ds->changed = 1;
+		}
+		return (EXIT_SUCCESS);
+	}
+	sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_ROLLBACK, -1, NULL));
+
+	return (EXIT_FAILURE);
+}
+
+/**
+ * @brief Keep the original content of the record (or the whole subtree) in
+ * the undo table before it is changed.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int sqlite_undo(struct ncds_ds_sqlite* sqlite_ds, int part, const char* path, int subtree)
+{
+	if (sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, subtree ? DS_SQL_UNDO_SAVE : DS_SQL_UNDO_SAVE_PATH, part, path)) != EXIT_SUCCESS ||
+			/* the record did not exist */
+			sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_UNDO_NEW, part, path)) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Start recording the change of the whole datastore for the rollback.
+ */
+static int sqlite_undo_all(struct ncds_ds_sqlite* sqlite_ds, int part)
+{
+	if (sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_UNDO_CLEAR, -1, NULL)) != EXIT_SUCCESS ||
+			sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_UNDO_SAVE_ALL, part, NULL)) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Set the modified flag of the (candidate) datastore.
+ */
+static int sqlite_modified(struct ncds_ds_sqlite* sqlite_ds, int part, int modified)
+{
+	sqlite3_stmt* stmt = sqlite_stmt(sqlite_ds, DS_SQL_SET_MODIFIED, part, NULL);
+
+	sqlite3_bind_int(stmt, 2, modified);
+	return (sqlite_exec(sqlite_ds, stmt));
+}
+
+/**
+ * @brief Finish the change of the datastore - remember it for the rollback and
+ * for the change detection. It MUST be called inside the write transaction.
+ *
+ * The generations of all the datastores are increased, the undo table is
+ * shared by them, so the rollback is possible only if no other datastore was
+ * changed since.
+ *
+ * @param sqlite_ds Datastore.
+ * @param part Index of the changed datastore.
+ * @param modified New value of the candidate's modified flag, -1 to keep it.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int sqlite_changed(struct ncds_ds_sqlite* sqlite_ds, int part, int modified)
+{
+	sqlite3_stmt* stmt;
+
+	if (sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_TOUCH, -1, NULL)) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+	if (modified != -1 && sqlite_modified(sqlite_ds, part, modified) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
+	stmt = sqlite_stmt(sqlite_ds, DS_SQL_GET_INFO, part, NULL);
+	if (sqlite3_step(stmt) != SQLITE_ROW) {
+		sqlite3_reset(stmt);
+		ERROR("SQLite datastore %s: %s.", sqlite_ds->path, sqlite3_errmsg(sqlite_ds->db));
+		return (EXIT_FAILURE);
+	}
+	sqlite_ds->change.part = part;
+	sqlite_ds->change.generation = sqlite3_column_int64(stmt, 3);
+	sqlite3_reset(stmt);
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Get the ID of the session holding the NETCONF lock of the datastore.
+ *
+ * @return 0 if not locked, 1 if locked, -1 on error.
+ */
+static int sqlite_lock_get(struct ncds_ds_sqlite* sqlite_ds, int part, char** sid, char** time, int* modified)
+{
+	sqlite3_stmt* stmt = sqlite_stmt(sqlite_ds, DS_SQL_GET_INFO, part, NULL);
+	const char* lock;
+	int ret;
+
+	if (sqlite3_step(stmt) != SQLITE_ROW) {
+		sqlite3_reset(stmt);
+		ERROR("SQLite datastore %s: %s.", sqlite_ds->path, sqlite3_errmsg(sqlite_ds->db));
+		return (-1);
+	}
+	lock = (const char*)sqlite3_column_text(stmt, 0);
+	ret = (lock != NULL && lock[0] != '\0');
+	if (ret && sid != NULL) {
+		*sid = strdup(lock);
+	}
+	if (ret && time != NULL) {
+		*time = strdup((sqlite3_column_text(stmt, 1) != NULL) ? (const char*)sqlite3_column_text(stmt, 1) : "");
+	}
+	if (modified != NULL) {
+		*modified = sqlite3_column_int(stmt, 2);
+	}
+	sqlite3_reset(stmt);
+
+	return (ret);
+}
+
+/**
+ * @brief Determine if the datastore is accessible (is not NETCONF locked) for
+ * the specified session. It MUST be called inside a transaction.
+ *
+ * @return 0 when the session can work with the datastore, non-zero else.
+ */
+static int sqlite_access(struct ncds_ds_sqlite* sqlite_ds, int part, const struct nc_session* session)
+{
+	char* sid = NULL;
+	int ret;
+
+	if ((ret = sqlite_lock_get(sqlite_ds, part, &sid, NULL, NULL)) == 1) {
+		ret = (session == NULL || strcmp(sid, session->session_id) != 0);
+	}
+	free(sid);
+
+	return (ret);
+}
+
+static const struct schema_node* sqlite_schema(const struct schema* schema, const struct schema_node* psnode, xmlNodePtr node)
+{
+	if (schema == NULL || node->type != XML_ELEMENT_NODE) {
+		return (NULL);
+	} else if (psnode == NULL) {
+		return (xmlHashLookup(schema->roots, node->name));
+	} else if (psnode->children == NULL) {
+		return (NULL);
+	}
+
+	return (xmlHashLookup(psnode->children, node->name));
+}
+
+static xmlNodePtr sqlite_key(xmlNodePtr node, const xmlChar* name)
+{
+	xmlNodePtr child;
+
+	for (child = node->children; child != NULL; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE && xmlStrEqual(child->name, name)) {
+			return (child);
+		}
+	}
+
+	return (NULL);
+}
+
+/**
+ * @brief Get the schema node of the data node stored as a separate record -
+ * a container or a list entry with all its keys. The other nodes are stored
+ * in the record of their parent.
+ */
+static const struct schema_node* sqlite_record(const struct schema* schema, const struct schema_node* psnode, xmlNodePtr node)
+{
+	const struct schema_node* snode;
+	int i;
+
+	if ((snode = sqlite_schema(schema, psnode, node)) == NULL) {
+		return (NULL);
+	} else if (snode->type == SCHEMA_CONTAINER) {
+		return (snode);
+	} else if (snode->type != SCHEMA_LIST || snode->keys_count == 0) {
+		return (NULL);
+	}
+
+	for (i = 0; i < snode->keys_count; i++) {
+		if (sqlite_key(node, snode->keys[i]) == NULL) {
+			return (NULL);
+		}
+	}
+
+	return (snode);
+}
+
+/**
+ * @brief Check if the schema node is placed in a choice.
+ */
+static int sqlite_choice_member(const struct schema_node* snode)
+{
+	xmlNodePtr yin;
+
+	for (yin = snode->yin->parent; yin != NULL && yin->type == XML_ELEMENT_NODE; yin = yin->parent) {
+		if (snode->parent != NULL && yin == snode->parent->yin) {
+			break;
+		} else if (xmlStrEqual(yin->name, BAD_CAST "choice")) {
+			return (1);
+		} else if (xmlStrEqual(yin->name, BAD_CAST "augment") || xmlStrEqual(yin->name, BAD_CAST "module") ||
+				xmlStrEqual(yin->name, BAD_CAST "submodule")) {
+			break;
+		}
+	}
+
+	return (0);
+}
+
+/**
+ * @brief Namespace of the node, the namespace of its parent for the nodes
+ * without a namespace (or with the NETCONF base namespace used by the subtree
+ * filters as the wildcard).
+ */
+static const xmlChar* sqlite_ns(xmlNodePtr node, const xmlChar* pns)
+{
+	if (node->ns == NULL || node->ns->href == NULL || xmlStrEqual(node->ns->href, BAD_CAST NC_NS_BASE10)) {
+		return (pns);
+	}
+
+	return (node->ns->href);
+}
+
+static void sqlite_escape(xmlBufferPtr buf, const xmlChar* value)
+{
+	char hex[4];
+
+	for (; *value != '\0'; value++) {
+		if (*value < 0x20 || strchr("%/[]{}", *value) != NULL) {
+			snprintf(hex, sizeof(hex), "%%%02X", *value);
+			xmlBufferCCat(buf, hex);
+		} else {
+			xmlBufferAdd(buf, value, 1);
+		}
+	}
+}
+
+/**
+ * @brief Get the path of the record.
+ *
+ * @param[in] ppath Path of the parent record.
+ * @param[in] pns Namespace of the parent node.
+ * @param[in] snode Schema node of the record.
+ * @param[in] node Data node, edit node or subtree filter node of the record.
+ * @param[in] filter The node is a subtree filter node, its list keys are
+ * used only if they are content match nodes.
+ * @param[out] name Name of the record without the list keys, it is not set
+ * if NULL.
+ *
+ * @return Path of the record, NULL if the list keys are not available.
+ */
+static char* sqlite_path(const char* ppath, const xmlChar* pns, const struct schema_node* snode, xmlNodePtr node, int filter, char** name)
+{
+	xmlBufferPtr buf;
+	xmlNodePtr key;
+	xmlChar* value;
+	const xmlChar* ns;
+	char* retval = NULL;
+	int i, ok = 1;
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	if ((ns = sqlite_ns(node, pns)) != NULL && pns != NULL && !xmlStrEqual(ns, pns)) {
+		xmlBufferCCat(buf, "{");
+		sqlite_escape(buf, ns);
+		xmlBufferCCat(buf, "}");
+	}
+	xmlBufferCat(buf, node->name);
+	if (name != NULL) {
+		*name = strdup((char*)xmlBufferContent(buf));
+	}
+
+	for (i = 0; ok && snode->type == SCHEMA_LIST && i < snode->keys_count; i++) {
+		if ((key = sqlite_key(node, snode->keys[i])) == NULL) {
+			ok = 0;
+			break;
+		}
+		value = xmlNodeGetContent(key);
+		if (filter && (value == NULL || value[0] == '\0' || xmlFirstElementChild(key) != NULL ||
+				isspace(value[0]) || isspace(value[xmlStrlen(value) - 1]))) {
+			/* not a content match node usable for the key */
+			ok = 0;
+		} else {
+			xmlBufferCCat(buf, "[");
+			xmlBufferCat(buf, snode->keys[i]);
+			xmlBufferCCat(buf, "=");
+			sqlite_escape(buf, (value != NULL) ? value : BAD_CAST "");
+			xmlBufferCCat(buf, "]");
+		}
+		xmlFree(value);
+	}
+
+	if (ok && asprintf(&retval, "%s/%s", ppath, (char*)xmlBufferContent(buf)) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		retval = NULL;
+	}
+	xmlBufferFree(buf);
+
+	return (retval);
+}
+
+/**
+ * @brief Serialize the content of the record - the node without its child
+ * records. The child records are moved after the other children of the node.
+ *
+ * @param[in] ld Loaded datastore.
+ * @param[in] snode Schema node of the record, NULL for the top level record.
+ * @param[in] node Node of the record, NULL for the top level record.
+ * @param[out] empty Set if the record has no content except its child records.
+ *
+ * @return Serialized record, NULL on error.
+ */
+static char* sqlite_dump(struct sqlite_load* ld, const struct schema_node* snode, xmlNodePtr node, int* empty)
+{
+	xmlNodePtr parent = (node != NULL) ? node : (xmlNodePtr)ld->doc;
+	xmlNodePtr holder, child, next, copy = NULL;
+	xmlDocPtr doc;
+	xmlBufferPtr buf;
+	char* retval = NULL;
+
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	holder = xmlNewDocNode(ld->doc, NULL, BAD_CAST "records", NULL);
+	buf = xmlBufferCreate();
+	if (doc == NULL || holder == NULL || buf == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		goto cleanup;
+	}
+
+	/* detach the child records */
+	for (child = parent->children; child != NULL; child = next) {
+		next = child->next;
+		if (sqlite_record(ld->schema, snode, child) != NULL) {
+			xmlUnlinkNode(child);
+			xmlAddChild(holder, child);
+		}
+	}
+	*empty = (parent->children == NULL);
+
+	/* the copy declares all the namespaces it uses */
+	if (node == NULL) {
+		if ((copy = xmlNewDocNode(doc, NULL, BAD_CAST "config", NULL)) != NULL) {
+			for (child = parent->children; child != NULL; child = child->next) {
+				xmlAddChild(copy, xmlDocCopyNode(child, doc, 1));
+			}
+		}
+	} else {
+		copy = xmlDocCopyNode(node, doc, 1);
+	}
+	if (copy == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+	} else {
+		xmlDocSetRootElement(doc, copy);
+		xmlNodeDump(buf, doc, copy, 0, 0);
+		retval = strdup((char*)xmlBufferContent(buf));
+	}
+
+	/* put the child records back */
+	while ((child = holder->children) != NULL) {
+		xmlUnlinkNode(child);
+		xmlAddChild(parent, child);
+	}
+
+cleanup:
+	xmlFreeNode(holder);
+	xmlBufferFree(buf);
+	xmlFreeDoc(doc);
+
+	return (retval);
+}
+
+static void sqlite_rec_free(void* payload, const xmlChar* UNUSED(name))
+{
+	struct sqlite_rec* rec = (struct sqlite_rec*)payload;
+
+	free(rec->data);
+	free(rec);
+}
+
+static int sqlite_load_init(struct sqlite_load* ld, struct ncds_ds_sqlite* sqlite_ds, int part)
+{
+	memset(ld, 0, sizeof(struct sqlite_load));
+	ld->sqlite_ds = sqlite_ds;
+	ld->schema = schema_get(sqlite_ds->ds.ext_model);
+	ld->part = part;
+	ld->doc = xmlNewDoc(BAD_CAST "1.0");
+	ld->recs = xmlHashCreate(64);
+	ld->nodes = xmlHashCreate(64);
+	ld->choices = xmlHashCreate(8);
+	if (ld->doc == NULL || ld->recs == NULL || ld->nodes == NULL || ld->choices == NULL ||
+			xmlHashAddEntry(ld->nodes, BAD_CAST "", ld->doc) != 0) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static void sqlite_load_clean(struct sqlite_load* ld)
+{
+	if (ld->recs != NULL) {
+		xmlHashFree(ld->recs, sqlite_rec_free);
+	}
+	if (ld->nodes != NULL) {
+		xmlHashFree(ld->nodes, NULL);
+	}
+	if (ld->choices != NULL) {
+		xmlHashFree(ld->choices, NULL);
+	}
+	xmlFreeDoc(ld->doc);
+}
+
+/**
+ * @brief Place the loaded record among its siblings, the child records
+ * follow the other children ordered by their positions.
+ */
+static void sqlite_attach(xmlNodePtr parent, xmlNodePtr node, double pos)
+{
+	xmlNodePtr sibling, first = NULL;
+
+	for (sibling = parent->last; sibling != NULL; sibling = sibling->prev) {
+		if (sibling->type != XML_ELEMENT_NODE || sibling->_private == NULL) {
+			continue;
+		} else if (((struct sqlite_rec*)sibling->_private)->pos < pos) {
+			xmlAddNextSibling(sibling, node);
+			return;
+		}
+		first = sibling;
+	}
+
+	if (first != NULL) {
+		xmlAddPrevSibling(first, node);
+	} else {
+		xmlAddChild(parent, node);
+	}
+}
+
+/**
+ * @brief Add the records selected by the executed statement into the loaded
+ * document. The parent of each record must be already loaded or it must
+ * precede the record in the result.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int sqlite_load_rows(struct sqlite_load* ld, sqlite3_stmt* stmt)
+{
+	struct sqlite_rec* rec;
+	xmlDocPtr rec_doc;
+	xmlNodePtr parent, node, child;
+	const char* path, *ppath, *data;
+	int ret;
+
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		path = (const char*)sqlite3_column_text(stmt, 0);
+		ppath = (const char*)sqlite3_column_text(stmt, 1);
+		data = (const char*)sqlite3_column_text(stmt, 3);
+		if (path == NULL || data == NULL || xmlHashLookup(ld->recs, BAD_CAST path) != NULL) {
+			/* already loaded */
+			continue;
+		}
+		if ((parent = xmlHashLookup(ld->nodes, BAD_CAST ((ppath != NULL) ? ppath : ""))) == NULL) {
+			WARN("SQLite datastore %s: record %s without its parent ignored.", ld->sqlite_ds->path, path);
+			continue;
+		}
+
+		if ((rec_doc = xmlReadMemory(data, strlen(data), NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL ||
+				(node = xmlDocCopyNode(xmlDocGetRootElement(rec_doc), ld->doc, 1)) == NULL) {
+			xmlFreeDoc(rec_doc);
+			ERROR("SQLite datastore %s: invalid record %s.", ld->sqlite_ds->path, path);
+			sqlite3_reset(stmt);
+			return (EXIT_FAILURE);
+		}
+		xmlFreeDoc(rec_doc);
+
+		if ((rec = calloc(1, sizeof(struct sqlite_rec))) == NULL || (rec->data = strdup(data)) == NULL ||
+				xmlHashAddEntry(ld->recs, BAD_CAST path, rec) != 0) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			if (rec != NULL) {
+				free(rec->data);
+				free(rec);
+			}
+			xmlFreeNode(node);
+			sqlite3_reset(stmt);
+			return (EXIT_FAILURE);
+		}
+		rec->pos = sqlite3_column_double(stmt, 2);
+
+		if (ppath == NULL) {
+			/* the top level leaves, they precede the top level records */
+			while ((child = node->last) != NULL) {
+				xmlUnlinkNode(child);
+				if (ld->doc->children != NULL) {
+					xmlAddPrevSibling(ld->doc->children, child);
+				} else {
+					xmlAddChild((xmlNodePtr)ld->doc, child);
+				}
+			}
+			xmlFreeNode(node);
+		} else {
+			node->_private = rec;
+			sqlite_attach(parent, node, rec->pos);
+			xmlHashAddEntry(ld->nodes, BAD_CAST path, node);
+		}
+	}
+	sqlite3_reset(stmt);
+
+	if (ret != SQLITE_DONE) {
+		ERROR("SQLite datastore %s: %s.", ld->sqlite_ds->path, sqlite3_errmsg(ld->sqlite_ds->db));
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static int sqlite_load_path(struct sqlite_load* ld, const char* path)
+{
+	return (sqlite_load_rows(ld, sqlite_stmt(ld->sqlite_ds, DS_SQL_GET_PATH, ld->part, path)));
+}
+
+static int sqlite_load_subtree(struct sqlite_load* ld, const char* path)
+{
+	return (sqlite_load_rows(ld, sqlite_stmt(ld->sqlite_ds, DS_SQL_GET_SUBTREE, ld->part, path)));
+}
+
+static int sqlite_load_all(struct sqlite_load* ld)
+{
+	return (sqlite_load_rows(ld, sqlite_stmt(ld->sqlite_ds, DS_SQL_GET_ALL, ld->part, NULL)));
+}
+
+/**
+ * @brief Load the records of the given name (all the list entries) without
+ * their subtrees.
+ */
+static int sqlite_load_named(struct sqlite_load* ld, const char* ppath, const char* name)
+{
+	sqlite3_stmt* stmt = sqlite_stmt(ld->sqlite_ds, DS_SQL_GET_NAMED, ld->part, ppath);
+
+	sqlite3_bind_text(stmt, 3, name, -1, SQLITE_STATIC);
+	return (sqlite_load_rows(ld, stmt));
+}
+
+/**
+ * @brief Load the list entries of the given name with their subtrees.
+ */
+static int sqlite_load_list(struct sqlite_load* ld, const char* ppath, const char* name)
+{
+	sqlite3_stmt* stmt;
+	char* from, *to;
+	int ret;
+
+	/* the paths of the entries continue with '[' followed by '\' in ASCII */
+	if (asprintf(&from, "%s/%s[", ppath, name) == -1 || asprintf(&to, "%s/%s\\", ppath, name) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	stmt = sqlite_stmt(ld->sqlite_ds, DS_SQL_GET_RANGE, ld->part, from);
+	sqlite3_bind_text(stmt, 3, to, -1, SQLITE_STATIC);
+	ret = sqlite_load_rows(ld, stmt);
+	free(from);
+	free(to);
+
+	return (ret);
+}
+
+struct sqlite_choices {
+	struct sqlite_load* ld;
+	const char* ppath;
+	int ret;
+};
+
+static void sqlite_load_choice(void* payload, void* data, const xmlChar* name)
+{
+	const struct schema_node* snode = (const struct schema_node*)payload;
+	struct sqlite_choices* choices = (struct sqlite_choices*)data;
+
+	if (choices->ret == EXIT_SUCCESS && (snode->type == SCHEMA_CONTAINER || snode->type == SCHEMA_LIST) && sqlite_choice_member(snode)) {
+		choices->ret = sqlite_load_named(choices->ld, choices->ppath, (const char*)name);
+	}
+}
+
+/**
+ * @brief Load the child records placed in choices, the edit of a choice's case
+ * removes the other cases.
+ */
+static int sqlite_load_choices(struct sqlite_load* ld, const struct schema_node* psnode, const char* ppath)
+{
+	struct sqlite_choices choices = {ld, ppath, EXIT_SUCCESS};
+	xmlHashTablePtr children = (psnode != NULL) ? psnode->children : ld->schema->roots;
+
+	if (children == NULL || xmlHashLookup(ld->choices, BAD_CAST ppath) != NULL) {
+		return (EXIT_SUCCESS);
+	}
+	xmlHashAddEntry(ld->choices, BAD_CAST ppath, ld);
+	xmlHashScan(children, sqlite_load_choice, &choices);
+
+	return (choices.ret);
+}
+
+/**
+ * @brief Load the records changed by the edit-config.
+ *
+ * The records of the nodes with the merge (or no) operation are loaded
+ * without their subtrees, the other operations require the whole subtree.
+ * All the entries of the user ordered lists are loaded for the positional
+ * insertion as well as the records placed in choices for the removal of the
+ * other cases.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int sqlite_load_edit(struct sqlite_load* ld, const struct schema_node* psnode, const char* ppath, const xmlChar* pns, xmlNodePtr edit)
+{
+	const struct schema_node* snode;
+	xmlChar* op;
+	char* path, *name = NULL;
+	int ret = EXIT_SUCCESS;
+
+	for (; ret == EXIT_SUCCESS && edit != NULL; edit = edit->next) {
+		if ((snode = sqlite_schema(ld->schema, psnode, edit)) == NULL) {
+			continue;
+		}
+		if (sqlite_choice_member(snode) && sqlite_load_choices(ld, psnode, ppath) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+		if (snode->type != SCHEMA_CONTAINER && (snode->type != SCHEMA_LIST || snode->keys_count == 0)) {
+			/* stored in the parent record */
+			continue;
+		}
+
+		path = sqlite_path(ppath, pns, snode, edit, 0, &name);
+		if (name == NULL) {
+			free(path);
+			return (EXIT_FAILURE);
+		}
+		if (snode->flags & SCHEMA_ORDERED_USER || path == NULL) {
+			/* the siblings are needed for the insertion, or to report the missing keys */
+			ret = sqlite_load_named(ld, ppath, name);
+		}
+
+		op = xmlGetNsProp(edit, BAD_CAST "operation", BAD_CAST NC_NS_BASE);
+		if (ret != EXIT_SUCCESS || path == NULL) {
+			/* nothing more to load */
+		} else if (op != NULL && !xmlStrEqual(op, BAD_CAST "merge")) {
+			ret = sqlite_load_subtree(ld, path);
+		} else if ((ret = sqlite_load_path(ld, path)) == EXIT_SUCCESS && xmlHashLookup(ld->nodes, BAD_CAST path) != NULL) {
+			ret = sqlite_load_edit(ld, snode, path, sqlite_ns(edit, pns), edit->children);
+		}
+		xmlFree(op);
+		free(path);
+		free(name);
+		name = NULL;
+	}
+
+	return (ret);
+}
+
+/**
+ * @brief Load the records possibly selected by the subtree filter. The
+ * selection is not exact, the filter is applied to the loaded data.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int sqlite_load_filter(struct sqlite_load* ld, const struct schema_node* psnode, const char* ppath, const xmlChar* pns, xmlNodePtr filter)
+{
+	const struct schema_node* snode;
+	xmlNodePtr child;
+	xmlChar* value;
+	char* path, *name = NULL;
+	int ret = EXIT_SUCCESS, containment;
+
+	for (; ret == EXIT_SUCCESS && filter != NULL; filter = filter->next) {
+		if ((snode = sqlite_schema(ld->schema, psnode, filter)) == NULL ||
+				(snode->type != SCHEMA_CONTAINER && (snode->type != SCHEMA_LIST || snode->keys_count == 0))) {
+			/* stored in the parent record */
+			continue;
+		}
+
+		/* without selection or containment nodes, the whole subtree is selected */
+		containment = 0;
+		for (child = xmlFirstElementChild(filter); child != NULL && !containment; child = xmlNextElementSibling(child)) {
+			value = xmlNodeGetContent(child);
+			containment = (xmlFirstElementChild(child) != NULL || value == NULL || xmlStrlen(value) == 0);
+			xmlFree(value);
+		}
+
+		path = sqlite_path(ppath, pns, snode, filter, 1, &name);
+		if (name == NULL) {
+			free(path);
+			return (EXIT_FAILURE);
+		}
+		if (path == NULL) {
+			/* all the list entries are candidates */
+			ret = sqlite_load_list(ld, ppath, name);
+		} else if (!containment) {
+			ret = sqlite_load_subtree(ld, path);
+		} else if ((ret = sqlite_load_path(ld, path)) == EXIT_SUCCESS && xmlHashLookup(ld->nodes, BAD_CAST path) != NULL) {
+			ret = sqlite_load_filter(ld, snode, path, sqlite_ns(filter, pns), filter->children);
+		}
+		free(path);
+		free(name);
+		name = NULL;
+	}
+
+	return (ret);
+}
+
+/**
+ * @brief Remove the loader's marks from the loaded nodes before the document is
+ * processed by the rest of the library.
+ */
+static void sqlite_unmark(xmlNodePtr node)
+{
+	for (; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE) {
+			node->_private = NULL;
+			sqlite_unmark(node->children);
+		}
+	}
+}
+
+/**
+ * @brief Give all the child records of the parent new positions following
+ * their order, there is no room left between some of them.
+ */
+static int sqlite_renumber(struct sqlite_load* ld, const char* ppath)
+{
+	struct ncds_ds_sqlite* sqlite_ds = ld->sqlite_ds;
+	struct sqlite_rec* rec;
+	sqlite3_stmt* stmt;
+	char** paths = NULL, **aux;
+	int count = 0, i, ret = EXIT_SUCCESS;
+
+	stmt = sqlite_stmt(sqlite_ds, DS_SQL_CHILDREN, ld->part, ppath);
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		if ((aux = realloc(paths, (count + 1) * sizeof(char*))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			break;
+		}
+		paths = aux;
+		paths[count++] = strdup((const char*)sqlite3_column_text(stmt, 0));
+	}
+	sqlite3_reset(stmt);
+	ret = (ret == SQLITE_DONE) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	for (i = 0; i < count; i++) {
+		if (ret == EXIT_SUCCESS && ld->undo) {
+			ret = sqlite_undo(sqlite_ds, ld->part, paths[i], 0);
+		}
+		if (ret == EXIT_SUCCESS) {
+			stmt = sqlite_stmt(sqlite_ds, DS_SQL_SET_POS, ld->part, paths[i]);
+			sqlite3_bind_double(stmt, 3, i + 1);
+			ret = sqlite_exec(sqlite_ds, stmt);
+		}
+		if (ret == EXIT_SUCCESS && (rec = xmlHashLookup(ld->recs, BAD_CAST paths[i])) != NULL) {
+			rec->pos = i + 1;
+		}
+		free(paths[i]);
+	}
+	free(paths);
+
+	return (ret);
+}
+
+/**
+ * @brief Find a position for the child record placed before the given one.
+ *
+ * @param[in] ld Loaded datastore.
+ * @param[in] ppath Path of the parent record.
+ * @param[in] upper Position of the following child record, DBL_MAX if none.
+ * @param[out] pos Position between the following record and the preceding
+ * record in the database.
+ *
+ * @return EXIT_SUCCESS, EXIT_FAILURE or 1 if the records were renumbered and
+ * the position must be looked up again.
+ */
+static int sqlite_position(struct sqlite_load* ld, const char* ppath, double upper, double* pos)
+{
+	sqlite3_stmt* stmt = sqlite_stmt(ld->sqlite_ds, DS_SQL_MAX_POS, ld->part, ppath);
+	double lower;
+	int ret;
+
+	sqlite3_bind_double(stmt, 3, upper);
+	if ((ret = sqlite3_step(stmt)) != SQLITE_ROW) {
+		sqlite3_reset(stmt);
+		ERROR("SQLite datastore %s: %s.", ld->sqlite_ds->path, sqlite3_errmsg(ld->sqlite_ds->db));
+		return (EXIT_FAILURE);
+	}
+	if (sqlite3_column_type(stmt, 0) == SQLITE_NULL) {
+		*pos = (upper == DBL_MAX) ? 1 : upper - 1;
+		sqlite3_reset(stmt);
+		return (EXIT_SUCCESS);
+	}
+	lower = sqlite3_column_double(stmt, 0);
+	sqlite3_reset(stmt);
+
+	if (upper == DBL_MAX) {
+		*pos = lower + 1;
+	} else {
+		*pos = lower + (upper - lower) / 2;
+		if (*pos <= lower || *pos >= upper) {
+			return ((sqlite_renumber(ld, ppath) == EXIT_SUCCESS) ? 1 : EXIT_FAILURE);
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static void sqlite_children_free(struct sqlite_child* children, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		free(children[i].path);
+		free(children[i].name);
+	}
+	free(children);
+}
+
+/**
+ * @brief Get the lowest position of the existing records following each child.
+ */
+static void sqlite_upper(struct sqlite_child* children, int count, double* upper)
+{
+	struct sqlite_rec* rec;
+	int i;
+
+	upper[count] = DBL_MAX;
+	for (i = count - 1; i >= 0; i--) {
+		rec = children[i].rec;
+		upper[i] = (rec != NULL && rec->data != NULL && rec->pos < upper[i + 1]) ? rec->pos : upper[i + 1];
+	}
+}
+
+/**
+ * @brief Write the changed child records of the node (and their subtrees)
+ * into the database.
+ *
+ * @param[in] ld Loaded datastore with the changed document.
+ * @param[in] psnode Schema node of the parent, NULL for the top level.
+ * @param[in] parent Parent node (the document for the top level).
+ * @param[in] ppath Path of the parent record.
+ * @param[in] pns Namespace of the parent node.
+ * @param[in] fresh The parent was just created, so are all its children.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int sqlite_store(struct sqlite_load* ld, const struct schema_node* psnode, xmlNodePtr parent, const char* ppath, const xmlChar* pns, int fresh)
+{
+	struct ncds_ds_sqlite* sqlite_ds = ld->sqlite_ds;
+	struct sqlite_child* children = NULL, *child;
+	struct sqlite_rec* rec;
+	const struct schema_node* snode;
+	sqlite3_stmt* stmt;
+	xmlNodePtr node;
+	double* upper = NULL, last;
+	char* data = NULL;
+	int count = 0, i, j, empty, ret = EXIT_SUCCESS;
+
+	for (node = parent->children; node != NULL; node = node->next) {
+		count += (sqlite_record(ld->schema, psnode, node) != NULL);
+	}
+	if (count == 0) {
+		return (EXIT_SUCCESS);
+	}
+	if ((children = calloc(count, sizeof(struct sqlite_child))) == NULL ||
+			(upper = malloc((count + 1) * sizeof(double))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		free(children);
+		return (EXIT_FAILURE);
+	}
+
+	for (i = 0, node = parent->children; node != NULL; node = node->next) {
+		if ((snode = sqlite_record(ld->schema, psnode, node)) == NULL) {
+			continue;
+		}
+		child = &children[i++];
+		child->node = node;
+		child->snode = snode;
+		if ((child->path = sqlite_path(ppath, pns, snode, node, 0, &child->name)) == NULL || child->name == NULL) {
+			ret = EXIT_FAILURE;
+			goto cleanup;
+		}
+		child->rec = fresh ? NULL : xmlHashLookup(ld->recs, BAD_CAST child->path);
+	}
+
+	sqlite_upper(children, count, upper);
+	for (i = 0, last = -DBL_MAX; i < count; i++) {
+		child = &children[i];
+		rec = child->rec;
+		if ((data = sqlite_dump(ld, child->snode, child->node, &empty)) == NULL) {
+			ret = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+		if (rec != NULL) {
+			rec->seen = 1;
+			if (rec->data != NULL && (rec->pos <= last || rec->pos >= upper[i + 1])) {
+				/* the record moved */
+				if ((j = sqlite_position(ld, ppath, upper[i + 1], &rec->pos)) == 1) {
+					/* try again with the new positions */
+					free(data);
+					data = NULL;
+					sqlite_upper(children, count, upper);
+					last = (i > 0 && children[i - 1].rec != NULL) ? children[i - 1].rec->pos : -DBL_MAX;
+					i--;
+					continue;
+				} else if (j != EXIT_SUCCESS || (ld->undo && sqlite_undo(sqlite_ds, ld->part, child->path, 0) != EXIT_SUCCESS)) {
+					ret = EXIT_FAILURE;
+					goto cleanup;
+				}
+				stmt = sqlite_stmt(sqlite_ds, DS_SQL_SET_POS, ld->part, child->path);
+				sqlite3_bind_double(stmt, 3, rec->pos);
+				if (sqlite_exec(sqlite_ds, stmt) != EXIT_SUCCESS) {
+					ret = EXIT_FAILURE;
+					goto cleanup;
+				}
+			}
+			if (rec->data != NULL && strcmp(rec->data, data) != 0) {
+				if (ld->undo && sqlite_undo(sqlite_ds, ld->part, child->path, 0) != EXIT_SUCCESS) {
+					ret = EXIT_FAILURE;
+					goto cleanup;
+				}
+				stmt = sqlite_stmt(sqlite_ds, DS_SQL_SET_DATA, ld->part, child->path);
+				sqlite3_bind_text(stmt, 3, data, -1, SQLITE_STATIC);
+				if (sqlite_exec(sqlite_ds, stmt) != EXIT_SUCCESS) {
+					ret = EXIT_FAILURE;
+					goto cleanup;
+				}
+			}
+			last = rec->pos;
+		} else {
+			/* new record */
+			if ((rec = calloc(1, sizeof(struct sqlite_rec))) == NULL) {
+				ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+				ret = EXIT_FAILURE;
+				goto cleanup;
+			}
+			rec->seen = 1;
+			if (fresh) {
+				rec->pos = i + 1;
+			} else if ((j = sqlite_position(ld, ppath, upper[i + 1], &rec->pos)) != EXIT_SUCCESS) {
+				free(rec);
+				free(data);
+				data = NULL;
+				if (j == 1) {
+					/* try again with the new positions */
+					sqlite_upper(children, count, upper);
+					last = (i > 0 && children[i - 1].rec != NULL) ? children[i - 1].rec->pos : -DBL_MAX;
+					i--;
+					continue;
+				}
+				ret = EXIT_FAILURE;
+				goto cleanup;
+			}
+			if (ld->undo && sqlite_undo(sqlite_ds, ld->part, child->path, 0) != EXIT_SUCCESS) {
+				free(rec);
+				ret = EXIT_FAILURE;
+				goto cleanup;
+			}
+			stmt = sqlite_stmt(sqlite_ds, DS_SQL_PUT, ld->part, child->path);
+			sqlite3_bind_text(stmt, 3, ppath, -1, SQLITE_STATIC);
+			sqlite3_bind_text(stmt, 4, child->name, -1, SQLITE_STATIC);
+			sqlite3_bind_double(stmt, 5, rec->pos);
+			sqlite3_bind_text(stmt, 6, data, -1, SQLITE_STATIC);
+			if (sqlite_exec(sqlite_ds, stmt) != EXIT_SUCCESS) {
+				free(rec);
+				ret = EXIT_FAILURE;
+				goto cleanup;
+			}
+			last = rec->pos;
+			if (fresh || xmlHashAddEntry(ld->recs, BAD_CAST child->path, rec) != 0) {
+				/* not needed by the following steps */
+				free(rec);
+				rec = NULL;
+			}
+			child->rec = rec;
+		}
+		free(data);
+		data = NULL;
+
+		if (sqlite_store(ld, child->snode, child->node, child->path, sqlite_ns(child->node, pns), fresh || child->rec == NULL || child->rec->data == NULL) != EXIT_SUCCESS) {
+			ret = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+cleanup:
+	free(data);
+	free(upper);
+	sqlite_children_free(children, count);
+
+	return (ret);
+}
+
+struct sqlite_deleted {
+	struct sqlite_load* ld;
+	int ret;
+};
+
+static void sqlite_delete_rec(void* payload, void* data, const xmlChar* path)
+{
+	struct sqlite_rec* rec = (struct sqlite_rec*)payload;
+	struct sqlite_deleted* deleted = (struct sqlite_deleted*)data;
+	struct sqlite_load* ld = deleted->ld;
+
+	if (deleted->ret != EXIT_SUCCESS || rec->data == NULL || rec->seen) {
+		return;
+	}
+
+	/* the record was removed with its whole subtree */
+	if ((ld->undo && sqlite_undo(ld->sqlite_ds, ld->part, (const char*)path, 1) != EXIT_SUCCESS) ||
+			sqlite_exec(ld->sqlite_ds, sqlite_stmt(ld->sqlite_ds, DS_SQL_DEL_SUBTREE, ld->part, (const char*)path)) != EXIT_SUCCESS) {
+		deleted->ret = EXIT_FAILURE;
+	}
+}
+
+/**
+ * @brief Write the changed loaded document into the database.
+ *
+ * @param[in] ld Loaded datastore with the changed document.
+ * @param[in] fresh The datastore is empty, nothing was loaded.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int sqlite_store_doc(struct sqlite_load* ld, int fresh)
+{
+	struct ncds_ds_sqlite* sqlite_ds = ld->sqlite_ds;
+	struct sqlite_deleted deleted = {ld, EXIT_SUCCESS};
+	struct sqlite_rec* rec;
+	sqlite3_stmt* stmt;
+	char* data;
+	int empty, ret = EXIT_SUCCESS;
+
+	/* the top level leaves */
+	if ((data = sqlite_dump(ld, NULL, NULL, &empty)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+	if ((rec = fresh ? NULL : xmlHashLookup(ld->recs, BAD_CAST "")) != NULL) {
+		rec->seen = 1;
+	}
+	if (empty) {
+		if (rec != NULL && ((ld->undo && sqlite_undo(sqlite_ds, ld->part, "", 0) != EXIT_SUCCESS) ||
+				sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_DEL_PATH, ld->part, "")) != EXIT_SUCCESS)) {
+			ret = EXIT_FAILURE;
+		}
+	} else if (rec == NULL || strcmp(rec->data, data) != 0) {
+		if (ld->undo) {
+			ret = sqlite_undo(sqlite_ds, ld->part, "", 0);
+		}
+		if (ret == EXIT_SUCCESS) {
+			stmt = sqlite_stmt(sqlite_ds, DS_SQL_PUT, ld->part, "");
+			sqlite3_bind_null(stmt, 3);
+			sqlite3_bind_text(stmt, 4, "", -1, SQLITE_STATIC);
+			sqlite3_bind_double(stmt, 5, 0);
+			sqlite3_bind_text(stmt, 6, data, -1, SQLITE_STATIC);
+			ret = sqlite_exec(sqlite_ds, stmt);
+		}
+	}
+	free(data);
+
+	if (ret != EXIT_SUCCESS || sqlite_store(ld, NULL, (xmlNodePtr)ld->doc, "",
+			(sqlite_ds->ds.data_model != NULL) ? BAD_CAST sqlite_ds->ds.data_model->ns : NULL, fresh) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
+	/* the loaded records not found in the document were removed */
+	if (!fresh) {
+		xmlHashScan(ld->recs, sqlite_delete_rec, &deleted);
+	}
+
+	return (deleted.ret);
+}
+
+/**
+ * @brief Parse the configuration data - the top level nodes.
+ *
+ * @return Document with the top level nodes, NULL on error.
+ */
+static xmlDocPtr sqlite_read(const char* data)
+{
+	xmlDocPtr doc;
+	xmlNodePtr root, node;
+	char* config;
+
+	if (strncmp(data, "<?xml", 5) == 0) {
+		if ((data = strchr(data, '>')) == NULL) {
+			return (NULL);
+		}
+		++data;
+	}
+	if (asprintf(&config, "<config>%s</config>", data) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	doc = xmlReadMemory(config, strlen(config), NULL, NULL, NC_XMLREAD_OPTIONS);
+	free(config);
+	if (doc == NULL) {
+		return (NULL);
+	}
+
+	/* get off the root config element */
+	root = xmlDocGetRootElement(doc);
+	while ((node = root->children) != NULL) {
+		xmlUnlinkNode(node);
+		xmlAddNextSibling(doc->last, node);
+	}
+	xmlUnlinkNode(root);
+	xmlFreeNode(root);
+
+	return (doc);
+}
+
+static char* sqlite_serialize(xmlDocPtr doc)
+{
+	xmlBufferPtr buf;
+	xmlNodePtr node;
+	char* data;
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	for (node = doc->children; node != NULL; node = node->next) {
+		xmlNodeDump(buf, doc, node, 0, 0);
+	}
+	data = strdup((char*)xmlBufferContent(buf));
+	xmlBufferFree(buf);
+
+	return (data);
+}
+
+/**
+ * @brief Check if the datastore contains any record.
+ *
+ * @return 0 if empty, 1 if not, -1 on error.
+ */
+static int sqlite_any(struct ncds_ds_sqlite* sqlite_ds, int part)
+{
+	sqlite3_stmt* stmt = sqlite_stmt(sqlite_ds, DS_SQL_ANY, part, NULL);
+	int ret;
+
+	ret = sqlite3_step(stmt);
+	sqlite3_reset(stmt);
+	if (ret != SQLITE_ROW && ret != SQLITE_DONE) {
+		ERROR("SQLite datastore %s: %s.", sqlite_ds->path, sqlite3_errmsg(sqlite_ds->db));
+		return (-1);
+	}
+
+	return (ret == SQLITE_ROW);
+}
+
+/**
+ * @brief Replace the whole content of the datastore with the content of
+ * another one. It MUST be called inside the write transaction.
+ */
+static int sqlite_copy(struct ncds_ds_sqlite* sqlite_ds, int part, int source)
+{
+	sqlite3_stmt* stmt;
+
+	if (sqlite_undo_all(sqlite_ds, part) != EXIT_SUCCESS ||
+			sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_DEL_ALL, part, NULL)) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+	stmt = sqlite_stmt(sqlite_ds, DS_SQL_COPY, part, NULL);
+	sqlite3_bind_int(stmt, 2, source);
+	if (sqlite_exec(sqlite_ds, stmt) != EXIT_SUCCESS ||
+			sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_UNDO_NEW_ALL, part, NULL)) != EXIT_SUCCESS) {
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+int ncds_sqlite_init(struct ncds_ds* ds)
+{
+	struct ncds_ds_sqlite* sqlite_ds = (struct ncds_ds_sqlite*)ds;
+	sqlite3_stmt* stmt;
+	mode_t mask;
+	int i, ret;
+
+	if (sqlite_ds->path == NULL) {
+		ERROR("%s: missing the datastore path.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	mask = umask(MASK_PERM);
+	ret = sqlite3_open_v2(sqlite_ds->path, &sqlite_ds->db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, NULL);
+	umask(mask);
+	if (ret != SQLITE_OK) {
+		ERROR("Unable to open the datastore %s (%s).", sqlite_ds->path, (sqlite_ds->db != NULL) ? sqlite3_errmsg(sqlite_ds->db) : sqlite3_errstr(ret));
+		sqlite3_close(sqlite_ds->db);
+		sqlite_ds->db = NULL;
+		return (EXIT_FAILURE);
+	}
+	sqlite3_busy_timeout(sqlite_ds->db, NCDS_SQLITE_LOCK_TIMEOUT * 1000);
+
+	/* readers do not block the writer and vice versa */
+	if (sqlite3_exec(sqlite_ds->db, "PRAGMA journal_mode=WAL", NULL, NULL, NULL) != SQLITE_OK ||
+			sqlite3_exec(sqlite_ds->db, sqlite_tables, NULL, NULL, NULL) != SQLITE_OK) {
+		ERROR("Unable to prepare the datastore %s (%s).", sqlite_ds->path, sqlite3_errmsg(sqlite_ds->db));
+		return (EXIT_FAILURE);
+	}
+	for (i = 0; i < DS_SQL_COUNT; i++) {
+		if (sqlite3_prepare_v2(sqlite_ds->db, sqlite_statements[i], -1, &sqlite_ds->stmt[i], NULL) != SQLITE_OK) {
+			ERROR("Unable to prepare the datastore %s (%s).", sqlite_ds->path, sqlite3_errmsg(sqlite_ds->db));
+			return (EXIT_FAILURE);
+		}
+	}
+
+	pthread_mutex_init(&(sqlite_ds->lock), NULL);
+	sqlite_ds->backup.part = -1;
+	for (i = 0; i < NCDS_SQLITE_PARTS; i++) {
+		sqlite_ds->lockinfo[i].datastore = (i == 0) ? NC_DATASTORE_RUNNING : (i == 1) ? NC_DATASTORE_STARTUP : NC_DATASTORE_CANDIDATE;
+	}
+
+	stmt = sqlite_stmt(sqlite_ds, DS_SQL_DATA_VERSION, -1, NULL);
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		sqlite_ds->data_version = sqlite3_column_int64(stmt, 0);
+	}
+	sqlite3_reset(stmt);
+
+	return (EXIT_SUCCESS);
+}
+
+void ncds_sqlite_free(struct ncds_ds* ds)
+{
+	struct ncds_ds_sqlite* sqlite_ds = (struct ncds_ds_sqlite*)ds;
+	int i;
+
+	if (sqlite_ds == NULL) {
+		return;
+	}
+
+	for (i = 0; i < NCDS_SQLITE_PARTS; i++) {
+		free(sqlite_ds->lockinfo[i].sid);
+		free(sqlite_ds->lockinfo[i].time);
+	}
+	if (sqlite_ds->db != NULL) {
+		for (i = 0; i < DS_SQL_COUNT; i++) {
+			sqlite3_finalize(sqlite_ds->stmt[i]);
+		}
+		if (sqlite_ds->stmt[DS_SQL_COUNT - 1] != NULL) {
+			/* completely initiated */
+			pthread_mutex_destroy(&(sqlite_ds->lock));
+		}
+		sqlite3_close(sqlite_ds->db);
+	}
+	free(sqlite_ds->path);
+}
+
+int ncds_sqlite_changed(struct ncds_ds* ds)
+{
+	struct ncds_ds_sqlite* sqlite_ds = (struct ncds_ds_sqlite*)ds;
+	sqlite3_stmt* stmt;
+	int ret;
+
+	pthread_mutex_lock(&(sqlite_ds->lock));
+	/* own changes are not counted by the data version */
+	ret = sqlite_ds->changed;
+	sqlite_ds->changed = 0;
+	stmt = sqlite_stmt(sqlite_ds, DS_SQL_DATA_VERSION, -1, NULL);
+	if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int64(stmt, 0) != sqlite_ds->data_version) {
+		sqlite_ds->data_version = sqlite3_column_int64(stmt, 0);
+		ret = 1;
+	}
+	sqlite3_reset(stmt);
+	pthread_mutex_unlock(&(sqlite_ds->lock));
+
+	return (ret);
+}
+
+int ncds_sqlite_rollback(struct ncds_ds* ds)
+{
+	struct ncds_ds_sqlite* sqlite_ds = (struct ncds_ds_sqlite*)ds;
+	sqlite3_stmt* stmt;
+	int ret;
+
+	pthread_mutex_lock(&(sqlite_ds->lock));
+	if (sqlite_ds->backup.part == -1 || sqlite_begin(sqlite_ds, 1) != EXIT_SUCCESS) {
+		pthread_mutex_unlock(&(sqlite_ds->lock));
+		ERROR("No backup repository for rollback operation (datastore %d).", sqlite_ds->ds.id);
+		return (EXIT_FAILURE);
+	}
+
+	stmt = sqlite_stmt(sqlite_ds, DS_SQL_GET_INFO, sqlite_ds->backup.part, NULL);
+	ret = (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int64(stmt, 3) == sqlite_ds->backup.generation);
+	sqlite3_reset(stmt);
+	if (!ret) {
+		/* changed by someone else since */
+		sqlite_end(sqlite_ds, 0);
+		pthread_mutex_unlock(&(sqlite_ds->lock));
+		ERROR("No backup repository for rollback operation (datastore %d).", sqlite_ds->ds.id);
+		return (EXIT_FAILURE);
+	}
+
+	if (sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_UNDO_DROP, -1, NULL)) != EXIT_SUCCESS ||
+			sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_UNDO_RESTORE, -1, NULL)) != EXIT_SUCCESS ||
+			sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_UNDO_CLEAR, -1, NULL)) != EXIT_SUCCESS ||
+			sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_TOUCH, -1, NULL)) != EXIT_SUCCESS) {
+		ret = sqlite_end(sqlite_ds, 0);
+	} else if ((ret = sqlite_end(sqlite_ds, 1)) == EXIT_SUCCESS) {
+		sqlite_ds->changed = 1;
+		sqlite_ds->backup.part = -1;
+	}
+	pthread_mutex_unlock(&(sqlite_ds->lock));
+
+	return (ret);
+}
+
+const struct ncds_lockinfo *ncds_sqlite_lockinfo(struct ncds_ds* ds, NC_DATASTORE target)
+{
+	struct ncds_ds_sqlite* sqlite_ds = (struct ncds_ds_sqlite*)ds;
+	struct ncds_lockinfo* info;
+	int part;
+
+	if ((part = sqlite_part(target)) == -1) {
+		return (NULL);
+	}
+
+	pthread_mutex_lock(&(sqlite_ds->lock));
+	info = &(sqlite_ds->lockinfo[part]);
+	free(info->sid);
+	free(info->time);
+	info->sid = NULL;
+	info->time = NULL;
+	if (sqlite_lock_get(sqlite_ds, part, &info->sid, &info->time, NULL) == -1) {
+		info = NULL;
+	}
+	pthread_mutex_unlock(&(sqlite_ds->lock));
+
+	return (info);
+}
+
+int ncds_sqlite_lock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
+{
+	struct ncds_ds_sqlite* sqlite_ds = (struct ncds_ds_sqlite*)ds;
+	sqlite3_stmt* stmt;
+	char* sid = NULL, *t;
+	int part, modified, ret;
+
+	assert(error);
+
+	if ((part = sqlite_part(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&(sqlite_ds->lock));
+	if (sqlite_begin(sqlite_ds, 1) != EXIT_SUCCESS) {
+		pthread_mutex_unlock(&(sqlite_ds->lock));
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore timeouted.");
+		return (EXIT_FAILURE);
+	}
+
+	if ((ret = sqlite_lock_get(sqlite_ds, part, &sid, NULL, &modified)) == -1) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		ret = EXIT_FAILURE;
+	} else if (ret == 1) {
+		/* someone is already holding the lock */
+		*error = nc_err_new(NC_ERR_LOCK_DENIED);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_SID, sid);
+		ret = EXIT_FAILURE;
+	} else if (target == NC_DATASTORE_CANDIDATE && modified) {
+		*error = nc_err_new(NC_ERR_LOCK_DENIED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Candidate datastore not locked but already modified.");
+		ret = EXIT_FAILURE;
+	} else {
+		t = nc_time2datetime(time(NULL), NULL);
+		stmt = sqlite_stmt(sqlite_ds, DS_SQL_SET_LOCK, part, session->session_id);
+		sqlite3_bind_text(stmt, 3, (t != NULL) ? t : "", -1, SQLITE_STATIC);
+		ret = sqlite_exec(sqlite_ds, stmt);
+		free(t);
+		if (ret != EXIT_SUCCESS) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+		}
+	}
+	free(sid);
+	if (sqlite_end(sqlite_ds, ret == EXIT_SUCCESS) != EXIT_SUCCESS && ret == EXIT_SUCCESS) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		ret = EXIT_FAILURE;
+	}
+	pthread_mutex_unlock(&(sqlite_ds->lock));
+
+	return (ret);
+}
+
+int ncds_sqlite_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
+{
+	struct ncds_ds_sqlite* sqlite_ds = (struct ncds_ds_sqlite*)ds;
+	sqlite3_stmt* stmt;
+	int part, ret;
+
+	assert(error);
+
+	if ((part = sqlite_part(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&(sqlite_ds->lock));
+	if (sqlite_begin(sqlite_ds, 1) != EXIT_SUCCESS) {
+		pthread_mutex_unlock(&(sqlite_ds->lock));
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore timeouted.");
+		return (EXIT_FAILURE);
+	}
+
+	ret = EXIT_SUCCESS;
+	if (sqlite_access(sqlite_ds, part, NULL) == 0) {
+		/* not locked */
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Target datastore is not locked.");
+		ret = EXIT_FAILURE;
+	} else if (sqlite_access(sqlite_ds, part, session) != 0) {
+		/* the datastore is locked by somebody else */
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Target datastore is locked by another session.");
+		ret = EXIT_FAILURE;
+	} else {
+		if (target == NC_DATASTORE_CANDIDATE) {
+			/* drop current candidate configuration, copy running into it */
+			if (sqlite_copy(sqlite_ds, part, sqlite_part(NC_DATASTORE_RUNNING)) != EXIT_SUCCESS ||
+					sqlite_changed(sqlite_ds, part, 0) != EXIT_SUCCESS) {
+				ret = EXIT_FAILURE;
+			}
+		}
+
+		/* unlock datastore */
+		stmt = sqlite_stmt(sqlite_ds, DS_SQL_SET_LOCK, part, NULL);
+		if (ret != EXIT_SUCCESS || sqlite_exec(sqlite_ds, stmt) != EXIT_SUCCESS) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			ret = EXIT_FAILURE;
+		}
+	}
+	if (sqlite_end(sqlite_ds, ret == EXIT_SUCCESS) != EXIT_SUCCESS && ret == EXIT_SUCCESS) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		ret = EXIT_FAILURE;
+	}
+	pthread_mutex_unlock(&(sqlite_ds->lock));
+
+	return (ret);
+}
+
+/**
+ * @brief Get the datastore content, all of it or only the part possibly
+ * selected by the subtree filter.
+ */
+static char* sqlite_getconfig(struct ncds_ds_sqlite* sqlite_ds, NC_DATASTORE source, xmlDocPtr filter, struct nc_err** error)
+{
+	struct sqlite_load ld;
+	char* data = NULL;
+	int part, ret;
+
+	if ((part = sqlite_part(source)) == -1) {
+		ERROR("%s: invalid source.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "source");
+		return (NULL);
+	}
+
+	pthread_mutex_lock(&(sqlite_ds->lock));
+	if ((ret = sqlite_load_init(&ld, sqlite_ds, part)) == EXIT_SUCCESS && (ret = sqlite_begin(sqlite_ds, 0)) == EXIT_SUCCESS) {
+		if (filter == NULL) {
+			ret = sqlite_load_all(&ld);
+		} else if ((ret = sqlite_load_path(&ld, "")) == EXIT_SUCCESS) {
+			ret = sqlite_load_filter(&ld, NULL, "", (sqlite_ds->ds.data_model != NULL) ? BAD_CAST sqlite_ds->ds.data_model->ns : NULL, filter->children);
+		}
+		/* nothing to commit */
+		sqlite_end(sqlite_ds, 0);
+	}
+	pthread_mutex_unlock(&(sqlite_ds->lock));
+
+	if (ret == EXIT_SUCCESS) {
+		data = sqlite_serialize(ld.doc);
+	}
+	sqlite_load_clean(&ld);
+	if (data == NULL) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+	}
+
+	return (data);
+}
+
+char* ncds_sqlite_getconfig(struct ncds_ds* ds, const struct nc_session* UNUSED(session), NC_DATASTORE source, struct nc_err** error)
+{
+	return (sqlite_getconfig((struct ncds_ds_sqlite*)ds, source, NULL, error));
+}
+
+char* ncds_sqlite_getconfig_filtered(struct ncds_ds* ds, const struct nc_session* UNUSED(session), NC_DATASTORE source, const char* filter, int* exact, struct nc_err** error)
+{
+	xmlDocPtr filter_doc;
+	char* data;
+
+	/* only the records are selected, the filter is applied to their content later */
+	*exact = 0;
+	if ((filter_doc = sqlite_read(filter)) == NULL) {
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "filter");
+		return (NULL);
+	}
+	data = sqlite_getconfig((struct ncds_ds_sqlite*)ds, source, filter_doc, error);
+	xmlFreeDoc(filter_doc);
+
+	return (data);
+}
+
+int ncds_sqlite_copyconfig(struct ncds_ds *ds, const struct nc_session *session, const nc_rpc* rpc, NC_DATASTORE target, NC_DATASTORE source, char* config, struct nc_err **error)
+{
+	struct ncds_ds_sqlite* sqlite_ds = (struct ncds_ds_sqlite*)ds;
+	struct sqlite_load ld, src;
+	xmlDocPtr aux_doc = NULL;
+	keyList keys;
+	int part, ret, r;
+
+	assert(error);
+
+	if ((part = sqlite_part(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+	if (source != NC_DATASTORE_CONFIG && sqlite_part(source) == -1) {
+		ERROR("%s: invalid source.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "source");
+		return (EXIT_FAILURE);
+	} else if (source == NC_DATASTORE_CONFIG && config == NULL) {
+		ERROR("%s: invalid source config.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
+		return (EXIT_FAILURE);
+	}
+
+	if (source == NC_DATASTORE_CONFIG && (aux_doc = sqlite_read(config)) == NULL) {
+		ERROR("%s: reading source config failed.", __func__);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&(sqlite_ds->lock));
+	if (sqlite_begin(sqlite_ds, 1) != EXIT_SUCCESS) {
+		pthread_mutex_unlock(&(sqlite_ds->lock));
+		xmlFreeDoc(aux_doc);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore timeouted.");
+		return (EXIT_FAILURE);
+	}
+
+	/* isn't target locked? */
+	if (sqlite_access(sqlite_ds, part, session) != 0 ||
+			/* commit - check also the lock on source (i.e. candidate) datastore */
+			(source == NC_DATASTORE_CANDIDATE && target == NC_DATASTORE_RUNNING && sqlite_access(sqlite_ds, sqlite_part(source), session) != 0)) {
+		sqlite_end(sqlite_ds, 0);
+		pthread_mutex_unlock(&(sqlite_ds->lock));
+		xmlFreeDoc(aux_doc);
+		*error = nc_err_new(NC_ERR_IN_USE);
+		return (EXIT_FAILURE);
+	}
+
+	memset(&ld, 0, sizeof(struct sqlite_load));
+	if (source != NC_DATASTORE_CONFIG && (rpc == NULL || rpc->nacm == NULL ||
+			(source == NC_DATASTORE_RUNNING && target == NC_DATASTORE_STARTUP))) {
+		/* no access control, the records are copied as they are */
+		if ((r = sqlite_any(sqlite_ds, sqlite_part(source))) == -1 || (ret = sqlite_any(sqlite_ds, part)) == -1) {
+			ret = EXIT_FAILURE;
+		} else if (r == 0 && ret == 0) {
+			ret = EXIT_RPC_NOT_APPLICABLE;
+		} else if (sqlite_part(source) == part) {
+			ret = EXIT_SUCCESS;
+		} else if ((ret = sqlite_copy(sqlite_ds, part, sqlite_part(source))) == EXIT_SUCCESS) {
+			ret = sqlite_changed(sqlite_ds, part, -1);
+		}
+		goto finish;
+	}
+
+	if (source != NC_DATASTORE_CONFIG) {
+		if (sqlite_load_init(&src, sqlite_ds, sqlite_part(source)) == EXIT_SUCCESS && sqlite_load_all(&src) == EXIT_SUCCESS) {
+			/* take the loaded document */
+			aux_doc = src.doc;
+			src.doc = NULL;
+		}
+		sqlite_load_clean(&src);
+	}
+	if (aux_doc == NULL || sqlite_load_init(&ld, sqlite_ds, part) != EXIT_SUCCESS || sqlite_load_all(&ld) != EXIT_SUCCESS) {
+		ERROR("%s: reading source config failed.", __func__);
+		ret = EXIT_FAILURE;
+		goto finish;
+	}
+	sqlite_unmark(aux_doc->children);
+	sqlite_unmark(ld.doc->children);
+
+	if (aux_doc->children == NULL && ld.doc->children == NULL) {
+		ret = EXIT_RPC_NOT_APPLICABLE;
+		goto finish;
+	}
+
+	if (rpc != NULL && rpc->nacm != NULL) {
+		/* NACM, the same as in the file datastore (RFC 6536, sec. 3.2.4.) */
+		keys = get_keynode_list(sqlite_ds->ds.ext_model);
+		if (source != NC_DATASTORE_CONFIG) {
+			nacm_check_data_read(aux_doc, rpc->nacm);
+		}
+		if (ld.doc->children == NULL) {
+			r = nacm_check_data(aux_doc->children, NACM_ACCESS_CREATE, rpc->nacm);
+		} else {
+			r = edit_replace_nacmcheck(ld.doc->children, aux_doc, sqlite_ds->ds.ext_model, keys, rpc->nacm, error);
+		}
+		keyListFree(keys);
+		if (r != NACM_PERMIT) {
+			if (*error == NULL) {
+				*error = nc_err_new((r == NACM_DENY) ? NC_ERR_ACCESS_DENIED : NC_ERR_OP_FAILED);
+			}
+			sqlite_end(sqlite_ds, 0);
+			pthread_mutex_unlock(&(sqlite_ds->lock));
+			sqlite_load_clean(&ld);
+			xmlFreeDoc(aux_doc);
+			return (EXIT_FAILURE);
+		}
+	}
+
+	/* write the new content as a whole */
+	xmlFreeDoc(ld.doc);
+	ld.doc = aux_doc;
+	aux_doc = NULL;
+	if (sqlite_undo_all(sqlite_ds, part) != EXIT_SUCCESS ||
+			sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_DEL_ALL, part, NULL)) != EXIT_SUCCESS ||
+			sqlite_store_doc(&ld, 1) != EXIT_SUCCESS ||
+			sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_UNDO_NEW_ALL, part, NULL)) != EXIT_SUCCESS) {
+		ret = EXIT_FAILURE;
+	} else {
+		ret = sqlite_changed(sqlite_ds, part, -1);
+	}
+
+finish:
+	if (ret != EXIT_FAILURE && target == NC_DATASTORE_CANDIDATE) {
+		/* according to RFC, candidate cannot be locked since it has been modified and not committed */
+		ret = sqlite_modified(sqlite_ds, part, (source != NC_DATASTORE_RUNNING)) == EXIT_SUCCESS ? ret : EXIT_FAILURE;
+	}
+	if (sqlite_end(sqlite_ds, ret != EXIT_FAILURE) != EXIT_SUCCESS) {
+		ret = EXIT_FAILURE;
+	}
+	if (ret == EXIT_FAILURE) {
+		if (*error == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+		}
+	}
+	pthread_mutex_unlock(&(sqlite_ds->lock));
+	sqlite_load_clean(&ld);
+	xmlFreeDoc(aux_doc);
+
+	return (ret);
+}
+
+int ncds_sqlite_deleteconfig(struct ncds_ds * ds, const struct nc_session * session, NC_DATASTORE target, struct nc_err **error)
+{
+	struct ncds_ds_sqlite* sqlite_ds = (struct ncds_ds_sqlite*)ds;
+	int part, ret;
+
+	assert(error);
+
+	if (target == NC_DATASTORE_RUNNING) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Cannot delete a running datastore.");
+		return (EXIT_FAILURE);
+	} else if ((part = sqlite_part(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&(sqlite_ds->lock));
+	if (sqlite_begin(sqlite_ds, 1) != EXIT_SUCCESS) {
+		pthread_mutex_unlock(&(sqlite_ds->lock));
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore timeouted.");
+		return (EXIT_FAILURE);
+	}
+
+	if (sqlite_access(sqlite_ds, part, session) != 0) {
+		sqlite_end(sqlite_ds, 0);
+		pthread_mutex_unlock(&(sqlite_ds->lock));
+		*error = nc_err_new(NC_ERR_IN_USE);
+		return (EXIT_FAILURE);
+	}
+
+	if (sqlite_undo_all(sqlite_ds, part) != EXIT_SUCCESS ||
+			sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_DEL_ALL, part, NULL)) != EXIT_SUCCESS ||
+			sqlite_changed(sqlite_ds, part, (target == NC_DATASTORE_CANDIDATE) ? 1 : -1) != EXIT_SUCCESS) {
+		sqlite_end(sqlite_ds, 0);
+		ret = EXIT_FAILURE;
+	} else {
+		ret = sqlite_end(sqlite_ds, 1);
+	}
+	if (ret != EXIT_SUCCESS) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+	}
+	pthread_mutex_unlock(&(sqlite_ds->lock));
+
+	return (ret);
+}
+
+int ncds_sqlite_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error)
+{
+	struct ncds_ds_sqlite* sqlite_ds = (struct ncds_ds_sqlite*)ds;
+	struct sqlite_load ld;
+	xmlDocPtr config_doc;
+	int part, ret;
+
+	assert(error);
+
+	if ((part = sqlite_part(target)) == -1) {
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
+		return (EXIT_FAILURE);
+	}
+
+	/* read config to XML doc */
+	if ((config_doc = sqlite_read(config)) == NULL) {
+		ERROR("%s: Reading xml data failed!", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
+		return (EXIT_FAILURE);
+	}
+
+	pthread_mutex_lock(&(sqlite_ds->lock));
+	if (sqlite_begin(sqlite_ds, 1) != EXIT_SUCCESS) {
+		pthread_mutex_unlock(&(sqlite_ds->lock));
+		xmlFreeDoc(config_doc);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore timeouted.");
+		return (EXIT_FAILURE);
+	}
+
+	if (sqlite_access(sqlite_ds, part, session) != 0) {
+		sqlite_end(sqlite_ds, 0);
+		pthread_mutex_unlock(&(sqlite_ds->lock));
+		xmlFreeDoc(config_doc);
+		*error = nc_err_new(NC_ERR_IN_USE);
+		return (EXIT_FAILURE);
+	}
+
+	/* load only the records touched by the edit */
+	if ((ret = sqlite_load_init(&ld, sqlite_ds, part)) == EXIT_SUCCESS) {
+		if (defop == NC_EDIT_DEFOP_REPLACE) {
+			ret = sqlite_load_all(&ld);
+		} else if ((ret = sqlite_load_path(&ld, "")) == EXIT_SUCCESS) {
+			ret = sqlite_load_edit(&ld, NULL, "", (ds->data_model != NULL) ? BAD_CAST ds->data_model->ns : NULL, config_doc->children);
+		}
+	}
+	if (ret != EXIT_SUCCESS) {
+		ERROR("Reading the datastore %s failed.", sqlite_ds->path);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+	} else {
+		sqlite_unmark(ld.doc->children);
+		if ((ret = edit_config(ld.doc, config_doc, ds, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error)) != EXIT_SUCCESS) {
+			ret = EXIT_FAILURE;
+		} else {
+			ld.undo = 1;
+			if (sqlite_exec(sqlite_ds, sqlite_stmt(sqlite_ds, DS_SQL_UNDO_CLEAR, -1, NULL)) != EXIT_SUCCESS ||
+					sqlite_store_doc(&ld, 0) != EXIT_SUCCESS ||
+					sqlite_changed(sqlite_ds, part, (target == NC_DATASTORE_CANDIDATE) ? 1 : -1) != EXIT_SUCCESS) {
+				*error = nc_err_new(NC_ERR_OP_FAILED);
+				ret = EXIT_FAILURE;
+			}
+		}
+	}
+	if (sqlite_end(sqlite_ds, ret == EXIT_SUCCESS) != EXIT_SUCCESS && ret == EXIT_SUCCESS) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		ret = EXIT_FAILURE;
+	}
+	pthread_mutex_unlock(&(sqlite_ds->lock));
+
+	sqlite_load_clean(&ld);
+	xmlFreeDoc(config_doc);
+
+	return (ret);
+}
@@ -0,0 +1,213 @@
+/**
+ * \file datastore_sqlite.h
+ * \brief NETCONF datastore handling function prototypes and structures for SQLite datastore implementation.
+ *
+ * Copyright (c) 2012-2014 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef NC_DATASTORE_SQLITE_H_
+#define NC_DATASTORE_SQLITE_H_
+
+#include "../../netconf_internal.h"
+#include "../datastore_internal.h"
+#include <stdint.h>
+#include <pthread.h>
+#include <sqlite3.h>
+
+/* Number of seconds waiting for the database lock before
+ * giving up and cancelling the locking
+ */
+#define NCDS_SQLITE_LOCK_TIMEOUT 5
+
+/* Number of the datastores (running, startup, candidate) */
+#define NCDS_SQLITE_PARTS 3
+
+/**
+ * @brief Prepared statements of the SQLite datastore, see sqlite_statements in
+ * datastore_sqlite.c.
+ */
+typedef enum {
+	DS_SQL_BEGIN_READ,
+	DS_SQL_BEGIN_WRITE,
+	DS_SQL_COMMIT,
+	DS_SQL_ROLLBACK,
+	DS_SQL_GET_ALL,
+	DS_SQL_GET_PATH,
+	DS_SQL_GET_SUBTREE,
+	DS_SQL_GET_NAMED,
+	DS_SQL_GET_RANGE,
+	DS_SQL_ANY,
+	DS_SQL_PUT,
+	DS_SQL_SET_DATA,
+	DS_SQL_SET_POS,
+	DS_SQL_DEL_PATH,
+	DS_SQL_DEL_SUBTREE,
+	DS_SQL_DEL_ALL,
+	DS_SQL_COPY,
+	DS_SQL_MAX_POS,
+	DS_SQL_CHILDREN,
+	DS_SQL_UNDO_CLEAR,
+	DS_SQL_UNDO_SAVE_PATH,
+	DS_SQL_UNDO_SAVE,
+	DS_SQL_UNDO_SAVE_ALL,
+	DS_SQL_UNDO_NEW,
+	DS_SQL_UNDO_NEW_ALL,
+	DS_SQL_UNDO_DROP,
+	DS_SQL_UNDO_RESTORE,
+	DS_SQL_GET_INFO,
+	DS_SQL_SET_LOCK,
+	DS_SQL_SET_MODIFIED,
+	DS_SQL_TOUCH,
+	DS_SQL_DATA_VERSION,
+	DS_SQL_COUNT
+} DS_SQL_STMT;
+
+/**
+ * @brief SQLite datastore implementation-specific ncds_ds structure.
+ *
+ * The configuration is stored as records, one record per container and list
+ * entry. A record is identified by its key path (node names and list keys
+ * from the top level node) and it contains the node with its leaves,
+ * leaf-lists and anyxml nodes. The top level leaves are kept in the record
+ * with the empty path.
+ */
+struct ncds_ds_sqlite {
+	/* common part from datastore_internal.h */
+	struct ncds_ds ds;
+
+	/* specific part */
+	/**
+	 * @brief Path to the database file.
+	 */
+	char* path;
+	/**
+	 * @brief Database connection.
+	 */
+	sqlite3* db;
+	/**
+	 * @brief Prepared statements.
+	 */
+	sqlite3_stmt* stmt[DS_SQL_COUNT];
+	/**
+	 * @brief Mutex of the threads sharing the database connection.
+	 */
+	pthread_mutex_t lock;
+	/**
+	 * @brief Database version seen by ncds_sqlite_changed().
+	 */
+	int64_t data_version;
+	/**
+	 * @brief The process changed the database since the last ncds_sqlite_changed().
+	 */
+	int changed;
+	/**
+	 * @brief The last change made by the process for ncds_sqlite_rollback(),
+	 * the replaced records are kept in the undo table.
+	 */
+	struct {
+		/**
+		 * changed datastore, -1 if there is nothing to roll back
+		 */
+		int part;
+		/**
+		 * generation of the datastores after the change
+		 */
+		int64_t generation;
+	} backup;
+	/**
+	 * @brief The change made in the current transaction, it replaces the
+	 * backup when the transaction is committed.
+	 */
+	struct {
+		int part;
+		int64_t generation;
+	} change;
+	/**
+	 * @brief Information about the NETCONF locks returned by ncds_sqlite_lockinfo().
+	 */
+	struct ncds_lockinfo lockinfo[NCDS_SQLITE_PARTS];
+};
+
+/**
+ * @brief Initialization of the SQLite datastore
+ *
+ * @param ds Datastore to initialize
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_sqlite_init(struct ncds_ds* ds);
+
+/**
+ * @brief Closes the database
+ *
+ * @param ds Datastore to close
+ */
+void ncds_sqlite_free(struct ncds_ds* ds);
+
+/**
+ * @brief Checks if the database was changed since the last call
+ *
+ * @param ds Datastore to check
+ *
+ * @return 0 if not changed, non-zero otherwise
+ */
+int ncds_sqlite_changed(struct ncds_ds* ds);
+
+/**
+ * @brief Undo the last change made by the calling process, if no other change
+ * was made since it.
+ *
+ * @param ds Datastore to roll back
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_sqlite_rollback(struct ncds_ds* ds);
+
+const struct ncds_lockinfo *ncds_sqlite_lockinfo(struct ncds_ds* ds, NC_DATASTORE target);
+
+int ncds_sqlite_lock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
+
+int ncds_sqlite_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
+
+char* ncds_sqlite_getconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
+
+char* ncds_sqlite_getconfig_filtered(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, const char* filter, int* exact, struct nc_err** error);
+
+int ncds_sqlite_copyconfig(struct ncds_ds* ds, const struct nc_session* session, const nc_rpc* rpc, NC_DATASTORE target, NC_DATASTORE source, char* config, struct nc_err** error);
+
+int ncds_sqlite_deleteconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error);
+
+int ncds_sqlite_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error);
+
+#endif /* NC_DATASTORE_SQLITE_H_ */
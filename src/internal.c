@@ -481,6 +481,7 @@ API int nc_init(int flags)
 
 			/* set last session id */
 			nc_info->last_session_id = 0;
+			nc_info->last_plock_id = 0;
 
 			/* init lock */
 			pthread_rwlockattr_init(&rwlockattr);
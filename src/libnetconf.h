@@ -180,6 +180,9 @@
  *  - required only when the TLS transport is enabled by `--enable-tls` option.
  *    More information about the TLS transport can be found in \ref transport
  *    section.
+ * - _libsqlite3_ (including headers from the devel package)
+ *  - required only when the SQLite datastore is enabled by `--enable-sqlite`
+ *    option.
  * - _doxygen_
  *  - optional, required to (re)build documentation (`make doc`)
  * - _rpmbuild_
@@ -233,6 +236,10 @@
  *  - Enable experimental support for TLS transport. More information about the
  *    TLS transport can be found in \ref transport section.
  *
+ * - `--enable-sqlite`
+ *  - Enable the \ref sqliteds "SQLite datastore" implementation
+ *    (*NCDS_TYPE_SQLITE*).
+ *
  * - `--with-pyapi[=path_to_python3]`
  *  - Build also the libnetconf Python API. This requires python3, so if it is
  *    installed in some non-standard location, specify the complete path to the
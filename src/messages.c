@@ -342,6 +342,7 @@ static struct nc_msg* ncxml_msg_build(xmlDocPtr msg_dump)
 	msg->error = NULL;
 	msg->with_defaults = NCWD_MODE_NOTSET;
 	msg->type.rpc = 0;
+	msg->nacm = NULL;
 
 	if ((id = nc_msg_parse_msgid (msg)) != NULL) {
 		msg->msgid = strdup(id);
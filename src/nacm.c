@@ -56,6 +56,7 @@
 #include "nacm.h"
 #include "datastore.h"
 #include "datastore/datastore_internal.h"
+#include "datastore/schema.h"
 #include "notifications.h"
 
 static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
@@ -1162,13 +1163,14 @@ static int compare_node_to_model(const xmlNodePtr node, const xmlNodePtr model_n
 
 int nacm_check_data(const xmlNodePtr node, const int access, const struct nacm_rpc* nacm)
 {
-	xmlXPathObjectPtr defdeny;
-	xmlXPathContextPtr model_ctxt = NULL;
 	xmlXPathContextPtr ctxt = NULL;
 	xmlXPathObjectPtr xpath_result = NULL;
 	struct nacm_ns *ns;
 	struct nacm_rule* rule;
 	const struct data_model* module;
+	struct schema* schema;
+	struct schema_node* snode;
+	xmlNodePtr aux;
 	int i, j, k;
 	int retval = -1;
 
@@ -1276,42 +1278,20 @@ int nacm_check_data(const xmlNodePtr node, const int access, const struct nacm_r
 		/* no matching rule found */
 
 		/* check nacm:default-deny-all and nacm:default-deny-write */
-		if ((model_ctxt = xmlXPathNewContext(module->xml)) != NULL &&
-		    xmlXPathRegisterNs(model_ctxt, BAD_CAST "yin", BAD_CAST NC_NS_YIN) == 0 &&
-		    xmlXPathRegisterNs(model_ctxt, BAD_CAST "nacm", BAD_CAST NC_NS_NACM) == 0) {
-			if ((defdeny = xmlXPathEvalExpression(BAD_CAST "/yin:module//nacm:default-deny-all", model_ctxt)) != NULL) {
-				if (!xmlXPathNodeSetIsEmpty(defdeny->nodesetval)) {
-					/* process all default-deny-all elements */
-					for (i = 0; i < defdeny->nodesetval->nodeNr; i++) {
-						if (compare_node_to_model(node, defdeny->nodesetval->nodeTab[i]->parent, module->ns) == 1) {
-							xmlXPathFreeObject(defdeny);
-							xmlXPathFreeContext(model_ctxt);
-							retval = NACM_DENY;
-							goto result;
-						}
-					}
+		if ((schema = schema_get(module->xml)) != NULL) {
+			/* the whole path to the node must be defined in the module */
+			snode = schema_find(schema, node);
+			for (aux = node; snode != NULL && aux != NULL && aux->type == XML_ELEMENT_NODE; aux = aux->parent) {
+				if (aux->ns == NULL || aux->ns->href == NULL || xmlStrcmp(aux->ns->href, BAD_CAST module->ns) != 0) {
+					snode = NULL;
 				}
-				xmlXPathFreeObject(defdeny);
 			}
-			if ((access & (NACM_ACCESS_CREATE | NACM_ACCESS_DELETE | NACM_ACCESS_UPDATE)) != 0) {
-				/* check default-deny-write */
-				if ((defdeny = xmlXPathEvalExpression(BAD_CAST "/yin:module//nacm:default-deny-write", model_ctxt)) != NULL ) {
-					if (!xmlXPathNodeSetIsEmpty(defdeny->nodesetval)) {
-						/* process all default-deny-all elements */
-						for (i = 0; i < defdeny->nodesetval->nodeNr; i++) {
-							if (compare_node_to_model(node, defdeny->nodesetval->nodeTab[i]->parent, module->ns) == 1) {
-								xmlXPathFreeObject(defdeny);
-								xmlXPathFreeContext(model_ctxt);
-								retval = NACM_DENY;
-								goto result;
-							}
-						}
-					}
-					xmlXPathFreeObject(defdeny);
-				}
+			if (snode != NULL && ((snode->flags & SCHEMA_NACM_DENY_ALL) ||
+			    ((snode->flags & SCHEMA_NACM_DENY_WRITE) && (access & (NACM_ACCESS_CREATE | NACM_ACCESS_DELETE | NACM_ACCESS_UPDATE)) != 0))) {
+				retval = NACM_DENY;
+				goto result;
 			}
 		}
-		xmlXPathFreeContext(model_ctxt);
 	}
 	/* no matching rule found */
 
@@ -115,6 +115,7 @@
 #define NC_CAP_MONITORING_ID    "urn:ietf:params:xml:ns:yang:ietf-netconf-monitoring"
 #define NC_CAP_WITHDEFAULTS_ID  "urn:ietf:params:netconf:capability:with-defaults:1.0"
 #define NC_CAP_URL_ID           "urn:ietf:params:netconf:capability:url:1.0"
+#define NC_CAP_PARTIALLOCK_ID   "urn:ietf:params:netconf:capability:partial-lock:1.0"
 
 #define NC_NS_WITHDEFAULTS      "urn:ietf:params:xml:ns:yang:ietf-netconf-with-defaults"
 #define NC_NS_WITHDEFAULTS_ID   "wd"
@@ -128,8 +129,10 @@
 #define NC_NS_YANG_ID           "yang"
 #define NC_NS_YIN               "urn:ietf:params:xml:ns:yang:yin:1"
 #define NC_NS_YIN_ID            "yin"
+#define NC_NS_PARTIAL_LOCK      "urn:ietf:params:xml:ns:netconf:partial-lock:1.0"
 
 #define NC_NS_LNC_NOTIFICATIONS "urn:cesnet:params:xml:ns:libnetconf:notifications"
+#define NC_NS_LNC_TRANSACTIONS  "urn:cesnet:params:xml:ns:libnetconf:transactions"
 
 /* NETCONF versions identificators */
 #define NETCONFV10	0
@@ -333,6 +336,7 @@ struct nc_shared_info {
 	struct nc_statistics stats;
 	struct nacm_stats stats_nacm;
 	struct nc_apps apps;
+	unsigned long last_plock_id;
 };
 
 /**
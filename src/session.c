@@ -984,6 +984,7 @@ API struct nc_cpblts* nc_session_get_cpblts_default(void)
 	nc_cpblts_add(retval, NC_CAP_CANDIDATE_ID);
 	nc_cpblts_add(retval, NC_CAP_STARTUP_ID);
 	nc_cpblts_add(retval, NC_CAP_ROLLBACK_ID);
+	nc_cpblts_add(retval, NC_CAP_PARTIALLOCK_ID);
 
 #ifndef DISABLE_NOTIFICATIONS
 	if (nc_init_flags & NC_INIT_NOTIF) {
@@ -47,6 +47,7 @@
 #include <libxml/xpathInternals.h>
 
 #include "datastore/edit_config.h"
+#include "datastore/schema.h"
 #include "with_defaults.h"
 #include "netconf_internal.h"
 
@@ -622,11 +623,45 @@ cleanup:
 	return (retvals);
 }
 
+struct default_scan {
+	xmlNodePtr module;
+	xmlNodeSetPtr defaults;
+};
+
+/*
+ * xmlHashScanner collecting the YIN default statements of the leafs from the
+ * schema subtree, the top level nodes are limited to the containers defined
+ * directly in the module
+ */
+static void default_values_scan(void* payload, void* data, const xmlChar* UNUSED(name))
+{
+	struct schema_node* snode = (struct schema_node*)payload;
+	struct default_scan* scan = (struct default_scan*)data;
+	xmlNodePtr stmt;
+
+	if (snode->parent == NULL && (snode->type != SCHEMA_CONTAINER || snode->yin->parent != scan->module)) {
+		return;
+	}
+
+	if (snode->dflt != NULL) {
+		for (stmt = snode->yin->children; stmt != NULL; stmt = stmt->next) {
+			if (stmt->type == XML_ELEMENT_NODE && xmlStrcmp(stmt->name, BAD_CAST "default") == 0) {
+				xmlXPathNodeSetAdd(scan->defaults, stmt);
+				break;
+			}
+		}
+	}
+
+	if (snode->children != NULL) {
+		xmlHashScan(snode->children, default_values_scan, scan);
+	}
+}
+
 int ncdflt_default_values(xmlDocPtr config, const xmlDocPtr model, NCWD_MODE mode)
 {
-	xmlXPathContextPtr model_ctxt = NULL;
-	xmlXPathObjectPtr defaults = NULL, query;
-	xmlNodePtr root;
+	struct schema* schema;
+	struct default_scan scan;
+	xmlNodePtr root, stmt;
 	xmlChar* namespace = NULL;
 	int i;
 
@@ -639,51 +674,44 @@ int ncdflt_default_values(xmlDocPtr config, const xmlDocPtr model, NCWD_MODE mod
 		return (EXIT_SUCCESS);
 	}
 
-	/* create xpath evaluation context */
-	if ((model_ctxt = xmlXPathNewContext(model)) == NULL) {
-		WARN("%s: Creating the XPath context failed.", __func__);
-		/* with-defaults cannot be found */
+	if ((schema = schema_get(model)) == NULL || (scan.module = xmlDocGetRootElement(model)) == NULL) {
+		ERROR("%s: Unable to compile the data model.", __func__);
 		return (EXIT_FAILURE);
 	}
-	if (xmlXPathRegisterNs(model_ctxt, BAD_CAST "yin", BAD_CAST NC_NS_YIN) != 0) {
-		ERROR("%s: Registering yin namespace for the model xpath context failed.", __func__);
-		xmlXPathFreeContext(model_ctxt);
-		return (EXIT_FAILURE);
+	for (stmt = scan.module->children; stmt != NULL; stmt = stmt->next) {
+		if (stmt->type == XML_ELEMENT_NODE && xmlStrcmp(stmt->name, BAD_CAST "namespace") == 0) {
+			namespace = xmlGetProp(stmt, BAD_CAST "uri");
+			break;
+		}
 	}
-	if ((query = xmlXPathEvalExpression(BAD_CAST "/yin:module/yin:namespace", model_ctxt)) == NULL) {
+	if (namespace == NULL) {
 		ERROR("%s: Unable to get namespace from the data model.", __func__);
-		xmlXPathFreeContext(model_ctxt);
 		return (EXIT_FAILURE);
 	}
-	if (xmlXPathNodeSetIsEmpty(query->nodesetval) || (namespace = xmlGetProp(query->nodesetval->nodeTab[0], BAD_CAST "uri")) == NULL) {
-		ERROR("%s: Unable to get namespace from the data model.", __func__);
+
+	if ((scan.defaults = xmlXPathNodeSetCreate(NULL)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
 		xmlFree(namespace);
-		xmlXPathFreeObject(query);
-		xmlXPathFreeContext(model_ctxt);
 		return (EXIT_FAILURE);
 	}
-	xmlXPathFreeObject(query);
+	xmlHashScan(schema->roots, default_values_scan, &scan);
 
-	if ((defaults = xmlXPathEvalExpression(BAD_CAST "/yin:module/yin:container//yin:default", model_ctxt)) != NULL) {
-		if (!xmlXPathNodeSetIsEmpty(defaults->nodesetval)) {
-			/* if report-all-tagged, add namespace for default attribute into the whole doc */
-			root = xmlDocGetRootElement(config);
-			if ((mode & (NCWD_MODE_ALL_TAGGED | NCWD_MODE_IMPL_TAGGED)) && root != NULL) {
-				xmlNewNs(root, BAD_CAST "urn:ietf:params:xml:ns:netconf:default:1.0", BAD_CAST "wd");
-			}
-			/* process all defaults elements */
-			for (i = 0; i < defaults->nodesetval->nodeNr; i++) {
-				if (xmlStrcmp(defaults->nodesetval->nodeTab[i]->parent->name, BAD_CAST "choice") == 0) {
-					/* skip defaults for choices */
-					continue;
-				}
-				fill_default(config, defaults->nodesetval->nodeTab[i], (char*)namespace, mode);
-			}
+	if (!xmlXPathNodeSetIsEmpty(scan.defaults)) {
+		/* keep the document order of the model, the hash tables are unordered */
+		xmlXPathNodeSetSort(scan.defaults);
+
+		/* if report-all-tagged, add namespace for default attribute into the whole doc */
+		root = xmlDocGetRootElement(config);
+		if ((mode & (NCWD_MODE_ALL_TAGGED | NCWD_MODE_IMPL_TAGGED)) && root != NULL) {
+			xmlNewNs(root, BAD_CAST "urn:ietf:params:xml:ns:netconf:default:1.0", BAD_CAST "wd");
+		}
+		/* process all defaults elements */
+		for (i = 0; i < scan.defaults->nodeNr; i++) {
+			fill_default(config, scan.defaults->nodeTab[i], (char*)namespace, mode);
 		}
-		xmlXPathFreeObject(defaults);
 	}
+	xmlXPathFreeNodeSet(scan.defaults);
 	xmlFree(namespace);
-	xmlXPathFreeContext(model_ctxt);
 
 	return (EXIT_SUCCESS);
 }
@@ -741,8 +769,8 @@ int ncdflt_edit_remove_default(xmlDocPtr config, const xmlDocPtr model)
 {
 	xmlXPathContextPtr ctxt = NULL;
 	xmlXPathObjectPtr defaults = NULL;
-	xmlNodePtr model_node, aux;
 	xmlChar* value_data, *value_model;
+	struct schema_node* snode;
 	xmlNsPtr ns;
 	int i, retval = EXIT_SUCCESS;
 
@@ -768,19 +796,13 @@ int ncdflt_edit_remove_default(xmlDocPtr config, const xmlDocPtr model)
 	if (defaults != NULL) {
 		/* RFC 6243 requires us to check, that the data contains correct default values */
 		for (i = 0; i < defaults->nodesetval->nodeNr; i++) {
-			if ((model_node = find_element_model(defaults->nodesetval->nodeTab[i], model)) == NULL) {
-				/* node with default attribute not defined in data model */
-				return (EXIT_FAILURE);
-			}
 			/* get default value from model ... */
 			value_model = NULL;
-			for (aux = model_node->children; aux != NULL; aux = aux->next) {
-				if (aux->type != XML_ELEMENT_NODE || xmlStrcmp(aux->name, BAD_CAST "default") != 0) {
-					continue;
-				}
-				value_model = xmlGetProp(aux, BAD_CAST "value");
-				break;
+			if ((snode = schema_find(schema_get(model), defaults->nodesetval->nodeTab[i])) == NULL) {
+				/* node with default attribute not defined in data model */
+				return (EXIT_FAILURE);
 			}
+			value_model = xmlStrdup(snode->dflt);
 			if (value_model == NULL) {
 				return (EXIT_FAILURE);
 			}